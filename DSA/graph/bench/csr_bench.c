@@ -0,0 +1,222 @@
+/** @file csr_bench.c
+ *
+ * @brief Measures breadth first searches over a compressed sparse row
+ *        graph against the same searches over graph_t, and the CSR graph
+ *        alone at sizes graph_t cannot hold.
+ *
+ * Build and run from DSA/graph with
+ *
+ *     gcc -std=c18 -O2 -D_DEFAULT_SOURCE src/graph.c src/csr_graph.c \
+ *         ../queue/src/queue.c bench/csr_bench.c -o csr_bench
+ *     ./csr_bench [vertices] [degree]
+ *
+ * The first part builds a random undirected graph of MAX_NUM_NODES nodes
+ * as a graph_t, converts it with graph_to_csr(), and times one closeness
+ * centrality per vertex on each, which is one full search from every
+ * vertex. graph_t reports the mean distance and CSR its inverse, so the
+ * totals printed differ but the work is the same. Betweenness for the
+ * same graph is timed on CSR only, since graph_t computes it through a
+ * CSR copy.
+ *
+ * The second part builds a CSR graph of the given number of vertices (1M
+ * by default) with the given mean degree (8 by default) from an edge
+ * list and reports the build time and the edges searched per second by
+ * csr_bfs() from a few sources.
+ *
+ */
+
+#include "../include/csr_graph.h"
+#include "../include/graph.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define SMALL_DEGREE 8
+#define SEARCHES 8
+
+static double
+now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+/* xorshift64*, so that both parts see the same graph on every run. */
+static uint64_t
+next_random(uint64_t * state)
+{
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545F4914F6CDD1DULL;
+}
+
+static int
+compare_int(const void * lhs, const void * rhs)
+{
+    return *(const int *)lhs - *(const int *)rhs;
+}
+
+static int
+bench_small(void)
+{
+    graph_t * graph = create_graph(free, compare_int);
+    node_t *  nodes[MAX_NUM_NODES];
+    uint64_t  state = 50;
+
+    if (graph == NULL)
+    {
+        return -1;
+    }
+    for (int i = 0; i < MAX_NUM_NODES; i++)
+    {
+        int * data = malloc(sizeof(int));
+        if (data == NULL)
+        {
+            free_graph(graph);
+            return -1;
+        }
+        *data    = i;
+        nodes[i] = add_node(graph, data);
+    }
+    for (int i = 0; i < MAX_NUM_NODES * SMALL_DEGREE / 2; i++)
+    {
+        node_t * source = nodes[next_random(&state) % MAX_NUM_NODES];
+        node_t * target = nodes[next_random(&state) % MAX_NUM_NODES];
+        if (add_edge(source, target) != 0)
+        {
+            free_graph(graph);
+            return -1;
+        }
+    }
+
+    csr_graph_t * csr    = graph_to_csr(graph);
+    double *      scores = malloc(MAX_NUM_NODES * sizeof(double));
+    if (csr == NULL || scores == NULL)
+    {
+        csr_destroy(&csr);
+        free(scores);
+        free_graph(graph);
+        return -1;
+    }
+
+    double start = now_ns();
+    double total = 0;
+    for (int i = 0; i < MAX_NUM_NODES; i++)
+    {
+        total += closeness_centrality(graph, nodes[i]);
+    }
+    double graph_ns = now_ns() - start;
+
+    start            = now_ns();
+    double csr_total = 0;
+    for (uint32_t v = 0; v < MAX_NUM_NODES; v++)
+    {
+        csr_total += csr_closeness_centrality(csr, v);
+    }
+    double csr_ns = now_ns() - start;
+
+    start = now_ns();
+    csr_betweenness_centrality(csr, scores);
+    double betweenness_ns = now_ns() - start;
+
+    printf("%d nodes, %zu edges stored\n",
+           MAX_NUM_NODES,
+           csr_edge_count(csr));
+    printf("  graph_t closeness, all nodes  %10.3f ms  (total %.3f)\n",
+           graph_ns / 1e6,
+           total);
+    printf("  CSR closeness, all vertices   %10.3f ms  (total %.3f)\n",
+           csr_ns / 1e6,
+           csr_total);
+    printf("  speedup                       %10.1fx\n", graph_ns / csr_ns);
+    printf("  CSR betweenness, all vertices %10.3f ms\n",
+           betweenness_ns / 1e6);
+
+    csr_destroy(&csr);
+    free(scores);
+    free_graph(graph);
+    return 0;
+}
+
+static int
+bench_large(size_t vertices, size_t degree)
+{
+    size_t       edge_count = vertices * degree / 2;
+    csr_edge_t * edges      = malloc((edge_count ? edge_count : 1)
+                                * sizeof(csr_edge_t));
+    uint32_t *   distances  = malloc(vertices * sizeof(uint32_t));
+    uint64_t     state      = 51;
+
+    if (edges == NULL || distances == NULL)
+    {
+        free(edges);
+        free(distances);
+        return -1;
+    }
+    for (size_t e = 0; e < edge_count; e++)
+    {
+        edges[e].source = (uint32_t)(next_random(&state) % vertices);
+        edges[e].target = (uint32_t)(next_random(&state) % vertices);
+        edges[e].weight = 0;
+    }
+
+    double        start = now_ns();
+    csr_graph_t * csr
+        = csr_create(vertices, edges, edge_count, CSR_UNDIRECTED);
+    double build_ns = now_ns() - start;
+    free(edges);
+    if (csr == NULL)
+    {
+        free(distances);
+        return -1;
+    }
+
+    size_t reached = 0;
+    start          = now_ns();
+    for (int i = 0; i < SEARCHES; i++)
+    {
+        uint32_t source = (uint32_t)(next_random(&state) % vertices);
+        reached += csr_bfs(csr, source, distances);
+    }
+    double bfs_ns = now_ns() - start;
+
+    printf("%zu vertices, %zu edges stored\n",
+           vertices,
+           csr_edge_count(csr));
+    printf("  build                         %10.3f ms\n", build_ns / 1e6);
+    printf("  bfs, %d sources               %10.3f ms  (%zu reached)\n",
+           SEARCHES,
+           bfs_ns / 1e6,
+           reached);
+    printf("  edges searched per second     %10.1f M\n",
+           (double)csr_edge_count(csr) * SEARCHES / bfs_ns * 1e3);
+
+    csr_destroy(&csr);
+    free(distances);
+    return 0;
+}
+
+int
+main(int argc, char ** argv)
+{
+    size_t vertices = argc > 1 ? strtoull(argv[1], NULL, 10) : 1000000;
+    size_t degree   = argc > 2 ? strtoull(argv[2], NULL, 10) : 8;
+
+    if (vertices == 0 || vertices > UINT32_MAX || degree > UINT32_MAX)
+    {
+        fprintf(stderr,
+                "vertices must be from 1 to %u, degree at most %u\n",
+                UINT32_MAX,
+                UINT32_MAX);
+        return EXIT_FAILURE;
+    }
+    if (bench_small() != 0 || bench_large(vertices, degree) != 0)
+    {
+        fprintf(stderr, "out of memory\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,174 @@
+/** @file csr_graph.h
+ *
+ * @brief An immutable graph in compressed sparse row form.
+ *
+ * Vertices are the integers 0 to vertex_count - 1. The out-edges of every
+ * vertex sit side by side in one array of targets, and a second array of
+ * vertex_count + 1 offsets says where each vertex's run starts: the
+ * neighbors of v are targets[offsets[v]] up to targets[offsets[v + 1]].
+ * Weights, when present, are a third array parallel to the targets.
+ *
+ * A traversal thus reads each adjacency list as one sequential run rather
+ * than chasing a pointer per neighbor, and the whole graph costs 4 bytes
+ * per edge (12 with weights) and 8 per vertex, with no per-node
+ * allocations.
+ *
+ * The graph is built once, from an edge list or from a graph_t with
+ * graph_to_csr(), and never changes; rebuild it to add or remove edges.
+ * Concurrent readers need no locking.
+ *
+ */
+
+#ifndef CSR_GRAPH_H
+#define CSR_GRAPH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Distance of a vertex that csr_bfs() did not reach.
+ *
+ */
+#define CSR_UNREACHED UINT32_MAX
+
+typedef struct csr_graph csr_graph_t;
+
+/**
+ * @brief An edge from source to target. weight is ignored unless the graph
+ *        is built with CSR_WEIGHTED.
+ *
+ */
+typedef struct csr_edge
+{
+    uint32_t source;
+    uint32_t target;
+    double   weight;
+} csr_edge_t;
+
+/**
+ * @brief Options for csr_create(), to be combined with |.
+ *
+ */
+typedef enum csr_flags
+{
+    CSR_WEIGHTED   = 1, /* Keep the weight of every edge. */
+    CSR_UNDIRECTED = 2  /* Store every edge in both directions. */
+} csr_flags_t;
+
+/**
+ * @brief Creates a graph from a list of edges. Each vertex's neighbors keep
+ *        the order of its edges in the list; repeated edges are kept too.
+ *
+ * @param vertex_count the number of vertices, at most UINT32_MAX
+ * @param edges the edges, with sources and targets below vertex_count
+ * @param edge_count the number of edges
+ * @param flags CSR_WEIGHTED, CSR_UNDIRECTED, both, or 0
+ * @return csr_graph_t* a pointer to the new graph, or NULL on failure or
+ *         if an edge is out of range
+ */
+csr_graph_t * csr_create(size_t             vertex_count,
+                         const csr_edge_t * edges,
+                         size_t             edge_count,
+                         int                flags);
+
+/**
+ * @brief Destroy the graph. *graph == NULL is safe. The graph pointer is
+ *        set to NULL afterwards.
+ *
+ * @param graph a reference to a pointer to an allocated graph
+ */
+void csr_destroy(csr_graph_t ** graph);
+
+/**
+ * @brief Returns the number of vertices.
+ *
+ * @param graph a pointer to an allocated graph
+ * @return size_t the number of vertices
+ */
+size_t csr_vertex_count(const csr_graph_t * graph);
+
+/**
+ * @brief Returns the number of stored edges, which counts an undirected
+ *        edge twice.
+ *
+ * @param graph a pointer to an allocated graph
+ * @return size_t the number of edges
+ */
+size_t csr_edge_count(const csr_graph_t * graph);
+
+/**
+ * @brief Returns the number of out-edges of a vertex.
+ *
+ * @param graph a pointer to an allocated graph
+ * @param vertex a vertex below the vertex count
+ * @return size_t the degree of the vertex
+ */
+size_t csr_degree(const csr_graph_t * graph, uint32_t vertex);
+
+/**
+ * @brief Returns the targets of a vertex's out-edges, in place.
+ *
+ * @param graph a pointer to an allocated graph
+ * @param vertex a vertex below the vertex count
+ * @param degree filled with the number of targets
+ * @return const uint32_t* the first of degree targets
+ */
+const uint32_t * csr_neighbors(const csr_graph_t * graph,
+                               uint32_t            vertex,
+                               size_t *            degree);
+
+/**
+ * @brief Returns the weights of a vertex's out-edges, in place, parallel
+ *        to csr_neighbors().
+ *
+ * @param graph a pointer to an allocated graph
+ * @param vertex a vertex below the vertex count
+ * @return const double* the first of the weights, or NULL if the graph was
+ *         built without CSR_WEIGHTED
+ */
+const double * csr_weights(const csr_graph_t * graph, uint32_t vertex);
+
+/**
+ * @brief Find the number of edges on a shortest path from a source to every
+ *        vertex, ignoring weights.
+ *
+ * @param graph a pointer to an allocated graph
+ * @param source the vertex to start from
+ * @param distances room for one distance per vertex, filled with the hop
+ *        counts, or CSR_UNREACHED
+ * @return size_t the number of vertices reached, the source included, or 0
+ *         on failure or if the source is out of range
+ */
+size_t csr_bfs(const csr_graph_t * graph,
+               uint32_t            source,
+               uint32_t *          distances);
+
+/**
+ * @brief Returns the closeness centrality of a vertex, ignoring weights:
+ *        the number of other vertices it reaches divided by the sum of
+ *        their distances from it.
+ *
+ * @param graph a pointer to an allocated graph
+ * @param vertex a vertex below the vertex count
+ * @return double the centrality, 0 if the vertex reaches no other, or -1
+ *         on failure
+ */
+double csr_closeness_centrality(const csr_graph_t * graph, uint32_t vertex);
+
+/**
+ * @brief Compute the betweenness centrality of every vertex, ignoring
+ *        weights, with Brandes' algorithm in O(VE) time and O(V) space.
+ *
+ * A vertex scores, for every ordered pair of other vertices, the fraction
+ * of their shortest paths that pass through it. Graphs built with
+ * CSR_UNDIRECTED count every pair both ways; halve the scores to count
+ * each once. Repeated edges count as separate paths.
+ *
+ * @param graph a pointer to an allocated graph
+ * @param centrality room for one score per vertex, filled with the scores
+ * @return 0 on success, -1 on failure
+ */
+int csr_betweenness_centrality(const csr_graph_t * graph, double * centrality);
+
+#endif
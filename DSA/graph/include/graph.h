@@ -8,6 +8,7 @@
 #define GRAPH_H
 
 #include <stdbool.h>
+#include "csr_graph.h"
 
 #define MAX_NUM_NODES 1000
 
@@ -18,11 +19,16 @@ typedef struct graph graph_t;
 // Function to create a new graph
 graph_t* create_graph(void (*free_data)(void*), int (*compare_data)(const void*, const void*));
 
-// Function to add a new node to the graph
-node_t* add_node(graph_t* graph, int data);
+// Function to free the graph, its nodes and their data
+void free_graph(graph_t* graph);
 
-// Function to add an edge between two nodes
-void add_edge(node_t* node1, node_t* node2);
+// Function to add a new node to the graph. Returns NULL on failure or when
+// the graph already holds MAX_NUM_NODES nodes.
+node_t* add_node(graph_t* graph, void* data);
+
+// Function to add an edge between two nodes. Returns 0 on success, -1 on
+// failure.
+int add_edge(node_t* node1, node_t* node2);
 
 // Function to remove an edge between two nodes
 void remove_edge(node_t* node1, node_t* node2);
@@ -36,7 +42,12 @@ bool is_path(graph_t* graph, node_t* start_node, node_t* end_node);
 // Function to calculate the closeness centrality of a node
 double closeness_centrality(graph_t* graph, node_t* node);
 
-// Function to calculate the betweenness centrality of a node
+// Function to calculate the betweenness centrality of a node, from 0 to 1.
+// Returns -1 on failure.
 double betweenness_centrality(graph_t* graph, node_t* node);
 
+// Function to build an immutable CSR copy of the graph, with each node's
+// index in the graph as its vertex. Returns NULL on failure.
+csr_graph_t* graph_to_csr(const graph_t* graph);
+
 #endif
@@ -0,0 +1,349 @@
+/** @file csr_graph.c
+ *
+ * @brief Compressed sparse row graphs, built with a counting sort of the
+ *        edge list.
+ *
+ * Building counts the out-degree of every vertex into offsets, turns the
+ * counts into start positions, then drops each edge into place by bumping
+ * its source's position. That leaves every offset at the end of its run,
+ * which is the start of the next one, so a final shift by one vertex puts
+ * them right with no second array. Two passes over the edges in all, and
+ * each vertex's edges keep their input order.
+ *
+ * The traversals use the BFS order array as their queue: every vertex is
+ * queued at most once, so vertex_count slots always suffice.
+ *
+ */
+
+#include "../include/csr_graph.h"
+#include <stdlib.h>
+
+struct csr_graph
+{
+    size_t     vertex_count;
+    size_t     edge_count;
+    size_t *   offsets; /* vertex_count + 1 run starts into targets. */
+    uint32_t * targets;
+    double *   weights; /* Parallel to targets, or NULL. */
+};
+
+/* Append one edge to its source's run, as positioned by offsets. */
+static void
+csr_place(csr_graph_t * graph,
+          uint32_t      source,
+          uint32_t      target,
+          double        weight)
+{
+    size_t position = graph->offsets[source]++;
+
+    graph->targets[position] = target;
+    if (graph->weights)
+    {
+        graph->weights[position] = weight;
+    }
+}
+
+/* Breadth first search from source, filling distances and order, the
+ * vertices in the order reached. Returns how many were reached. */
+static size_t
+csr_bfs_order(const csr_graph_t * graph,
+              uint32_t            source,
+              uint32_t *          distances,
+              uint32_t *          order)
+{
+    size_t head = 0;
+    size_t tail = 0;
+
+    for (size_t v = 0; v < graph->vertex_count; v++)
+    {
+        distances[v] = CSR_UNREACHED;
+    }
+    distances[source] = 0;
+    order[tail++]     = source;
+
+    while (head < tail)
+    {
+        uint32_t vertex = order[head++];
+        uint32_t next   = distances[vertex] + 1;
+        size_t   end    = graph->offsets[vertex + 1];
+
+        for (size_t e = graph->offsets[vertex]; e < end; e++)
+        {
+            uint32_t target = graph->targets[e];
+            if (distances[target] == CSR_UNREACHED)
+            {
+                distances[target] = next;
+                order[tail++]     = target;
+            }
+        }
+    }
+    return tail;
+}
+
+csr_graph_t *
+csr_create(size_t             vertex_count,
+           const csr_edge_t * edges,
+           size_t             edge_count,
+           int                flags)
+{
+    size_t stored = edge_count;
+
+    if (vertex_count > UINT32_MAX)
+    {
+        return NULL;
+    }
+    if (flags & CSR_UNDIRECTED)
+    {
+        if (edge_count > SIZE_MAX / 2)
+        {
+            return NULL;
+        }
+        stored *= 2;
+    }
+    for (size_t e = 0; e < edge_count; e++)
+    {
+        if (edges[e].source >= vertex_count
+            || edges[e].target >= vertex_count)
+        {
+            return NULL;
+        }
+    }
+
+    csr_graph_t * graph = calloc(1, sizeof(csr_graph_t));
+    if (graph == NULL)
+    {
+        return NULL;
+    }
+    graph->vertex_count = vertex_count;
+    graph->edge_count   = stored;
+    graph->offsets      = calloc(vertex_count + 1, sizeof(size_t));
+    graph->targets      = malloc((stored ? stored : 1) * sizeof(uint32_t));
+    if (flags & CSR_WEIGHTED)
+    {
+        graph->weights = malloc((stored ? stored : 1) * sizeof(double));
+    }
+    if (graph->offsets == NULL || graph->targets == NULL
+        || ((flags & CSR_WEIGHTED) && graph->weights == NULL))
+    {
+        csr_destroy(&graph);
+        return NULL;
+    }
+
+    /* Count each vertex's edges one slot up, and sum them into starts. */
+    for (size_t e = 0; e < edge_count; e++)
+    {
+        graph->offsets[edges[e].source + 1]++;
+        if (flags & CSR_UNDIRECTED)
+        {
+            graph->offsets[edges[e].target + 1]++;
+        }
+    }
+    for (size_t v = 0; v < vertex_count; v++)
+    {
+        graph->offsets[v + 1] += graph->offsets[v];
+    }
+
+    for (size_t e = 0; e < edge_count; e++)
+    {
+        csr_place(graph, edges[e].source, edges[e].target, edges[e].weight);
+        if (flags & CSR_UNDIRECTED)
+        {
+            csr_place(graph,
+                      edges[e].target,
+                      edges[e].source,
+                      edges[e].weight);
+        }
+    }
+
+    /* Each offset now holds the end of its run: shift them back to starts. */
+    for (size_t v = vertex_count; v > 0; v--)
+    {
+        graph->offsets[v] = graph->offsets[v - 1];
+    }
+    graph->offsets[0] = 0;
+    return graph;
+}
+
+void
+csr_destroy(csr_graph_t ** graph)
+{
+    if (!graph || !*graph)
+    {
+        return;
+    }
+
+    free((*graph)->offsets);
+    free((*graph)->targets);
+    free((*graph)->weights);
+    free(*graph);
+    *graph = NULL;
+}
+
+size_t
+csr_vertex_count(const csr_graph_t * graph)
+{
+    return graph->vertex_count;
+}
+
+size_t
+csr_edge_count(const csr_graph_t * graph)
+{
+    return graph->edge_count;
+}
+
+size_t
+csr_degree(const csr_graph_t * graph, uint32_t vertex)
+{
+    return graph->offsets[vertex + 1] - graph->offsets[vertex];
+}
+
+const uint32_t *
+csr_neighbors(const csr_graph_t * graph, uint32_t vertex, size_t * degree)
+{
+    *degree = csr_degree(graph, vertex);
+    return graph->targets + graph->offsets[vertex];
+}
+
+const double *
+csr_weights(const csr_graph_t * graph, uint32_t vertex)
+{
+    if (graph->weights == NULL)
+    {
+        return NULL;
+    }
+    return graph->weights + graph->offsets[vertex];
+}
+
+size_t
+csr_bfs(const csr_graph_t * graph, uint32_t source, uint32_t * distances)
+{
+    if (source >= graph->vertex_count)
+    {
+        return 0;
+    }
+
+    uint32_t * order = malloc(graph->vertex_count * sizeof(uint32_t));
+    if (order == NULL)
+    {
+        return 0;
+    }
+    size_t reached = csr_bfs_order(graph, source, distances, order);
+    free(order);
+    return reached;
+}
+
+double
+csr_closeness_centrality(const csr_graph_t * graph, uint32_t vertex)
+{
+    if (vertex >= graph->vertex_count)
+    {
+        return -1;
+    }
+
+    uint32_t * distances = malloc(graph->vertex_count * sizeof(uint32_t));
+    uint32_t * order     = malloc(graph->vertex_count * sizeof(uint32_t));
+    if (distances == NULL || order == NULL)
+    {
+        free(distances);
+        free(order);
+        return -1;
+    }
+
+    size_t reached = csr_bfs_order(graph, vertex, distances, order);
+    double total   = 0;
+    for (size_t i = 1; i < reached; i++)
+    {
+        total += distances[order[i]];
+    }
+    free(distances);
+    free(order);
+    return reached > 1 ? (double)(reached - 1) / total : 0;
+}
+
+int
+csr_betweenness_centrality(const csr_graph_t * graph, double * centrality)
+{
+    size_t     count     = graph->vertex_count ? graph->vertex_count : 1;
+    uint32_t * distances = malloc(count * sizeof(uint32_t));
+    uint32_t * order     = malloc(count * sizeof(uint32_t));
+    double *   paths     = calloc(count, sizeof(double)); /* Shortest paths. */
+    double *   share     = calloc(count, sizeof(double)); /* Dependencies. */
+    int        status    = -1;
+
+    if (distances && order && paths && share)
+    {
+        for (size_t v = 0; v < graph->vertex_count; v++)
+        {
+            distances[v]  = CSR_UNREACHED;
+            centrality[v] = 0;
+        }
+
+        for (uint32_t source = 0; source < graph->vertex_count; source++)
+        {
+            size_t head = 0;
+            size_t tail = 0;
+
+            /* Count the shortest paths from source to every vertex. */
+            distances[source] = 0;
+            paths[source]     = 1;
+            order[tail++]     = source;
+            while (head < tail)
+            {
+                uint32_t vertex = order[head++];
+                uint32_t next   = distances[vertex] + 1;
+                size_t   end    = graph->offsets[vertex + 1];
+                for (size_t e = graph->offsets[vertex]; e < end; e++)
+                {
+                    uint32_t target = graph->targets[e];
+                    if (distances[target] == CSR_UNREACHED)
+                    {
+                        distances[target] = next;
+                        order[tail++]     = target;
+                    }
+                    if (distances[target] == next)
+                    {
+                        paths[target] += paths[vertex];
+                    }
+                }
+            }
+
+            /* Farthest first, pass each vertex's share of the paths
+             * through it back to the vertices one step closer, which
+             * reach it along out-edges. */
+            for (size_t i = tail; i-- > 0;)
+            {
+                uint32_t vertex = order[i];
+                uint32_t next   = distances[vertex] + 1;
+                size_t   end    = graph->offsets[vertex + 1];
+                for (size_t e = graph->offsets[vertex]; e < end; e++)
+                {
+                    uint32_t target = graph->targets[e];
+                    if (distances[target] == next)
+                    {
+                        share[vertex] += paths[vertex] / paths[target]
+                                       * (1 + share[target]);
+                    }
+                }
+                if (vertex != source)
+                {
+                    centrality[vertex] += share[vertex];
+                }
+            }
+
+            /* Reset only what this search touched. */
+            for (size_t i = 0; i < tail; i++)
+            {
+                distances[order[i]] = CSR_UNREACHED;
+                paths[order[i]]     = 0;
+                share[order[i]]     = 0;
+            }
+        }
+        status = 0;
+    }
+
+    free(distances);
+    free(order);
+    free(paths);
+    free(share);
+    return status;
+}
@@ -7,8 +7,9 @@
 // Structure to represent a node in the graph
 typedef struct node {
     void* data;  // Data stored at the node
-    int node_id; // Unique id for node. Used for indexing
+    int node_id; // Index of the node in graph->nodes. Used for indexing
     int num_neighbors;  // Number of neighboring nodes
+    int max_neighbors;  // Number of neighbors there is room for
     node_t** neighbors;  // List of neighboring nodes
 } node_t;
 
@@ -20,17 +21,17 @@ typedef struct graph {
     int (*compare_data)(const void*, const void*);  // pointer to the function to compare the data
 } graph_t;
 
-// Function to create a new node
-node_t* create_node(void* data) {
-    node_t* new_node = (node_t*) malloc(sizeof(node_t));
-    new_node->data = data;
-    new_node->num_neighbors = 0;
-    return new_node;
-}
-
 // Function to create a new graph
 graph_t* create_graph(void (*free_data)(void*), int (*compare_data)(const void*, const void*)) {
     graph_t* new_graph = (graph_t*) malloc(sizeof(graph_t));
+    if (new_graph == NULL) {
+        return NULL;
+    }
+    new_graph->nodes = (node_t**) malloc(MAX_NUM_NODES * sizeof(node_t*));
+    if (new_graph->nodes == NULL) {
+        free(new_graph);
+        return NULL;
+    }
     new_graph->num_nodes = 0;
     new_graph->free_data = free_data;
     new_graph->compare_data = compare_data;
@@ -38,34 +39,95 @@ graph_t* create_graph(void (*free_data)(void*), int (*compare_data)(const void*,
 }
 
 // Function to add a new node to the graph
-void add_node_to_graph(graph_t* graph, node_t* node) {
-    graph->nodes[graph->num_nodes++] = node;
+// The node's id is its index in graph->nodes, which remove_node keeps true.
+node_t* add_node(graph_t* graph, void* data) {
+    if (graph->num_nodes == MAX_NUM_NODES) {
+        return NULL;
+    }
+    node_t* new_node = (node_t*) malloc(sizeof(node_t));
+    if (new_node == NULL) {
+        return NULL;
+    }
+    new_node->data = data;
+    new_node->node_id = graph->num_nodes;
+    new_node->num_neighbors = 0;
+    new_node->max_neighbors = 0;
+    new_node->neighbors = NULL;
+    graph->nodes[graph->num_nodes++] = new_node;
+    return new_node;
+}
+
+// Function to make room for one more neighbor, doubling the list when full
+static int reserve_neighbor(node_t* node) {
+    if (node->num_neighbors < node->max_neighbors) {
+        return 0;
+    }
+    int max_neighbors = node->max_neighbors ? 2 * node->max_neighbors : 4;
+    node_t** neighbors = (node_t**) realloc(node->neighbors,
+                                            max_neighbors * sizeof(node_t*));
+    if (neighbors == NULL) {
+        return -1;
+    }
+    node->neighbors = neighbors;
+    node->max_neighbors = max_neighbors;
+    return 0;
 }
 
 // Function to add an edge between two nodes
-void add_edge(node_t* node1, node_t* node2) {
+// A loop takes two entries in the node's own list, so room is made for each
+// entry just before it is stored.
+int add_edge(node_t* node1, node_t* node2) {
+    if (reserve_neighbor(node1) != 0) {
+        return -1;
+    }
     node1->neighbors[node1->num_neighbors++] = node2;
+    if (reserve_neighbor(node2) != 0) {
+        node1->num_neighbors--;
+        return -1;
+    }
     node2->neighbors[node2->num_neighbors++] = node1;
+    return 0;
+}
+
+// Function to remove every neighbor entry of node that is neighbor
+static void unlink_neighbor(node_t* node, node_t* neighbor) {
+    for (int j = 0; j < node->num_neighbors;) {
+        if (node->neighbors[j] == neighbor) {
+            node->neighbors[j] = node->neighbors[--node->num_neighbors];
+        } else {
+            j++;
+        }
+    }
+}
+
+// Function to remove an edge between two nodes
+void remove_edge(node_t* node1, node_t* node2) {
+    unlink_neighbor(node1, node2);
+    unlink_neighbor(node2, node1);
 }
 
 // Function to perform a breadth-first search on the graph
 void breadth_first_search(graph_t* graph, node_t* start_node) {
-    bool visited[MAX_NUM_NODES] = {false};
-    Queue_t* queue = create_queue();
-    enqueue(queue, start_node);
+    bool visited[MAX_NUM_NODES];
+    for (int i = 0; i < graph->num_nodes; i++) {
+        visited[i] = false;
+    }
+    queue_t* queue = queue_create(sizeof(node_t*), 0);
+    queue_enqueue(queue, start_node);
     visited[start_node->node_id] = true;
 
-    while (!is_empty(queue)) {
-        node_t* current_node = dequeue(queue);
-        printf("Visited node with data %d\n", current_node->data);
+    while (!queue_is_empty(queue)) {
+        node_t* current_node = queue_dequeue(queue);
+        printf("Visited node %d\n", current_node->node_id);
         for (int i = 0; i < current_node->num_neighbors; i++) {
             node_t* neighbor = current_node->neighbors[i];
             if (!visited[neighbor->node_id]) {
-                enqueue(queue, neighbor);
+                queue_enqueue(queue, neighbor);
                 visited[neighbor->node_id] = true;
             }
         }
     }
+    queue_destroy(&queue);
 }
 
 // Function to calculate the degree centrality of a node
@@ -79,11 +141,10 @@ void free_graph(graph_t* graph) {
     for (int i = 0; i < graph->num_nodes; i++) {
         node_t* node = graph->nodes[i];
         graph->free_data(node->data);
-        for (int j = 0; j < node->num_neighbors; j++) {
-            free(node->neighbors[j]);
-        }
+        free(node->neighbors);
         free(node);
     }
+    free(graph->nodes);
     free(graph);
 }
 
@@ -100,32 +161,48 @@ node_t* find_node(graph_t* graph, void* data) {
 
 // Function to remove a node from the graph
 void remove_node(graph_t* graph, node_t* node) {
-    // Find the node in the graph and remove it
-    int node_index;
-    for (int i = 0; i < graph->num_nodes; i++) {
-        if (graph->compare_data(graph->nodes[i]->data, node->data) == 0) {
-            node_index = i;
-            break;
-        }
-    }
+    // Move the last node into the removed node's slot, and give it that id
+    int node_index = node->node_id;
     graph->nodes[node_index] = graph->nodes[graph->num_nodes - 1];
+    graph->nodes[node_index]->node_id = node_index;
     graph->num_nodes--;
 
-    // Remove edges from neighboring nodes to the removed node
-    for (int i = 0; i < graph->num_nodes; i++) {
-        node_t* current_node = graph->nodes[i];
-        for (int j = 0; j < current_node->num_neighbors; j++) {
-            if (graph->compare_data(current_node->neighbors[j]->data, node->data) == 0) {
-                current_node->neighbors[j] = current_node->neighbors[current_node->num_neighbors - 1];
-                current_node->num_neighbors--;
-                break;
-            }
-        }
+    // Remove edges from neighboring nodes to the removed node, loops first
+    // so that the list does not change under the loop
+    unlink_neighbor(node, node);
+    for (int i = 0; i < node->num_neighbors; i++) {
+        unlink_neighbor(node->neighbors[i], node);
     }
     graph->free_data(node->data);
+    free(node->neighbors);
     free(node);
 }
 
+// Function to check if there is a path between two nodes
+bool is_path(graph_t* graph, node_t* start_node, node_t* end_node) {
+    bool visited[MAX_NUM_NODES];
+    for (int i = 0; i < graph->num_nodes; i++) {
+        visited[i] = false;
+    }
+    queue_t* queue = queue_create(sizeof(node_t*), 0);
+    queue_enqueue(queue, start_node);
+    visited[start_node->node_id] = true;
+
+    bool found = false;
+    while (!found && !queue_is_empty(queue)) {
+        node_t* current_node = queue_dequeue(queue);
+        found = current_node == end_node;
+        for (int i = 0; i < current_node->num_neighbors; i++) {
+            node_t* neighbor = current_node->neighbors[i];
+            if (!visited[neighbor->node_id]) {
+                queue_enqueue(queue, neighbor);
+                visited[neighbor->node_id] = true;
+            }
+        }
+    }
+    queue_destroy(&queue);
+    return found;
+}
 
 // Function to calculate the closeness centrality of a node
 double closeness_centrality(graph_t* graph, node_t* node) {
@@ -135,18 +212,19 @@ double closeness_centrality(graph_t* graph, node_t* node) {
         distances[i] = -1;
     }
     distances[node->node_id] = 0;
-    Queue_t* queue = create_queue();
-    enqueue(queue, node);
-    while (!is_empty(queue)) {
-        node_t* current_node = dequeue(queue);
+    queue_t* queue = queue_create(sizeof(node_t*), 0);
+    queue_enqueue(queue, node);
+    while (!queue_is_empty(queue)) {
+        node_t* current_node = queue_dequeue(queue);
         for (int i = 0; i < current_node->num_neighbors; i++) {
             node_t* neighbor = current_node->neighbors[i];
             if (distances[neighbor->node_id] == -1) {
                 distances[neighbor->node_id] = distances[current_node->node_id] + 1;
-                enqueue(queue, neighbor);
+                queue_enqueue(queue, neighbor);
             }
         }
     }
+    queue_destroy(&queue);
 
     // Sum the shortest distances from the node to all other nodes
     int sum_distances = 0;
@@ -162,38 +240,52 @@ double closeness_centrality(graph_t* graph, node_t* node) {
 }
 
 // Function to calculate the between-ness centrality of a node
+// The fraction of the shortest paths between every ordered pair of other
+// nodes that pass through the node, averaged over the pairs, computed with
+// Brandes' algorithm on a CSR copy of the graph. Returns -1 on failure.
 double betweenness_centrality(graph_t* graph, node_t* node) {
-    // Use a breadth-first search to find the number of shortest paths that pass through the node
-    int num_shortest_paths[MAX_NUM_NODES] = {0};
-    int num_paths[MAX_NUM_NODES] = {0};
+    if (graph->num_nodes < 3) {
+        return 0;
+    }
+    csr_graph_t* csr = graph_to_csr(graph);
+    double* scores = (double*) malloc(graph->num_nodes * sizeof(double));
+    double centrality = -1;
+    if (csr != NULL && scores != NULL
+        && csr_betweenness_centrality(csr, scores) == 0) {
+        double pairs = (double) (graph->num_nodes - 1) * (graph->num_nodes - 2);
+        centrality = scores[node->node_id] / pairs;
+    }
+    free(scores);
+    csr_destroy(&csr);
+    return centrality;
+}
+
+
+// Function to build an immutable CSR copy of the graph
+// Every neighbor entry becomes one directed edge. add_edge links both nodes,
+// so an edge of the graph is stored once in each direction, as in the graph.
+csr_graph_t* graph_to_csr(const graph_t* graph) {
+    size_t edge_count = 0;
     for (int i = 0; i < graph->num_nodes; i++) {
-        num_shortest_paths[i] = 0;
-        num_paths[i] = 0;
-    }
-    num_shortest_paths[node->data] = 1;
-    num_paths[node->data] = 1;
-    Queue_t* queue = create_queue();
-    enqueue(queue, node);
-    while (!is_empty(queue)) {
-        node_t* current_node = dequeue(queue);
-        for (int i = 0; i < current_node->num_neighbors; i++) {
-            node_t* neighbor = current_node->neighbors[i];
-            num_paths[neighbor->node_id] += num_paths[current_node->node_id];
-            if (neighbor != node) {
-                num_shortest_paths[neighbor->node_id] += num_shortest_paths[current_node->node_id];
-            }
-            enqueue(queue, neighbor);
-        }
+        edge_count += graph->nodes[i]->num_neighbors;
     }
 
-        // Divide the number of shortest paths that pass through the node by the total number of shortest paths
-    double centrality = 0;
+    csr_edge_t* edges = malloc((edge_count ? edge_count : 1) * sizeof(csr_edge_t));
+    if (edges == NULL) {
+        return NULL;
+    }
+    size_t e = 0;
     for (int i = 0; i < graph->num_nodes; i++) {
-        if (i != node->data) {
-            centrality += ((double) num_shortest_paths[i]) / num_paths[i];
+        node_t* node = graph->nodes[i];
+        for (int j = 0; j < node->num_neighbors; j++) {
+            edges[e].source = node->node_id;
+            edges[e].target = node->neighbors[j]->node_id;
+            edges[e].weight = 0;
+            e++;
         }
     }
-    centrality /= (graph->num_nodes - 1) * (graph->num_nodes - 2);
-    return centrality;
-}
 
+    csr_graph_t* csr = csr_create(graph->num_nodes, edges, edge_count, 0);
+    free(edges);
+    return csr;
+}
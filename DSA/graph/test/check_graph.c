@@ -0,0 +1,449 @@
+/** @file check_graph.c
+ *
+ * @brief Tests for the compressed sparse row graph, with distances,
+ *        closeness and betweenness checked against brute force on small
+ *        random graphs, and for graph_t and its conversion to CSR.
+ *
+ * Build and run from DSA/graph with
+ *
+ *     gcc -std=c18 -O2 -D_DEFAULT_SOURCE src/graph.c src/csr_graph.c \
+ *         ../queue/src/queue.c test/check_graph.c \
+ *         -lcheck -lm -lrt -lsubunit -pthread -o check_graph
+ *     ./check_graph
+ *
+ */
+
+#include <check.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "../include/csr_graph.h"
+#include "../include/graph.h"
+
+#define SMALL_VERTICES 12
+#define RANDOM_GRAPHS 200
+#define TOLERANCE 1e-9
+
+/* A small graph as a matrix of edge counts, with distances and shortest
+ * path counts between every pair found by brute force. */
+typedef struct
+{
+    size_t   count;
+    uint32_t edges[SMALL_VERTICES][SMALL_VERTICES];
+    uint32_t distance[SMALL_VERTICES][SMALL_VERTICES];
+    double   paths[SMALL_VERTICES][SMALL_VERTICES];
+} Matrix_T;
+
+/* Relax distances and path counts one hop at a time, from every source,
+ * until no path of the next length exists. */
+static void
+solve_matrix(Matrix_T * matrix)
+{
+    size_t n = matrix->count;
+
+    for (size_t s = 0; s < n; s++)
+    {
+        for (size_t v = 0; v < n; v++)
+        {
+            matrix->distance[s][v] = CSR_UNREACHED;
+            matrix->paths[s][v]    = 0;
+        }
+        matrix->distance[s][s] = 0;
+        matrix->paths[s][s]    = 1;
+        for (uint32_t hops = 0; hops < n; hops++)
+        {
+            for (size_t u = 0; u < n; u++)
+            {
+                if (matrix->distance[s][u] != hops)
+                {
+                    continue;
+                }
+                for (size_t v = 0; v < n; v++)
+                {
+                    if (matrix->edges[u][v] == 0
+                        || matrix->distance[s][v] < hops + 1)
+                    {
+                        continue;
+                    }
+                    matrix->distance[s][v] = hops + 1;
+                    matrix->paths[s][v] += matrix->paths[s][u]
+                                           * matrix->edges[u][v];
+                }
+            }
+        }
+    }
+}
+
+/* Random edges, some repeated, and as a list for csr_create(). */
+static size_t
+random_graph(Matrix_T *   matrix,
+             csr_edge_t * edges,
+             size_t       max_edges,
+             bool         undirected)
+{
+    size_t edge_count = (size_t)rand() % (max_edges + 1);
+
+    matrix->count = 1 + (size_t)rand() % SMALL_VERTICES;
+    for (size_t u = 0; u < SMALL_VERTICES; u++)
+    {
+        for (size_t v = 0; v < SMALL_VERTICES; v++)
+        {
+            matrix->edges[u][v] = 0;
+        }
+    }
+    for (size_t e = 0; e < edge_count; e++)
+    {
+        edges[e].source = (uint32_t)((size_t)rand() % matrix->count);
+        edges[e].target = (uint32_t)((size_t)rand() % matrix->count);
+        edges[e].weight = (double)e;
+        matrix->edges[edges[e].source][edges[e].target]++;
+        if (undirected)
+        {
+            matrix->edges[edges[e].target][edges[e].source]++;
+        }
+    }
+    solve_matrix(matrix);
+    return edge_count;
+}
+
+START_TEST(test_create_keeps_edge_order)
+{
+    const csr_edge_t edges[] = {
+        { 2, 0, 0.5 }, { 0, 1, 1.5 }, { 2, 1, 2.5 }, { 0, 3, 3.5 },
+        { 2, 0, 4.5 },
+    };
+    csr_graph_t * graph = csr_create(5, edges, 5, CSR_WEIGHTED);
+    size_t        degree;
+
+    ck_assert_ptr_nonnull(graph);
+    ck_assert_uint_eq(csr_vertex_count(graph), 5);
+    ck_assert_uint_eq(csr_edge_count(graph), 5);
+
+    const uint32_t * targets = csr_neighbors(graph, 2, &degree);
+    const double *   weights = csr_weights(graph, 2);
+    ck_assert_uint_eq(degree, 3);
+    ck_assert_uint_eq(targets[0], 0);
+    ck_assert_uint_eq(targets[1], 1);
+    ck_assert_uint_eq(targets[2], 0);
+    ck_assert(weights[0] == 0.5 && weights[1] == 2.5 && weights[2] == 4.5);
+
+    targets = csr_neighbors(graph, 0, &degree);
+    ck_assert_uint_eq(degree, 2);
+    ck_assert_uint_eq(targets[0], 1);
+    ck_assert_uint_eq(targets[1], 3);
+    ck_assert_uint_eq(csr_degree(graph, 1), 0);
+    ck_assert_uint_eq(csr_degree(graph, 4), 0);
+    csr_destroy(&graph);
+    ck_assert_ptr_null(graph);
+
+    /* Undirected graphs store each edge twice; weights are optional. */
+    graph = csr_create(5, edges, 5, CSR_UNDIRECTED);
+    ck_assert_ptr_nonnull(graph);
+    ck_assert_uint_eq(csr_edge_count(graph), 10);
+    ck_assert_uint_eq(csr_degree(graph, 0), 4);
+    ck_assert_ptr_null(csr_weights(graph, 0));
+    csr_destroy(&graph);
+    csr_destroy(NULL);
+
+    /* An edge out of range is refused, and no edges at all is fine. */
+    ck_assert_ptr_null(csr_create(2, edges, 5, 0));
+    graph = csr_create(3, NULL, 0, 0);
+    ck_assert_ptr_nonnull(graph);
+    ck_assert_uint_eq(csr_edge_count(graph), 0);
+    csr_destroy(&graph);
+}
+END_TEST
+
+/* Distances from csr_bfs() and closeness against brute force. */
+static void
+check_distances(bool undirected)
+{
+    static Matrix_T matrix;
+    csr_edge_t      edges[3 * SMALL_VERTICES];
+    uint32_t        distances[SMALL_VERTICES];
+    int             flags = undirected ? CSR_UNDIRECTED : 0;
+
+    for (int g = 0; g < RANDOM_GRAPHS; g++)
+    {
+        size_t edge_count = random_graph(
+            &matrix, edges, 3 * SMALL_VERTICES, undirected);
+        csr_graph_t * graph
+            = csr_create(matrix.count, edges, edge_count, flags);
+        ck_assert_ptr_nonnull(graph);
+
+        for (uint32_t s = 0; s < matrix.count; s++)
+        {
+            size_t reached = 0;
+            double total   = 0;
+            for (size_t v = 0; v < matrix.count; v++)
+            {
+                reached += matrix.distance[s][v] != CSR_UNREACHED;
+                total += matrix.distance[s][v] != CSR_UNREACHED
+                             ? matrix.distance[s][v]
+                             : 0;
+            }
+            ck_assert_uint_eq(csr_bfs(graph, s, distances), reached);
+            for (size_t v = 0; v < matrix.count; v++)
+            {
+                ck_assert_uint_eq(distances[v], matrix.distance[s][v]);
+            }
+
+            double expected = reached > 1 ? (double)(reached - 1) / total : 0;
+            ck_assert(fabs(csr_closeness_centrality(graph, s) - expected)
+                      < TOLERANCE);
+        }
+        ck_assert_uint_eq(csr_bfs(graph, (uint32_t)matrix.count, distances),
+                          0);
+        ck_assert(csr_closeness_centrality(graph, (uint32_t)matrix.count)
+                  == -1);
+        csr_destroy(&graph);
+    }
+}
+
+START_TEST(test_bfs_matches_brute_force)
+{
+    srand(50);
+    check_distances(false);
+    check_distances(true);
+}
+END_TEST
+
+/* Betweenness against the definition: v lies on paths[s][v] *
+ * paths[v][t] of the paths[s][t] shortest paths from s to t exactly when
+ * it is at distance[s][v] + distance[v][t] == distance[s][t]. */
+static void
+check_betweenness(bool undirected)
+{
+    static Matrix_T matrix;
+    csr_edge_t      edges[3 * SMALL_VERTICES];
+    double          centrality[SMALL_VERTICES];
+    int             flags = undirected ? CSR_UNDIRECTED : 0;
+
+    for (int g = 0; g < RANDOM_GRAPHS; g++)
+    {
+        size_t edge_count = random_graph(
+            &matrix, edges, 3 * SMALL_VERTICES, undirected);
+        size_t        n     = matrix.count;
+        csr_graph_t * graph = csr_create(n, edges, edge_count, flags);
+        ck_assert_ptr_nonnull(graph);
+        ck_assert_int_eq(csr_betweenness_centrality(graph, centrality), 0);
+
+        for (size_t v = 0; v < n; v++)
+        {
+            double expected = 0;
+            for (size_t s = 0; s < n; s++)
+            {
+                for (size_t t = 0; t < n; t++)
+                {
+                    if (s == v || t == v || s == t
+                        || matrix.distance[s][t] == CSR_UNREACHED
+                        || matrix.distance[s][v] == CSR_UNREACHED
+                        || matrix.distance[v][t] == CSR_UNREACHED
+                        || matrix.distance[s][v] + matrix.distance[v][t]
+                               != matrix.distance[s][t])
+                    {
+                        continue;
+                    }
+                    expected += matrix.paths[s][v] * matrix.paths[v][t]
+                                / matrix.paths[s][t];
+                }
+            }
+            ck_assert(fabs(centrality[v] - expected)
+                      < TOLERANCE * (1 + expected));
+        }
+        csr_destroy(&graph);
+    }
+}
+
+START_TEST(test_betweenness_matches_brute_force)
+{
+    srand(51);
+    check_betweenness(false);
+    check_betweenness(true);
+}
+END_TEST
+
+static int
+compare_int(const void * lhs, const void * rhs)
+{
+    return *(const int *)lhs - *(const int *)rhs;
+}
+
+static int *
+make_int(int value)
+{
+    int * data = malloc(sizeof(int));
+    ck_assert_ptr_nonnull(data);
+    *data = value;
+    return data;
+}
+
+/* The neighbors of every vertex of csr, as a set, are those of the graph
+ * node with that index, given as a list per vertex ended by -1. */
+static void
+check_adjacency(const csr_graph_t * csr, const int expected[][8])
+{
+    for (uint32_t v = 0; v < csr_vertex_count(csr); v++)
+    {
+        size_t           degree;
+        const uint32_t * targets = csr_neighbors(csr, v, &degree);
+        size_t           count   = 0;
+
+        for (; expected[v][count] >= 0; count++)
+        {
+            bool found = false;
+            for (size_t i = 0; i < degree; i++)
+            {
+                found = found || targets[i] == (uint32_t)expected[v][count];
+            }
+            ck_assert(found);
+        }
+        ck_assert_uint_eq(degree, count);
+    }
+}
+
+START_TEST(test_graph_converts_to_csr)
+{
+    graph_t * graph = create_graph(free, compare_int);
+    node_t *  nodes[7];
+
+    ck_assert_ptr_nonnull(graph);
+    for (int i = 0; i < 6; i++)
+    {
+        nodes[i] = add_node(graph, make_int(i));
+        ck_assert_ptr_nonnull(nodes[i]);
+    }
+
+    /* A star around 0, a path 3 - 4 - 5 hanging off leaf 3, and 2 alone.
+     * Every edge is stored in both directions. */
+    ck_assert_int_eq(add_edge(nodes[0], nodes[1]), 0);
+    ck_assert_int_eq(add_edge(nodes[0], nodes[2]), 0);
+    ck_assert_int_eq(add_edge(nodes[0], nodes[3]), 0);
+    ck_assert_int_eq(add_edge(nodes[3], nodes[4]), 0);
+    ck_assert_int_eq(add_edge(nodes[4], nodes[5]), 0);
+    remove_edge(nodes[0], nodes[2]);
+
+    /* Loops and repeated edges, added and removed again. */
+    for (int i = 0; i < 5; i++)
+    {
+        ck_assert_int_eq(add_edge(nodes[2], nodes[2]), 0);
+        ck_assert_int_eq(add_edge(nodes[1], nodes[2]), 0);
+    }
+    remove_edge(nodes[2], nodes[2]);
+    remove_edge(nodes[2], nodes[1]);
+
+    csr_graph_t * csr = graph_to_csr(graph);
+    ck_assert_ptr_nonnull(csr);
+    ck_assert_uint_eq(csr_vertex_count(csr), 6);
+    ck_assert_uint_eq(csr_edge_count(csr), 8);
+    check_adjacency(csr,
+                    (const int[][8]) { { 1, 3, -1 },
+                                       { 0, -1 },
+                                       { -1 },
+                                       { 0, 4, -1 },
+                                       { 3, 5, -1 },
+                                       { 4, -1 } });
+    csr_destroy(&csr);
+
+    ck_assert(is_path(graph, nodes[1], nodes[5]));
+    ck_assert(!is_path(graph, nodes[1], nodes[2]));
+
+    /* Of the 20 ordered pairs of the other five nodes, 3 is on the 8
+     * joining {0, 1} and {4, 5}. */
+    ck_assert(fabs(betweenness_centrality(graph, nodes[3]) - 8.0 / 20)
+              < TOLERANCE);
+    ck_assert(fabs(betweenness_centrality(graph, nodes[1])) < TOLERANCE);
+
+    /* Removing 0 moves 5 into its place, as vertex 0. Removing a node with
+     * a loop leaves no entries pointing at it. */
+    remove_node(graph, nodes[0]);
+    nodes[6] = add_node(graph, make_int(6));
+    ck_assert_ptr_nonnull(nodes[6]);
+    ck_assert_int_eq(add_edge(nodes[6], nodes[6]), 0);
+    ck_assert_int_eq(add_edge(nodes[6], nodes[1]), 0);
+    ck_assert_int_eq(add_edge(nodes[6], nodes[6]), 0);
+    remove_node(graph, nodes[6]);
+    csr = graph_to_csr(graph);
+    ck_assert_ptr_nonnull(csr);
+    ck_assert_uint_eq(csr_vertex_count(csr), 5);
+    check_adjacency(csr,
+                    (const int[][8]) { { 4, -1 },
+                                       { -1 },
+                                       { -1 },
+                                       { 4, -1 },
+                                       { 3, 0, -1 } });
+    csr_destroy(&csr);
+    ck_assert(is_path(graph, nodes[5], nodes[3]));
+    ck_assert(!is_path(graph, nodes[5], nodes[1]));
+    free_graph(graph);
+}
+END_TEST
+
+START_TEST(test_graph_holds_many_edges)
+{
+    graph_t * graph = create_graph(free, compare_int);
+    node_t *  nodes[MAX_NUM_NODES];
+
+    ck_assert_ptr_nonnull(graph);
+    for (int i = 0; i < MAX_NUM_NODES; i++)
+    {
+        nodes[i] = add_node(graph, make_int(i));
+        ck_assert_ptr_nonnull(nodes[i]);
+    }
+    int * extra = make_int(-1);
+    ck_assert_ptr_null(add_node(graph, extra));
+    free(extra);
+
+    /* Node 0 joins every other, growing its neighbor list past any
+     * initial size. */
+    for (int i = 1; i < MAX_NUM_NODES; i++)
+    {
+        ck_assert_int_eq(add_edge(nodes[0], nodes[i]), 0);
+    }
+
+    csr_graph_t * csr = graph_to_csr(graph);
+    uint32_t      distances[MAX_NUM_NODES];
+    ck_assert_ptr_nonnull(csr);
+    ck_assert_uint_eq(csr_degree(csr, 0), MAX_NUM_NODES - 1);
+    ck_assert_uint_eq(csr_bfs(csr, 1, distances), MAX_NUM_NODES);
+    ck_assert_uint_eq(distances[0], 1);
+    ck_assert_uint_eq(distances[MAX_NUM_NODES - 1], 2);
+    csr_destroy(&csr);
+
+    ck_assert(fabs(betweenness_centrality(graph, nodes[0]) - 1.0)
+              < TOLERANCE);
+    free_graph(graph);
+}
+END_TEST
+
+Suite *
+check_graph_suite(void)
+{
+    Suite * suite   = suite_create("graph_test");
+    TCase * tc_core = tcase_create("Core");
+    TCase * tc_csr  = tcase_create("BruteForce");
+
+    tcase_add_test(tc_core, test_create_keeps_edge_order);
+    tcase_add_test(tc_core, test_graph_converts_to_csr);
+    tcase_add_test(tc_core, test_graph_holds_many_edges);
+    tcase_add_test(tc_csr, test_bfs_matches_brute_force);
+    tcase_add_test(tc_csr, test_betweenness_matches_brute_force);
+    tcase_set_timeout(tc_csr, 60);
+
+    suite_add_tcase(suite, tc_core);
+    suite_add_tcase(suite, tc_csr);
+    return suite;
+}
+
+int
+main(void)
+{
+    SRunner * runner = srunner_create(check_graph_suite());
+
+    srunner_run_all(runner, CK_VERBOSE);
+
+    int no_failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+    return (no_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,196 @@
+/** @file bloom_bench.c
+ *
+ * @brief Measures how much a blocked Bloom filter in front of the chained
+ *        hashtable saves on lookups that mostly miss.
+ *
+ * Build and run from DSA/hashtable with
+ *
+ *     gcc -std=c18 -O2 -D_DEFAULT_SOURCE -Iinclude src/hashtable.c \
+ *         src/ht_arena.c src/ht_hash.c src/bloom_filter.c \
+ *         bench/bloom_bench.c -lm -o bloom_bench
+ *     ./bloom_bench [entries] [miss_percent]
+ *
+ * A table of string keys (1M by default) is queried for a shuffled mix of
+ * present and absent keys (90% absent by default), once directly and once
+ * through filters sized for 10%, 1% and 0.1% false positives. Times are
+ * nanoseconds per lookup; the false positive rate is the one measured.
+ *
+ */
+
+#include "../include/bloom_filter.h"
+#include "../include/hashtable.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define KEY_SIZE 24
+
+static double
+now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static uint64_t
+next_random(uint64_t * state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+/* Keys count .. 2 * count - 1 of the returned array are never inserted. */
+static char *
+make_keys(size_t count)
+{
+    char * keys = malloc(2 * count * KEY_SIZE);
+    if (keys == NULL)
+    {
+        return NULL;
+    }
+    for (size_t i = 0; i < 2 * count; i++)
+    {
+        snprintf(keys + i * KEY_SIZE, KEY_SIZE, "key-%zu", i);
+    }
+    return keys;
+}
+
+/* Indices of the keys to look up, miss_percent of them absent. */
+static size_t *
+make_queries(size_t count, size_t lookups, unsigned miss_percent)
+{
+    uint64_t rng     = 0x2545F4914F6CDD1DULL;
+    size_t * queries = malloc(lookups * sizeof(size_t));
+    if (queries == NULL)
+    {
+        return NULL;
+    }
+    for (size_t i = 0; i < lookups; i++)
+    {
+        bool miss  = next_random(&rng) % 100 < miss_percent;
+        queries[i] = next_random(&rng) % count + (miss ? count : 0);
+    }
+    return queries;
+}
+
+static size_t
+run_table(const htable_t * table,
+          const char *     keys,
+          const size_t *   queries,
+          size_t           lookups)
+{
+    size_t found = 0;
+    for (size_t i = 0; i < lookups; i++)
+    {
+        found += ht_get(table, keys + queries[i] * KEY_SIZE) != NULL;
+    }
+    return found;
+}
+
+static size_t
+run_filtered(const htable_t * table,
+             const bloom_t *  filter,
+             const char *     keys,
+             const size_t *   queries,
+             size_t           lookups,
+             size_t *         passed)
+{
+    size_t found = 0;
+    for (size_t i = 0; i < lookups; i++)
+    {
+        const char * key = keys + queries[i] * KEY_SIZE;
+        if (bf_may_contain(filter, ht_string_hash(key)))
+        {
+            (*passed)++;
+            found += ht_get(table, key) != NULL;
+        }
+    }
+    return found;
+}
+
+int
+main(int argc, char ** argv)
+{
+    size_t   count        = 1000000;
+    unsigned miss_percent = 90;
+    if (argc > 1)
+    {
+        count = strtoull(argv[1], NULL, 10);
+    }
+    if (argc > 2)
+    {
+        miss_percent = (unsigned)strtoul(argv[2], NULL, 10);
+    }
+
+    size_t     lookups = 4 * count;
+    char *     keys    = make_keys(count);
+    size_t *   queries = make_queries(count, lookups, miss_percent);
+    htable_t * table = ht_create(ht_string_hash, ht_string_eq, NULL, NULL, 0);
+    if (keys == NULL || queries == NULL || table == NULL)
+    {
+        fprintf(stderr, "out of memory\n");
+        return EXIT_FAILURE;
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        ht_set(table, keys + i * KEY_SIZE, keys);
+    }
+
+    printf("%-10s %10s %10s %10s %12s\n",
+           "filter",
+           "bytes/key",
+           "hashes",
+           "lookup ns",
+           "false pos");
+
+    double start    = now_ns();
+    size_t expected = run_table(table, keys, queries, lookups);
+    printf("%-10s %10s %10s %10.1f %12s\n",
+           "none",
+           "-",
+           "-",
+           (now_ns() - start) / (double)lookups,
+           "-");
+
+    const double rates[] = { 0.1, 0.01, 0.001 };
+    for (size_t r = 0; r < sizeof(rates) / sizeof(rates[0]); r++)
+    {
+        bloom_t * filter = bf_create(count, rates[r]);
+        if (filter == NULL)
+        {
+            fprintf(stderr, "out of memory\n");
+            return EXIT_FAILURE;
+        }
+        for (size_t i = 0; i < count; i++)
+        {
+            bf_add(filter, ht_string_hash(keys + i * KEY_SIZE));
+        }
+
+        size_t passed = 0;
+        start         = now_ns();
+        size_t found
+            = run_filtered(table, filter, keys, queries, lookups, &passed);
+        double took   = (now_ns() - start) / (double)lookups;
+        size_t misses = lookups - expected;
+
+        if (found != expected)
+        {
+            fprintf(stderr, "filter lost keys\n");
+        }
+        printf("%-10g %10.2f %10u %10.1f %12.5f\n",
+               rates[r],
+               (double)bf_size(filter) / (double)count,
+               bf_hash_count(filter),
+               took,
+               misses ? (double)(passed - found) / (double)misses : 0.0);
+        bf_destroy(&filter);
+    }
+
+    ht_destroy(&table);
+    free(queries);
+    free(keys);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,217 @@
+/** @file concurrent_bench.c
+ *
+ * @brief Measures how lookups in the concurrent hashtable scale with the
+ *        number of reading threads.
+ *
+ * Build and run from DSA/hashtable with
+ *
+ *     gcc -std=c18 -O2 -D_DEFAULT_SOURCE -pthread -Iinclude \
+ *         src/concurrent_hashtable.c bench/concurrent_bench.c \
+ *         -o concurrent_bench
+ *     ./concurrent_bench [entries] [max_threads]
+ *
+ * The table is filled with entries integer keys (1M by default), then 1, 2,
+ * 4, ... up to max_threads threads (the number of online CPUs by default)
+ * each look up LOOKUPS_PER_THREAD random keys, all of them present. The
+ * same runs are repeated with one more thread replacing values throughout,
+ * which keeps memory retiring and the epoch moving. Throughput is in
+ * millions of lookups per second; speedup is relative to one reader.
+ *
+ */
+
+#include "../include/concurrent_hashtable.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LOOKUPS_PER_THREAD (1u << 23)
+
+typedef struct bench_reader
+{
+    pthread_t   thread;
+    chtable_t * table;
+    size_t      entries;
+    uint64_t    seed;
+    size_t      found;
+} bench_reader_t;
+
+typedef struct bench_writer
+{
+    pthread_t   thread;
+    chtable_t * table;
+    size_t      entries;
+    atomic_bool stop;
+} bench_writer_t;
+
+static pthread_barrier_t g_start;
+
+static uint64_t
+key_hash(const void * key)
+{
+    return (uint64_t)(uintptr_t)key * 0x9E3779B97F4A7C15ULL;
+}
+
+static bool
+key_eq(const void * lhs, const void * rhs)
+{
+    return lhs == rhs;
+}
+
+static double
+now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static uint64_t
+next_random(uint64_t * state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+static void *
+reader_main(void * arg)
+{
+    bench_reader_t * reader = arg;
+    uint64_t         rng    = reader->seed;
+    size_t           found  = 0;
+
+    pthread_barrier_wait(&g_start);
+    for (size_t i = 0; i < LOOKUPS_PER_THREAD; i++)
+    {
+        uintptr_t key = next_random(&rng) % reader->entries + 1;
+        found += cht_get(reader->table, (void *)key) != NULL;
+    }
+    reader->found = found;
+    return NULL;
+}
+
+static void *
+writer_main(void * arg)
+{
+    bench_writer_t * writer = arg;
+    uint64_t         rng    = 0x853C49E6748FEA9BULL;
+
+    pthread_barrier_wait(&g_start);
+    while (!atomic_load_explicit(&writer->stop, memory_order_relaxed))
+    {
+        uintptr_t key = next_random(&rng) % writer->entries + 1;
+        cht_set(writer->table, (void *)key, (void *)key);
+    }
+    return NULL;
+}
+
+/* Lookups per second, in millions, of threads readers running at once. */
+static double
+run(chtable_t * table, size_t entries, size_t threads, bool with_writer)
+{
+    bench_reader_t * readers = calloc(threads, sizeof(bench_reader_t));
+    bench_writer_t   writer  = { .table = table, .entries = entries };
+    if (readers == NULL)
+    {
+        return 0.0;
+    }
+
+    pthread_barrier_init(
+        &g_start, NULL, (unsigned)(threads + 1 + with_writer));
+    atomic_init(&writer.stop, false);
+    if (with_writer)
+    {
+        pthread_create(&writer.thread, NULL, writer_main, &writer);
+    }
+    for (size_t i = 0; i < threads; i++)
+    {
+        readers[i].table   = table;
+        readers[i].entries = entries;
+        readers[i].seed    = 0x9E3779B97F4A7C15ULL * (i + 1);
+        pthread_create(&readers[i].thread, NULL, reader_main, &readers[i]);
+    }
+
+    pthread_barrier_wait(&g_start);
+    double start = now_ns();
+    size_t found = 0;
+    for (size_t i = 0; i < threads; i++)
+    {
+        pthread_join(readers[i].thread, NULL);
+        found += readers[i].found;
+    }
+    double elapsed = now_ns() - start;
+
+    if (with_writer)
+    {
+        atomic_store(&writer.stop, true);
+        pthread_join(writer.thread, NULL);
+    }
+    pthread_barrier_destroy(&g_start);
+    free(readers);
+
+    if (found != threads * LOOKUPS_PER_THREAD)
+    {
+        fprintf(stderr, "lookup mismatch\n");
+    }
+    return (double)(threads * LOOKUPS_PER_THREAD) / elapsed * 1e3;
+}
+
+int
+main(int argc, char ** argv)
+{
+    size_t entries     = 1000000;
+    size_t max_threads = (size_t)sysconf(_SC_NPROCESSORS_ONLN);
+    if (argc > 1)
+    {
+        entries = strtoull(argv[1], NULL, 10);
+    }
+    if (argc > 2)
+    {
+        max_threads = strtoull(argv[2], NULL, 10);
+    }
+
+    chtable_t * table = cht_create(key_hash, key_eq, NULL, NULL, 0);
+    if (table == NULL || entries == 0)
+    {
+        fprintf(stderr, "could not create the table\n");
+        return EXIT_FAILURE;
+    }
+    for (uintptr_t key = 1; key <= entries; key++)
+    {
+        if (cht_set(table, (void *)key, (void *)key))
+        {
+            fprintf(stderr, "out of memory at %zu entries\n", (size_t)key);
+            return EXIT_FAILURE;
+        }
+    }
+
+    printf("%-8s %8s %12s %10s\n",
+           "writer",
+           "threads",
+           "Mlookups/s",
+           "speedup");
+    for (int with_writer = 0; with_writer < 2; with_writer++)
+    {
+        double base = 0.0;
+        for (size_t threads = 1; threads <= max_threads; threads *= 2)
+        {
+            double rate = run(table, entries, threads, with_writer);
+            if (threads == 1)
+            {
+                base = rate;
+            }
+            printf("%-8s %8zu %12.1f %10.2f\n",
+                   with_writer ? "yes" : "no",
+                   threads,
+                   rate,
+                   rate / base);
+        }
+    }
+
+    cht_destroy(&table);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,237 @@
+/** @file hashtable_bench.c
+ *
+ * @brief Compares the chained and the flat hashtable on insert heavy and
+ *        lookup heavy workloads.
+ *
+ * Build and run from DSA/hashtable with
+ *
+ *     gcc -std=c18 -O2 -D_DEFAULT_SOURCE -Iinclude src/hashtable.c \
+ *         src/ht_arena.c src/ht_hash.c src/flat_hashtable.c \
+ *         bench/hashtable_bench.c -o hashtable_bench
+ *     ./hashtable_bench [max_entries]
+ *
+ * For every table size from 1K up to max_entries (10M by default; 100M
+ * needs roughly 8 GB) both tables are filled with integer keys, then
+ * queried in random order for keys that are present (hit) and keys that
+ * are not (miss). Times are nanoseconds per operation, except for the worst
+ * single insert, in microseconds, which shows the pause a resize costs.
+ *
+ */
+
+#include "../include/flat_hashtable.h"
+#include "../include/hashtable.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/* Lookups timed per size, at least; small tables repeat their keys. */
+#define MIN_LOOKUPS (1u << 22)
+
+typedef struct bench_ops
+{
+    const char * name;
+    void * (*create)(size_t capacity);
+    int (*set)(void * table, void * key, void * value);
+    void * (*get)(const void * table, const void * key);
+    void (*destroy)(void * table);
+} bench_ops_t;
+
+static uint64_t
+key_hash(const void * key)
+{
+    return (uint64_t)(uintptr_t)key * 0x9E3779B97F4A7C15ULL;
+}
+
+static bool
+key_eq(const void * lhs, const void * rhs)
+{
+    return lhs == rhs;
+}
+
+static void *
+chained_create(size_t capacity)
+{
+    (void)capacity;
+    return ht_create(key_hash, key_eq, NULL, NULL, 0);
+}
+
+static int
+chained_set(void * table, void * key, void * value)
+{
+    return ht_set(table, key, value);
+}
+
+static void *
+chained_get(const void * table, const void * key)
+{
+    return ht_get(table, key);
+}
+
+static void
+chained_destroy(void * table)
+{
+    htable_t * hashtable = table;
+    ht_destroy(&hashtable);
+}
+
+static void *
+flat_create(size_t capacity)
+{
+    (void)capacity;
+    return fht_create(key_hash, key_eq, NULL, NULL, 0);
+}
+
+static int
+flat_set(void * table, void * key, void * value)
+{
+    return fht_set(table, key, value);
+}
+
+static void *
+flat_get(const void * table, const void * key)
+{
+    return fht_get(table, key);
+}
+
+static void
+flat_destroy(void * table)
+{
+    fhtable_t * flat = table;
+    fht_destroy(&flat);
+}
+
+static const bench_ops_t g_tables[] = {
+    { "chained", chained_create, chained_set, chained_get, chained_destroy },
+    { "flat", flat_create, flat_set, flat_get, flat_destroy },
+};
+
+static double
+now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static uint64_t
+next_random(uint64_t * state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+/* Odd keys are inserted, even keys are misses. Keys are shuffled so that
+ * neither inserts nor lookups walk memory in order. */
+static uintptr_t *
+make_keys(size_t count, uint64_t * rng)
+{
+    uintptr_t * keys = malloc(count * sizeof(uintptr_t));
+    if (keys == NULL)
+    {
+        return NULL;
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        keys[i] = 2 * i + 1;
+    }
+    for (size_t i = count - 1; i > 0; i--)
+    {
+        size_t    j = next_random(rng) % (i + 1);
+        uintptr_t t = keys[i];
+        keys[i]     = keys[j];
+        keys[j]     = t;
+    }
+    return keys;
+}
+
+static void
+run(const bench_ops_t * ops, const uintptr_t * keys, size_t count)
+{
+    void * table = ops->create(count);
+    if (table == NULL)
+    {
+        fprintf(stderr, "%s: out of memory\n", ops->name);
+        return;
+    }
+
+    double start = now_ns();
+    double worst = 0.0;
+    for (size_t i = 0; i < count; i++)
+    {
+        double before = now_ns();
+        ops->set(table, (void *)keys[i], (void *)keys[i]);
+        double took = now_ns() - before;
+        if (took > worst)
+        {
+            worst = took;
+        }
+    }
+    double insert = (now_ns() - start) / (double)count;
+
+    size_t lookups = count < MIN_LOOKUPS ? MIN_LOOKUPS : count;
+    size_t found   = 0;
+    start          = now_ns();
+    for (size_t i = 0; i < lookups; i++)
+    {
+        found += ops->get(table, (void *)keys[(i * 7919) % count]) != NULL;
+    }
+    double hit = (now_ns() - start) / (double)lookups;
+
+    start = now_ns();
+    for (size_t i = 0; i < lookups; i++)
+    {
+        uintptr_t miss_key = keys[(i * 7919) % count] + 1;
+        found += ops->get(table, (void *)miss_key) != NULL;
+    }
+    double miss = (now_ns() - start) / (double)lookups;
+
+    if (found != lookups)
+    {
+        fprintf(stderr, "%s: lookup mismatch\n", ops->name);
+    }
+    printf("%-8s %12zu %10.1f %10.1f %10.1f %10.1f\n",
+           ops->name,
+           count,
+           insert,
+           worst / 1e3,
+           hit,
+           miss);
+    ops->destroy(table);
+}
+
+int
+main(int argc, char ** argv)
+{
+    size_t max_entries = 10000000;
+    if (argc > 1)
+    {
+        max_entries = strtoull(argv[1], NULL, 10);
+    }
+
+    printf("%-8s %12s %10s %10s %10s %10s\n",
+           "table",
+           "entries",
+           "insert ns",
+           "worst us",
+           "hit ns",
+           "miss ns");
+
+    uint64_t rng = 0x2545F4914F6CDD1DULL;
+    for (size_t count = 1000; count <= max_entries; count *= 10)
+    {
+        uintptr_t * keys = make_keys(count, &rng);
+        if (keys == NULL)
+        {
+            fprintf(stderr, "out of memory at %zu entries\n", count);
+            return EXIT_FAILURE;
+        }
+        for (size_t i = 0; i < sizeof(g_tables) / sizeof(g_tables[0]); i++)
+        {
+            run(&g_tables[i], keys, count);
+        }
+        free(keys);
+    }
+    return EXIT_SUCCESS;
+}
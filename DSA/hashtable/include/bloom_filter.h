@@ -0,0 +1,110 @@
+/** @file bloom_filter.h
+ *
+ * @brief A cache line blocked Bloom filter, to answer most lookups of
+ *        absent keys without touching a table.
+ *
+ * The filter is an array of 64 byte blocks. A key's hash picks one block,
+ * and sets or tests its k bits inside that block only, spread over the
+ * block's eight words, so each query costs one cache line whatever k is.
+ * Keeping the bits of a key together costs accuracy, which the sizing
+ * makes up for with more bits per key: about 10 instead of 9.6 for a 1%
+ * rate, but twice as many as an unblocked filter at one in a billion.
+ *
+ * A filter never reports an added key as absent. It reports an absent key
+ * as possibly present at about the false positive rate it was sized for,
+ * as long as no more keys than expected are added.
+ *
+ * The filter takes 64 bit hashes rather than keys, so it can sit in front
+ * of any table: add the table's hash of every key stored, and only search
+ * the table when bf_may_contain() says so. Hashes are mixed again inside,
+ * so weak hash functions work too. Keys cannot be removed; rebuild the
+ * filter, or bf_clear() it and add the remaining keys, once enough of them
+ * are gone.
+ *
+ */
+
+#ifndef BLOOM_FILTER_H
+#define BLOOM_FILTER_H
+
+#include "hashtable.h"
+
+/**
+ * @brief Bits set per key, at most.
+ *
+ */
+#define BF_MAX_HASHES 16
+
+typedef struct bloom bloom_t;
+
+/**
+ * @brief Creates an empty filter sized for a number of keys and a false
+ *        positive rate. The number of bits per key and of bits set per key
+ *        are chosen together, for the smallest filter that meets the rate.
+ *
+ * @param expected_count the number of keys to be added
+ * @param false_positive_rate the rate wanted, between 1e-9 and 0.5
+ * @return bloom_t* a pointer to the new filter, or NULL on failure or if
+ *         the rate is out of range
+ */
+bloom_t * bf_create(size_t expected_count, double false_positive_rate);
+
+/**
+ * @brief Destroy the filter. *filter == NULL is safe. The filter pointer is
+ *        set to NULL afterwards.
+ *
+ * @param filter a reference to a pointer to an allocated filter
+ */
+void bf_destroy(bloom_t ** filter);
+
+/**
+ * @brief Add the hash of a key.
+ *
+ * @param filter a pointer to an allocated filter
+ * @param hash the hash of the key
+ */
+void bf_add(bloom_t * filter, uint64_t hash);
+
+/**
+ * @brief Check whether a key may have been added.
+ *
+ * @param filter a pointer to an allocated filter
+ * @param hash the hash of the key
+ * @return false if the key was certainly not added, true if it may have
+ *         been
+ */
+bool bf_may_contain(const bloom_t * filter, uint64_t hash);
+
+/**
+ * @brief Remove every key from the filter.
+ *
+ * @param filter a pointer to an allocated filter
+ */
+void bf_clear(bloom_t * filter);
+
+/**
+ * @brief Returns the memory taken by the filter's bits, in bytes.
+ *
+ * @param filter a pointer to an allocated filter
+ * @return size_t the size of the bit array
+ */
+size_t bf_size(const bloom_t * filter);
+
+/**
+ * @brief Returns the number of bits set per key.
+ *
+ * @param filter a pointer to an allocated filter
+ * @return unsigned the number of bits, from 1 to BF_MAX_HASHES
+ */
+unsigned bf_hash_count(const bloom_t * filter);
+
+/**
+ * @brief Estimate the false positive rate after some number of keys have
+ *        been added.
+ *
+ * @param filter a pointer to an allocated filter
+ * @param count the number of keys added
+ * @return double the expected rate
+ */
+double bf_false_positive_rate(const bloom_t * filter, size_t count);
+
+#endif
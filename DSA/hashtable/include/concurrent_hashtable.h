@@ -0,0 +1,154 @@
+/** @file concurrent_hashtable.h
+ *
+ * @brief A chained hashtable that many threads may read and write at once.
+ *
+ * Lookups take no locks and never wait for writers. Inserts and deletes
+ * lock one of a fixed set of stripes, so writers only contend when they
+ * touch buckets of the same stripe. When the table grows, the threads that
+ * write to it share the work of moving buckets into the larger array, while
+ * lookups carry on in whichever array holds their bucket.
+ *
+ * Memory that writers unlink (replaced or deleted entries and old bucket
+ * arrays) is freed only once every thread that might still be reading it
+ * has left its read section. Release functions passed to cht_create() may
+ * therefore run later, on any thread using a concurrent table, and must not
+ * use the table themselves.
+ *
+ * A value returned by cht_get() stays valid while the caller holds a read
+ * section, opened with cht_read_lock(). Without one it may be released as
+ * soon as another thread replaces or deletes its entry.
+ *
+ * At most CHT_MAX_THREADS threads can use concurrent tables at once; a
+ * thread's slot is given back when it exits.
+ *
+ * The callbacks and ownership rules are otherwise the same as for
+ * hashtable.h.
+ *
+ */
+
+#ifndef CONCURRENT_HASHTABLE_H
+#define CONCURRENT_HASHTABLE_H
+
+#include "hashtable.h"
+
+/**
+ * @brief Number of threads that may use concurrent tables at the same time.
+ *        Further threads wait for a running one to exit.
+ *
+ */
+#define CHT_MAX_THREADS 1024
+
+typedef struct chtable chtable_t;
+
+/**
+ * @brief Creates a newly allocated concurrent hashtable.
+ *
+ * @param hash a function pointer to the hash function for keys
+ * @param eq a function pointer to the equality function for keys
+ * @param key_free a function pointer to release keys, or NULL
+ * @param value_free a function pointer to release values, or NULL
+ * @param capacity the number of entries expected; the table starts with
+ *        enough buckets to hold them without growing
+ * @return chtable_t* a pointer to the new table, or NULL on failure or if
+ *         hash or eq is NULL
+ */
+chtable_t * cht_create(ht_hash_f hash,
+                       ht_eq_f   eq,
+                       ht_free_f key_free,
+                       ht_free_f value_free,
+                       size_t    capacity);
+
+/**
+ * @brief Destroy the table, releasing every key and value it owns.
+ *
+ * No other thread may be using the table. *table == NULL is safe. The
+ * table pointer is set to NULL afterwards.
+ *
+ * @param table a reference to a pointer to an allocated table
+ */
+void cht_destroy(chtable_t ** table);
+
+/**
+ * @brief Open a read section on the calling thread.
+ *
+ * Keys and values seen inside the section are not released before it
+ * ends, even if other threads replace or delete them. Sections nest and
+ * must be kept short, since memory unlinked by writers piles up while any
+ * thread is inside one.
+ *
+ */
+void cht_read_lock(void);
+
+/**
+ * @brief Close the innermost read section opened by cht_read_lock().
+ *
+ */
+void cht_read_unlock(void);
+
+/**
+ * @brief Insert a key-value pair, or replace the value of an existing key.
+ *
+ * When the key is already present, the table keeps its existing key, and
+ * releases the key passed in at once and the old value once no reader can
+ * see it.
+ *
+ * @param table a pointer to an allocated table
+ * @param key the key, owned by the table on success
+ * @param value the value, owned by the table on success
+ * @return 0 on success, -1 if memory could not be allocated, in which case
+ *         the table does not take ownership of key and value
+ */
+int cht_set(chtable_t * table, void * key, void * value);
+
+/**
+ * @brief Look up the value stored under a key, without locking.
+ *
+ * @param table a pointer to an allocated table
+ * @param key the key to look up
+ * @return void* the value, or NULL if the key is not present
+ */
+void * cht_get(const chtable_t * table, const void * key);
+
+/**
+ * @brief Check whether a key is present, even if its value is NULL.
+ *
+ * @param table a pointer to an allocated table
+ * @param key the key to look up
+ * @return true if the key is present
+ */
+bool cht_contains(const chtable_t * table, const void * key);
+
+/**
+ * @brief Remove a key. Its key and value are released once no reader can
+ *        see them.
+ *
+ * @param table a pointer to an allocated table
+ * @param key the key to remove
+ * @return 0 if the key was removed, -1 if it was not present
+ */
+int cht_delete(chtable_t * table, const void * key);
+
+/**
+ * @brief Returns the number of entries in the table. While other threads
+ *        write to it the count is only a snapshot.
+ *
+ * @param table a pointer to an allocated table
+ * @return size_t the number of entries
+ */
+size_t cht_size(const chtable_t * table);
+
+/**
+ * @brief Calls the function specified in the action parameter on every entry
+ *        in the table, in no particular order.
+ *
+ * Runs inside a read section. Entries inserted or deleted by other threads
+ * during the walk may or may not be visited; every other entry is visited
+ * once. The action must not write to the table.
+ *
+ * @param table a pointer to an allocated table
+ * @param action a function pointer called with each key and value
+ * @param action_ctx passed to action as its last parameter
+ */
+void cht_for_each(chtable_t * table, ht_action_f action, void * action_ctx);
+
+#endif
@@ -0,0 +1,112 @@
+/** @file flat_hashtable.h
+ *
+ * @brief An open addressing hashtable probed sixteen slots at a time.
+ *
+ * Keys and values live in flat slot arrays. A separate array holds one
+ * control byte per slot: either a marker for an empty or deleted slot, or
+ * seven bits of the key's hash. A lookup compares sixteen control bytes
+ * with one SSE2 instruction (or a scalar loop where SSE2 is not available)
+ * and only calls the equality function for slots whose seven bits match,
+ * so most probes touch a single cache line and no pointers. The table
+ * grows once seven eighths of its slots are used.
+ *
+ * The callbacks and ownership rules are the same as for hashtable.h.
+ *
+ */
+
+#ifndef FLAT_HASHTABLE_H
+#define FLAT_HASHTABLE_H
+
+#include "hashtable.h"
+
+typedef struct fhtable fhtable_t;
+
+/**
+ * @brief Creates a newly allocated flat hashtable.
+ *
+ * @param hash a function pointer to the hash function for keys
+ * @param eq a function pointer to the equality function for keys
+ * @param key_free a function pointer to release keys, or NULL
+ * @param value_free a function pointer to release values, or NULL
+ * @param capacity the number of entries expected; the table starts with
+ *        enough slots to hold them without growing
+ * @return fhtable_t* a pointer to the new table, or NULL on failure or if
+ *         hash or eq is NULL
+ */
+fhtable_t * fht_create(ht_hash_f hash,
+                       ht_eq_f   eq,
+                       ht_free_f key_free,
+                       ht_free_f value_free,
+                       size_t    capacity);
+
+/**
+ * @brief Destroy the table, releasing every key and value it owns.
+ *
+ * *table == NULL is safe. The table pointer is set to NULL afterwards.
+ *
+ * @param table a reference to a pointer to an allocated table
+ */
+void fht_destroy(fhtable_t ** table);
+
+/**
+ * @brief Insert a key-value pair, or replace the value of an existing key.
+ *
+ * When the key is already present, the table keeps its existing key, and
+ * releases both the old value and the key passed in.
+ *
+ * @param table a pointer to an allocated table
+ * @param key the key, owned by the table on success
+ * @param value the value, owned by the table on success
+ * @return 0 on success, -1 if memory could not be allocated, in which case
+ *         the table does not take ownership of key and value
+ */
+int fht_set(fhtable_t * table, void * key, void * value);
+
+/**
+ * @brief Look up the value stored under a key.
+ *
+ * @param table a pointer to an allocated table
+ * @param key the key to look up
+ * @return void* the value, or NULL if the key is not present
+ */
+void * fht_get(const fhtable_t * table, const void * key);
+
+/**
+ * @brief Check whether a key is present, even if its value is NULL.
+ *
+ * @param table a pointer to an allocated table
+ * @param key the key to look up
+ * @return true if the key is present
+ */
+bool fht_contains(const fhtable_t * table, const void * key);
+
+/**
+ * @brief Remove a key and release its key and value.
+ *
+ * @param table a pointer to an allocated table
+ * @param key the key to remove
+ * @return 0 if the key was removed, -1 if it was not present
+ */
+int fht_delete(fhtable_t * table, const void * key);
+
+/**
+ * @brief Returns the number of entries in the table.
+ *
+ * @param table a pointer to an allocated table
+ * @return size_t the number of entries
+ */
+size_t fht_size(const fhtable_t * table);
+
+/**
+ * @brief Calls the function specified in the action parameter on every entry
+ *        in the table, in no particular order.
+ *
+ * The action must not insert into or delete from the table.
+ *
+ * @param table a pointer to an allocated table
+ * @param action a function pointer called with each key and value
+ * @param action_ctx passed to action as its last parameter
+ */
+void fht_for_each(fhtable_t * table, ht_action_f action, void * action_ctx);
+
+#endif
@@ -2,11 +2,283 @@
  *
  * @brief A basic data agnostic hashtable library.
  *
+ * Keys and values are opaque pointers. The hash and equality of keys are
+ * supplied by the library user, so any key type can be stored. The table
+ * grows automatically once the number of entries passes HT_MAX_LOAD times
+ * the number of buckets, keeping lookups O(1) as it fills up.
+ *
+ * Tables made with ht_create_arena() instead keep copies of their keys and
+ * values, together with their buckets, in large chunks owned by the table,
+ * so that an insert makes no allocation of its own.
+ *
  */
 
 #ifndef HASHTABLE_H
 #define HASHTABLE_H
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Number of entries per bucket, on average, past which the table
+ *        doubles its bucket count.
+ *
+ */
+#define HT_MAX_LOAD 0.75
+
+/**
+ * @brief ht_create_arena() flag: equal keys and values share one copy.
+ *
+ */
+#define HT_ARENA_INTERN 0x1
+
+/**
+ * @brief A function pointer to a custom-defined hash function. Keys that
+ *        compare equal must hash to the same value.
+ *
+ */
+typedef uint64_t (*ht_hash_f)(const void * key);
+
+/**
+ * @brief A function pointer to a custom-defined equality function.
+ *
+ * @returns true if lhs and rhs are the same key, false otherwise
+ *
+ */
+typedef bool (*ht_eq_f)(const void * lhs, const void * rhs);
+
+/**
+ * @brief A function pointer to a custom-defined delete function used to
+ *        release keys and values owned by the table. For simple data types
+ *        this can simply point to the free function.
+ *
+ */
+typedef void (*ht_free_f)(void * data);
+
+/**
+ * @brief A function pointer to a custom-defined action function called by
+ *        ht_for_each() on every entry, with an optional context pointer
+ *        supplied by the caller.
+ *
+ */
+typedef void (*ht_action_f)(const void * key, void * value, void * ctx);
+
+typedef struct htable htable_t;
+
+/**
+ * @brief Memory use of an arena table, in bytes.
+ *
+ */
+typedef struct ht_arena_stats
+{
+    size_t reserved; /* Allocated from the system for the arena. */
+    size_t live;     /* Holding buckets, keys and values in use. */
+    size_t dead;     /* Freed since the last compaction, not yet reused. */
+    size_t interned; /* Distinct interned keys and values. */
+} ht_arena_stats_t;
+
+/**
+ * @brief Creates a newly allocated hashtable.
+ *
+ * The table takes ownership of the keys and values stored in it and
+ * releases them with key_free and value_free when they are replaced or
+ * deleted, or when the table is destroyed. Either may be NULL if the table
+ * should not release that part of its entries.
+ *
+ * @param hash a function pointer to the hash function for keys
+ * @param eq a function pointer to the equality function for keys
+ * @param key_free a function pointer to release keys, or NULL
+ * @param value_free a function pointer to release values, or NULL
+ * @param capacity the number of entries expected; the table starts with
+ *        enough buckets to hold them without growing
+ * @return htable_t* a pointer to the new table, or NULL on failure or if
+ *         hash or eq is NULL
+ */
+htable_t * ht_create(ht_hash_f hash,
+                     ht_eq_f   eq,
+                     ht_free_f key_free,
+                     ht_free_f value_free,
+                     size_t    capacity);
+
+/**
+ * @brief Creates a newly allocated hashtable that stores copies of its keys
+ *        and values.
+ *
+ * Entries are added with ht_set_copy(); ht_set() is refused. Keys and
+ * values handed out by the table point into its arena and stay valid until
+ * the next call that modifies the table. Once over half of the arena is
+ * freed memory, the live entries are copied into a fresh one a few buckets
+ * per insert or delete, so no single call pays for the whole table.
+ *
+ * @param hash a function pointer to the hash function for keys
+ * @param eq a function pointer to the equality function for keys
+ * @param capacity the number of entries expected
+ * @param flags HT_ARENA_INTERN, or 0
+ * @return htable_t* a pointer to the new table, or NULL on failure or if
+ *         hash or eq is NULL
+ */
+htable_t * ht_create_arena(ht_hash_f hash,
+                           ht_eq_f   eq,
+                           size_t    capacity,
+                           unsigned  flags);
+
+/**
+ * @brief Destroy the table, releasing every key and value it owns.
+ *
+ * *table == NULL is safe. The table pointer is set to NULL afterwards.
+ *
+ * @param table a reference to a pointer to an allocated table
+ */
+void ht_destroy(htable_t ** table);
+
+/**
+ * @brief Insert a key-value pair, or replace the value of an existing key.
+ *
+ * When the key is already present, the table keeps its existing key, and
+ * releases both the old value and the key passed in.
+ *
+ * @param table a pointer to an allocated table
+ * @param key the key, owned by the table on success
+ * @param value the value, owned by the table on success
+ * @return 0 on success, -1 if memory could not be allocated, in which case
+ *         the table does not take ownership of key and value
+ */
+int ht_set(htable_t * table, void * key, void * value);
+
+/**
+ * @brief Copy a key-value pair into an arena table, or overwrite the value
+ *        of an existing key.
+ *
+ * The hash and equality functions see the copy of the key, so for string
+ * keys key_size must include the terminator.
+ *
+ * @param table a pointer to a table made by ht_create_arena()
+ * @param key the bytes of the key
+ * @param key_size the number of bytes of the key
+ * @param value the bytes of the value
+ * @param value_size the number of bytes of the value
+ * @return 0 on success, -1 if memory could not be allocated or the table
+ *         is not an arena table
+ */
+int ht_set_copy(htable_t *   table,
+                const void * key,
+                size_t       key_size,
+                const void * value,
+                size_t       value_size);
 
+/**
+ * @brief Look up the value stored under a key.
+ *
+ * @param table a pointer to an allocated table
+ * @param key the key to look up
+ * @return void* the value, or NULL if the key is not present
+ */
+void * ht_get(const htable_t * table, const void * key);
+
+/**
+ * @brief Check whether a key is present, even if its value is NULL.
+ *
+ * @param table a pointer to an allocated table
+ * @param key the key to look up
+ * @return true if the key is present
+ */
+bool ht_contains(const htable_t * table, const void * key);
+
+/**
+ * @brief Remove a key and release its key and value.
+ *
+ * @param table a pointer to an allocated table
+ * @param key the key to remove
+ * @return 0 if the key was removed, -1 if it was not present
+ */
+int ht_delete(htable_t * table, const void * key);
+
+/**
+ * @brief Returns the number of entries in the table.
+ *
+ * @param table a pointer to an allocated table
+ * @return size_t the number of entries
+ */
+size_t ht_size(const htable_t * table);
+
+/**
+ * @brief Copy the live entries of an arena table into a fresh arena and
+ *        free the old one, at once rather than a few buckets per call.
+ *
+ * Finishes any compaction already under way. Does nothing for other
+ * tables. If memory runs out, the compaction is left under way and later
+ * inserts and deletes carry on with it.
+ *
+ * @param table a pointer to an allocated table
+ */
+void ht_compact(htable_t * table);
+
+/**
+ * @brief Report the memory use of an arena table.
+ *
+ * @param table a pointer to an allocated table
+ * @param stats filled in with the figures
+ * @return 0 on success, -1 if the table is not an arena table
+ */
+int ht_arena_stats(const htable_t * table, ht_arena_stats_t * stats);
+
+/**
+ * @brief Calls the function specified in the action parameter on every entry
+ *        in the table, in no particular order.
+ *
+ * The action must not insert into or delete from the table.
+ *
+ * @param table a pointer to an allocated table
+ * @param action a function pointer called with each key and value
+ * @param action_ctx passed to action as its last parameter
+ */
+void ht_for_each(htable_t * table, ht_action_f action, void * action_ctx);
+
+/**
+ * @brief Hash a block of bytes with a seed.
+ *
+ * A wyhash style function that consumes the input eight bytes at a time and
+ * mixes with 64x64->128 bit multiplies. Tables whose keys may be chosen by
+ * an attacker should use a secret random seed, so that colliding keys
+ * cannot be computed in advance.
+ *
+ * @param data a pointer to the bytes to hash
+ * @param length the number of bytes
+ * @param seed the seed; different seeds give unrelated hash functions
+ * @return uint64_t the hash of the bytes
+ */
+uint64_t ht_hash_bytes(const void * data, size_t length, uint64_t seed);
+
+/**
+ * @brief Set the seed used by ht_string_hash().
+ *
+ * Call it once at start up, with a random value, before any table using
+ * ht_string_hash() holds entries; entries hashed under another seed can no
+ * longer be found.
+ *
+ * @param seed the new seed
+ */
+void ht_set_hash_seed(uint64_t seed);
+
+/**
+ * @brief Hash function for NUL terminated string keys.
+ *
+ * Equivalent to ht_hash_bytes() over the string, without its terminator,
+ * with the seed set by ht_set_hash_seed().
+ *
+ * @param key a pointer to a NUL terminated string
+ * @return uint64_t the hash of the string
+ */
+uint64_t ht_string_hash(const void * key);
+
+/**
+ * @brief Equality function for NUL terminated string keys.
+ *
+ * @param lhs a pointer to a NUL terminated string
+ * @param rhs a pointer to a NUL terminated string
+ * @return true if the strings are equal
+ */
+bool ht_string_eq(const void * lhs, const void * rhs);
 
-#endif
\ No newline at end of file
+#endif
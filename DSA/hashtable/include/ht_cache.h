@@ -0,0 +1,230 @@
+/** @file ht_cache.h
+ *
+ * @brief Bounded caches over the chained hashtable, evicting entries by
+ *        LRU or CLOCK.
+ *
+ * A cache holds at most max_entries entries and at most max_bytes bytes,
+ * where each entry counts for the charge given when it was stored; a limit
+ * of 0 means no limit of that kind. When an insert would break a limit,
+ * entries are evicted first, their keys and values released like deleted
+ * ones.
+ *
+ * HTC_LRU evicts the least recently used entry. Every hit moves its entry
+ * to the front of an intrusive list, which makes hits writes.
+ *
+ * HTC_CLOCK approximates LRU with one reference bit per entry: a hit sets
+ * its bit, and eviction sweeps a hand over the entries, clearing set bits
+ * and evicting the first entry whose bit is already clear. A hit on an
+ * entry whose bit is set writes nothing, so hits on a sharded cache can
+ * share their shard's lock.
+ *
+ * htcache_t is for one thread. shtcache_t splits its capacity among shards
+ * chosen by key hash, each with its own lock, for use by many threads.
+ *
+ * The callbacks and ownership rules are otherwise the same as for
+ * hashtable.h.
+ *
+ */
+
+#ifndef HT_CACHE_H
+#define HT_CACHE_H
+
+#include "hashtable.h"
+
+typedef enum htc_policy
+{
+    HTC_LRU,
+    HTC_CLOCK
+} htc_policy_t;
+
+/**
+ * @brief Counters of a cache, summed over the shards of a sharded one.
+ *
+ */
+typedef struct htc_stats
+{
+    uint64_t hits;
+    uint64_t misses;    /* Lookups of keys not present. */
+    uint64_t evictions; /* Entries removed to make room, not deletes. */
+    size_t   entries;
+    size_t   bytes; /* Sum of the charges of the entries. */
+} htc_stats_t;
+
+typedef struct htcache  htcache_t;
+typedef struct shtcache shtcache_t;
+
+/**
+ * @brief Creates an empty cache.
+ *
+ * @param hash a function pointer to the hash function for keys
+ * @param eq a function pointer to the equality function for keys
+ * @param key_free a function pointer to release keys, or NULL
+ * @param value_free a function pointer to release values, or NULL
+ * @param policy HTC_LRU or HTC_CLOCK
+ * @param max_entries the number of entries to keep at most, or 0
+ * @param max_bytes the sum of charges to keep at most, or 0
+ * @return htcache_t* a pointer to the new cache, or NULL on failure, if
+ *         hash or eq is NULL, or if both limits are 0
+ */
+htcache_t * htc_create(ht_hash_f    hash,
+                       ht_eq_f      eq,
+                       ht_free_f    key_free,
+                       ht_free_f    value_free,
+                       htc_policy_t policy,
+                       size_t       max_entries,
+                       size_t       max_bytes);
+
+/**
+ * @brief Destroy the cache, releasing every key and value it holds.
+ *
+ * *cache == NULL is safe. The cache pointer is set to NULL afterwards.
+ *
+ * @param cache a reference to a pointer to an allocated cache
+ */
+void htc_destroy(htcache_t ** cache);
+
+/**
+ * @brief Insert a key-value pair, or replace the value of an existing key,
+ *        evicting entries as needed to stay within the limits.
+ *
+ * When the key is already present, the cache keeps its existing key, and
+ * releases both the old value and the key passed in.
+ *
+ * @param cache a pointer to an allocated cache
+ * @param key the key, owned by the cache on success
+ * @param value the value, owned by the cache on success
+ * @param charge the bytes the entry counts for against max_bytes
+ * @return 0 on success, -1 if memory could not be allocated or charge
+ *         exceeds max_bytes, in which case the cache does not take
+ *         ownership of key and value
+ */
+int htc_set(htcache_t * cache, void * key, void * value, size_t charge);
+
+/**
+ * @brief Look up the value stored under a key, marking it as used.
+ *
+ * @param cache a pointer to an allocated cache
+ * @param key the key to look up
+ * @return void* the value, or NULL if the key is not present; it stays
+ *         valid until the entry is replaced, deleted or evicted
+ */
+void * htc_get(htcache_t * cache, const void * key);
+
+/**
+ * @brief Remove a key and release its key and value.
+ *
+ * @param cache a pointer to an allocated cache
+ * @param key the key to remove
+ * @return 0 if the key was removed, -1 if it was not present
+ */
+int htc_delete(htcache_t * cache, const void * key);
+
+/**
+ * @brief Returns the number of entries in the cache.
+ *
+ * @param cache a pointer to an allocated cache
+ * @return size_t the number of entries
+ */
+size_t htc_size(const htcache_t * cache);
+
+/**
+ * @brief Read the counters of the cache.
+ *
+ * @param cache a pointer to an allocated cache
+ * @param stats filled in with the counters
+ */
+void htc_stats(const htcache_t * cache, htc_stats_t * stats);
+
+/**
+ * @brief Creates an empty sharded cache. Each shard gets an even share of
+ *        the limits, rounded up.
+ *
+ * @param hash a function pointer to the hash function for keys
+ * @param eq a function pointer to the equality function for keys
+ * @param key_free a function pointer to release keys, or NULL
+ * @param value_free a function pointer to release values, or NULL
+ * @param policy HTC_LRU or HTC_CLOCK
+ * @param max_entries the number of entries to keep at most, or 0
+ * @param max_bytes the sum of charges to keep at most, or 0
+ * @param shard_count the number of shards, rounded up to a power of two
+ * @return shtcache_t* a pointer to the new cache, or NULL on failure, if
+ *         hash or eq is NULL, if both limits are 0, or if shard_count is 0
+ */
+shtcache_t * shtc_create(ht_hash_f    hash,
+                         ht_eq_f      eq,
+                         ht_free_f    key_free,
+                         ht_free_f    value_free,
+                         htc_policy_t policy,
+                         size_t       max_entries,
+                         size_t       max_bytes,
+                         size_t       shard_count);
+
+/**
+ * @brief Destroy the sharded cache, releasing every key and value it holds.
+ *        No other thread may be using it.
+ *
+ * *cache == NULL is safe. The cache pointer is set to NULL afterwards.
+ *
+ * @param cache a reference to a pointer to an allocated sharded cache
+ */
+void shtc_destroy(shtcache_t ** cache);
+
+/**
+ * @brief Insert a key-value pair, or replace the value of an existing key.
+ *        Same as htc_set().
+ *
+ * @param cache a pointer to an allocated sharded cache
+ * @param key the key, owned by the cache on success
+ * @param value the value, owned by the cache on success
+ * @param charge the bytes the entry counts for against max_bytes
+ * @return 0 on success, -1 on failure as for htc_set()
+ */
+int shtc_set(shtcache_t * cache, void * key, void * value, size_t charge);
+
+/**
+ * @brief Look up a key and pass its entry to action while holding the
+ *        shard's lock, marking it as used.
+ *
+ * Other threads may evict the entry as soon as the lock is dropped, so the
+ * value can only be used, or copied out, inside action. For HTC_CLOCK
+ * caches action runs under a shared lock and may run on several threads at
+ * once; it must not modify the value unless the value is safe for that.
+ *
+ * @param cache a pointer to an allocated sharded cache
+ * @param key the key to look up
+ * @param action a function pointer called with the key, value and ctx
+ * @param action_ctx a pointer passed through to action
+ * @return true if the key was present and action was called
+ */
+bool shtc_get(shtcache_t * cache,
+              const void * key,
+              ht_action_f  action,
+              void *       action_ctx);
+
+/**
+ * @brief Remove a key and release its key and value.
+ *
+ * @param cache a pointer to an allocated sharded cache
+ * @param key the key to remove
+ * @return 0 if the key was removed, -1 if it was not present
+ */
+int shtc_delete(shtcache_t * cache, const void * key);
+
+/**
+ * @brief Returns the number of entries in the cache. Shards are counted one
+ *        at a time, so the result may be stale under concurrent writes.
+ *
+ * @param cache a pointer to an allocated sharded cache
+ * @return size_t the number of entries
+ */
+size_t shtc_size(shtcache_t * cache);
+
+/**
+ * @brief Read the counters of all shards, one shard at a time.
+ *
+ * @param cache a pointer to an allocated sharded cache
+ * @param stats filled in with the sums of the counters
+ */
+void shtc_stats(shtcache_t * cache, htc_stats_t * stats);
+
+#endif
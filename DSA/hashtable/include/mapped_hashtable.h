@@ -0,0 +1,157 @@
+/** @file mapped_hashtable.h
+ *
+ * @brief A read-only hashtable file that is queried straight from a memory
+ *        mapping.
+ *
+ * mht_save() writes the entries of a table as a position independent image:
+ * every reference inside the file is a byte offset, never a pointer, so the
+ * file can be mapped at any address and used without being parsed. Opening
+ * one costs a single mmap() and a check of its header; lookups then touch
+ * only the pages they need, and processes mapping the same file share them
+ * in the page cache.
+ *
+ * Layout, with every section starting on a MHT_ALIGN byte boundary and
+ * integers in the byte order of the machine that wrote the file:
+ *
+ *   header   magic, version, kind of index, sizes and offsets of the other
+ *            sections, the checksum of everything after the header, and a
+ *            checksum of the header itself.
+ *   index    chained files: bucket_count + 1 uint64_t indices into the
+ *            entries; the entries of bucket b are those from buckets[b] to
+ *            buckets[b+1].
+ *            perfect files: bucket_count uint16_t pilots, then the uint32_t
+ *            remap array of a minimal perfect hash (see perfect_hash.h)
+ *            that gives every key the index of its entry.
+ *   entries  {hash, key offset, value offset, key size, value size}, with
+ *            offsets relative to the data section.
+ *   data     key and value bytes, each starting on an 8 byte boundary.
+ *
+ * A perfect file takes about 4.3 bits of index per entry instead of about
+ * 128, and a lookup reads exactly one entry. It costs more time to write.
+ *
+ * Keys are hashed with ht_hash_bytes() under a seed stored in the header,
+ * so the hash function of the saved table does not matter. Keys compare
+ * equal when their bytes do.
+ *
+ */
+
+#ifndef MAPPED_HASHTABLE_H
+#define MAPPED_HASHTABLE_H
+
+#include "hashtable.h"
+
+/**
+ * @brief Alignment of the sections of a table file, in bytes.
+ *
+ */
+#define MHT_ALIGN 64
+
+/**
+ * @brief mht_open() flag: check the body checksum too, reading the whole
+ *        file once.
+ *
+ */
+#define MHT_VERIFY 0x1
+
+/**
+ * @brief A function pointer returning the number of bytes of a key or
+ *        value.
+ *
+ */
+typedef size_t (*ht_size_f)(const void * data);
+
+typedef struct mhtable mhtable_t;
+
+/**
+ * @brief Size function for NUL terminated strings, terminator included.
+ *
+ * @param data a pointer to a NUL terminated string
+ * @return size_t strlen(data) + 1
+ */
+size_t ht_string_size(const void * data);
+
+/**
+ * @brief Write every entry of a table to a table file.
+ *
+ * The file is written under a temporary name and renamed over path once
+ * complete, so readers never see a partial file.
+ *
+ * @param table a pointer to an allocated table
+ * @param path the file to write
+ * @param key_size a function pointer returning the size of a key
+ * @param value_size a function pointer returning the size of a value
+ * @return 0 on success, -1 on failure with errno set
+ */
+int mht_save(htable_t *   table,
+             const char * path,
+             ht_size_f    key_size,
+             ht_size_f    value_size);
+
+/**
+ * @brief Write every entry of a table to a table file indexed by a minimal
+ *        perfect hash. Otherwise the same as mht_save().
+ *
+ * @param table a pointer to an allocated table
+ * @param path the file to write
+ * @param key_size a function pointer returning the size of a key
+ * @param value_size a function pointer returning the size of a value
+ * @return 0 on success, -1 on failure with errno set; EINVAL if two keys of
+ *         the table have the same bytes
+ */
+int mht_save_perfect(htable_t *   table,
+                     const char * path,
+                     ht_size_f    key_size,
+                     ht_size_f    value_size);
+
+/**
+ * @brief Map a table file for reading, of either kind.
+ *
+ * @param path the file to open
+ * @param flags MHT_VERIFY, or 0
+ * @return mhtable_t* a pointer to the mapped table, or NULL if the file
+ *         could not be mapped or is not a valid table file
+ */
+mhtable_t * mht_open(const char * path, unsigned flags);
+
+/**
+ * @brief Unmap the table. *table == NULL is safe. The table pointer is set
+ *        to NULL afterwards.
+ *
+ * @param table a reference to a pointer to a mapped table
+ */
+void mht_close(mhtable_t ** table);
+
+/**
+ * @brief Look up the value stored under a key.
+ *
+ * @param table a pointer to a mapped table
+ * @param key the bytes of the key
+ * @param key_size the number of bytes of the key
+ * @param value_size set to the size of the value when found; may be NULL
+ * @return const void* the value, inside the mapping, or NULL if the key is
+ *         not present
+ */
+const void * mht_get(const mhtable_t * table,
+                     const void *      key,
+                     size_t            key_size,
+                     size_t *          value_size);
+
+/**
+ * @brief Look up a NUL terminated string key in a table of strings saved
+ *        with ht_string_size().
+ *
+ * @param table a pointer to a mapped table
+ * @param key a pointer to a NUL terminated string
+ * @return const char* the value, or NULL if the key is not present
+ */
+const char * mht_get_string(const mhtable_t * table, const char * key);
+
+/**
+ * @brief Returns the number of entries in the table.
+ *
+ * @param table a pointer to a mapped table
+ * @return size_t the number of entries
+ */
+size_t mht_size(const mhtable_t * table);
+
+#endif
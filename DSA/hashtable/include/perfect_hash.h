@@ -0,0 +1,89 @@
+/** @file perfect_hash.h
+ *
+ * @brief Minimal perfect hashing of a fixed set of keys.
+ *
+ * An mphash_t maps each of the count keys it was built from to its own
+ * index between 0 and count - 1, so values can live in a plain array of
+ * count elements, indexed without chains or probing.
+ *
+ * The construction hashes and displaces: keys are split into buckets of
+ * about four, and each bucket gets a 16 bit pilot chosen so that its keys
+ * land in free slots of a table slightly larger than the key set. The few
+ * keys that land past the end are moved into the holes left below it. A
+ * lookup hashes the key once, reads its bucket's pilot and lands on the
+ * index directly. The structure takes about 4.3 bits per key.
+ *
+ * Keys outside the set also get an index, of some other key. Callers that
+ * may look up foreign keys should keep the keys, or a fingerprint of them,
+ * next to the values and compare. Tables of this kind can also be saved
+ * to a file and mapped with mht_save_perfect().
+ *
+ */
+
+#ifndef PERFECT_HASH_H
+#define PERFECT_HASH_H
+
+#include "hashtable.h"
+
+/**
+ * @brief Returned by mph_index() for a hash of the empty set, which has no
+ *        index to give.
+ *
+ */
+#define MPH_NO_INDEX SIZE_MAX
+
+typedef struct mphash mphash_t;
+
+/**
+ * @brief Build a minimal perfect hash over a set of distinct keys.
+ *
+ * The keys are only read during the call.
+ *
+ * @param keys pointers to the bytes of the keys
+ * @param key_sizes the number of bytes of each key
+ * @param count the number of keys, less than 2^32 - 2^26
+ * @return mphash_t* a pointer to the new hash, or NULL with errno set to
+ *         ENOMEM, to EINVAL if two keys are equal or count is too large, or
+ *         to EAGAIN if no construction was found
+ */
+mphash_t * mph_create(const void * const * keys,
+                      const size_t *       key_sizes,
+                      size_t               count);
+
+/**
+ * @brief Destroy the hash. *mph == NULL is safe. The pointer is set to
+ *        NULL afterwards.
+ *
+ * @param mph a reference to a pointer to a hash
+ */
+void mph_destroy(mphash_t ** mph);
+
+/**
+ * @brief Returns the index of a key.
+ *
+ * @param mph a pointer to a hash
+ * @param key the bytes of the key
+ * @param key_size the number of bytes of the key
+ * @return size_t the index of the key, below mph_size(), if the key is one
+ *         of the set; some index below mph_size() otherwise, or
+ *         MPH_NO_INDEX if the set is empty
+ */
+size_t mph_index(const mphash_t * mph, const void * key, size_t key_size);
+
+/**
+ * @brief Returns the number of keys in the set.
+ *
+ * @param mph a pointer to a hash
+ * @return size_t the number of keys
+ */
+size_t mph_size(const mphash_t * mph);
+
+/**
+ * @brief Returns the memory taken by the hash, in bits per key.
+ *
+ * @param mph a pointer to a hash
+ * @return double the size of the pilots and remap arrays over the key count
+ */
+double mph_bits_per_key(const mphash_t * mph);
+
+#endif
@@ -0,0 +1,259 @@
+/** @file bloom_filter.c
+ *
+ * @brief A split block Bloom filter: each key sets at most two bits in every
+ *        word of one 64 byte block.
+ *
+ * The mixed hash is split in two: its upper half picks the block, and its
+ * lower half, multiplied by a different odd constant per bit, gives each
+ * bit's position inside its word. Bit i goes to word i % 8, so the masks of
+ * all words are built by one short loop of independent multiplies and
+ * shifts, which compilers turn into vector code, and applied or tested with
+ * eight independent word operations.
+ *
+ * The false positive rate of a blocked filter is that of a small filter of
+ * 512 bits, averaged over the Poisson distributed number of keys that land
+ * in a block. bf_create() evaluates it directly to size the filter.
+ *
+ */
+
+#include "../include/bloom_filter.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BF_BLOCK_BYTES 64
+#define BF_BLOCK_WORDS 8
+#define BF_MIN_RATE 1e-9
+#define BF_MAX_RATE 0.5
+#define BF_MAX_BITS_PER_KEY 128.0
+
+typedef struct bf_block
+{
+    _Alignas(BF_BLOCK_BYTES) uint64_t words[BF_BLOCK_WORDS];
+} bf_block_t;
+
+struct bloom
+{
+    bf_block_t * blocks;
+    size_t       block_count;
+    unsigned     hash_count;
+};
+
+static const uint32_t bf_salts[BF_MAX_HASHES] = {
+    0x47B6137Bu, 0x44974D91u, 0x8824AD5Bu, 0xA2B7289Du,
+    0x705495C7u, 0x2DF1424Bu, 0x9EFC4947u, 0x5C6BFB31u,
+    0x9E3779B1u, 0x85EBCA77u, 0xC2B2AE3Du, 0x27D4EB2Fu,
+    0x165667B1u, 0xD3A2646Du, 0xFD7046C5u, 0xB55A4F09u,
+};
+
+static uint64_t
+bf_mix(uint64_t hash)
+{
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDULL;
+    hash ^= hash >> 33;
+    hash *= 0xC4CEB9FE1A85EC53ULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+/* The block of a mixed hash, and the bits to set in each of its words. */
+static const bf_block_t *
+bf_locate(const bloom_t * filter, uint64_t hash, uint64_t * mask)
+{
+    uint64_t mixed = bf_mix(hash);
+    uint32_t low   = (uint32_t)mixed;
+    size_t   block = (size_t)(((mixed >> 32) * filter->block_count) >> 32);
+
+    memset(mask, 0, BF_BLOCK_WORDS * sizeof(uint64_t));
+    for (unsigned i = 0; i < filter->hash_count; i++)
+    {
+        mask[i % BF_BLOCK_WORDS] |= 1ULL << ((low * bf_salts[i]) >> 26);
+    }
+    return &filter->blocks[block];
+}
+
+/* Rate of a 512 bit block holding keys keys. A word that takes c bits per
+ * key answers falsely when all c of its tested bits are set. */
+static double
+bf_rate_at(double keys, unsigned hash_count)
+{
+    double rate = 1.0;
+    for (unsigned w = 0; w < BF_BLOCK_WORDS; w++)
+    {
+        unsigned bits = hash_count / BF_BLOCK_WORDS
+                        + (w < hash_count % BF_BLOCK_WORDS ? 1 : 0);
+        if (bits > 0)
+        {
+            double set = 1.0 - pow(1.0 - 1.0 / 64.0, keys * bits);
+            rate *= pow(set, bits);
+        }
+    }
+    return rate;
+}
+
+/* Rate of the whole filter, weighting each block load by its Poisson
+ * probability. The probabilities are worked out from their logarithms,
+ * since exp(-keys_per_block) underflows to 0 past about 745 keys per
+ * block, and only loads within 12 standard deviations of the mean are
+ * summed. */
+static double
+bf_rate(double keys_per_block, unsigned hash_count)
+{
+    if (!(keys_per_block > 0.0))
+    {
+        return 0.0;
+    }
+
+    double spread   = 12.0 * sqrt(keys_per_block) + 32.0;
+    double first    = floor(fmax(0.0, keys_per_block - spread));
+    double last     = keys_per_block + spread;
+    double log_mean = log(keys_per_block);
+    double rate     = 0.0;
+
+    for (double keys = first; keys <= last; keys += 1.0)
+    {
+        double term
+            = exp(keys * log_mean - keys_per_block - lgamma(keys + 1.0));
+        rate += term * bf_rate_at(keys, hash_count);
+    }
+    return fmin(rate, 1.0);
+}
+
+/* Fewest bits per key that reach the rate with hash_count bits per key,
+ * or 0 if BF_MAX_BITS_PER_KEY is not enough. */
+static double
+bf_bits_per_key(double false_positive_rate, unsigned hash_count)
+{
+    double low  = 1.0;
+    double high = BF_MAX_BITS_PER_KEY;
+
+    if (bf_rate(BF_BLOCK_BYTES * 8 / high, hash_count) > false_positive_rate)
+    {
+        return 0.0;
+    }
+    while (high - low > 0.01)
+    {
+        double middle = (low + high) / 2;
+        if (bf_rate(BF_BLOCK_BYTES * 8 / middle, hash_count)
+            > false_positive_rate)
+        {
+            low = middle;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    return high;
+}
+
+bloom_t *
+bf_create(size_t expected_count, double false_positive_rate)
+{
+    if (!(false_positive_rate >= BF_MIN_RATE
+          && false_positive_rate <= BF_MAX_RATE))
+    {
+        return NULL;
+    }
+
+    double   best_bits  = 0.0;
+    unsigned best_count = 0;
+    for (unsigned k = 1; k <= BF_MAX_HASHES; k++)
+    {
+        double bits = bf_bits_per_key(false_positive_rate, k);
+        if (bits > 0.0 && (best_count == 0 || bits < best_bits))
+        {
+            best_bits  = bits;
+            best_count = k;
+        }
+    }
+
+    double blocks = ceil(best_bits * (double)expected_count
+                         / (BF_BLOCK_BYTES * 8));
+    if (best_count == 0 || blocks > UINT32_MAX)
+    {
+        return NULL;
+    }
+
+    bloom_t * filter = malloc(sizeof(bloom_t));
+    if (filter == NULL)
+    {
+        return NULL;
+    }
+    filter->block_count = blocks < 1.0 ? 1 : (size_t)blocks;
+    filter->hash_count  = best_count;
+    filter->blocks      = aligned_alloc(
+        BF_BLOCK_BYTES, filter->block_count * sizeof(bf_block_t));
+    if (filter->blocks == NULL)
+    {
+        free(filter);
+        return NULL;
+    }
+    bf_clear(filter);
+    return filter;
+}
+
+void
+bf_destroy(bloom_t ** filter)
+{
+    if (!filter || !*filter)
+    {
+        return;
+    }
+
+    free((*filter)->blocks);
+    free(*filter);
+    *filter = NULL;
+}
+
+void
+bf_add(bloom_t * filter, uint64_t hash)
+{
+    uint64_t     mask[BF_BLOCK_WORDS];
+    bf_block_t * block = (bf_block_t *)bf_locate(filter, hash, mask);
+
+    for (unsigned w = 0; w < BF_BLOCK_WORDS; w++)
+    {
+        block->words[w] |= mask[w];
+    }
+}
+
+bool
+bf_may_contain(const bloom_t * filter, uint64_t hash)
+{
+    uint64_t           mask[BF_BLOCK_WORDS];
+    const bf_block_t * block   = bf_locate(filter, hash, mask);
+    uint64_t           missing = 0;
+
+    for (unsigned w = 0; w < BF_BLOCK_WORDS; w++)
+    {
+        missing |= mask[w] & ~block->words[w];
+    }
+    return missing == 0;
+}
+
+void
+bf_clear(bloom_t * filter)
+{
+    memset(filter->blocks, 0, filter->block_count * sizeof(bf_block_t));
+}
+
+size_t
+bf_size(const bloom_t * filter)
+{
+    return filter->block_count * sizeof(bf_block_t);
+}
+
+unsigned
+bf_hash_count(const bloom_t * filter)
+{
+    return filter->hash_count;
+}
+
+double
+bf_false_positive_rate(const bloom_t * filter, size_t count)
+{
+    return bf_rate((double)count / (double)filter->block_count,
+                   filter->hash_count);
+}
@@ -0,0 +1,839 @@
+/** @file concurrent_hashtable.c
+ *
+ * @brief A chained hashtable that many threads may read and write at once.
+ *
+ * Readers take no locks. A reader announces the global epoch it started in,
+ * and memory unlinked by a writer is only freed once the epoch has moved
+ * two steps past the one it was unlinked in, which cannot happen while any
+ * reader still announces an older epoch.
+ *
+ * Writers lock one of CHT_STRIPES mutexes, picked by the low bits of the
+ * bucket index. Bucket counts are multiples of CHT_STRIPES, so a bucket and
+ * the two buckets it splits into when the table doubles share a stripe.
+ * Published nodes are never changed apart from their next link; replacing
+ * a value swaps in a new node.
+ *
+ * Growing publishes a second bucket array, and every writer that notices it
+ * claims chunks of buckets to copy over. A copied bucket is marked with
+ * CHT_MOVED, which sends readers and writers on to the new array, and the
+ * new array replaces the old one once every chunk is done.
+ *
+ */
+
+#include "../include/concurrent_hashtable.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+
+#define CHT_STRIPES 64
+#define CHT_MIN_BUCKETS CHT_STRIPES
+#define CHT_MIGRATE_CHUNK 256
+#define CHT_RECLAIM_BATCH 64
+#define CHT_CACHE_LINE 64
+
+/* Header of memory unlinked from a table, waiting for its readers to go.
+ * key_free and value_free are applied to a node's key and value when it is
+ * freed, and are NULL for parts that live on in another node. */
+typedef struct cht_retired
+{
+    struct cht_retired * next;
+    ht_free_f            key_free;
+    ht_free_f            value_free;
+    uint32_t             epoch;
+    uint32_t             is_array;
+} cht_retired_t;
+
+typedef struct cht_node
+{
+    cht_retired_t              retired;
+    _Atomic(struct cht_node *) next;
+    uint64_t                   hash;
+    void *                     key;
+    void *                     value;
+} cht_node_t;
+
+typedef struct cht_array
+{
+    cht_retired_t               retired;
+    size_t                      bucket_count;
+    _Atomic(struct cht_array *) next;
+    atomic_size_t               claimed;
+    atomic_size_t               migrated;
+    _Atomic(cht_node_t *)       buckets[];
+} cht_array_t;
+
+typedef struct cht_stripe
+{
+    _Alignas(CHT_CACHE_LINE) pthread_mutex_t lock;
+    atomic_size_t count;
+} cht_stripe_t;
+
+struct chtable
+{
+    cht_stripe_t          stripes[CHT_STRIPES];
+    _Atomic(cht_array_t *) array;
+    pthread_mutex_t       resize_lock;
+    ht_hash_f             hash;
+    ht_eq_f               eq;
+    ht_free_f             key_free;
+    ht_free_f             value_free;
+};
+
+/* Per thread reclamation state. active is zero outside read sections, and
+ * the announced epoch shifted left by one with the low bit set inside. The
+ * limbo list is only touched by the owning thread. */
+typedef struct cht_thread
+{
+    _Alignas(CHT_CACHE_LINE) _Atomic uint64_t active;
+    atomic_bool     in_use;
+    cht_retired_t * limbo;
+    size_t          limbo_count;
+    size_t          limbo_limit;
+} cht_thread_t;
+
+static cht_thread_t    g_threads[CHT_MAX_THREADS];
+static atomic_size_t   g_thread_count;
+static _Atomic uint64_t g_epoch = 1;
+static pthread_key_t   g_thread_key;
+static pthread_once_t  g_thread_once = PTHREAD_ONCE_INIT;
+
+/* Limbo lists left behind by exited threads. */
+static pthread_mutex_t g_orphan_lock = PTHREAD_MUTEX_INITIALIZER;
+static cht_retired_t * g_orphans;
+
+static _Thread_local cht_thread_t * t_self;
+static _Thread_local unsigned       t_depth;
+
+static cht_node_t g_moved;
+#define CHT_MOVED (&g_moved)
+
+static void
+cht_reclaim_one(cht_retired_t * retired)
+{
+    if (retired->is_array)
+    {
+        free(retired);
+        return;
+    }
+
+    cht_node_t * node = (cht_node_t *)retired;
+    if (retired->key_free)
+    {
+        retired->key_free(node->key);
+    }
+    if (retired->value_free)
+    {
+        retired->value_free(node->value);
+    }
+    free(node);
+}
+
+/* Free the entries of list retired two or more epochs ago and return the
+ * rest. */
+static cht_retired_t *
+cht_reclaim_list(cht_retired_t * list, size_t * kept)
+{
+    uint32_t        epoch = (uint32_t)atomic_load(&g_epoch);
+    cht_retired_t * keep  = NULL;
+
+    *kept = 0;
+    while (list)
+    {
+        cht_retired_t * next = list->next;
+        if ((uint32_t)(epoch - list->epoch) >= 2)
+        {
+            cht_reclaim_one(list);
+        }
+        else
+        {
+            list->next = keep;
+            keep       = list;
+            (*kept)++;
+        }
+        list = next;
+    }
+    return keep;
+}
+
+/* Move the global epoch on if every thread inside a read section has seen
+ * the current one. */
+static void
+cht_try_advance(void)
+{
+    uint64_t epoch = atomic_load(&g_epoch);
+    size_t   count = atomic_load(&g_thread_count);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        uint64_t active = atomic_load(&g_threads[i].active);
+        if ((active & 1) && (active >> 1) != epoch)
+        {
+            return;
+        }
+    }
+    atomic_compare_exchange_strong(&g_epoch, &epoch, epoch + 1);
+}
+
+static void
+cht_collect(cht_thread_t * self)
+{
+    size_t kept = 0;
+
+    cht_try_advance();
+    self->limbo       = cht_reclaim_list(self->limbo, &self->limbo_count);
+    self->limbo_limit = CHT_RECLAIM_BATCH;
+    if (self->limbo_count * 2 > self->limbo_limit)
+    {
+        /* Readers are holding the epoch back; wait for more garbage before
+         * walking the list again. */
+        self->limbo_limit = self->limbo_count * 2;
+    }
+
+    pthread_mutex_lock(&g_orphan_lock);
+    g_orphans = cht_reclaim_list(g_orphans, &kept);
+    pthread_mutex_unlock(&g_orphan_lock);
+}
+
+/* pthread key destructor: hand what the thread could not free yet to the
+ * orphan list and give its slot back. */
+static void
+cht_thread_exit(void * data)
+{
+    cht_thread_t *  self  = data;
+    cht_retired_t * limbo = NULL;
+    size_t          kept  = 0;
+
+    cht_try_advance();
+    limbo = cht_reclaim_list(self->limbo, &kept);
+    if (limbo)
+    {
+        cht_retired_t * tail = limbo;
+        while (tail->next)
+        {
+            tail = tail->next;
+        }
+        pthread_mutex_lock(&g_orphan_lock);
+        tail->next = g_orphans;
+        g_orphans  = limbo;
+        pthread_mutex_unlock(&g_orphan_lock);
+    }
+
+    self->limbo       = NULL;
+    self->limbo_count = 0;
+    t_self            = NULL;
+    t_depth           = 0;
+    atomic_store(&self->active, 0);
+    atomic_store(&self->in_use, false);
+}
+
+static void
+cht_thread_key_init(void)
+{
+    /* Without the key, slots of exited threads are never reused. */
+    (void)pthread_key_create(&g_thread_key, cht_thread_exit);
+}
+
+static cht_thread_t *
+cht_register(void)
+{
+    pthread_once(&g_thread_once, cht_thread_key_init);
+
+    for (;;)
+    {
+        for (size_t i = 0; i < CHT_MAX_THREADS; i++)
+        {
+            cht_thread_t * self     = &g_threads[i];
+            bool           expected = false;
+            if (atomic_load_explicit(&self->in_use, memory_order_relaxed)
+                || !atomic_compare_exchange_strong(
+                    &self->in_use, &expected, true))
+            {
+                continue;
+            }
+
+            size_t count = atomic_load(&g_thread_count);
+            while (count <= i
+                   && !atomic_compare_exchange_weak(
+                       &g_thread_count, &count, i + 1))
+            {
+            }
+            self->limbo_limit = CHT_RECLAIM_BATCH;
+            pthread_setspecific(g_thread_key, self);
+            return self;
+        }
+        sched_yield();
+    }
+}
+
+void
+cht_read_lock(void)
+{
+    if (t_depth++ > 0)
+    {
+        return;
+    }
+    if (t_self == NULL)
+    {
+        t_self = cht_register();
+    }
+
+    uint64_t epoch = atomic_load_explicit(&g_epoch, memory_order_relaxed);
+    atomic_store_explicit(&t_self->active, (epoch << 1) | 1,
+                          memory_order_relaxed);
+    /* The announcement must be visible before the table is read. */
+    atomic_thread_fence(memory_order_seq_cst);
+}
+
+void
+cht_read_unlock(void)
+{
+    if (--t_depth > 0)
+    {
+        return;
+    }
+    atomic_store_explicit(&t_self->active, 0, memory_order_release);
+}
+
+/* Queue memory that has just been unlinked. The caller is inside a read
+ * section. */
+static void
+cht_retire(cht_retired_t * retired)
+{
+    cht_thread_t * self = t_self;
+
+    atomic_thread_fence(memory_order_seq_cst);
+    retired->epoch = (uint32_t)atomic_load(&g_epoch);
+    retired->next  = self->limbo;
+    self->limbo    = retired;
+    if (++self->limbo_count >= self->limbo_limit)
+    {
+        cht_collect(self);
+    }
+}
+
+static uint64_t
+cht_mix(uint64_t hash)
+{
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+static size_t
+cht_index(uint64_t hash, size_t bucket_count)
+{
+    return (size_t)hash & (bucket_count - 1);
+}
+
+static size_t
+cht_buckets_for(size_t capacity)
+{
+    size_t buckets = CHT_MIN_BUCKETS;
+    while ((double)buckets * HT_MAX_LOAD < (double)capacity)
+    {
+        buckets *= 2;
+    }
+    return buckets;
+}
+
+static cht_array_t *
+cht_array_alloc(size_t bucket_count)
+{
+    cht_array_t * array = calloc(
+        1, sizeof(cht_array_t) + bucket_count * sizeof(array->buckets[0]));
+    if (array)
+    {
+        array->retired.is_array = 1;
+        array->bucket_count     = bucket_count;
+    }
+    return array;
+}
+
+chtable_t *
+cht_create(ht_hash_f hash,
+           ht_eq_f   eq,
+           ht_free_f key_free,
+           ht_free_f value_free,
+           size_t    capacity)
+{
+    chtable_t * table = NULL;
+
+    if (!hash || !eq)
+    {
+        return NULL;
+    }
+
+    if ((table = aligned_alloc(CHT_CACHE_LINE, sizeof(chtable_t))) == NULL)
+    {
+        return NULL;
+    }
+
+    cht_array_t * array = cht_array_alloc(cht_buckets_for(capacity));
+    if (array == NULL)
+    {
+        free(table);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < CHT_STRIPES; i++)
+    {
+        pthread_mutex_init(&table->stripes[i].lock, NULL);
+        atomic_init(&table->stripes[i].count, 0);
+    }
+    atomic_init(&table->array, array);
+    pthread_mutex_init(&table->resize_lock, NULL);
+    table->hash       = hash;
+    table->eq         = eq;
+    table->key_free   = key_free;
+    table->value_free = value_free;
+
+    return table;
+}
+
+static void
+cht_free_chain(chtable_t * table, cht_node_t * node)
+{
+    while (node)
+    {
+        cht_node_t * next = atomic_load(&node->next);
+        if (table->key_free)
+        {
+            table->key_free(node->key);
+        }
+        if (table->value_free)
+        {
+            table->value_free(node->value);
+        }
+        free(node);
+        node = next;
+    }
+}
+
+void
+cht_destroy(chtable_t ** table)
+{
+    if (!table || !*table)
+    {
+        return;
+    }
+
+    chtable_t *   concurrent = *table;
+    cht_array_t * array      = atomic_load(&concurrent->array);
+    while (array)
+    {
+        /* Buckets not yet moved by an unfinished resize are still here; the
+         * moved ones are walked in the next array. */
+        for (size_t i = 0; i < array->bucket_count; i++)
+        {
+            cht_node_t * head = atomic_load(&array->buckets[i]);
+            if (head != CHT_MOVED)
+            {
+                cht_free_chain(concurrent, head);
+            }
+        }
+        cht_array_t * next = atomic_load(&array->next);
+        free(array);
+        array = next;
+    }
+
+    for (size_t i = 0; i < CHT_STRIPES; i++)
+    {
+        pthread_mutex_destroy(&concurrent->stripes[i].lock);
+    }
+    pthread_mutex_destroy(&concurrent->resize_lock);
+    free(concurrent);
+    *table = NULL;
+}
+
+/* Copy bucket index of old into next and mark it moved. The tail of the
+ * chain whose nodes all land in the same new bucket is shared rather than
+ * copied; the nodes before it are copied, since readers may be walking the
+ * old chain. */
+static void
+cht_migrate_bucket(chtable_t *   table,
+                   cht_array_t * old,
+                   cht_array_t * next,
+                   size_t        index)
+{
+    cht_stripe_t * stripe = &table->stripes[index & (CHT_STRIPES - 1)];
+
+    for (;;)
+    {
+        pthread_mutex_lock(&stripe->lock);
+
+        cht_node_t * head
+            = atomic_load_explicit(&old->buckets[index], memory_order_relaxed);
+        cht_node_t * last_run = head;
+        size_t       last_bin = 0;
+        cht_node_t * node     = head;
+        while (node)
+        {
+            size_t bin = cht_index(node->hash, next->bucket_count);
+            if (node == head || bin != last_bin)
+            {
+                last_bin = bin;
+                last_run = node;
+            }
+            node = atomic_load_explicit(&node->next, memory_order_relaxed);
+        }
+
+        /* lists[0] goes to bucket index, lists[1] to index + old size. */
+        cht_node_t * lists[2] = { NULL, NULL };
+        if (last_run)
+        {
+            lists[last_bin != index] = last_run;
+        }
+
+        node = head;
+        while (node != last_run)
+        {
+            cht_node_t * copy = malloc(sizeof(cht_node_t));
+            if (copy == NULL)
+            {
+                break;
+            }
+            size_t side = cht_index(node->hash, next->bucket_count) != index;
+            copy->retired.is_array = 0;
+            copy->hash             = node->hash;
+            copy->key              = node->key;
+            copy->value            = node->value;
+            atomic_init(&copy->next, lists[side]);
+            lists[side] = copy;
+            node = atomic_load_explicit(&node->next, memory_order_relaxed);
+        }
+
+        if (node != last_run)
+        {
+            /* Out of memory: drop the copies and try again later, leaving
+             * the bucket to be served from the old array meanwhile. */
+            for (size_t side = 0; side < 2; side++)
+            {
+                cht_node_t * copy = lists[side];
+                while (copy && copy != last_run)
+                {
+                    cht_node_t * after = atomic_load(&copy->next);
+                    free(copy);
+                    copy = after;
+                }
+            }
+            pthread_mutex_unlock(&stripe->lock);
+            sched_yield();
+            continue;
+        }
+
+        atomic_store_explicit(
+            &next->buckets[index], lists[0], memory_order_release);
+        atomic_store_explicit(&next->buckets[index + old->bucket_count],
+                              lists[1],
+                              memory_order_release);
+        atomic_store_explicit(
+            &old->buckets[index], CHT_MOVED, memory_order_release);
+        pthread_mutex_unlock(&stripe->lock);
+
+        /* The copied originals keep their keys and values alive in the
+         * copies; only the nodes themselves go. */
+        for (node = head; node != last_run;)
+        {
+            cht_node_t * after
+                = atomic_load_explicit(&node->next, memory_order_relaxed);
+            node->retired.key_free   = NULL;
+            node->retired.value_free = NULL;
+            cht_retire(&node->retired);
+            node = after;
+        }
+        return;
+    }
+}
+
+/* Claim and move chunks of old until none are left. Whoever moves the last
+ * bucket makes next the table's array. */
+static void
+cht_help_resize(chtable_t * table, cht_array_t * old, cht_array_t * next)
+{
+    size_t start = 0;
+
+    while ((start = atomic_fetch_add(&old->claimed, CHT_MIGRATE_CHUNK))
+           < old->bucket_count)
+    {
+        size_t end = start + CHT_MIGRATE_CHUNK;
+        if (end > old->bucket_count)
+        {
+            end = old->bucket_count;
+        }
+        for (size_t i = start; i < end; i++)
+        {
+            cht_migrate_bucket(table, old, next, i);
+        }
+
+        if (atomic_fetch_add(&old->migrated, end - start) + (end - start)
+            == old->bucket_count)
+        {
+            atomic_store_explicit(&table->array, next, memory_order_release);
+            cht_retire(&old->retired);
+        }
+    }
+}
+
+/* Publish a twice as large array behind array, unless another thread has
+ * already, and help move buckets into it. Failure to allocate is not an
+ * error; the table only gets slower. */
+static void
+cht_start_resize(chtable_t * table, cht_array_t * array)
+{
+    pthread_mutex_lock(&table->resize_lock);
+    if (atomic_load(&table->array) == array
+        && atomic_load(&array->next) == NULL)
+    {
+        cht_array_t * next = cht_array_alloc(array->bucket_count * 2);
+        if (next)
+        {
+            atomic_store_explicit(&array->next, next, memory_order_release);
+        }
+    }
+    pthread_mutex_unlock(&table->resize_lock);
+
+    cht_array_t * next = atomic_load_explicit(&array->next,
+                                              memory_order_acquire);
+    if (next)
+    {
+        cht_help_resize(table, array, next);
+    }
+}
+
+/* Lock the stripe of the bucket hash belongs to, in the newest array that
+ * still holds that bucket, helping any resize along first. */
+static cht_array_t *
+cht_lock_bucket(chtable_t * table, uint64_t hash, cht_stripe_t ** stripe)
+{
+    cht_array_t * array
+        = atomic_load_explicit(&table->array, memory_order_acquire);
+
+    for (;;)
+    {
+        cht_array_t * next
+            = atomic_load_explicit(&array->next, memory_order_acquire);
+        if (next)
+        {
+            cht_help_resize(table, array, next);
+        }
+
+        size_t index = cht_index(hash, array->bucket_count);
+        *stripe      = &table->stripes[index & (CHT_STRIPES - 1)];
+        pthread_mutex_lock(&(*stripe)->lock);
+        if (atomic_load_explicit(&array->buckets[index], memory_order_relaxed)
+            != CHT_MOVED)
+        {
+            return array;
+        }
+        pthread_mutex_unlock(&(*stripe)->lock);
+        array = atomic_load_explicit(&array->next, memory_order_acquire);
+    }
+}
+
+/* Link pointing at the node holding key, or at the NULL ending its chain.
+ * The caller holds the bucket's stripe. */
+static _Atomic(cht_node_t *) *
+cht_find_locked(const chtable_t * table,
+                cht_array_t *     array,
+                const void *      key,
+                uint64_t          hash)
+{
+    _Atomic(cht_node_t *) * link
+        = &array->buckets[cht_index(hash, array->bucket_count)];
+    cht_node_t * node = NULL;
+
+    while ((node = atomic_load_explicit(link, memory_order_relaxed))
+           && (node->hash != hash || !table->eq(key, node->key)))
+    {
+        link = &node->next;
+    }
+    return link;
+}
+
+int
+cht_set(chtable_t * table, void * key, void * value)
+{
+    uint64_t     hash = cht_mix(table->hash(key));
+    cht_node_t * node = malloc(sizeof(cht_node_t));
+    if (node == NULL)
+    {
+        return -1;
+    }
+    node->retired.is_array = 0;
+    node->hash             = hash;
+    node->key              = key;
+    node->value            = value;
+
+    cht_read_lock();
+    cht_stripe_t *          stripe = NULL;
+    cht_array_t *           array  = cht_lock_bucket(table, hash, &stripe);
+    _Atomic(cht_node_t *) * link   = cht_find_locked(table, array, key, hash);
+    cht_node_t * old = atomic_load_explicit(link, memory_order_relaxed);
+
+    if (old)
+    {
+        /* There's already a pair. The new node keeps its key and takes
+         * over the rest of the chain. */
+        node->key = old->key;
+        atomic_init(&node->next,
+                    atomic_load_explicit(&old->next, memory_order_relaxed));
+        atomic_store_explicit(link, node, memory_order_release);
+        pthread_mutex_unlock(&stripe->lock);
+
+        if (table->key_free)
+        {
+            table->key_free(key);
+        }
+        old->retired.key_free   = NULL;
+        old->retired.value_free = table->value_free;
+        cht_retire(&old->retired);
+        cht_read_unlock();
+        return 0;
+    }
+
+    atomic_init(&node->next, NULL);
+    atomic_store_explicit(link, node, memory_order_release);
+    size_t count = atomic_fetch_add_explicit(
+                       &stripe->count, 1, memory_order_relaxed)
+                   + 1;
+    pthread_mutex_unlock(&stripe->lock);
+
+    /* Stripes cover equal shares of the buckets, so one stripe passing its
+     * share of the maximum load stands for the whole table. */
+    if ((double)count * CHT_STRIPES
+        > (double)array->bucket_count * HT_MAX_LOAD)
+    {
+        cht_start_resize(table, array);
+    }
+    cht_read_unlock();
+    return 0;
+}
+
+/* Node holding key. The caller is inside a read section. */
+static cht_node_t *
+cht_lookup(const chtable_t * table, const void * key, uint64_t hash)
+{
+    cht_array_t * array
+        = atomic_load_explicit(&table->array, memory_order_acquire);
+
+    for (;;)
+    {
+        cht_node_t * node = atomic_load_explicit(
+            &array->buckets[cht_index(hash, array->bucket_count)],
+            memory_order_acquire);
+        if (node != CHT_MOVED)
+        {
+            while (node && (node->hash != hash || !table->eq(key, node->key)))
+            {
+                node = atomic_load_explicit(&node->next, memory_order_acquire);
+            }
+            return node;
+        }
+        array = atomic_load_explicit(&array->next, memory_order_acquire);
+    }
+}
+
+void *
+cht_get(const chtable_t * table, const void * key)
+{
+    uint64_t hash = cht_mix(table->hash(key));
+
+    cht_read_lock();
+    cht_node_t * node  = cht_lookup(table, key, hash);
+    void *       value = node ? node->value : NULL;
+    cht_read_unlock();
+    return value;
+}
+
+bool
+cht_contains(const chtable_t * table, const void * key)
+{
+    uint64_t hash = cht_mix(table->hash(key));
+
+    cht_read_lock();
+    bool found = cht_lookup(table, key, hash) != NULL;
+    cht_read_unlock();
+    return found;
+}
+
+int
+cht_delete(chtable_t * table, const void * key)
+{
+    uint64_t hash = cht_mix(table->hash(key));
+
+    cht_read_lock();
+    cht_stripe_t *          stripe = NULL;
+    cht_array_t *           array  = cht_lock_bucket(table, hash, &stripe);
+    _Atomic(cht_node_t *) * link   = cht_find_locked(table, array, key, hash);
+    cht_node_t * node = atomic_load_explicit(link, memory_order_relaxed);
+    if (node == NULL)
+    {
+        pthread_mutex_unlock(&stripe->lock);
+        cht_read_unlock();
+        return -1;
+    }
+
+    atomic_store_explicit(
+        link,
+        atomic_load_explicit(&node->next, memory_order_relaxed),
+        memory_order_release);
+    atomic_fetch_sub_explicit(&stripe->count, 1, memory_order_relaxed);
+    pthread_mutex_unlock(&stripe->lock);
+
+    node->retired.key_free   = table->key_free;
+    node->retired.value_free = table->value_free;
+    cht_retire(&node->retired);
+    cht_read_unlock();
+    return 0;
+}
+
+size_t
+cht_size(const chtable_t * table)
+{
+    size_t size = 0;
+    for (size_t i = 0; i < CHT_STRIPES; i++)
+    {
+        size += atomic_load_explicit(&table->stripes[i].count,
+                                     memory_order_relaxed);
+    }
+    return size;
+}
+
+static void
+cht_visit(cht_array_t * array,
+          size_t        index,
+          ht_action_f   action,
+          void *        action_ctx)
+{
+    cht_node_t * node
+        = atomic_load_explicit(&array->buckets[index], memory_order_acquire);
+    if (node == CHT_MOVED)
+    {
+        cht_array_t * next
+            = atomic_load_explicit(&array->next, memory_order_acquire);
+        cht_visit(next, index, action, action_ctx);
+        cht_visit(next, index + array->bucket_count, action, action_ctx);
+        return;
+    }
+
+    for (; node;
+         node = atomic_load_explicit(&node->next, memory_order_acquire))
+    {
+        action(node->key, node->value, action_ctx);
+    }
+}
+
+void
+cht_for_each(chtable_t * table, ht_action_f action, void * action_ctx)
+{
+    cht_read_lock();
+    cht_array_t * array
+        = atomic_load_explicit(&table->array, memory_order_acquire);
+    for (size_t i = 0; i < array->bucket_count; i++)
+    {
+        cht_visit(array, i, action, action_ctx);
+    }
+    cht_read_unlock();
+}
@@ -0,0 +1,391 @@
+/** @file flat_hashtable.c
+ *
+ * @brief An open addressing hashtable probed sixteen slots at a time.
+ *
+ * The slots are split into groups of sixteen whose control bytes fill one
+ * aligned 16 byte word. A key's hash picks the group its probe starts at
+ * (the high bits, h1) and the seven bit fingerprint stored in the control
+ * byte (the low bits, h2). Probing visits whole groups in triangular order,
+ * which reaches every group of a power of two sized table, and stops at the
+ * first group holding an empty slot.
+ *
+ */
+
+#include "../include/flat_hashtable.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define FHT_GROUP_WIDTH 16
+#define FHT_MIN_CAPACITY 16
+
+/* Control bytes. Full slots hold h2, from 0 to 127, so the sign bit alone
+ * tells a free slot from a full one. */
+#define FHT_EMPTY ((int8_t)-128)
+#define FHT_DELETED ((int8_t)-2)
+
+/* One bit per slot of a group, lowest bit first. */
+typedef uint32_t fht_mask_t;
+
+/* Key and value side by side, so a hit costs one cache miss beyond the
+ * control bytes. */
+typedef struct fht_slot
+{
+    void * key;
+    void * value;
+} fht_slot_t;
+
+struct fhtable
+{
+    int8_t *     ctrl;
+    fht_slot_t * slots;
+    size_t       capacity;
+    size_t       size;
+    size_t       growth_left;
+    ht_hash_f    hash;
+    ht_eq_f      eq;
+    ht_free_f    key_free;
+    ht_free_f    value_free;
+};
+
+/* Slots that may be used before the table is rehashed: seven eighths. */
+static size_t
+fht_max_load(size_t capacity)
+{
+    return capacity - capacity / 8;
+}
+
+static size_t
+fht_capacity_for(size_t entries)
+{
+    size_t capacity = FHT_MIN_CAPACITY;
+    while (fht_max_load(capacity) < entries)
+    {
+        capacity *= 2;
+    }
+    return capacity;
+}
+
+/* Finalize the user hash so both h1 and h2 get well mixed bits. */
+static uint64_t
+fht_mix(uint64_t hash)
+{
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+static int8_t
+fht_h2(uint64_t hash)
+{
+    return (int8_t)(hash & 0x7F);
+}
+
+static fht_mask_t
+fht_match(const int8_t * group, int8_t h2)
+{
+#if defined(__SSE2__)
+    __m128i ctrl = _mm_load_si128((const __m128i *)group);
+    return (fht_mask_t)_mm_movemask_epi8(
+        _mm_cmpeq_epi8(ctrl, _mm_set1_epi8(h2)));
+#else
+    fht_mask_t mask = 0;
+    for (int i = 0; i < FHT_GROUP_WIDTH; i++)
+    {
+        mask |= (fht_mask_t)(group[i] == h2) << i;
+    }
+    return mask;
+#endif
+}
+
+static fht_mask_t
+fht_match_empty(const int8_t * group)
+{
+    return fht_match(group, FHT_EMPTY);
+}
+
+/* Empty or deleted slots. */
+static fht_mask_t
+fht_match_free(const int8_t * group)
+{
+#if defined(__SSE2__)
+    return (fht_mask_t)_mm_movemask_epi8(
+        _mm_load_si128((const __m128i *)group));
+#else
+    fht_mask_t mask = 0;
+    for (int i = 0; i < FHT_GROUP_WIDTH; i++)
+    {
+        mask |= (fht_mask_t)(group[i] < 0) << i;
+    }
+    return mask;
+#endif
+}
+
+/* Allocate empty slot arrays of the given capacity. */
+static int
+fht_alloc_slots(fhtable_t * table, size_t capacity)
+{
+    int8_t *     ctrl  = aligned_alloc(FHT_GROUP_WIDTH, capacity);
+    fht_slot_t * slots = malloc(capacity * sizeof(fht_slot_t));
+    if (ctrl == NULL || slots == NULL)
+    {
+        free(ctrl);
+        free(slots);
+        return -1;
+    }
+
+    memset(ctrl, FHT_EMPTY, capacity);
+    table->ctrl        = ctrl;
+    table->slots       = slots;
+    table->capacity    = capacity;
+    table->growth_left = fht_max_load(capacity);
+    return 0;
+}
+
+fhtable_t *
+fht_create(ht_hash_f hash,
+           ht_eq_f   eq,
+           ht_free_f key_free,
+           ht_free_f value_free,
+           size_t    capacity)
+{
+    fhtable_t * table = NULL;
+
+    if (!hash || !eq)
+    {
+        return NULL;
+    }
+
+    if ((table = malloc(sizeof(fhtable_t))) == NULL)
+    {
+        return NULL;
+    }
+
+    if (fht_alloc_slots(table, fht_capacity_for(capacity)))
+    {
+        free(table);
+        return NULL;
+    }
+
+    table->size       = 0;
+    table->hash       = hash;
+    table->eq         = eq;
+    table->key_free   = key_free;
+    table->value_free = value_free;
+
+    return table;
+}
+
+static void
+fht_release(fhtable_t * table, void * key, void * value)
+{
+    if (table->key_free)
+    {
+        table->key_free(key);
+    }
+    if (table->value_free)
+    {
+        table->value_free(value);
+    }
+}
+
+void
+fht_destroy(fhtable_t ** table)
+{
+    if (!table || !*table)
+    {
+        return;
+    }
+
+    fhtable_t * flat = *table;
+    for (size_t i = 0; i < flat->capacity; i++)
+    {
+        if (flat->ctrl[i] >= 0)
+        {
+            fht_release(flat, flat->slots[i].key, flat->slots[i].value);
+        }
+    }
+
+    free(flat->ctrl);
+    free(flat->slots);
+    free(flat);
+    *table = NULL;
+}
+
+/* Slot holding key, or capacity if the key is not present. */
+static size_t
+fht_find(const fhtable_t * table, const void * key, uint64_t hash)
+{
+    size_t group_mask = table->capacity / FHT_GROUP_WIDTH - 1;
+    size_t group      = (size_t)(hash >> 7) & group_mask;
+    int8_t h2         = fht_h2(hash);
+
+    for (size_t step = 1;; step++)
+    {
+        const int8_t * ctrl = table->ctrl + group * FHT_GROUP_WIDTH;
+        fht_mask_t     mask = fht_match(ctrl, h2);
+        while (mask)
+        {
+            size_t slot
+                = group * FHT_GROUP_WIDTH + (size_t)__builtin_ctz(mask);
+            if (table->eq(key, table->slots[slot].key))
+            {
+                return slot;
+            }
+            mask &= mask - 1;
+        }
+        if (fht_match_empty(ctrl))
+        {
+            return table->capacity;
+        }
+        group = (group + step) & group_mask;
+    }
+}
+
+/* First empty or deleted slot on the probe sequence of hash. */
+static size_t
+fht_find_free(const fhtable_t * table, uint64_t hash)
+{
+    size_t group_mask = table->capacity / FHT_GROUP_WIDTH - 1;
+    size_t group      = (size_t)(hash >> 7) & group_mask;
+
+    for (size_t step = 1;; step++)
+    {
+        fht_mask_t mask
+            = fht_match_free(table->ctrl + group * FHT_GROUP_WIDTH);
+        if (mask)
+        {
+            return group * FHT_GROUP_WIDTH + (size_t)__builtin_ctz(mask);
+        }
+        group = (group + step) & group_mask;
+    }
+}
+
+/* Rebuild the table without tombstones, doubling it unless tombstones are
+ * what used up the free slots. */
+static int
+fht_rehash(fhtable_t * table)
+{
+    fhtable_t old      = *table;
+    size_t    capacity = old.capacity;
+    if (old.size >= fht_max_load(capacity) / 2)
+    {
+        capacity *= 2;
+    }
+
+    if (fht_alloc_slots(table, capacity))
+    {
+        *table = old;
+        return -1;
+    }
+
+    for (size_t i = 0; i < old.capacity; i++)
+    {
+        if (old.ctrl[i] >= 0)
+        {
+            uint64_t hash = fht_mix(table->hash(old.slots[i].key));
+            size_t   slot = fht_find_free(table, hash);
+            table->ctrl[slot]  = fht_h2(hash);
+            table->slots[slot] = old.slots[i];
+        }
+    }
+    table->growth_left -= old.size;
+
+    free(old.ctrl);
+    free(old.slots);
+    return 0;
+}
+
+int
+fht_set(fhtable_t * table, void * key, void * value)
+{
+    uint64_t hash = fht_mix(table->hash(key));
+    size_t   slot = fht_find(table, key, hash);
+
+    if (slot != table->capacity)
+    {
+        fht_release(table, key, table->slots[slot].value);
+        table->slots[slot].value = value;
+        return 0;
+    }
+
+    if (table->growth_left == 0 && fht_rehash(table))
+    {
+        return -1;
+    }
+
+    slot = fht_find_free(table, hash);
+    if (table->ctrl[slot] == FHT_EMPTY)
+    {
+        table->growth_left--;
+    }
+    table->ctrl[slot]        = fht_h2(hash);
+    table->slots[slot].key   = key;
+    table->slots[slot].value = value;
+    table->size++;
+    return 0;
+}
+
+void *
+fht_get(const fhtable_t * table, const void * key)
+{
+    size_t slot = fht_find(table, key, fht_mix(table->hash(key)));
+    return (slot != table->capacity) ? table->slots[slot].value : NULL;
+}
+
+bool
+fht_contains(const fhtable_t * table, const void * key)
+{
+    return fht_find(table, key, fht_mix(table->hash(key))) != table->capacity;
+}
+
+int
+fht_delete(fhtable_t * table, const void * key)
+{
+    size_t slot = fht_find(table, key, fht_mix(table->hash(key)));
+    if (slot == table->capacity)
+    {
+        return -1;
+    }
+
+    /* A group that still has an empty slot has never been probed past, so
+     * the slot can become empty again. Otherwise probes for other keys may
+     * run through it and it has to stay a tombstone. */
+    const int8_t * group
+        = table->ctrl + (slot & ~(size_t)(FHT_GROUP_WIDTH - 1));
+    if (fht_match_empty(group))
+    {
+        table->ctrl[slot] = FHT_EMPTY;
+        table->growth_left++;
+    }
+    else
+    {
+        table->ctrl[slot] = FHT_DELETED;
+    }
+
+    fht_release(table, table->slots[slot].key, table->slots[slot].value);
+    table->size--;
+    return 0;
+}
+
+size_t
+fht_size(const fhtable_t * table)
+{
+    return table->size;
+}
+
+void
+fht_for_each(fhtable_t * table, ht_action_f action, void * action_ctx)
+{
+    for (size_t i = 0; i < table->capacity; i++)
+    {
+        if (table->ctrl[i] >= 0)
+        {
+            action(table->slots[i].key, table->slots[i].value, action_ctx);
+        }
+    }
+}
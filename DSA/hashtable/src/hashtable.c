@@ -2,171 +2,666 @@
  *
  * @brief A basic data agnostic hashtable library.
  *
+ * Entries are kept in per-bucket chains. The bucket count is always a power
+ * of two, and doubles whenever the number of entries passes HT_MAX_LOAD
+ * times the bucket count.
+ *
+ * Doubling is incremental. The old bucket array is kept beside the new one
+ * and every insert or delete moves at most HT_REHASH_STEP of its buckets,
+ * lowest first. An entry is in the old array if its old bucket has not been
+ * moved yet, and in the new array otherwise, so lookups still probe a
+ * single chain. Moving HT_REHASH_STEP buckets per insert empties the old
+ * array long before the next doubling is due.
+ *
+ * Arena tables allocate their buckets and copies of keys and values from a
+ * ht_arena_t. Memory freed there is reclaimed by copying the live pairs
+ * into a fresh arena, which is incremental too: once over half of the
+ * arena is freed memory, every insert or delete copies the chains of at
+ * most HT_COMPACT_STEP buckets, lowest first, and the old arena is freed
+ * after the last one. A pair lives in the fresh arena if its bucket has
+ * been copied and in the old one otherwise. Doubling waits for a
+ * compaction to finish, and a compaction for a doubling, so that a bucket
+ * index always tells which arena holds a pair.
+ *
  */
 
-#include <stdio.h>
+#include "../include/hashtable.h"
+#include "ht_arena.h"
 #include <stdlib.h>
 #include <string.h>
-#include <limits.h>
 
-#define TABLE_SIZE 10
+#define HT_MIN_BUCKETS 16
+#define HT_REHASH_STEP 16
+#define HT_COMPACT_STEP 16
 
 typedef struct ht_bucket
 {
-    char *           key;
-    char *           value;
+    void *             key;
+    void *             value;
+    uint64_t           hash; /* Cached so growing never rehashes keys. */
     struct ht_bucket * next;
 } ht_bucket_t;
 
-typedef struct
+struct htable
 {
     ht_bucket_t ** entries;
-} htable_t;
+    size_t         bucket_count;
+    ht_bucket_t ** old_entries; /* NULL unless a doubling is under way. */
+    size_t         old_bucket_count;
+    size_t         rehash_index; /* Old buckets below it have been moved. */
+    size_t         size;
+    ht_arena_t *   arena;     /* NULL unless made by ht_create_arena(). */
+    ht_arena_t *   old_arena; /* NULL unless a compaction is under way. */
+    size_t         compact_index; /* Buckets below it are in arena. */
+    ht_hash_f      hash;
+    ht_eq_f        eq;
+    ht_free_f      key_free;
+    ht_free_f      value_free;
+};
+
+/* Smallest power of two bucket count that holds capacity entries without
+ * passing the maximum load. */
+static size_t
+ht_buckets_for(size_t capacity)
+{
+    size_t buckets = HT_MIN_BUCKETS;
+    while ((double)buckets * HT_MAX_LOAD < (double)capacity)
+    {
+        buckets *= 2;
+    }
+    return buckets;
+}
+
+/* Spread the hash before masking, so that user hashes with poor low bits
+ * still use every bucket. */
+static size_t
+ht_index(uint64_t hash, size_t bucket_count)
+{
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDULL;
+    hash ^= hash >> 33;
+    return (size_t)hash & (bucket_count - 1);
+}
 
-/* Create a new hash table. */
 htable_t *
-ht_create()
+ht_create(ht_hash_f hash,
+          ht_eq_f   eq,
+          ht_free_f key_free,
+          ht_free_f value_free,
+          size_t    capacity)
 {
     htable_t * hashtable = NULL;
-    int    i;
+
+    if (!hash || !eq)
+    {
+        return NULL;
+    }
 
     if ((hashtable = malloc(sizeof(htable_t))) == NULL)
     {
         return NULL;
     }
 
-    if ((hashtable->entries = malloc(sizeof(ht_bucket_t *) * TABLE_SIZE)) == NULL)
+    hashtable->bucket_count = ht_buckets_for(capacity);
+    hashtable->entries
+        = calloc(hashtable->bucket_count, sizeof(ht_bucket_t *));
+    if (hashtable->entries == NULL)
     {
+        free(hashtable);
         return NULL;
     }
 
-    for (i = 0; i < TABLE_SIZE; i++)
+    hashtable->old_entries      = NULL;
+    hashtable->old_bucket_count = 0;
+    hashtable->rehash_index     = 0;
+    hashtable->size             = 0;
+    hashtable->arena            = NULL;
+    hashtable->old_arena        = NULL;
+    hashtable->compact_index    = 0;
+    hashtable->hash             = hash;
+    hashtable->eq               = eq;
+    hashtable->key_free         = key_free;
+    hashtable->value_free       = value_free;
+
+    return hashtable;
+}
+
+htable_t *
+ht_create_arena(ht_hash_f hash, ht_eq_f eq, size_t capacity, unsigned flags)
+{
+    htable_t * hashtable = ht_create(hash, eq, NULL, NULL, capacity);
+    if (hashtable == NULL)
     {
-        hashtable->entries[i] = NULL;
+        return NULL;
     }
 
+    hashtable->arena = ht_arena_create(flags & HT_ARENA_INTERN);
+    if (hashtable->arena == NULL)
+    {
+        ht_destroy(&hashtable);
+    }
     return hashtable;
 }
 
-/* Hash a string for a particular hash table. */
-int
-ht_hash(htable_t * hashtable, char * key)
+/* The arena holding the pairs of the bucket hash falls in, NULL for
+ * tables without one. */
+static ht_arena_t *
+ht_arena_for(const htable_t * hashtable, uint64_t hash)
 {
-    unsigned long int hashval = 0;
-    int               i       = 0;
+    if (hashtable->old_arena
+        && ht_index(hash, hashtable->bucket_count) >= hashtable->compact_index)
+    {
+        return hashtable->old_arena;
+    }
+    return hashtable->arena;
+}
 
-    /* Convert our string to an integer */
-    while (hashval < ULONG_MAX && i < strlen(key))
+static void
+ht_release(htable_t * hashtable, ht_arena_t * arena, void * key, void * value)
+{
+    if (arena)
+    {
+        ht_arena_release(arena, key);
+        ht_arena_release(arena, value);
+        return;
+    }
+    if (hashtable->key_free)
     {
-        hashval = hashval << 8;
-        hashval += key[i];
-        i++;
+        hashtable->key_free(key);
     }
+    if (hashtable->value_free)
+    {
+        hashtable->value_free(value);
+    }
+}
 
-    return hashval % TABLE_SIZE;
+static void
+ht_free_pair(ht_arena_t * arena, ht_bucket_t * pair)
+{
+    if (arena)
+    {
+        ht_arena_free(arena, pair, sizeof(ht_bucket_t));
+    }
+    else
+    {
+        free(pair);
+    }
 }
 
-/* Create a key-value pair. */
-ht_bucket_t *
-ht_newpair(char * key, char * value)
+/* The pairs of an arena table go with its arena. */
+static void
+ht_free_buckets(htable_t * hashtable, ht_bucket_t ** entries, size_t count)
 {
-    ht_bucket_t * newpair;
+    for (size_t i = 0; i < count && !hashtable->arena; i++)
+    {
+        ht_bucket_t * pair = entries[i];
+        while (pair)
+        {
+            ht_bucket_t * next = pair->next;
+            ht_release(hashtable, NULL, pair->key, pair->value);
+            free(pair);
+            pair = next;
+        }
+    }
+    free(entries);
+}
 
-    if ((newpair = malloc(sizeof(ht_bucket_t))) == NULL)
+void
+ht_destroy(htable_t ** table)
+{
+    if (!table || !*table)
     {
-        return NULL;
+        return;
     }
 
-    if ((newpair->key = strdup(key)) == NULL)
+    htable_t * hashtable = *table;
+    ht_free_buckets(hashtable, hashtable->entries, hashtable->bucket_count);
+    if (hashtable->old_entries)
     {
-        return NULL;
+        ht_free_buckets(
+            hashtable, hashtable->old_entries, hashtable->old_bucket_count);
     }
+    ht_arena_destroy(hashtable->arena);
+    ht_arena_destroy(hashtable->old_arena);
+    free(hashtable);
+    *table = NULL;
+}
 
-    if ((newpair->value = strdup(value)) == NULL)
+/* Start doubling the bucket count. The pairs stay where they are until
+ * ht_rehash_step() moves them. Failure to grow is not an error; the table
+ * only gets slower. */
+static void
+ht_grow(htable_t * hashtable)
+{
+    size_t         bucket_count = hashtable->bucket_count * 2;
+    ht_bucket_t ** entries      = calloc(bucket_count, sizeof(ht_bucket_t *));
+    if (entries == NULL)
     {
-        return NULL;
+        return;
     }
 
-    newpair->next = NULL;
+    hashtable->old_entries      = hashtable->entries;
+    hashtable->old_bucket_count = hashtable->bucket_count;
+    hashtable->rehash_index     = 0;
+    hashtable->entries          = entries;
+    hashtable->bucket_count     = bucket_count;
+}
+
+/* Move up to HT_REHASH_STEP old buckets into the new array, freeing the old
+ * array once the last one has moved. */
+static void
+ht_rehash_step(htable_t * hashtable)
+{
+    for (size_t step = 0; step < HT_REHASH_STEP && hashtable->old_entries;
+         step++)
+    {
+        ht_bucket_t ** entries = hashtable->entries;
+        ht_bucket_t ** old
+            = hashtable->old_entries + hashtable->rehash_index;
+        ht_bucket_t * pair = *old;
+        while (pair)
+        {
+            ht_bucket_t * next = pair->next;
+            size_t        bin  = ht_index(pair->hash, hashtable->bucket_count);
+            pair->next         = entries[bin];
+            entries[bin]       = pair;
+            pair               = next;
+        }
+        *old = NULL;
 
-    return newpair;
+        if (++hashtable->rehash_index == hashtable->old_bucket_count)
+        {
+            free(hashtable->old_entries);
+            hashtable->old_entries      = NULL;
+            hashtable->old_bucket_count = 0;
+        }
+    }
 }
 
-/* Insert a key-value pair into a hash table. */
-void
-ht_set(htable_t * hashtable, char * key, char * value)
+/* Copy the chain at link from the old arena into the fresh one. If memory
+ * runs out, the copies made so far are dropped and the chain is left where
+ * it was. */
+static int
+ht_copy_chain(htable_t * hashtable, ht_bucket_t ** link)
 {
-    int       bin     = 0;
-    ht_bucket_t * newpair = NULL;
-    ht_bucket_t * next    = NULL;
-    ht_bucket_t * last    = NULL;
+    ht_arena_t *  arena  = hashtable->arena;
+    ht_bucket_t * copies = NULL;
+    int           failed = 0;
+    for (ht_bucket_t * pair = *link; pair && !failed; pair = pair->next)
+    {
+        ht_bucket_t * copy = ht_arena_alloc(arena, sizeof(ht_bucket_t));
+        if (copy == NULL)
+        {
+            failed = -1;
+            break;
+        }
+        copy->key   = ht_arena_copy(arena, pair->key);
+        copy->value = copy->key ? ht_arena_copy(arena, pair->value) : NULL;
+        copy->hash  = pair->hash;
+        copy->next  = copies;
+        copies      = copy;
+        failed      = (copy->value == NULL) ? -1 : 0;
+    }
 
-    bin = ht_hash(hashtable, key);
+    if (!failed)
+    {
+        /* Free the originals too, so that the stats of the old arena only
+         * count the pairs it still holds. */
+        ht_arena_t *  old  = hashtable->old_arena;
+        ht_bucket_t * pair = *link;
+        while (pair)
+        {
+            ht_bucket_t * next = pair->next;
+            ht_release(hashtable, old, pair->key, pair->value);
+            ht_free_pair(old, pair);
+            pair = next;
+        }
+        *link = copies;
+        return 0;
+    }
+    while (copies)
+    {
+        ht_bucket_t * next = copies->next;
+        if (copies->key)
+        {
+            ht_arena_release(arena, copies->key);
+        }
+        if (copies->value)
+        {
+            ht_arena_release(arena, copies->value);
+        }
+        ht_free_pair(arena, copies);
+        copies = next;
+    }
+    return -1;
+}
 
-    next = hashtable->entries[bin];
+/* Copy up to HT_COMPACT_STEP buckets into the fresh arena, freeing the old
+ * arena once the last one has been copied. */
+static void
+ht_compact_step(htable_t * hashtable)
+{
+    for (size_t step = 0; step < HT_COMPACT_STEP && hashtable->old_arena;
+         step++)
+    {
+        if (ht_copy_chain(hashtable,
+                          &hashtable->entries[hashtable->compact_index]))
+        {
+            return;
+        }
+        if (++hashtable->compact_index == hashtable->bucket_count)
+        {
+            ht_arena_destroy(hashtable->old_arena);
+            hashtable->old_arena     = NULL;
+            hashtable->compact_index = 0;
+        }
+    }
+}
 
-    while (next != NULL && next->key != NULL && strcmp(key, next->key) > 0)
+/* Start compacting into a fresh arena. The pairs stay where they are until
+ * ht_compact_step() copies them. Failure to start is not an error; the
+ * arena only holds on to its freed memory for longer. */
+static void
+ht_compact_start(htable_t * hashtable)
+{
+    ht_arena_t * arena
+        = ht_arena_create(ht_arena_is_interning(hashtable->arena));
+    if (arena == NULL)
     {
-        last = next;
-        next = next->next;
+        return;
     }
 
-    /* There's already a pair.  Let's replace that string. */
-    if (next != NULL && next->key != NULL && strcmp(key, next->key) == 0)
+    hashtable->old_arena     = hashtable->arena;
+    hashtable->arena         = arena;
+    hashtable->compact_index = 0;
+}
+
+/* Start a compaction if one is due and nothing else is under way. */
+static void
+ht_maybe_compact(htable_t * hashtable)
+{
+    if (hashtable->arena && !hashtable->old_arena && !hashtable->old_entries
+        && ht_arena_should_compact(hashtable->arena))
     {
+        ht_compact_start(hashtable);
+    }
+}
+
+/* Carry on with whichever doubling or compaction is under way. */
+static void
+ht_step(htable_t * hashtable)
+{
+    ht_rehash_step(hashtable);
+    ht_compact_step(hashtable);
+}
 
-        free(next->value);
-        next->value = strdup(value);
+/* Find the link pointing at the pair holding key, or at the NULL ending its
+ * chain, in whichever array holds the key's chain. The equality function
+ * only runs for pairs whose hash matches. */
+static ht_bucket_t **
+ht_find(const htable_t * hashtable, const void * key, uint64_t hash)
+{
+    ht_bucket_t ** link = NULL;
+    size_t         bin  = 0;
 
-        /* Nope, could't find it.  Time to grow a pair. */
+    if (hashtable->old_entries)
+    {
+        bin = ht_index(hash, hashtable->old_bucket_count);
+    }
+    if (hashtable->old_entries && bin >= hashtable->rehash_index)
+    {
+        link = &hashtable->old_entries[bin];
     }
     else
     {
-        newpair = ht_newpair(key, value);
+        link = &hashtable->entries[ht_index(hash, hashtable->bucket_count)];
+    }
 
-        /* We're at the start of the linked list in this bin. */
-        if (next == hashtable->entries[bin])
-        {
-            newpair->next           = next;
-            hashtable->entries[bin] = newpair;
+    while (*link
+           && ((*link)->hash != hash || !hashtable->eq(key, (*link)->key)))
+    {
+        link = &(*link)->next;
+    }
+    return link;
+}
 
-            /* We're at the end of the linked list in this bin. */
-        }
-        else if (next == NULL)
-        {
-            last->next = newpair;
+/* Add a pair at link, the end of the chain its key belongs in, allocating
+ * it from arena if there is one. */
+static int
+ht_insert(htable_t *     hashtable,
+          ht_arena_t *   arena,
+          ht_bucket_t ** link,
+          void *         key,
+          void *         value,
+          uint64_t       hash)
+{
+    ht_bucket_t * newpair = NULL;
+    if (arena)
+    {
+        newpair = ht_arena_alloc(arena, sizeof(ht_bucket_t));
+    }
+    else
+    {
+        newpair = malloc(sizeof(ht_bucket_t));
+    }
+    if (newpair == NULL)
+    {
+        return -1;
+    }
+    newpair->key   = key;
+    newpair->value = value;
+    newpair->hash  = hash;
+    newpair->next  = NULL;
+    *link          = newpair;
+    hashtable->size++;
+
+    if (!hashtable->old_entries && !hashtable->old_arena
+        && (double)hashtable->size
+               > (double)hashtable->bucket_count * HT_MAX_LOAD)
+    {
+        ht_grow(hashtable);
+    }
+    return 0;
+}
+
+int
+ht_set(htable_t * hashtable, void * key, void * value)
+{
+    if (hashtable->arena)
+    {
+        return -1;
+    }
+    ht_step(hashtable);
+
+    uint64_t       hash = hashtable->hash(key);
+    ht_bucket_t ** link = ht_find(hashtable, key, hash);
+
+    /* There's already a pair.  Let's replace the value. */
+    if (*link)
+    {
+        ht_release(hashtable, NULL, key, (*link)->value);
+        (*link)->value = value;
+        return 0;
+    }
+
+    return ht_insert(hashtable, NULL, link, key, value, hash);
+}
+
+int
+ht_set_copy(htable_t *   hashtable,
+            const void * key,
+            size_t       key_size,
+            const void * value,
+            size_t       value_size)
+{
+    if (hashtable->arena == NULL)
+    {
+        return -1;
+    }
+    ht_step(hashtable);
+
+    uint64_t       hash  = hashtable->hash(key);
+    ht_bucket_t ** link  = ht_find(hashtable, key, hash);
+    ht_arena_t *   arena = ht_arena_for(hashtable, hash);
 
-            /* We're in the middle of the list. */
+    if (*link)
+    {
+        void * copy
+            = ht_arena_replace(arena, (*link)->value, value, value_size);
+        if (copy == NULL)
+        {
+            return -1;
         }
-        else
+        (*link)->value = copy;
+        ht_maybe_compact(hashtable);
+        return 0;
+    }
+
+    void * key_copy   = ht_arena_store(arena, key, key_size);
+    void * value_copy = NULL;
+    if (key_copy == NULL)
+    {
+        return -1;
+    }
+    if ((value_copy = ht_arena_store(arena, value, value_size)) == NULL
+        || ht_insert(hashtable, arena, link, key_copy, value_copy, hash))
+    {
+        ht_arena_release(arena, key_copy);
+        if (value_copy)
         {
-            newpair->next = next;
-            last->next    = newpair;
+            ht_arena_release(arena, value_copy);
         }
+        return -1;
     }
-}    
-    /* Retrieve a key-value pair from a hash table. */
-    char * ht_get(htable_t * hashtable, char * key)
+    return 0;
+}
+
+void *
+ht_get(const htable_t * hashtable, const void * key)
+{
+    ht_bucket_t * pair = *ht_find(hashtable, key, hashtable->hash(key));
+    return pair ? pair->value : NULL;
+}
+
+bool
+ht_contains(const htable_t * hashtable, const void * key)
+{
+    return *ht_find(hashtable, key, hashtable->hash(key)) != NULL;
+}
+
+int
+ht_delete(htable_t * hashtable, const void * key)
+{
+    ht_step(hashtable);
+
+    uint64_t       hash = hashtable->hash(key);
+    ht_bucket_t ** link = ht_find(hashtable, key, hash);
+    ht_bucket_t *  pair = *link;
+    if (pair == NULL)
     {
-        int       bin = 0;
-        ht_bucket_t * pair;
+        return -1;
+    }
+
+    ht_arena_t * arena = ht_arena_for(hashtable, hash);
+    *link              = pair->next;
+    ht_release(hashtable, arena, pair->key, pair->value);
+    ht_free_pair(arena, pair);
+    hashtable->size--;
+
+    ht_maybe_compact(hashtable);
+    return 0;
+}
 
-        bin = ht_hash(hashtable, key);
+void
+ht_compact(htable_t * hashtable)
+{
+    if (hashtable->arena == NULL)
+    {
+        return;
+    }
+    while (hashtable->old_entries)
+    {
+        ht_rehash_step(hashtable);
+    }
 
-        /* Step through the bin, looking for our value. */
-        pair = hashtable->entries[bin];
-        while (pair != NULL && pair->key != NULL && strcmp(key, pair->key) > 0)
+    /* Finish any compaction under way, then copy again, since the fresh
+     * arena may hold memory freed since that compaction started. */
+    for (int pass = 0; pass < 2; pass++)
+    {
+        if (hashtable->old_arena == NULL)
         {
-            pair = pair->next;
+            ht_compact_start(hashtable);
         }
-
-        /* Did we actually find anything? */
-        if (pair == NULL || pair->key == NULL || strcmp(key, pair->key) != 0)
+        while (hashtable->old_arena)
         {
-            return NULL;
+            size_t index = hashtable->compact_index;
+            ht_compact_step(hashtable);
+            if (hashtable->old_arena && hashtable->compact_index == index)
+            {
+                return;
+            }
         }
-        else
+    }
+}
+
+int
+ht_arena_stats(const htable_t * hashtable, ht_arena_stats_t * stats)
+{
+    if (hashtable->arena == NULL)
+    {
+        return -1;
+    }
+    ht_arena_get_stats(hashtable->arena, stats);
+    if (hashtable->old_arena)
+    {
+        ht_arena_stats_t old;
+        ht_arena_get_stats(hashtable->old_arena, &old);
+        stats->reserved += old.reserved;
+        stats->live += old.live;
+        stats->dead += old.dead;
+        stats->interned += old.interned;
+    }
+    return 0;
+}
+
+size_t
+ht_size(const htable_t * hashtable)
+{
+    return hashtable->size;
+}
+
+static void
+ht_for_each_in(ht_bucket_t ** entries,
+               size_t         count,
+               ht_action_f    action,
+               void *         action_ctx)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        ht_bucket_t * pair = entries[i];
+        for (; pair; pair = pair->next)
         {
-            return pair->value;
+            action(pair->key, pair->value, action_ctx);
         }
-    }
\ No newline at end of file
+    }
+}
+
+void
+ht_for_each(htable_t * hashtable, ht_action_f action, void * action_ctx)
+{
+    if (hashtable->old_entries)
+    {
+        ht_for_each_in(hashtable->old_entries + hashtable->rehash_index,
+                       hashtable->old_bucket_count - hashtable->rehash_index,
+                       action,
+                       action_ctx);
+    }
+    ht_for_each_in(
+        hashtable->entries, hashtable->bucket_count, action, action_ctx);
+}
+
+bool
+ht_string_eq(const void * lhs, const void * rhs)
+{
+    return strcmp(lhs, rhs) == 0;
+}
@@ -0,0 +1,345 @@
+/** @file ht_arena.c
+ *
+ * @brief A chunked bump allocator for the buckets, keys and values of arena
+ *        tables, with optional interning of equal keys and values.
+ *
+ * Allocations are carved out of 64 KiB chunks, or get a chunk of their own
+ * when larger than a quarter of that. Nothing is returned to the chunks;
+ * freed bytes are only counted, so the owning table knows when copying its
+ * live entries into a fresh arena is worth it.
+ *
+ * Interned blobs are indexed by an open addressing table with linear
+ * probing, which is kept at most half full.
+ *
+ */
+
+#include "ht_arena.h"
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define HT_ARENA_CHUNK (64 * 1024)
+#define HT_ARENA_ALIGN _Alignof(max_align_t)
+#define HT_INTERN_MIN_SLOTS 64
+#define HT_INTERN_SEED 0x6A09E667F3BCC909ULL
+
+typedef struct ht_chunk
+{
+    struct ht_chunk * next;
+    size_t            size;
+    size_t            used;
+    _Alignas(max_align_t) unsigned char data[];
+} ht_chunk_t;
+
+/* Header in front of every stored key and value. capacity is the number of
+ * bytes the blob can hold, size the number it holds. */
+typedef struct ht_blob
+{
+    uint32_t refs;
+    uint32_t size;
+    uint32_t capacity;
+    uint32_t hash;
+    _Alignas(max_align_t) unsigned char data[];
+} ht_blob_t;
+
+struct ht_arena
+{
+    ht_chunk_t * chunks; /* The chunk being filled comes first. */
+    size_t       reserved;
+    size_t       used;
+    size_t       dead;
+    bool         intern;
+    ht_blob_t ** slots;
+    size_t       slot_count;
+    size_t       interned;
+};
+
+static size_t
+ht_round(size_t size)
+{
+    return (size + HT_ARENA_ALIGN - 1) & ~(HT_ARENA_ALIGN - 1);
+}
+
+static ht_blob_t *
+ht_blob_of(const void * data)
+{
+    return (ht_blob_t *)((const unsigned char *)data
+                         - offsetof(ht_blob_t, data));
+}
+
+ht_arena_t *
+ht_arena_create(bool intern)
+{
+    ht_arena_t * arena = calloc(1, sizeof(ht_arena_t));
+    if (arena)
+    {
+        arena->intern = intern;
+    }
+    return arena;
+}
+
+bool
+ht_arena_is_interning(const ht_arena_t * arena)
+{
+    return arena->intern;
+}
+
+void
+ht_arena_destroy(ht_arena_t * arena)
+{
+    if (arena == NULL)
+    {
+        return;
+    }
+
+    ht_chunk_t * chunk = arena->chunks;
+    while (chunk)
+    {
+        ht_chunk_t * next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    free(arena->slots);
+    free(arena);
+}
+
+void *
+ht_arena_alloc(ht_arena_t * arena, size_t size)
+{
+    ht_chunk_t * chunk = arena->chunks;
+
+    size = ht_round(size);
+    if (chunk == NULL || chunk->size - chunk->used < size)
+    {
+        size_t       chunk_size = HT_ARENA_CHUNK;
+        ht_chunk_t * fresh      = NULL;
+        if (size > HT_ARENA_CHUNK / 4)
+        {
+            chunk_size = size;
+        }
+        if ((fresh = malloc(sizeof(ht_chunk_t) + chunk_size)) == NULL)
+        {
+            return NULL;
+        }
+        fresh->size = chunk_size;
+        fresh->used = 0;
+
+        /* A chunk made for one large allocation is full at once; keep
+         * filling the current one. */
+        if (chunk && chunk_size != HT_ARENA_CHUNK)
+        {
+            fresh->next = chunk->next;
+            chunk->next = fresh;
+        }
+        else
+        {
+            fresh->next   = chunk;
+            arena->chunks = fresh;
+        }
+        arena->reserved += sizeof(ht_chunk_t) + chunk_size;
+        chunk = fresh;
+    }
+
+    void * data = chunk->data + chunk->used;
+    chunk->used += size;
+    arena->used += size;
+    return data;
+}
+
+void
+ht_arena_free(ht_arena_t * arena, void * data, size_t size)
+{
+    (void)data;
+    arena->dead += ht_round(size);
+}
+
+/* Slot holding the blob equal to data, or the empty slot ending its probe
+ * sequence. */
+static size_t
+ht_intern_find(const ht_arena_t * arena,
+               const void *       data,
+               size_t             size,
+               uint32_t           hash)
+{
+    size_t mask = arena->slot_count - 1;
+    size_t slot = hash & mask;
+
+    while (arena->slots[slot])
+    {
+        const ht_blob_t * blob = arena->slots[slot];
+        if (blob->hash == hash && blob->size == size
+            && memcmp(blob->data, data, size) == 0)
+        {
+            break;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+static int
+ht_intern_grow(ht_arena_t * arena)
+{
+    size_t       count = arena->slot_count ? arena->slot_count * 2
+                                           : HT_INTERN_MIN_SLOTS;
+    ht_blob_t ** slots = calloc(count, sizeof(ht_blob_t *));
+    if (slots == NULL)
+    {
+        return -1;
+    }
+
+    for (size_t i = 0; i < arena->slot_count; i++)
+    {
+        ht_blob_t * blob = arena->slots[i];
+        if (blob)
+        {
+            size_t slot = blob->hash & (count - 1);
+            while (slots[slot])
+            {
+                slot = (slot + 1) & (count - 1);
+            }
+            slots[slot] = blob;
+        }
+    }
+
+    free(arena->slots);
+    arena->slots      = slots;
+    arena->slot_count = count;
+    return 0;
+}
+
+/* Remove a blob from the index, shifting later members of its probe run
+ * back so that no lookup stops short of them. */
+static void
+ht_intern_remove(ht_arena_t * arena, const ht_blob_t * blob)
+{
+    size_t mask = arena->slot_count - 1;
+    size_t hole = blob->hash & mask;
+
+    while (arena->slots[hole] != blob)
+    {
+        hole = (hole + 1) & mask;
+    }
+
+    for (size_t next = (hole + 1) & mask; arena->slots[next];
+         next        = (next + 1) & mask)
+    {
+        size_t home = arena->slots[next]->hash & mask;
+        /* The entry may fill the hole unless its home lies cyclically in
+         * (hole, next]. */
+        if (((next - home) & mask) >= ((next - hole) & mask))
+        {
+            arena->slots[hole] = arena->slots[next];
+            hole               = next;
+        }
+    }
+    arena->slots[hole] = NULL;
+    arena->interned--;
+}
+
+void *
+ht_arena_store(ht_arena_t * arena, const void * data, size_t size)
+{
+    uint32_t hash = 0;
+    size_t   slot = 0;
+
+    if (size > UINT32_MAX)
+    {
+        return NULL;
+    }
+
+    if (arena->intern)
+    {
+        if ((arena->interned + 1) * 2 > arena->slot_count
+            && ht_intern_grow(arena))
+        {
+            return NULL;
+        }
+        hash = (uint32_t)ht_hash_bytes(data, size, HT_INTERN_SEED);
+        slot = ht_intern_find(arena, data, size, hash);
+        if (arena->slots[slot])
+        {
+            arena->slots[slot]->refs++;
+            return arena->slots[slot]->data;
+        }
+    }
+
+    size_t      total = ht_round(sizeof(ht_blob_t) + size);
+    ht_blob_t * blob  = ht_arena_alloc(arena, total);
+    if (blob == NULL)
+    {
+        return NULL;
+    }
+    blob->refs     = 1;
+    blob->size     = (uint32_t)size;
+    blob->capacity = (uint32_t)(total - sizeof(ht_blob_t));
+    blob->hash     = hash;
+    memcpy(blob->data, data, size);
+
+    if (arena->intern)
+    {
+        arena->slots[slot] = blob;
+        arena->interned++;
+    }
+    return blob->data;
+}
+
+void *
+ht_arena_replace(ht_arena_t * arena,
+                 void *       old,
+                 const void * data,
+                 size_t       size)
+{
+    ht_blob_t * blob = ht_blob_of(old);
+
+    if (!arena->intern && blob->refs == 1 && size <= blob->capacity)
+    {
+        memmove(blob->data, data, size);
+        blob->size = (uint32_t)size;
+        return old;
+    }
+
+    void * fresh = ht_arena_store(arena, data, size);
+    if (fresh)
+    {
+        ht_arena_release(arena, old);
+    }
+    return fresh;
+}
+
+void *
+ht_arena_copy(ht_arena_t * arena, const void * blob)
+{
+    return ht_arena_store(arena, blob, ht_blob_of(blob)->size);
+}
+
+void
+ht_arena_release(ht_arena_t * arena, void * data)
+{
+    ht_blob_t * blob = ht_blob_of(data);
+
+    if (--blob->refs > 0)
+    {
+        return;
+    }
+    if (arena->intern)
+    {
+        ht_intern_remove(arena, blob);
+    }
+    arena->dead += sizeof(ht_blob_t) + blob->capacity;
+}
+
+bool
+ht_arena_should_compact(const ht_arena_t * arena)
+{
+    return arena->dead > HT_ARENA_CHUNK && arena->dead * 2 > arena->used;
+}
+
+void
+ht_arena_get_stats(const ht_arena_t * arena, ht_arena_stats_t * stats)
+{
+    stats->reserved = arena->reserved;
+    stats->live     = arena->used - arena->dead;
+    stats->dead     = arena->dead;
+    stats->interned = arena->interned;
+}
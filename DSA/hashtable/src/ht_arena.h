@@ -0,0 +1,63 @@
+/** @file ht_arena.h
+ *
+ * @brief Internal interface of the chunked arena behind arena tables.
+ *
+ * Arena tables keep their buckets, keys and values in large chunks instead
+ * of one allocation each. Keys and values are stored as blobs: a small
+ * header followed by a copy of the caller's bytes. Freed memory is only
+ * counted, and reclaimed by copying the live contents into a new arena.
+ *
+ */
+
+#ifndef HT_ARENA_H
+#define HT_ARENA_H
+
+#include "../include/hashtable.h"
+
+typedef struct ht_arena ht_arena_t;
+
+/** @brief Create an empty arena; intern shares storage of equal blobs. */
+ht_arena_t * ht_arena_create(bool intern);
+
+/** @brief Whether the arena interns its blobs. */
+bool ht_arena_is_interning(const ht_arena_t * arena);
+
+/** @brief Free every chunk of the arena at once. NULL is safe. */
+void ht_arena_destroy(ht_arena_t * arena);
+
+/** @brief Allocate size bytes for the caller's own use, or NULL. */
+void * ht_arena_alloc(ht_arena_t * arena, size_t size);
+
+/** @brief Give back memory from ht_arena_alloc() of the same size. */
+void ht_arena_free(ht_arena_t * arena, void * data, size_t size);
+
+/**
+ * @brief Copy size bytes into a blob and return the copy, or NULL if
+ *        memory ran out. When interning, an equal blob already stored is
+ *        shared instead.
+ */
+void * ht_arena_store(ht_arena_t * arena, const void * data, size_t size);
+
+/**
+ * @brief Replace the blob old with a copy of data, reusing its storage in
+ *        place when nothing else shares it and the new bytes fit. Returns
+ *        the new blob, or NULL with old untouched if memory ran out.
+ */
+void * ht_arena_replace(ht_arena_t * arena,
+                        void *       old,
+                        const void * data,
+                        size_t       size);
+
+/** @brief Store a copy of a blob of another arena in this one. */
+void * ht_arena_copy(ht_arena_t * arena, const void * blob);
+
+/** @brief Drop one reference to a blob, freeing it with the last. */
+void ht_arena_release(ht_arena_t * arena, void * blob);
+
+/** @brief Whether enough of the arena is freed memory to compact it. */
+bool ht_arena_should_compact(const ht_arena_t * arena);
+
+/** @brief Fill in the usage figures of the arena. */
+void ht_arena_get_stats(const ht_arena_t * arena, ht_arena_stats_t * stats);
+
+#endif
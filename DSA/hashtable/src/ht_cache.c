@@ -0,0 +1,580 @@
+/** @file ht_cache.c
+ *
+ * @brief LRU and CLOCK caches over the chained hashtable, and their sharded
+ *        variant.
+ *
+ * The table maps each key to a node holding the key, value and charge, the
+ * node's links in the LRU list, and its slot in the CLOCK ring. The ring is
+ * kept dense: a removed entry's slot is filled by the last one, so the hand
+ * never meets empty slots. Reference bits sit in a separate bit array, and
+ * are set with atomic operations so that readers holding a shard's shared
+ * lock may set them together.
+ *
+ */
+
+#include "../include/ht_cache.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+
+#define HTC_CACHE_LINE 64
+#define HTC_MIN_RING 64
+
+typedef struct htc_node
+{
+    void *            key;
+    void *            value;
+    size_t            charge;
+    struct htc_node * prev; /* LRU list, most recently used first. */
+    struct htc_node * next;
+    size_t            slot; /* CLOCK ring. */
+} htc_node_t;
+
+struct htcache
+{
+    htable_t *   table; /* Key to node; releases nothing itself. */
+    ht_free_f    key_free;
+    ht_free_f    value_free;
+    htc_policy_t policy;
+    size_t       max_entries;
+    size_t       max_bytes;
+    size_t       bytes;
+    uint64_t     hits;
+    uint64_t     misses;
+    uint64_t     evictions;
+
+    htc_node_t lru; /* Sentinel; lru.prev is the least recently used. */
+
+    htc_node_t **      ring;
+    _Atomic uint64_t * referenced; /* One bit per ring slot. */
+    size_t             ring_size;
+    size_t             ring_used;
+    size_t             hand;
+};
+
+/* Hits and misses of a shared lock lookup are counted here; everything
+ * else in the shard's cache changes under the exclusive lock. */
+typedef struct shtc_shard
+{
+    _Alignas(HTC_CACHE_LINE) pthread_rwlock_t lock;
+    _Atomic uint64_t hits;
+    _Atomic uint64_t misses;
+    htcache_t *      cache;
+} shtc_shard_t;
+
+struct shtcache
+{
+    ht_hash_f      hash;
+    htc_policy_t   policy;
+    size_t         shard_count;
+    shtc_shard_t * shards;
+};
+
+static bool
+htc_is_referenced(const htcache_t * cache, size_t slot)
+{
+    return atomic_load_explicit(&cache->referenced[slot / 64],
+                                memory_order_relaxed)
+           & (1ULL << (slot % 64));
+}
+
+static void
+htc_set_referenced(htcache_t * cache, size_t slot, bool referenced)
+{
+    if (referenced)
+    {
+        atomic_fetch_or_explicit(&cache->referenced[slot / 64],
+                                 1ULL << (slot % 64),
+                                 memory_order_relaxed);
+    }
+    else
+    {
+        atomic_fetch_and_explicit(&cache->referenced[slot / 64],
+                                  ~(1ULL << (slot % 64)),
+                                  memory_order_relaxed);
+    }
+}
+
+/* Mark a node as used. For CLOCK this only reads when the bit is already
+ * set, and is safe under a shared lock. */
+static void
+htc_touch(htcache_t * cache, htc_node_t * node)
+{
+    if (cache->policy == HTC_CLOCK)
+    {
+        if (!htc_is_referenced(cache, node->slot))
+        {
+            htc_set_referenced(cache, node->slot, true);
+        }
+        return;
+    }
+
+    node->prev->next      = node->next;
+    node->next->prev      = node->prev;
+    node->next            = cache->lru.next;
+    node->prev            = &cache->lru;
+    cache->lru.next->prev = node;
+    cache->lru.next       = node;
+}
+
+static int
+htc_grow_ring(htcache_t * cache)
+{
+    size_t size      = cache->ring_size ? cache->ring_size * 2 : HTC_MIN_RING;
+    size_t words     = size / 64;
+    size_t old_words = cache->ring_size / 64;
+
+    htc_node_t ** ring = realloc(cache->ring, size * sizeof(htc_node_t *));
+    if (ring == NULL)
+    {
+        return -1;
+    }
+    cache->ring = ring;
+
+    _Atomic uint64_t * referenced
+        = realloc(cache->referenced, words * sizeof(uint64_t));
+    if (referenced == NULL)
+    {
+        return -1;
+    }
+    for (size_t i = old_words; i < words; i++)
+    {
+        atomic_init(&referenced[i], 0);
+    }
+    cache->referenced = referenced;
+    cache->ring_size  = size;
+    return 0;
+}
+
+/* Add a new node as the most recently used entry. */
+static int
+htc_link(htcache_t * cache, htc_node_t * node)
+{
+    if (cache->policy == HTC_CLOCK)
+    {
+        if (cache->ring_used == cache->ring_size && htc_grow_ring(cache))
+        {
+            return -1;
+        }
+        node->slot              = cache->ring_used++;
+        cache->ring[node->slot] = node;
+        htc_set_referenced(cache, node->slot, false);
+        return 0;
+    }
+
+    node->next            = cache->lru.next;
+    node->prev            = &cache->lru;
+    cache->lru.next->prev = node;
+    cache->lru.next       = node;
+    return 0;
+}
+
+static void
+htc_unlink(htcache_t * cache, htc_node_t * node)
+{
+    if (cache->policy == HTC_LRU)
+    {
+        node->prev->next = node->next;
+        node->next->prev = node->prev;
+        return;
+    }
+
+    /* Move the last node of the ring into the hole, bit included. */
+    size_t       last  = --cache->ring_used;
+    htc_node_t * moved = cache->ring[last];
+    if (moved != node)
+    {
+        moved->slot             = node->slot;
+        cache->ring[node->slot] = moved;
+        htc_set_referenced(
+            cache, node->slot, htc_is_referenced(cache, last));
+    }
+    if (cache->hand >= cache->ring_used)
+    {
+        cache->hand = 0;
+    }
+}
+
+/* Pick the entry to evict: the LRU tail, or the first node the hand finds
+ * unreferenced, clearing the bits it passes. */
+static htc_node_t *
+htc_victim(htcache_t * cache)
+{
+    if (cache->policy == HTC_LRU)
+    {
+        return cache->lru.prev;
+    }
+
+    for (;;)
+    {
+        size_t slot = cache->hand;
+        cache->hand = (slot + 1) % cache->ring_used;
+        if (!htc_is_referenced(cache, slot))
+        {
+            return cache->ring[slot];
+        }
+        htc_set_referenced(cache, slot, false);
+    }
+}
+
+static void
+htc_remove(htcache_t * cache, htc_node_t * node)
+{
+    ht_delete(cache->table, node->key);
+    htc_unlink(cache, node);
+    cache->bytes -= node->charge;
+    if (cache->key_free)
+    {
+        cache->key_free(node->key);
+    }
+    if (cache->value_free)
+    {
+        cache->value_free(node->value);
+    }
+    free(node);
+}
+
+/* Whether adding extra entries and bytes would break a limit. */
+static bool
+htc_over(const htcache_t * cache, size_t entries, size_t bytes)
+{
+    return (cache->max_entries
+            && ht_size(cache->table) + entries > cache->max_entries)
+           || (cache->max_bytes && cache->bytes + bytes > cache->max_bytes);
+}
+
+static void
+htc_make_room(htcache_t * cache, size_t entries, size_t bytes)
+{
+    while (ht_size(cache->table) > 0 && htc_over(cache, entries, bytes))
+    {
+        htc_remove(cache, htc_victim(cache));
+        cache->evictions++;
+    }
+}
+
+htcache_t *
+htc_create(ht_hash_f    hash,
+           ht_eq_f      eq,
+           ht_free_f    key_free,
+           ht_free_f    value_free,
+           htc_policy_t policy,
+           size_t       max_entries,
+           size_t       max_bytes)
+{
+    if (!hash || !eq || (max_entries == 0 && max_bytes == 0))
+    {
+        return NULL;
+    }
+
+    htcache_t * cache = calloc(1, sizeof(htcache_t));
+    if (cache == NULL)
+    {
+        return NULL;
+    }
+    if ((cache->table = ht_create(hash, eq, NULL, NULL, max_entries))
+        == NULL)
+    {
+        free(cache);
+        return NULL;
+    }
+    cache->key_free    = key_free;
+    cache->value_free  = value_free;
+    cache->policy      = policy;
+    cache->max_entries = max_entries;
+    cache->max_bytes   = max_bytes;
+    cache->lru.next    = &cache->lru;
+    cache->lru.prev    = &cache->lru;
+    return cache;
+}
+
+void
+htc_destroy(htcache_t ** cache)
+{
+    if (!cache || !*cache)
+    {
+        return;
+    }
+
+    htcache_t * self = *cache;
+    while (ht_size(self->table) > 0)
+    {
+        htc_remove(self, htc_victim(self));
+    }
+    ht_destroy(&self->table);
+    free(self->ring);
+    free(self->referenced);
+    free(self);
+    *cache = NULL;
+}
+
+int
+htc_set(htcache_t * cache, void * key, void * value, size_t charge)
+{
+    if (cache->max_bytes && charge > cache->max_bytes)
+    {
+        return -1;
+    }
+
+    /* There's already an entry.  Let's replace the value. */
+    htc_node_t * node = ht_get(cache->table, key);
+    if (node)
+    {
+        if (cache->key_free)
+        {
+            cache->key_free(key);
+        }
+        if (cache->value_free)
+        {
+            cache->value_free(node->value);
+        }
+        node->value = value;
+        cache->bytes += charge - node->charge;
+        node->charge = charge;
+        htc_touch(cache, node);
+        htc_make_room(cache, 0, 0);
+        return 0;
+    }
+
+    htc_make_room(cache, 1, charge);
+    if ((node = malloc(sizeof(htc_node_t))) == NULL)
+    {
+        return -1;
+    }
+    node->key    = key;
+    node->value  = value;
+    node->charge = charge;
+    if (htc_link(cache, node))
+    {
+        free(node);
+        return -1;
+    }
+    if (ht_set(cache->table, key, node))
+    {
+        htc_unlink(cache, node);
+        free(node);
+        return -1;
+    }
+    cache->bytes += charge;
+    return 0;
+}
+
+void *
+htc_get(htcache_t * cache, const void * key)
+{
+    htc_node_t * node = ht_get(cache->table, key);
+    if (node == NULL)
+    {
+        cache->misses++;
+        return NULL;
+    }
+    cache->hits++;
+    htc_touch(cache, node);
+    return node->value;
+}
+
+int
+htc_delete(htcache_t * cache, const void * key)
+{
+    htc_node_t * node = ht_get(cache->table, key);
+    if (node == NULL)
+    {
+        return -1;
+    }
+    htc_remove(cache, node);
+    return 0;
+}
+
+size_t
+htc_size(const htcache_t * cache)
+{
+    return ht_size(cache->table);
+}
+
+void
+htc_stats(const htcache_t * cache, htc_stats_t * stats)
+{
+    stats->hits      = cache->hits;
+    stats->misses    = cache->misses;
+    stats->evictions = cache->evictions;
+    stats->entries   = ht_size(cache->table);
+    stats->bytes     = cache->bytes;
+}
+
+static shtc_shard_t *
+shtc_shard(const shtcache_t * cache, const void * key)
+{
+    /* Fibonacci hashing spreads keys over the shards even when the hash
+     * function leaves the top or bottom bits unused. */
+    uint64_t mixed = cache->hash(key) * 0x9E3779B97F4A7C15ULL;
+    return &cache->shards[(mixed >> 32) & (cache->shard_count - 1)];
+}
+
+shtcache_t *
+shtc_create(ht_hash_f    hash,
+            ht_eq_f      eq,
+            ht_free_f    key_free,
+            ht_free_f    value_free,
+            htc_policy_t policy,
+            size_t       max_entries,
+            size_t       max_bytes,
+            size_t       shard_count)
+{
+    if (!hash || !eq || shard_count == 0
+        || (max_entries == 0 && max_bytes == 0))
+    {
+        return NULL;
+    }
+
+    size_t count = 1;
+    while (count < shard_count)
+    {
+        count *= 2;
+    }
+
+    shtcache_t * cache = malloc(sizeof(shtcache_t));
+    if (cache == NULL)
+    {
+        return NULL;
+    }
+    cache->hash        = hash;
+    cache->policy      = policy;
+    cache->shard_count = count;
+    cache->shards
+        = aligned_alloc(HTC_CACHE_LINE, count * sizeof(shtc_shard_t));
+    if (cache->shards == NULL)
+    {
+        free(cache);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        shtc_shard_t * shard = &cache->shards[i];
+        pthread_rwlock_init(&shard->lock, NULL);
+        atomic_init(&shard->hits, 0);
+        atomic_init(&shard->misses, 0);
+        shard->cache = htc_create(hash,
+                                  eq,
+                                  key_free,
+                                  value_free,
+                                  policy,
+                                  (max_entries + count - 1) / count,
+                                  (max_bytes + count - 1) / count);
+        if (shard->cache == NULL)
+        {
+            cache->shard_count = i + 1;
+            shtc_destroy(&cache);
+            return NULL;
+        }
+    }
+    return cache;
+}
+
+void
+shtc_destroy(shtcache_t ** cache)
+{
+    if (!cache || !*cache)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < (*cache)->shard_count; i++)
+    {
+        shtc_shard_t * shard = &(*cache)->shards[i];
+        htc_destroy(&shard->cache);
+        pthread_rwlock_destroy(&shard->lock);
+    }
+    free((*cache)->shards);
+    free(*cache);
+    *cache = NULL;
+}
+
+int
+shtc_set(shtcache_t * cache, void * key, void * value, size_t charge)
+{
+    shtc_shard_t * shard = shtc_shard(cache, key);
+
+    pthread_rwlock_wrlock(&shard->lock);
+    int status = htc_set(shard->cache, key, value, charge);
+    pthread_rwlock_unlock(&shard->lock);
+    return status;
+}
+
+bool
+shtc_get(shtcache_t * cache,
+         const void * key,
+         ht_action_f  action,
+         void *       action_ctx)
+{
+    shtc_shard_t * shard = shtc_shard(cache, key);
+
+    /* A CLOCK hit only sets a bit, and table lookups do not modify the
+     * table, so readers share the lock. An LRU hit relinks its node. */
+    if (cache->policy == HTC_CLOCK)
+    {
+        pthread_rwlock_rdlock(&shard->lock);
+    }
+    else
+    {
+        pthread_rwlock_wrlock(&shard->lock);
+    }
+
+    htc_node_t * node = ht_get(shard->cache->table, key);
+    if (node)
+    {
+        htc_touch(shard->cache, node);
+        action(node->key, node->value, action_ctx);
+    }
+    atomic_fetch_add_explicit(
+        node ? &shard->hits : &shard->misses, 1, memory_order_relaxed);
+    pthread_rwlock_unlock(&shard->lock);
+    return node != NULL;
+}
+
+int
+shtc_delete(shtcache_t * cache, const void * key)
+{
+    shtc_shard_t * shard = shtc_shard(cache, key);
+
+    pthread_rwlock_wrlock(&shard->lock);
+    int status = htc_delete(shard->cache, key);
+    pthread_rwlock_unlock(&shard->lock);
+    return status;
+}
+
+size_t
+shtc_size(shtcache_t * cache)
+{
+    size_t size = 0;
+    for (size_t i = 0; i < cache->shard_count; i++)
+    {
+        shtc_shard_t * shard = &cache->shards[i];
+        pthread_rwlock_rdlock(&shard->lock);
+        size += htc_size(shard->cache);
+        pthread_rwlock_unlock(&shard->lock);
+    }
+    return size;
+}
+
+void
+shtc_stats(shtcache_t * cache, htc_stats_t * stats)
+{
+    htc_stats_t total = { 0 };
+    for (size_t i = 0; i < cache->shard_count; i++)
+    {
+        shtc_shard_t * shard = &cache->shards[i];
+        htc_stats_t    part  = { 0 };
+
+        pthread_rwlock_rdlock(&shard->lock);
+        htc_stats(shard->cache, &part);
+        pthread_rwlock_unlock(&shard->lock);
+
+        total.hits += part.hits + atomic_load(&shard->hits);
+        total.misses += part.misses + atomic_load(&shard->misses);
+        total.evictions += part.evictions;
+        total.entries += part.entries;
+        total.bytes += part.bytes;
+    }
+    *stats = total;
+}
@@ -0,0 +1,139 @@
+/** @file ht_hash.c
+ *
+ * @brief Fast seeded hashing of byte strings for the hashtables.
+ *
+ * The construction follows wyhash: the input is read in 8 byte words, three
+ * independent lanes absorb 48 bytes per iteration for long inputs, and every
+ * mixing step is a 64x64->128 bit multiply whose halves are folded together.
+ * Short inputs are read with overlapping loads instead of a byte loop.
+ *
+ */
+
+#include "../include/hashtable.h"
+#include <string.h>
+
+/* Odd constants with balanced bits, one per lane. */
+#define HT_SECRET0 0xA0761D6478BD642FULL
+#define HT_SECRET1 0xE7037ED1A0B428DBULL
+#define HT_SECRET2 0x8EBC6AF09C88C6E3ULL
+#define HT_SECRET3 0x589965CC75374CC3ULL
+
+static uint64_t g_ht_seed = 0x9E3779B97F4A7C15ULL;
+
+/* Multiply a by b and return the low and high halves in a and b. */
+static inline void
+ht_mum(uint64_t * a, uint64_t * b)
+{
+#if defined(__SIZEOF_INT128__)
+    __extension__ typedef unsigned __int128 ht_u128_t;
+    ht_u128_t product = (ht_u128_t)*a * *b;
+    *a                = (uint64_t)product;
+    *b                = (uint64_t)(product >> 64);
+#else
+    uint64_t ha = *a >> 32, la = (uint32_t)*a;
+    uint64_t hb = *b >> 32, lb = (uint32_t)*b;
+    uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    uint64_t t  = rl + (rm0 << 32);
+    uint64_t c  = t < rl;
+    uint64_t lo = t + (rm1 << 32);
+    c += lo < t;
+    *a = lo;
+    *b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+static inline uint64_t
+ht_mix(uint64_t a, uint64_t b)
+{
+    ht_mum(&a, &b);
+    return a ^ b;
+}
+
+static inline uint64_t
+ht_read64(const uint8_t * p)
+{
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline uint64_t
+ht_read32(const uint8_t * p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+uint64_t
+ht_hash_bytes(const void * data, size_t length, uint64_t seed)
+{
+    const uint8_t * p = data;
+    uint64_t        a = 0;
+    uint64_t        b = 0;
+
+    seed ^= ht_mix(seed ^ HT_SECRET0, HT_SECRET1);
+    if (length <= 16)
+    {
+        if (length >= 4)
+        {
+            /* Two pairs of overlapping 4 byte reads cover 4 to 16 bytes. */
+            size_t shift = (length >> 3) << 2;
+            a = (ht_read32(p) << 32) | ht_read32(p + shift);
+            b = (ht_read32(p + length - 4) << 32)
+                | ht_read32(p + length - 4 - shift);
+        }
+        else if (length > 0)
+        {
+            a = ((uint64_t)p[0] << 16) | ((uint64_t)p[length >> 1] << 8)
+                | p[length - 1];
+        }
+    }
+    else
+    {
+        size_t left = length;
+        if (left > 48)
+        {
+            uint64_t lane1 = seed;
+            uint64_t lane2 = seed;
+            do
+            {
+                seed  = ht_mix(ht_read64(p) ^ HT_SECRET1,
+                               ht_read64(p + 8) ^ seed);
+                lane1 = ht_mix(ht_read64(p + 16) ^ HT_SECRET2,
+                               ht_read64(p + 24) ^ lane1);
+                lane2 = ht_mix(ht_read64(p + 32) ^ HT_SECRET3,
+                               ht_read64(p + 40) ^ lane2);
+                p += 48;
+                left -= 48;
+            } while (left > 48);
+            seed ^= lane1 ^ lane2;
+        }
+        while (left > 16)
+        {
+            seed = ht_mix(ht_read64(p) ^ HT_SECRET1, ht_read64(p + 8) ^ seed);
+            p += 16;
+            left -= 16;
+        }
+        /* The last 16 bytes, overlapping what came before if need be. */
+        a = ht_read64(p + left - 16);
+        b = ht_read64(p + left - 8);
+    }
+
+    a ^= HT_SECRET1;
+    b ^= seed;
+    ht_mum(&a, &b);
+    return ht_mix(a ^ HT_SECRET0 ^ length, b ^ HT_SECRET1);
+}
+
+void
+ht_set_hash_seed(uint64_t seed)
+{
+    g_ht_seed = seed;
+}
+
+uint64_t
+ht_string_hash(const void * key)
+{
+    return ht_hash_bytes(key, strlen(key), g_ht_seed);
+}
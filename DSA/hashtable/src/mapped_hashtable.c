@@ -0,0 +1,672 @@
+/** @file mapped_hashtable.c
+ *
+ * @brief Writing table files, and looking keys up in mapped ones.
+ *
+ * The writer builds the whole image in memory, then writes it in one go.
+ * In chained files entries are grouped by bucket, so a lookup reads one pair
+ * of bucket indices and then a run of adjacent entries. With at least as
+ * many buckets as entries, most runs hold one entry. In perfect files each
+ * entry sits at the position the perfect hash gives its key, so a lookup
+ * reads one pilot and one entry, and one remap value for about one key in
+ * a hundred.
+ *
+ * The reader trusts nothing it has not checked: the header is validated on
+ * open, and every offset read during a lookup is bounds checked against its
+ * section before use, so a damaged file gives wrong answers at worst.
+ *
+ */
+
+#include "../include/mapped_hashtable.h"
+#include "mph_index.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define MHT_MAGIC "HTMAPPED"
+#define MHT_VERSION 2
+#define MHT_BYTE_ORDER 0x01020304u
+#define MHT_SEED 0x243F6A8885A308D3ULL
+#define MHT_CHAINED 0
+#define MHT_PERFECT 1
+
+typedef struct mht_header
+{
+    char     magic[8];
+    uint32_t version;
+    uint32_t byte_order; /* MHT_BYTE_ORDER as written by the writer. */
+    uint64_t seed;
+    uint64_t entry_count;
+    uint64_t bucket_count;
+    uint64_t buckets_offset;
+    uint64_t entries_offset;
+    uint64_t data_offset;
+    uint64_t data_size;
+    uint64_t file_size;
+    uint32_t kind;         /* MHT_CHAINED or MHT_PERFECT. */
+    uint32_t slot_count;   /* Perfect files: slots of the perfect hash. */
+    uint64_t remap_offset; /* Perfect files: start of the remap array. */
+    uint64_t body_checksum;   /* Of the file_size - sizeof(header) bytes. */
+    uint64_t header_checksum; /* Of the bytes before this field. */
+} mht_header_t;
+
+typedef struct mht_entry
+{
+    uint64_t hash;
+    uint64_t key_offset;
+    uint64_t value_offset;
+    uint32_t key_size;
+    uint32_t value_size;
+} mht_entry_t;
+
+struct mhtable
+{
+    const unsigned char * base;
+    size_t                length;
+    const mht_header_t *  header;
+    const uint64_t *      buckets; /* Chained files. */
+    mph_index_t           index;   /* Perfect files. */
+    const mht_entry_t *   entries;
+    const unsigned char * data;
+};
+
+/* Entries gathered from the table being saved. */
+typedef struct mht_source
+{
+    const void * key;
+    const void * value;
+    size_t       key_size;
+    size_t       value_size;
+    uint64_t     hash;
+} mht_source_t;
+
+typedef struct mht_gather
+{
+    mht_source_t * sources;
+    size_t         count;
+    ht_size_f      key_size;
+    ht_size_f      value_size;
+} mht_gather_t;
+
+static size_t
+mht_align(size_t offset, size_t alignment)
+{
+    return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+static uint64_t
+mht_header_checksum(const mht_header_t * header)
+{
+    return ht_hash_bytes(
+        header, offsetof(mht_header_t, header_checksum), MHT_SEED);
+}
+
+size_t
+ht_string_size(const void * data)
+{
+    return strlen(data) + 1;
+}
+
+static void
+mht_gather_entry(const void * key, void * value, void * ctx)
+{
+    mht_gather_t * gather = ctx;
+    mht_source_t * source = &gather->sources[gather->count++];
+
+    source->key        = key;
+    source->value      = value;
+    source->key_size   = gather->key_size(key);
+    source->value_size = gather->value_size(value);
+    source->hash       = ht_hash_bytes(key, source->key_size, MHT_SEED);
+}
+
+/* Fill in the entries and data of an image of header->file_size bytes,
+ * the source order[i] becoming entry i, then the checksums and header. */
+static void
+mht_fill(unsigned char *      image,
+         const mht_source_t * sources,
+         const size_t *       order,
+         mht_header_t *       header)
+{
+    mht_entry_t *   entries = (mht_entry_t *)(image + header->entries_offset);
+    unsigned char * data    = image + header->data_offset;
+    size_t          offset  = 0;
+
+    for (size_t i = 0; i < header->entry_count; i++)
+    {
+        const mht_source_t * source = &sources[order[i]];
+        mht_entry_t *        entry  = &entries[i];
+
+        entry->hash       = source->hash;
+        entry->key_size   = (uint32_t)source->key_size;
+        entry->value_size = (uint32_t)source->value_size;
+        entry->key_offset = offset;
+        memcpy(data + offset, source->key, source->key_size);
+        offset              = mht_align(offset + source->key_size, 8);
+        entry->value_offset = offset;
+        memcpy(data + offset, source->value, source->value_size);
+        offset = mht_align(offset + source->value_size, 8);
+    }
+
+    header->body_checksum
+        = ht_hash_bytes(image + sizeof(mht_header_t),
+                        header->file_size - sizeof(mht_header_t),
+                        MHT_SEED);
+    header->header_checksum = mht_header_checksum(header);
+    memcpy(image, header, sizeof(mht_header_t));
+}
+
+static int
+mht_write_file(const char * path, const unsigned char * image, size_t length)
+{
+    size_t tmp_length = strlen(path) + sizeof(".tmp");
+    char * tmp_path   = malloc(tmp_length);
+    if (tmp_path == NULL)
+    {
+        return -1;
+    }
+    snprintf(tmp_path, tmp_length, "%s.tmp", path);
+
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        free(tmp_path);
+        return -1;
+    }
+
+    while (length > 0)
+    {
+        ssize_t written = write(fd, image, length);
+        if (written < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (written <= 0)
+        {
+            break;
+        }
+        image += written;
+        length -= (size_t)written;
+    }
+
+    int status = (length == 0 && fsync(fd) == 0) ? 0 : -1;
+    if (close(fd) != 0 || (status == 0 && rename(tmp_path, path) != 0))
+    {
+        status = -1;
+    }
+    if (status != 0)
+    {
+        int saved = errno;
+        unlink(tmp_path);
+        errno = saved;
+    }
+    free(tmp_path);
+    return status;
+}
+
+/* Collect the entries of the table, and fill in the header fields both
+ * kinds of file share, up to the start of the index section. */
+static int
+mht_gather(htable_t *     table,
+           mht_gather_t * gather,
+           mht_header_t * header,
+           unsigned       kind)
+{
+    size_t count = ht_size(table);
+
+    gather->sources = malloc((count ? count : 1) * sizeof(mht_source_t));
+    if (gather->sources == NULL)
+    {
+        return -1;
+    }
+    ht_for_each(table, mht_gather_entry, gather);
+
+    size_t data_size = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (gather->sources[i].key_size > UINT32_MAX
+            || gather->sources[i].value_size > UINT32_MAX)
+        {
+            free(gather->sources);
+            errno = EFBIG;
+            return -1;
+        }
+        data_size += mht_align(gather->sources[i].key_size, 8)
+                     + mht_align(gather->sources[i].value_size, 8);
+    }
+
+    memcpy(header->magic, MHT_MAGIC, sizeof(header->magic));
+    header->version        = MHT_VERSION;
+    header->byte_order     = MHT_BYTE_ORDER;
+    header->kind           = kind;
+    header->seed           = MHT_SEED;
+    header->entry_count    = count;
+    header->data_size      = data_size;
+    header->buckets_offset = mht_align(sizeof(mht_header_t), MHT_ALIGN);
+    return 0;
+}
+
+/* Lay the entries and data out after an index section ending at
+ * index_end, and allocate a zeroed image of the whole file. */
+static unsigned char *
+mht_image(mht_header_t * header, size_t index_end)
+{
+    header->entries_offset = mht_align(index_end, MHT_ALIGN);
+    header->data_offset    = mht_align(
+        header->entries_offset + header->entry_count * sizeof(mht_entry_t),
+        MHT_ALIGN);
+    header->file_size = header->data_offset + header->data_size;
+    return calloc(1, header->file_size);
+}
+
+/* Complete an image whose index section is filled in, write it to path, and
+ * free it. */
+static int
+mht_write_image(unsigned char *      image,
+                const mht_source_t * sources,
+                const size_t *       order,
+                mht_header_t *       header,
+                const char *         path)
+{
+    mht_fill(image, sources, order, header);
+
+    int status = mht_write_file(path, image, header->file_size);
+    free(image);
+    return status;
+}
+
+int
+mht_save(htable_t *   table,
+         const char * path,
+         ht_size_f    key_size,
+         ht_size_f    value_size)
+{
+    mht_gather_t gather = { NULL, 0, key_size, value_size };
+    mht_header_t header = { 0 };
+
+    if (mht_gather(table, &gather, &header, MHT_CHAINED) != 0)
+    {
+        return -1;
+    }
+
+    size_t count        = header.entry_count;
+    size_t bucket_count = 1;
+    while (bucket_count < count)
+    {
+        bucket_count *= 2;
+    }
+    header.bucket_count = bucket_count;
+
+    unsigned char * image = mht_image(
+        &header,
+        header.buckets_offset + (bucket_count + 1) * sizeof(uint64_t));
+    size_t * next  = malloc(bucket_count * sizeof(size_t));
+    size_t * order = malloc((count ? count : 1) * sizeof(size_t));
+    if (image == NULL || next == NULL || order == NULL)
+    {
+        free(image);
+        free(next);
+        free(order);
+        free(gather.sources);
+        return -1;
+    }
+
+    /* Count the entries of each bucket, turn the counts into start
+     * indices, then place every entry at its bucket's next free index. */
+    uint64_t * buckets = (uint64_t *)(image + header.buckets_offset);
+    for (size_t i = 0; i < count; i++)
+    {
+        buckets[(gather.sources[i].hash & (bucket_count - 1)) + 1]++;
+    }
+    for (size_t b = 0; b < bucket_count; b++)
+    {
+        buckets[b + 1] += buckets[b];
+        next[b] = buckets[b];
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        order[next[gather.sources[i].hash & (bucket_count - 1)]++] = i;
+    }
+    free(next);
+
+    int status = mht_write_image(image, gather.sources, order, &header, path);
+    free(order);
+    free(gather.sources);
+    return status;
+}
+
+/* Build the perfect hash over the gathered keys, and rehash them under its
+ * seed. */
+static int
+mht_perfect_index(mht_gather_t * gather, mph_index_t * index)
+{
+    size_t        count     = gather->count;
+    const void ** keys      = malloc((count ? count : 1) * sizeof(void *));
+    size_t *      key_sizes = malloc((count ? count : 1) * sizeof(size_t));
+    int           status    = -1;
+
+    if (keys && key_sizes)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            keys[i]      = gather->sources[i].key;
+            key_sizes[i] = gather->sources[i].key_size;
+        }
+        status = mph_index_create(keys, key_sizes, count, index);
+    }
+    free(keys);
+    free(key_sizes);
+
+    for (size_t i = 0; status == 0 && i < count; i++)
+    {
+        mht_source_t * source = &gather->sources[i];
+        source->hash
+            = ht_hash_bytes(source->key, source->key_size, index->seed);
+    }
+    return status;
+}
+
+int
+mht_save_perfect(htable_t *   table,
+                 const char * path,
+                 ht_size_f    key_size,
+                 ht_size_f    value_size)
+{
+    mht_gather_t gather = { NULL, 0, key_size, value_size };
+    mht_header_t header = { 0 };
+    mph_index_t  index  = { 0 };
+
+    if (mht_gather(table, &gather, &header, MHT_PERFECT) != 0)
+    {
+        return -1;
+    }
+    if (mht_perfect_index(&gather, &index) != 0)
+    {
+        free(gather.sources);
+        return -1;
+    }
+
+    size_t count        = header.entry_count;
+    size_t remap_count  = index.slot_count - index.count;
+    header.seed         = index.seed;
+    header.bucket_count = index.bucket_count;
+    header.slot_count   = index.slot_count;
+    header.remap_offset = mht_align(
+        header.buckets_offset + index.bucket_count * sizeof(uint16_t),
+        MHT_ALIGN);
+
+    unsigned char * image = mht_image(
+        &header, header.remap_offset + remap_count * sizeof(uint32_t));
+    size_t * order = malloc((count ? count : 1) * sizeof(size_t));
+    if (image == NULL || order == NULL)
+    {
+        free(image);
+        free(order);
+        free(gather.sources);
+        mph_index_free(&index);
+        return -1;
+    }
+
+    memcpy(image + header.buckets_offset,
+           index.pilots,
+           index.bucket_count * sizeof(uint16_t));
+    memcpy(image + header.remap_offset,
+           index.remap,
+           remap_count * sizeof(uint32_t));
+    for (size_t i = 0; i < count; i++)
+    {
+        order[mph_index_position(&index, gather.sources[i].hash)] = i;
+    }
+    mph_index_free(&index);
+
+    int status = mht_write_image(image, gather.sources, order, &header, path);
+    free(order);
+    free(gather.sources);
+    return status;
+}
+
+/* Whether count items of size bytes starting at offset end by limit,
+ * worked out without letting a hostile header overflow the sum. */
+static bool
+mht_section_fits(uint64_t offset, uint64_t count, size_t size, uint64_t limit)
+{
+    return offset <= limit && count <= (limit - offset) / size;
+}
+
+/* Whether the header describes sections that fit the file and each
+ * other. Every offset is first bounded by the length, so the section
+ * checks can subtract rather than add. */
+static bool
+mht_header_valid(const mht_header_t * header, size_t length, unsigned flags)
+{
+    if (length < sizeof(mht_header_t)
+        || memcmp(header->magic, MHT_MAGIC, sizeof(header->magic)) != 0
+        || header->version != MHT_VERSION
+        || header->byte_order != MHT_BYTE_ORDER
+        || header->header_checksum != mht_header_checksum(header)
+        || header->file_size != length)
+    {
+        return false;
+    }
+
+    uint64_t buckets = header->bucket_count;
+    uint64_t count   = header->entry_count;
+    if (buckets == 0 || buckets > length || count > length
+        || header->buckets_offset > length || header->entries_offset > length
+        || header->data_offset > length
+        || header->buckets_offset % MHT_ALIGN != 0
+        || header->entries_offset % MHT_ALIGN != 0
+        || header->data_offset % MHT_ALIGN != 0
+        || header->buckets_offset < sizeof(mht_header_t)
+        || !mht_section_fits(header->entries_offset,
+                             count,
+                             sizeof(mht_entry_t),
+                             header->data_offset)
+        || header->data_size != length - header->data_offset)
+    {
+        return false;
+    }
+
+    if (header->kind == MHT_CHAINED)
+    {
+        if ((buckets & (buckets - 1)) != 0
+            || !mht_section_fits(header->buckets_offset,
+                                 buckets + 1,
+                                 sizeof(uint64_t),
+                                 header->entries_offset))
+        {
+            return false;
+        }
+    }
+    else if (header->kind != MHT_PERFECT || count > UINT32_MAX
+             || buckets > UINT32_MAX || header->slot_count == 0
+             || header->slot_count < count || header->remap_offset > length
+             || header->remap_offset % MHT_ALIGN != 0
+             || !mht_section_fits(header->buckets_offset,
+                                  buckets,
+                                  sizeof(uint16_t),
+                                  header->remap_offset)
+             || !mht_section_fits(header->remap_offset,
+                                  header->slot_count - count,
+                                  sizeof(uint32_t),
+                                  header->entries_offset))
+    {
+        return false;
+    }
+
+    if ((flags & MHT_VERIFY)
+        && header->body_checksum
+               != ht_hash_bytes((const unsigned char *)header
+                                    + sizeof(mht_header_t),
+                                length - sizeof(mht_header_t),
+                                MHT_SEED))
+    {
+        return false;
+    }
+    return true;
+}
+
+mhtable_t *
+mht_open(const char * path, unsigned flags)
+{
+    struct stat st;
+    mhtable_t * table = NULL;
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return NULL;
+    }
+    if (fstat(fd, &st) != 0 || st.st_size <= 0)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    size_t length = (size_t)st.st_size;
+    void * base   = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+    {
+        return NULL;
+    }
+
+    const mht_header_t * header = base;
+    if (!mht_header_valid(header, length, flags)
+        || (table = malloc(sizeof(mhtable_t))) == NULL)
+    {
+        munmap(base, length);
+        return NULL;
+    }
+
+    table->base    = base;
+    table->length  = length;
+    table->header  = header;
+    table->buckets = (const uint64_t *)(table->base + header->buckets_offset);
+    if (header->kind == MHT_PERFECT)
+    {
+        table->index.seed         = header->seed;
+        table->index.count        = (uint32_t)header->entry_count;
+        table->index.slot_count   = header->slot_count;
+        table->index.bucket_count = (uint32_t)header->bucket_count;
+        table->index.pilots
+            = (const uint16_t *)(table->base + header->buckets_offset);
+        table->index.remap
+            = (const uint32_t *)(table->base + header->remap_offset);
+    }
+    table->entries
+        = (const mht_entry_t *)(table->base + header->entries_offset);
+    table->data = table->base + header->data_offset;
+    return table;
+}
+
+void
+mht_close(mhtable_t ** table)
+{
+    if (!table || !*table)
+    {
+        return;
+    }
+
+    munmap((void *)(*table)->base, (*table)->length);
+    free(*table);
+    *table = NULL;
+}
+
+/* The value of entry i if it holds the key, else NULL. */
+static const void *
+mht_match(const mhtable_t * table,
+          uint64_t          i,
+          uint64_t          hash,
+          const void *      key,
+          size_t            key_size,
+          size_t *          value_size)
+{
+    const mht_header_t * header = table->header;
+    const mht_entry_t *  entry  = &table->entries[i];
+
+    if (entry->hash != hash || entry->key_size != key_size
+        || key_size > header->data_size
+        || entry->key_offset > header->data_size - key_size
+        || entry->value_size > header->data_size
+        || entry->value_offset > header->data_size - entry->value_size
+        || memcmp(table->data + entry->key_offset, key, key_size) != 0)
+    {
+        return NULL;
+    }
+
+    if (value_size)
+    {
+        *value_size = entry->value_size;
+    }
+    return table->data + entry->value_offset;
+}
+
+const void *
+mht_get(const mhtable_t * table,
+        const void *      key,
+        size_t            key_size,
+        size_t *          value_size)
+{
+    const mht_header_t * header = table->header;
+    uint64_t hash = ht_hash_bytes(key, key_size, header->seed);
+
+    if (header->kind == MHT_PERFECT)
+    {
+        const mph_index_t * index = &table->index;
+        uint64_t            slot  = mph_index_slot(index, hash);
+        uint64_t            position
+            = slot < index->count ? slot : index->remap[slot - index->count];
+
+        if (position >= header->entry_count)
+        {
+            return NULL;
+        }
+        return mht_match(table, position, hash, key, key_size, value_size);
+    }
+
+    uint64_t bucket = hash & (header->bucket_count - 1);
+    uint64_t first  = table->buckets[bucket];
+    uint64_t last   = table->buckets[bucket + 1];
+
+    if (last > header->entry_count)
+    {
+        return NULL;
+    }
+
+    for (uint64_t i = first; i < last; i++)
+    {
+        const void * value
+            = mht_match(table, i, hash, key, key_size, value_size);
+        if (value)
+        {
+            return value;
+        }
+    }
+    return NULL;
+}
+
+const char *
+mht_get_string(const mhtable_t * table, const char * key)
+{
+    size_t       value_size = 0;
+    const char * value
+        = mht_get(table, key, ht_string_size(key), &value_size);
+
+    /* Only hand out values that end within their bytes. */
+    if (value == NULL || value_size == 0 || value[value_size - 1] != '\0')
+    {
+        return NULL;
+    }
+    return value;
+}
+
+size_t
+mht_size(const mhtable_t * table)
+{
+    return table->header->entry_count;
+}
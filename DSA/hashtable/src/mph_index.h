@@ -0,0 +1,48 @@
+/** @file mph_index.h
+ *
+ * @brief Internal interface of the minimal perfect hash index shared by
+ *        mphash_t and the perfect table files of mapped_hashtable.h.
+ *
+ * The index maps count distinct keys onto 0 .. count - 1. It is plain data
+ * with no pointers of its own but the two arrays, so a mapped file can
+ * point them into the mapping.
+ *
+ */
+
+#ifndef MPH_INDEX_H
+#define MPH_INDEX_H
+
+#include "../include/hashtable.h"
+
+typedef struct mph_index
+{
+    uint64_t         seed;         /* Keys are hashed with ht_hash_bytes(). */
+    uint32_t         count;        /* Keys, and positions handed out. */
+    uint32_t         slot_count;   /* Slots the pilots place keys in. */
+    uint32_t         bucket_count; /* Pilots. */
+    const uint16_t * pilots;
+    const uint32_t * remap; /* Positions of slots count .. slot_count - 1. */
+} mph_index_t;
+
+/**
+ * @brief Build an index over the keys, owning its arrays.
+ *
+ * @return 0 on success, -1 with errno set to ENOMEM, to EINVAL if two keys
+ *         are equal, or to EAGAIN if no seed worked
+ */
+int mph_index_create(const void * const * keys,
+                     const size_t *       key_sizes,
+                     size_t               count,
+                     mph_index_t *        index);
+
+/** @brief Free the arrays of an index made by mph_index_create(). */
+void mph_index_free(mph_index_t * index);
+
+/** @brief Slot of a key's hash, before remapping. */
+uint32_t mph_index_slot(const mph_index_t * index, uint64_t hash);
+
+/** @brief Position of a member key's hash; arbitrary for other keys, and
+ *         not below count for an empty index. */
+uint32_t mph_index_position(const mph_index_t * index, uint64_t hash);
+
+#endif
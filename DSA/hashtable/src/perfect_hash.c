@@ -0,0 +1,451 @@
+/** @file perfect_hash.c
+ *
+ * @brief Construction and lookup of minimal perfect hash indices.
+ *
+ * Each key hashes to one bucket, and each bucket is given a pilot: the
+ * smallest value that, mixed into the hashes of the bucket's keys, sends
+ * all of them to slots no earlier bucket took. Buckets are placed largest
+ * first, while the table is still empty enough for big ones to fit; the
+ * single key buckets left for last only need one free slot among the
+ * remaining one percent.
+ *
+ * The slots outnumber the keys by one percent, which keeps the last pilot
+ * searches short. The keys that end up in the slots past count are given
+ * the free positions below it through the remap array.
+ *
+ * When a bucket finds no pilot, or two keys share a hash, the whole build
+ * is retried under another seed.
+ *
+ */
+
+#include "../include/perfect_hash.h"
+#include "mph_index.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MPH_KEYS_PER_BUCKET 4
+#define MPH_SLACK 99 /* One extra slot per MPH_SLACK keys. */
+#define MPH_MAX_KEYS ((1ULL << 32) - (1ULL << 26))
+#define MPH_ATTEMPTS 16
+#define MPH_SEED 0x13198A2E03707344ULL
+
+struct mphash
+{
+    mph_index_t index;
+};
+
+/* Working arrays of a build, allocated once for every seed tried. */
+typedef struct mph_build
+{
+    const void * const * keys;
+    const size_t *       key_sizes;
+    uint64_t *           hashes;  /* Of each key, in key order. */
+    uint64_t *           grouped; /* The same hashes, grouped by bucket. */
+    uint32_t *           members; /* Key of each grouped hash. */
+    uint32_t *           starts;  /* First grouped index of each bucket. */
+    uint32_t *           order;   /* Buckets, largest first. */
+    uint64_t *           taken;   /* One bit per slot. */
+    uint16_t *           pilots;
+} mph_build_t;
+
+/* Maps a 32 bit value evenly onto 0 .. range - 1 without a division. */
+static uint32_t
+mph_range(uint32_t value, uint32_t range)
+{
+    return (uint32_t)(((uint64_t)value * range) >> 32);
+}
+
+static uint64_t
+mph_mix(uint64_t value)
+{
+    value ^= value >> 33;
+    value *= 0xFF51AFD7ED558CCDULL;
+    value ^= value >> 33;
+    value *= 0xC4CEB9FE1A85EC53ULL;
+    value ^= value >> 33;
+    return value;
+}
+
+static uint32_t
+mph_bucket(uint64_t hash, uint32_t bucket_count)
+{
+    return mph_range((uint32_t)(hash >> 32), bucket_count);
+}
+
+static uint32_t
+mph_place(uint64_t hash, uint32_t pilot, uint32_t slot_count)
+{
+    uint64_t mixed = mph_mix(hash ^ (pilot + 1) * 0x9E3779B97F4A7C15ULL);
+    return mph_range((uint32_t)(mixed >> 32), slot_count);
+}
+
+uint32_t
+mph_index_slot(const mph_index_t * index, uint64_t hash)
+{
+    uint32_t bucket = mph_bucket(hash, index->bucket_count);
+    return mph_place(hash, index->pilots[bucket], index->slot_count);
+}
+
+uint32_t
+mph_index_position(const mph_index_t * index, uint64_t hash)
+{
+    uint32_t slot = mph_index_slot(index, hash);
+    return slot < index->count ? slot : index->remap[slot - index->count];
+}
+
+/* Hash every key under the seed and group the hashes by bucket. */
+static void
+mph_group(mph_build_t * build, const mph_index_t * index)
+{
+    uint32_t * starts = build->starts;
+
+    memset(starts, 0, (index->bucket_count + 1) * sizeof(uint32_t));
+    for (uint32_t i = 0; i < index->count; i++)
+    {
+        uint64_t hash
+            = ht_hash_bytes(build->keys[i], build->key_sizes[i], index->seed);
+        build->hashes[i] = hash;
+        starts[mph_bucket(hash, index->bucket_count) + 1]++;
+    }
+    for (uint32_t b = 0; b < index->bucket_count; b++)
+    {
+        starts[b + 1] += starts[b];
+    }
+
+    /* Place each hash at the end of its bucket's run, then shift the start
+     * indices back to where the runs begin. */
+    for (uint32_t i = 0; i < index->count; i++)
+    {
+        uint32_t bucket = mph_bucket(build->hashes[i], index->bucket_count);
+        uint32_t at     = starts[bucket]++;
+        build->grouped[at] = build->hashes[i];
+        build->members[at] = i;
+    }
+    memmove(starts + 1, starts, index->bucket_count * sizeof(uint32_t));
+    starts[0] = 0;
+}
+
+/* Order the buckets by decreasing size with a counting sort. Returns the
+ * size of the largest bucket, or 0 if memory ran out. */
+static uint32_t
+mph_sort_buckets(mph_build_t * build, const mph_index_t * index)
+{
+    uint32_t largest = 0;
+    for (uint32_t b = 0; b < index->bucket_count; b++)
+    {
+        uint32_t size = build->starts[b + 1] - build->starts[b];
+        largest       = size > largest ? size : largest;
+    }
+
+    uint32_t * firsts = calloc((size_t)largest + 2, sizeof(uint32_t));
+    if (firsts == NULL)
+    {
+        return 0;
+    }
+    for (uint32_t b = 0; b < index->bucket_count; b++)
+    {
+        firsts[largest - (build->starts[b + 1] - build->starts[b]) + 1]++;
+    }
+    for (uint32_t s = 0; s <= largest; s++)
+    {
+        firsts[s + 1] += firsts[s];
+    }
+    for (uint32_t b = 0; b < index->bucket_count; b++)
+    {
+        uint32_t size = build->starts[b + 1] - build->starts[b];
+        build->order[firsts[largest - size]++] = b;
+    }
+    free(firsts);
+    return largest ? largest : 1;
+}
+
+/* Whether the keys of a bucket have distinct hashes. Sets errno to EINVAL
+ * when two of them are the same key, to EAGAIN when they only collide. */
+static bool
+mph_distinct(const mph_build_t * build, uint32_t first, uint32_t last)
+{
+    for (uint32_t i = first + 1; i < last; i++)
+    {
+        for (uint32_t j = first; j < i; j++)
+        {
+            if (build->grouped[i] != build->grouped[j])
+            {
+                continue;
+            }
+
+            uint32_t a = build->members[i];
+            uint32_t b = build->members[j];
+            bool     same
+                = build->key_sizes[a] == build->key_sizes[b]
+                  && memcmp(build->keys[a], build->keys[b], build->key_sizes[a])
+                         == 0;
+            errno = same ? EINVAL : EAGAIN;
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Find the first pilot that sends every key of the bucket to a free slot,
+ * distinct from the slots of the other keys, and take those slots. */
+static bool
+mph_place_bucket(mph_build_t *       build,
+                 const mph_index_t * index,
+                 uint32_t            bucket,
+                 uint32_t *          slots)
+{
+    const uint64_t * hashes = build->grouped + build->starts[bucket];
+    uint32_t size = build->starts[bucket + 1] - build->starts[bucket];
+
+    for (uint32_t pilot = 0; pilot <= UINT16_MAX; pilot++)
+    {
+        uint32_t k = 0;
+        for (; k < size; k++)
+        {
+            uint32_t slot = mph_place(hashes[k], pilot, index->slot_count);
+            uint32_t j    = 0;
+            if (build->taken[slot / 64] & (1ULL << (slot % 64)))
+            {
+                break;
+            }
+            while (j < k && slots[j] != slot)
+            {
+                j++;
+            }
+            if (j < k)
+            {
+                break;
+            }
+            slots[k] = slot;
+        }
+
+        if (k == size)
+        {
+            for (k = 0; k < size; k++)
+            {
+                build->taken[slots[k] / 64] |= 1ULL << (slots[k] % 64);
+            }
+            build->pilots[bucket] = (uint16_t)pilot;
+            return true;
+        }
+    }
+    return false;
+}
+
+/* One try at placing every bucket under index->seed. Returns 0, or -1 with
+ * errno set to ENOMEM, EINVAL or EAGAIN. */
+static int
+mph_attempt(mph_build_t * build, const mph_index_t * index)
+{
+    mph_group(build, index);
+
+    uint32_t largest = mph_sort_buckets(build, index);
+    if (largest == 0)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+    uint32_t * slots = malloc(largest * sizeof(uint32_t));
+    if (slots == NULL)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    memset(build->taken, 0, (index->slot_count + 63) / 64 * sizeof(uint64_t));
+    memset(build->pilots, 0, index->bucket_count * sizeof(uint16_t));
+
+    int status = 0;
+    for (uint32_t i = 0; i < index->bucket_count && status == 0; i++)
+    {
+        uint32_t bucket = build->order[i];
+        uint32_t first  = build->starts[bucket];
+        uint32_t last   = build->starts[bucket + 1];
+        if (first == last)
+        {
+            break; /* Only empty buckets are left. */
+        }
+        if (!mph_distinct(build, first, last))
+        {
+            status = -1;
+        }
+        else if (!mph_place_bucket(build, index, bucket, slots))
+        {
+            errno  = EAGAIN;
+            status = -1;
+        }
+    }
+    free(slots);
+    return status;
+}
+
+/* Give each taken slot past count one of the free positions below it. */
+static void
+mph_fill_remap(const mph_build_t * build,
+               const mph_index_t * index,
+               uint32_t *          remap)
+{
+    const uint64_t * taken         = build->taken;
+    uint32_t         free_position = 0;
+
+    for (uint32_t slot = index->count; slot < index->slot_count; slot++)
+    {
+        if (!(taken[slot / 64] & (1ULL << (slot % 64))))
+        {
+            continue;
+        }
+        while (taken[free_position / 64] & (1ULL << (free_position % 64)))
+        {
+            free_position++;
+        }
+        remap[slot - index->count] = free_position++;
+    }
+}
+
+static void
+mph_build_free(mph_build_t * build)
+{
+    free(build->hashes);
+    free(build->grouped);
+    free(build->members);
+    free(build->starts);
+    free(build->order);
+    free(build->taken);
+}
+
+int
+mph_index_create(const void * const * keys,
+                 const size_t *       key_sizes,
+                 size_t               count,
+                 mph_index_t *        index)
+{
+    if (count >= MPH_MAX_KEYS)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    memset(index, 0, sizeof(mph_index_t));
+    index->count        = (uint32_t)count;
+    index->slot_count   = (uint32_t)(count + count / MPH_SLACK + 1);
+    index->bucket_count = (uint32_t)((count + MPH_KEYS_PER_BUCKET - 1)
+                                     / MPH_KEYS_PER_BUCKET);
+    index->bucket_count = index->bucket_count ? index->bucket_count : 1;
+
+    size_t      keys_size = count ? count : 1;
+    mph_build_t build     = { 0 };
+    build.keys            = keys;
+    build.key_sizes       = key_sizes;
+    build.hashes          = malloc(keys_size * sizeof(uint64_t));
+    build.grouped         = malloc(keys_size * sizeof(uint64_t));
+    build.members         = malloc(keys_size * sizeof(uint32_t));
+    build.starts  = malloc((index->bucket_count + 1ULL) * sizeof(uint32_t));
+    build.order   = malloc(index->bucket_count * sizeof(uint32_t));
+    build.taken   = malloc((index->slot_count + 63ULL) / 64 * sizeof(uint64_t));
+    build.pilots  = malloc(index->bucket_count * sizeof(uint16_t));
+    uint32_t * remap
+        = calloc(index->slot_count - index->count, sizeof(uint32_t));
+
+    int status = -1;
+    if (build.hashes && build.grouped && build.members && build.starts
+        && build.order && build.taken && build.pilots && remap)
+    {
+        for (uint64_t attempt = 0; attempt < MPH_ATTEMPTS; attempt++)
+        {
+            index->seed = mph_mix(MPH_SEED + attempt);
+            status      = mph_attempt(&build, index);
+            if (status == 0 || errno != EAGAIN)
+            {
+                break;
+            }
+        }
+    }
+    else
+    {
+        errno = ENOMEM;
+    }
+
+    if (status == 0)
+    {
+        mph_fill_remap(&build, index, remap);
+        index->pilots = build.pilots;
+        index->remap  = remap;
+    }
+    else
+    {
+        free(build.pilots);
+        free(remap);
+    }
+    mph_build_free(&build);
+    return status;
+}
+
+void
+mph_index_free(mph_index_t * index)
+{
+    free((void *)index->pilots);
+    free((void *)index->remap);
+    index->pilots = NULL;
+    index->remap  = NULL;
+}
+
+mphash_t *
+mph_create(const void * const * keys, const size_t * key_sizes, size_t count)
+{
+    mphash_t * mph = malloc(sizeof(mphash_t));
+    if (mph == NULL)
+    {
+        return NULL;
+    }
+    if (mph_index_create(keys, key_sizes, count, &mph->index) != 0)
+    {
+        free(mph);
+        return NULL;
+    }
+    return mph;
+}
+
+void
+mph_destroy(mphash_t ** mph)
+{
+    if (!mph || !*mph)
+    {
+        return;
+    }
+
+    mph_index_free(&(*mph)->index);
+    free(*mph);
+    *mph = NULL;
+}
+
+size_t
+mph_index(const mphash_t * mph, const void * key, size_t key_size)
+{
+    const mph_index_t * index = &mph->index;
+    if (index->count == 0)
+    {
+        return MPH_NO_INDEX;
+    }
+    return mph_index_position(index,
+                              ht_hash_bytes(key, key_size, index->seed));
+}
+
+size_t
+mph_size(const mphash_t * mph)
+{
+    return mph->index.count;
+}
+
+double
+mph_bits_per_key(const mphash_t * mph)
+{
+    const mph_index_t * index = &mph->index;
+    if (index->count == 0)
+    {
+        return 0.0;
+    }
+    return (index->bucket_count * 16.0
+            + (index->slot_count - index->count) * 32.0)
+           / index->count;
+}
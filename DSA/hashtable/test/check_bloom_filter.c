@@ -0,0 +1,175 @@
+/** @file check_bloom_filter.c
+ *
+ * @brief Tests for the blocked Bloom filter: no false negatives, measured
+ *        false positive rates close to the requested and estimated ones,
+ *        and estimates that stay sound when a filter is filled far past
+ *        the count it was sized for.
+ *
+ * Build and run from DSA/hashtable with
+ *
+ *     gcc -std=c18 -O2 -D_DEFAULT_SOURCE -Iinclude src/bloom_filter.c \
+ *         test/check_bloom_filter.c -lcheck -lm -lrt -lsubunit -pthread \
+ *         -o check_bloom_filter
+ *     ./check_bloom_filter
+ *
+ */
+
+#include <check.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "../include/bloom_filter.h"
+
+#define KEY_COUNT 100000
+#define PROBES 1000000
+
+/* Keys added are hashes with the top bit clear, probes have it set, so no
+ * probe was ever added. */
+#define PROBE_BIT (1ULL << 63)
+
+/* Fraction of PROBES keys never added that the filter may contain. */
+static double
+measured_rate(const bloom_t * filter)
+{
+    size_t positives = 0;
+    for (uint64_t i = 0; i < PROBES; i++)
+    {
+        positives += bf_may_contain(filter, PROBE_BIT | i);
+    }
+    return (double)positives / PROBES;
+}
+
+static void
+add_keys(bloom_t * filter, uint64_t first, uint64_t last)
+{
+    for (uint64_t key = first; key < last; key++)
+    {
+        bf_add(filter, key);
+    }
+}
+
+static void
+check_rate(double rate)
+{
+    bloom_t * filter = bf_create(KEY_COUNT, rate);
+
+    ck_assert_ptr_nonnull(filter);
+    add_keys(filter, 0, KEY_COUNT);
+    for (uint64_t key = 0; key < KEY_COUNT; key++)
+    {
+        ck_assert(bf_may_contain(filter, key));
+    }
+
+    /* The filter is sized for the rate, and the estimate matches what is
+     * measured to within the noise of a million probes. */
+    double estimate = bf_false_positive_rate(filter, KEY_COUNT);
+    double measured = measured_rate(filter);
+    ck_assert(estimate <= rate * 1.05);
+    ck_assert(estimate >= rate * 0.5);
+    ck_assert(measured <= estimate * 1.25);
+    ck_assert(measured >= estimate * 0.75);
+    bf_destroy(&filter);
+    ck_assert_ptr_null(filter);
+}
+
+START_TEST(test_rates_match_request)
+{
+    check_rate(0.1);
+    check_rate(0.01);
+    check_rate(0.001);
+}
+END_TEST
+
+START_TEST(test_overfilled_filter)
+{
+    bloom_t * filter = bf_create(1000, 0.01);
+    double    last   = 0.0;
+
+    ck_assert_ptr_nonnull(filter);
+
+    /* Estimates grow with the count and approach 1, including at loads of
+     * thousands of keys per block, where a Poisson weight computed
+     * directly underflows. Near 1 they are only good to rounding. */
+    for (size_t count = 1000; count <= 100000000; count *= 10)
+    {
+        double estimate = bf_false_positive_rate(filter, count);
+        ck_assert(isfinite(estimate));
+        ck_assert(estimate >= last - 1e-6);
+        ck_assert(estimate <= 1.0);
+        last = estimate;
+    }
+    ck_assert(last > 0.99);
+
+    /* Filled 20 times over, the measured rate still matches. */
+    add_keys(filter, 0, 20 * 1000);
+    double estimate = bf_false_positive_rate(filter, 20 * 1000);
+    double measured = measured_rate(filter);
+    ck_assert(estimate > 0.5);
+    ck_assert(fabs(measured - estimate) < 0.05);
+    bf_destroy(&filter);
+}
+END_TEST
+
+START_TEST(test_empty_and_cleared_filters)
+{
+    bloom_t * filter = bf_create(KEY_COUNT, 0.01);
+
+    ck_assert_ptr_nonnull(filter);
+    ck_assert(bf_false_positive_rate(filter, 0) == 0.0);
+    ck_assert(measured_rate(filter) == 0.0);
+
+    add_keys(filter, 0, KEY_COUNT);
+    bf_clear(filter);
+    ck_assert(measured_rate(filter) == 0.0);
+    ck_assert(!bf_may_contain(filter, 0));
+    ck_assert_uint_ge(bf_size(filter) * 8, KEY_COUNT);
+    ck_assert_uint_ge(bf_hash_count(filter), 1);
+    ck_assert_uint_le(bf_hash_count(filter), BF_MAX_HASHES);
+    bf_destroy(&filter);
+    bf_destroy(NULL);
+}
+END_TEST
+
+START_TEST(test_create_rejects_bad_rates)
+{
+    ck_assert_ptr_null(bf_create(KEY_COUNT, 0.0));
+    ck_assert_ptr_null(bf_create(KEY_COUNT, 0.9));
+    ck_assert_ptr_null(bf_create(KEY_COUNT, NAN));
+
+    bloom_t * filter = bf_create(0, 0.01);
+    ck_assert_ptr_nonnull(filter);
+    ck_assert_uint_gt(bf_size(filter), 0);
+    bf_destroy(&filter);
+}
+END_TEST
+
+Suite *
+check_bloom_filter_suite(void)
+{
+    Suite * suite   = suite_create("bloom_filter_test");
+    TCase * tc_core = tcase_create("Core");
+    TCase * tc_rate = tcase_create("Rates");
+
+    tcase_add_test(tc_core, test_empty_and_cleared_filters);
+    tcase_add_test(tc_core, test_create_rejects_bad_rates);
+    tcase_add_test(tc_rate, test_rates_match_request);
+    tcase_add_test(tc_rate, test_overfilled_filter);
+    tcase_set_timeout(tc_rate, 60);
+
+    suite_add_tcase(suite, tc_core);
+    suite_add_tcase(suite, tc_rate);
+    return suite;
+}
+
+int
+main(void)
+{
+    SRunner * runner = srunner_create(check_bloom_filter_suite());
+
+    srunner_run_all(runner, CK_VERBOSE);
+
+    int no_failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+    return (no_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
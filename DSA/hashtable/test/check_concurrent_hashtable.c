@@ -0,0 +1,387 @@
+/** @file check_concurrent_hashtable.c
+ *
+ * @brief Tests for the concurrent hashtable, with writers inserting,
+ *        replacing and deleting while the table migrates to larger bucket
+ *        arrays and readers look keys up.
+ *
+ * Build and run from DSA/hashtable with
+ *
+ *     gcc -std=c18 -O2 -D_DEFAULT_SOURCE -pthread -Iinclude \
+ *         src/concurrent_hashtable.c test/check_concurrent_hashtable.c \
+ *         -lcheck -lm -lrt -lsubunit -o check_concurrent_hashtable
+ *     ./check_concurrent_hashtable
+ *
+ * Every table starts with room for one entry, so the inserts below force
+ * a migration every time the entry count doubles.
+ *
+ */
+
+#include <check.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "../include/concurrent_hashtable.h"
+
+#define WRITERS 4
+#define READERS 4
+#define KEYS_PER_WRITER 20000
+#define STABLE_KEYS 1000
+#define POISON 0xDEADDEADDEADDEADULL
+
+/* Keys are integers stored in the key pointers; values are allocated and
+ * hold their key, so a reader can tell a live value from a released one. */
+#define KEY(n) ((void *)(uintptr_t)(n))
+
+typedef struct
+{
+    chtable_t * table;
+    uint64_t    first; /* First key of the writer's range. */
+    uint64_t    count;
+    atomic_bool done;  /* Set once every writer has finished. */
+    atomic_long errors;
+} Shared_T;
+
+typedef struct
+{
+    Shared_T * shared;
+    uint64_t   first;
+} Writer_T;
+
+static uint64_t
+key_hash(const void * key)
+{
+    uint64_t x = (uint64_t)(uintptr_t)key;
+    x ^= x >> 33;
+    x *= 0xFF51AFD7ED558CCDULL;
+    x ^= x >> 33;
+    return x;
+}
+
+static bool
+key_eq(const void * lhs, const void * rhs)
+{
+    return lhs == rhs;
+}
+
+static void
+value_free(void * value)
+{
+    if (value)
+    {
+        *(uint64_t *)value = POISON;
+        free(value);
+    }
+}
+
+static uint64_t *
+value_new(uint64_t key)
+{
+    uint64_t * value = malloc(sizeof(uint64_t));
+    ck_assert_ptr_nonnull(value);
+    *value = key;
+    return value;
+}
+
+static chtable_t *
+table_new(void)
+{
+    chtable_t * table = cht_create(key_hash, key_eq, NULL, value_free, 1);
+    ck_assert_ptr_nonnull(table);
+    return table;
+}
+
+static void
+set_key(chtable_t * table, uint64_t key)
+{
+    uint64_t * value = value_new(key);
+    ck_assert_int_eq(cht_set(table, KEY(key), value), 0);
+}
+
+/* Whether key maps to a live value holding key. */
+static bool
+holds_key(const chtable_t * table, uint64_t key)
+{
+    cht_read_lock();
+    const uint64_t * value = cht_get(table, KEY(key));
+    bool             valid = value != NULL && *value == key;
+    cht_read_unlock();
+    return valid;
+}
+
+static void *
+insert_range(void * arg)
+{
+    Writer_T * writer = arg;
+
+    for (uint64_t i = 0; i < writer->shared->count; i++)
+    {
+        set_key(writer->shared->table, writer->first + i);
+    }
+    return NULL;
+}
+
+static void *
+replace_range(void * arg)
+{
+    Writer_T * writer = arg;
+
+    for (int round = 0; round < 4; round++)
+    {
+        for (uint64_t i = 0; i < writer->shared->count; i++)
+        {
+            set_key(writer->shared->table, writer->first + i);
+        }
+    }
+    return NULL;
+}
+
+static void *
+delete_range(void * arg)
+{
+    Writer_T * writer = arg;
+
+    for (uint64_t i = 0; i < writer->shared->count; i++)
+    {
+        if (cht_delete(writer->shared->table, KEY(writer->first + i)) != 0)
+        {
+            atomic_fetch_add(&writer->shared->errors, 1);
+        }
+    }
+    return NULL;
+}
+
+/* Look up the stable keys, 1 to STABLE_KEYS, until the writers are done.
+ * Each must be found with its own value throughout. */
+static void *
+read_stable(void * arg)
+{
+    Shared_T * shared = arg;
+
+    while (!atomic_load(&shared->done))
+    {
+        for (uint64_t key = 1; key <= STABLE_KEYS; key++)
+        {
+            if (!holds_key(shared->table, key))
+            {
+                atomic_fetch_add(&shared->errors, 1);
+            }
+        }
+    }
+    return NULL;
+}
+
+/* Look up the writers' keys while they change. A key may be absent, but a
+ * value that is found must be live and belong to it. */
+static void *
+read_changing(void * arg)
+{
+    Shared_T * shared = arg;
+    uint64_t   last   = shared->first + WRITERS * shared->count;
+
+    while (!atomic_load(&shared->done))
+    {
+        for (uint64_t key = shared->first; key < last; key += 7)
+        {
+            cht_read_lock();
+            const uint64_t * value = cht_get(shared->table, KEY(key));
+            if (value != NULL && *value != key)
+            {
+                atomic_fetch_add(&shared->errors, 1);
+            }
+            cht_read_unlock();
+        }
+    }
+    return NULL;
+}
+
+/* Run one writer per range and READERS readers until the writers finish. */
+static void
+run_threads(Shared_T * shared,
+            void * (*write)(void *),
+            void * (*read)(void *))
+{
+    pthread_t writers[WRITERS];
+    pthread_t readers[READERS];
+    Writer_T  ranges[WRITERS];
+
+    atomic_store(&shared->done, false);
+    for (int i = 0; i < READERS; i++)
+    {
+        ck_assert_int_eq(pthread_create(&readers[i], NULL, read, shared), 0);
+    }
+    for (int i = 0; i < WRITERS; i++)
+    {
+        ranges[i].shared = shared;
+        ranges[i].first  = shared->first + (uint64_t)i * shared->count;
+        ck_assert_int_eq(
+            pthread_create(&writers[i], NULL, write, &ranges[i]), 0);
+    }
+    for (int i = 0; i < WRITERS; i++)
+    {
+        ck_assert_int_eq(pthread_join(writers[i], NULL), 0);
+    }
+    atomic_store(&shared->done, true);
+    for (int i = 0; i < READERS; i++)
+    {
+        ck_assert_int_eq(pthread_join(readers[i], NULL), 0);
+    }
+}
+
+static void
+shared_init(Shared_T * shared, chtable_t * table)
+{
+    shared->table = table;
+    shared->first = STABLE_KEYS + 1;
+    shared->count = KEYS_PER_WRITER;
+    atomic_init(&shared->done, false);
+    atomic_init(&shared->errors, 0);
+}
+
+START_TEST(test_insert_during_migration)
+{
+    Shared_T    shared;
+    chtable_t * table = table_new();
+
+    shared_init(&shared, table);
+    for (uint64_t key = 1; key <= STABLE_KEYS; key++)
+    {
+        set_key(table, key);
+    }
+
+    run_threads(&shared, insert_range, read_stable);
+
+    ck_assert_int_eq(atomic_load(&shared.errors), 0);
+    ck_assert_uint_eq(cht_size(table),
+                      STABLE_KEYS + WRITERS * KEYS_PER_WRITER);
+    for (uint64_t key = 1; key < shared.first + WRITERS * shared.count; key++)
+    {
+        ck_assert(holds_key(table, key));
+    }
+    cht_destroy(&table);
+    ck_assert_ptr_null(table);
+}
+END_TEST
+
+START_TEST(test_delete_during_migration)
+{
+    Shared_T    shared;
+    chtable_t * table = table_new();
+
+    /* The writers delete their own ranges while one more thread inserts
+     * above them, keeping the table growing throughout. */
+    shared_init(&shared, table);
+    for (uint64_t key = 1; key < shared.first + WRITERS * shared.count; key++)
+    {
+        set_key(table, key);
+    }
+
+    Shared_T grower;
+    shared_init(&grower, table);
+    grower.first = shared.first + WRITERS * shared.count;
+    grower.count = WRITERS * KEYS_PER_WRITER;
+
+    pthread_t grow_thread;
+    Writer_T  grow_range = { &grower, grower.first };
+    ck_assert_int_eq(
+        pthread_create(&grow_thread, NULL, insert_range, &grow_range), 0);
+    run_threads(&shared, delete_range, read_stable);
+    ck_assert_int_eq(pthread_join(grow_thread, NULL), 0);
+
+    ck_assert_int_eq(atomic_load(&shared.errors), 0);
+    ck_assert_uint_eq(cht_size(table), STABLE_KEYS + grower.count);
+    for (uint64_t key = 1; key <= STABLE_KEYS; key++)
+    {
+        ck_assert(holds_key(table, key));
+    }
+    for (uint64_t key = shared.first; key < grower.first; key++)
+    {
+        ck_assert(!cht_contains(table, KEY(key)));
+        ck_assert_int_eq(cht_delete(table, KEY(key)), -1);
+    }
+    for (uint64_t key = grower.first; key < grower.first + grower.count; key++)
+    {
+        ck_assert(holds_key(table, key));
+    }
+    cht_destroy(&table);
+}
+END_TEST
+
+START_TEST(test_replace_while_reading)
+{
+    Shared_T    shared;
+    chtable_t * table = table_new();
+
+    /* Readers dereference values in their read sections while writers
+     * replace them, so any value released too early reads as POISON. */
+    shared_init(&shared, table);
+    run_threads(&shared, replace_range, read_changing);
+
+    ck_assert_int_eq(atomic_load(&shared.errors), 0);
+    ck_assert_uint_eq(cht_size(table), WRITERS * KEYS_PER_WRITER);
+    uint64_t last = shared.first + WRITERS * shared.count;
+    for (uint64_t key = shared.first; key < last; key++)
+    {
+        ck_assert(holds_key(table, key));
+    }
+    cht_destroy(&table);
+}
+END_TEST
+
+START_TEST(test_single_thread_basics)
+{
+    chtable_t * table = table_new();
+
+    ck_assert_uint_eq(cht_size(table), 0);
+    ck_assert_ptr_null(cht_get(table, KEY(1)));
+    ck_assert_int_eq(cht_delete(table, KEY(1)), -1);
+
+    set_key(table, 1);
+    set_key(table, 1);
+    ck_assert_uint_eq(cht_size(table), 1);
+    ck_assert(holds_key(table, 1));
+
+    ck_assert_int_eq(cht_set(table, KEY(2), NULL), 0);
+    ck_assert(cht_contains(table, KEY(2)));
+    ck_assert_ptr_null(cht_get(table, KEY(2)));
+
+    ck_assert_int_eq(cht_delete(table, KEY(1)), 0);
+    ck_assert(!cht_contains(table, KEY(1)));
+    ck_assert_uint_eq(cht_size(table), 1);
+
+    cht_destroy(&table);
+    cht_destroy(&table);
+    cht_destroy(NULL);
+}
+END_TEST
+
+Suite *
+check_concurrent_hashtable_suite(void)
+{
+    Suite * suite     = suite_create("concurrent_hashtable_test");
+    TCase * tc_core   = tcase_create("Core");
+    TCase * tc_thread = tcase_create("Migration");
+
+    tcase_add_test(tc_core, test_single_thread_basics);
+    tcase_add_test(tc_thread, test_insert_during_migration);
+    tcase_add_test(tc_thread, test_delete_during_migration);
+    tcase_add_test(tc_thread, test_replace_while_reading);
+    tcase_set_timeout(tc_thread, 60);
+
+    suite_add_tcase(suite, tc_core);
+    suite_add_tcase(suite, tc_thread);
+    return suite;
+}
+
+int
+main(void)
+{
+    SRunner * runner = srunner_create(check_concurrent_hashtable_suite());
+
+    srunner_run_all(runner, CK_VERBOSE);
+
+    int no_failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+    return (no_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,377 @@
+/** @file check_flat_hashtable.c
+ *
+ * @brief Tests for the flat hashtable against a reference map, with hash
+ *        functions weak enough to make long probe chains, deleted slots
+ *        that probes run through and inserts reuse, and tables that grow
+ *        from their smallest size.
+ *
+ * Build and run from DSA/hashtable with
+ *
+ *     gcc -std=c18 -O2 -D_DEFAULT_SOURCE -Iinclude src/flat_hashtable.c \
+ *         test/check_flat_hashtable.c -lcheck -lm -lrt -lsubunit \
+ *         -pthread -o check_flat_hashtable
+ *     ./check_flat_hashtable
+ *
+ */
+
+#include <check.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "../include/flat_hashtable.h"
+
+#define KEY_SPACE 4096
+#define OPERATIONS 200000
+#define GROWTH_KEYS 100000
+#define GROUP_WIDTH 16
+#define CHURN_ROUNDS 50000
+#define CHURN_LIVE 12
+
+/* Keys are integers stored in the key pointers, starting from 1. Values
+ * are allocated and hold their key, so a value found under the wrong key
+ * shows up. */
+#define KEY(n) ((void *)(uintptr_t)(n))
+
+typedef struct
+{
+    bool     present[KEY_SPACE + 1];
+    uint64_t value[KEY_SPACE + 1];
+    size_t   size;
+} Reference_T;
+
+typedef struct
+{
+    void * keys[2 * GROUP_WIDTH];
+    size_t count;
+} Order_T;
+
+static size_t g_values_made  = 0;
+static size_t g_values_freed = 0;
+static size_t g_keys_freed   = 0;
+
+static uint64_t
+key_hash(const void * key)
+{
+    return (uint64_t)(uintptr_t)key;
+}
+
+/* Only 32 distinct hashes, so probe chains run through many groups. */
+static uint64_t
+weak_hash(const void * key)
+{
+    return (uint64_t)(uintptr_t)key % 32;
+}
+
+/* Every key collides, so keys fill the slots in probe order. */
+static uint64_t
+constant_hash(const void * key)
+{
+    (void)key;
+    return 42;
+}
+
+static bool
+key_eq(const void * lhs, const void * rhs)
+{
+    return lhs == rhs;
+}
+
+static void
+key_free(void * key)
+{
+    (void)key;
+    g_keys_freed++;
+}
+
+static void
+value_free(void * value)
+{
+    free(value);
+    g_values_freed++;
+}
+
+static uint64_t *
+make_value(uint64_t contents)
+{
+    uint64_t * value = malloc(sizeof(uint64_t));
+    ck_assert_ptr_nonnull(value);
+    *value = contents;
+    g_values_made++;
+    return value;
+}
+
+static uint64_t
+next_random(uint64_t * state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+static void
+check_entry(const void * key, void * value, void * ctx)
+{
+    Reference_T * reference = ctx;
+    uintptr_t     n         = (uintptr_t)key;
+
+    ck_assert_uint_ge(n, 1);
+    ck_assert_uint_le(n, KEY_SPACE);
+    ck_assert(reference->present[n]);
+    ck_assert_uint_eq(*(uint64_t *)value, reference->value[n]);
+    reference->present[n] = false;
+}
+
+static void
+record_order(const void * key, void * value, void * ctx)
+{
+    Order_T * order = ctx;
+
+    (void)value;
+    ck_assert_uint_lt(order->count, 2 * GROUP_WIDTH);
+    order->keys[order->count++] = (void *)key;
+}
+
+/* Every entry of the table is in the reference and the other way round. */
+static void
+compare_all(fhtable_t * table, const Reference_T * reference)
+{
+    static Reference_T remaining;
+
+    remaining = *reference;
+    ck_assert_uint_eq(fht_size(table), reference->size);
+    fht_for_each(table, check_entry, &remaining);
+    for (size_t n = 1; n <= KEY_SPACE; n++)
+    {
+        ck_assert(!remaining.present[n]);
+    }
+}
+
+/* Random sets, replacements, deletes and lookups, checked against the
+ * reference as they go. */
+static void
+run_against_reference(ht_hash_f hash, size_t capacity)
+{
+    static Reference_T reference;
+    uint64_t           state = 0x9E3779B97F4A7C15ULL;
+    fhtable_t *        table
+        = fht_create(hash, key_eq, key_free, value_free, capacity);
+
+    ck_assert_ptr_nonnull(table);
+    reference      = (Reference_T) { .size = 0 };
+    g_values_made  = 0;
+    g_values_freed = 0;
+    for (uint64_t i = 1; i <= OPERATIONS; i++)
+    {
+        uint64_t  r = next_random(&state);
+        uintptr_t n = (uintptr_t)(r % KEY_SPACE) + 1;
+        switch ((r >> 32) % 4)
+        {
+            case 0:
+            case 1:
+                ck_assert_int_eq(fht_set(table, KEY(n), make_value(i)), 0);
+                reference.size += !reference.present[n];
+                reference.present[n] = true;
+                reference.value[n]   = i;
+                break;
+            case 2:
+                ck_assert_int_eq(fht_delete(table, KEY(n)),
+                                 reference.present[n] ? 0 : -1);
+                reference.size -= reference.present[n];
+                reference.present[n] = false;
+                break;
+            default:
+            {
+                uint64_t * value = fht_get(table, KEY(n));
+                ck_assert_int_eq(fht_contains(table, KEY(n)),
+                                 reference.present[n]);
+                if (reference.present[n])
+                {
+                    ck_assert_ptr_nonnull(value);
+                    ck_assert_uint_eq(*value, reference.value[n]);
+                }
+                else
+                {
+                    ck_assert_ptr_null(value);
+                }
+                break;
+            }
+        }
+        ck_assert_uint_eq(fht_size(table), reference.size);
+        if (i % 10000 == 0)
+        {
+            compare_all(table, &reference);
+        }
+    }
+    compare_all(table, &reference);
+
+    /* Every value the table took is released exactly once. */
+    ck_assert_uint_eq(g_values_made - g_values_freed, reference.size);
+    fht_destroy(&table);
+    ck_assert_ptr_null(table);
+    ck_assert_uint_eq(g_values_freed, g_values_made);
+}
+
+START_TEST(test_matches_reference)
+{
+    run_against_reference(key_hash, 0);
+    run_against_reference(key_hash, KEY_SPACE);
+}
+END_TEST
+
+START_TEST(test_matches_reference_with_collisions)
+{
+    run_against_reference(weak_hash, 0);
+}
+END_TEST
+
+START_TEST(test_deleted_slot_is_reused)
+{
+    Order_T     before = { .count = 0 };
+    Order_T     after  = { .count = 0 };
+    fhtable_t * table
+        = fht_create(constant_hash, key_eq, key_free, value_free, 20);
+    ck_assert_ptr_nonnull(table);
+
+    /* The first sixteen keys fill the group every probe starts at, so
+     * deleting one of them leaves a tombstone that the probes for the last
+     * four keys run through. */
+    for (uintptr_t n = 1; n <= 20; n++)
+    {
+        ck_assert_int_eq(fht_set(table, KEY(n), make_value(n)), 0);
+    }
+    fht_for_each(table, record_order, &before);
+    ck_assert_uint_eq(before.count, 20);
+
+    ck_assert_int_eq(fht_delete(table, KEY(4)), 0);
+    ck_assert(!fht_contains(table, KEY(4)));
+    for (uintptr_t n = GROUP_WIDTH + 1; n <= 20; n++)
+    {
+        ck_assert(fht_contains(table, KEY(n)));
+    }
+
+    /* The next insert lands in the deleted slot, the first free one on the
+     * probe sequence. */
+    ck_assert_int_eq(fht_set(table, KEY(100), make_value(100)), 0);
+    fht_for_each(table, record_order, &after);
+    ck_assert_uint_eq(after.count, before.count);
+    for (size_t i = 0; i < after.count; i++)
+    {
+        ck_assert_ptr_eq(after.keys[i],
+                         before.keys[i] == KEY(4) ? KEY(100) : before.keys[i]);
+    }
+    ck_assert_uint_eq(*(uint64_t *)fht_get(table, KEY(100)), 100);
+
+    fht_destroy(&table);
+}
+END_TEST
+
+START_TEST(test_churn_rehashes_tombstones)
+{
+    fhtable_t * table
+        = fht_create(constant_hash, key_eq, key_free, value_free, 0);
+    ck_assert_ptr_nonnull(table);
+
+    /* A few live keys and a stream of deleted ones: the tombstones use up
+     * the free slots again and again and each rehash clears them. */
+    for (uintptr_t n = 1; n <= CHURN_ROUNDS; n++)
+    {
+        ck_assert_int_eq(fht_set(table, KEY(n), make_value(n)), 0);
+        if (n > CHURN_LIVE)
+        {
+            ck_assert_int_eq(fht_delete(table, KEY(n - CHURN_LIVE)), 0);
+        }
+        ck_assert_uint_eq(fht_size(table), n < CHURN_LIVE ? n : CHURN_LIVE);
+    }
+    for (uintptr_t n = CHURN_ROUNDS - CHURN_LIVE + 1; n <= CHURN_ROUNDS; n++)
+    {
+        ck_assert_uint_eq(*(uint64_t *)fht_get(table, KEY(n)), n);
+    }
+    ck_assert(!fht_contains(table, KEY(CHURN_ROUNDS - CHURN_LIVE)));
+
+    fht_destroy(&table);
+}
+END_TEST
+
+START_TEST(test_growth_from_smallest_table)
+{
+    fhtable_t * table = fht_create(key_hash, key_eq, NULL, value_free, 0);
+    ck_assert_ptr_nonnull(table);
+
+    for (uintptr_t n = 1; n <= GROWTH_KEYS; n++)
+    {
+        ck_assert_int_eq(fht_set(table, KEY(n), make_value(n)), 0);
+    }
+    ck_assert_uint_eq(fht_size(table), GROWTH_KEYS);
+    for (uintptr_t n = 1; n <= GROWTH_KEYS; n++)
+    {
+        uint64_t * value = fht_get(table, KEY(n));
+        ck_assert_ptr_nonnull(value);
+        ck_assert_uint_eq(*value, n);
+    }
+    ck_assert(!fht_contains(table, KEY(GROWTH_KEYS + 1)));
+
+    fht_destroy(&table);
+}
+END_TEST
+
+START_TEST(test_replace_releases_new_key_and_old_value)
+{
+    fhtable_t * table = fht_create(key_hash, key_eq, key_free, value_free, 0);
+    ck_assert_ptr_nonnull(table);
+
+    g_keys_freed   = 0;
+    g_values_freed = 0;
+    ck_assert_int_eq(fht_set(table, KEY(1), make_value(1)), 0);
+    ck_assert_int_eq(fht_set(table, KEY(1), make_value(2)), 0);
+    ck_assert_uint_eq(g_keys_freed, 1);
+    ck_assert_uint_eq(g_values_freed, 1);
+    ck_assert_uint_eq(fht_size(table), 1);
+    ck_assert_uint_eq(*(uint64_t *)fht_get(table, KEY(1)), 2);
+
+    /* A NULL value is still an entry. */
+    ck_assert_int_eq(fht_set(table, KEY(2), NULL), 0);
+    ck_assert(fht_contains(table, KEY(2)));
+    ck_assert_ptr_null(fht_get(table, KEY(2)));
+    ck_assert_int_eq(fht_delete(table, KEY(3)), -1);
+
+    fht_destroy(&table);
+    ck_assert_uint_eq(g_keys_freed, 3);
+    fht_destroy(&table);
+    fht_destroy(NULL);
+    ck_assert_ptr_null(fht_create(NULL, key_eq, NULL, NULL, 0));
+    ck_assert_ptr_null(fht_create(key_hash, NULL, NULL, NULL, 0));
+}
+END_TEST
+
+Suite *
+check_flat_hashtable_suite(void)
+{
+    Suite * suite        = suite_create("flat_hashtable_test");
+    TCase * tc_core      = tcase_create("Core");
+    TCase * tc_reference = tcase_create("Reference");
+
+    tcase_add_test(tc_core, test_replace_releases_new_key_and_old_value);
+    tcase_add_test(tc_core, test_deleted_slot_is_reused);
+    tcase_add_test(tc_core, test_churn_rehashes_tombstones);
+    tcase_add_test(tc_core, test_growth_from_smallest_table);
+    tcase_add_test(tc_reference, test_matches_reference);
+    tcase_add_test(tc_reference, test_matches_reference_with_collisions);
+    tcase_set_timeout(tc_reference, 60);
+
+    suite_add_tcase(suite, tc_core);
+    suite_add_tcase(suite, tc_reference);
+    return suite;
+}
+
+int
+main(void)
+{
+    SRunner * runner = srunner_create(check_flat_hashtable_suite());
+
+    srunner_run_all(runner, CK_VERBOSE);
+
+    int no_failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+    return (no_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
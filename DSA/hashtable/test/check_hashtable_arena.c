@@ -0,0 +1,296 @@
+/** @file check_hashtable_arena.c
+ *
+ * @brief Tests for arena tables: compaction that moves a few buckets per
+ *        delete rather than the whole table at once, and contents that
+ *        survive compactions under churn, with and without interning.
+ *
+ * Build and run from DSA/hashtable with
+ *
+ *     gcc -std=c18 -O2 -D_DEFAULT_SOURCE -Iinclude src/hashtable.c \
+ *         src/ht_arena.c src/ht_hash.c test/check_hashtable_arena.c \
+ *         -lcheck -lm -lrt -lsubunit -pthread -o check_hashtable_arena
+ *     ./check_hashtable_arena
+ *
+ */
+
+#include <check.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/hashtable.h"
+
+#define KEY_COUNT 8192
+#define KEY_SPACE 2048
+#define OPERATIONS 200000
+#define VALUE_FILL 200
+
+/* A copy of the key and filler, so a value found under the wrong key or
+ * damaged by a move shows up. */
+typedef struct
+{
+    uint64_t key;
+    uint8_t  fill[VALUE_FILL];
+} Value_T;
+
+typedef struct
+{
+    bool   present[KEY_SPACE];
+    size_t fill_size[KEY_SPACE];
+    size_t size;
+} Reference_T;
+
+static uint64_t
+key_hash(const void * key)
+{
+    return ht_hash_bytes(key, sizeof(uint64_t), 0);
+}
+
+static bool
+key_eq(const void * lhs, const void * rhs)
+{
+    return *(const uint64_t *)lhs == *(const uint64_t *)rhs;
+}
+
+static void
+make_value(Value_T * value, uint64_t key)
+{
+    value->key = key;
+    memset(value->fill, (int)(key & 0xff), sizeof(value->fill));
+}
+
+static void
+check_value(const htable_t * table, uint64_t key, size_t fill_size)
+{
+    const Value_T * value = ht_get(table, &key);
+    ck_assert_ptr_nonnull(value);
+    ck_assert_uint_eq(value->key, key);
+    for (size_t i = 0; i < fill_size; i++)
+    {
+        ck_assert_uint_eq(value->fill[i], key & 0xff);
+    }
+}
+
+START_TEST(test_compaction_moves_a_few_buckets_per_call)
+{
+    htable_t * table = ht_create_arena(key_hash, key_eq, 0, 0);
+    void **    where = calloc(KEY_COUNT, sizeof(void *));
+    size_t     moves = 0;
+    size_t     calls = 0;
+    Value_T    value;
+
+    ck_assert_ptr_nonnull(table);
+    ck_assert_ptr_nonnull(where);
+    for (uint64_t key = 0; key < KEY_COUNT; key++)
+    {
+        make_value(&value, key);
+        ck_assert_int_eq(
+            ht_set_copy(table, &key, sizeof(key), &value, sizeof(value)), 0);
+    }
+
+    ht_arena_stats_t before;
+    ck_assert_int_eq(ht_arena_stats(table, &before), 0);
+
+    /* Keep every fourth key. Where a survivor's value lives only changes
+     * when its bucket is copied, so the values that move per delete show
+     * how much of the table that delete compacted. */
+    for (uint64_t key = 0; key < KEY_COUNT; key += 4)
+    {
+        where[key] = ht_get(table, &key);
+    }
+    for (uint64_t key = 0; key < KEY_COUNT; key++)
+    {
+        if (key % 4 == 0)
+        {
+            continue;
+        }
+        ck_assert_int_eq(ht_delete(table, &key), 0);
+
+        size_t moved = 0;
+        for (uint64_t kept = 0; kept < KEY_COUNT; kept += 4)
+        {
+            void * now = ht_get(table, &kept);
+            moved += (now != where[kept]);
+            where[kept] = now;
+        }
+        ck_assert_uint_lt(moved, KEY_COUNT / 4 / 8);
+        moves += moved;
+        calls += (moved > 0);
+    }
+
+    /* Every survivor was moved at least once, over many calls. */
+    ck_assert_uint_ge(moves, KEY_COUNT / 4);
+    ck_assert_uint_gt(calls, 8);
+    for (uint64_t key = 0; key < KEY_COUNT; key += 4)
+    {
+        check_value(table, key, VALUE_FILL);
+    }
+
+    ht_arena_stats_t after;
+    ht_compact(table);
+    ck_assert_int_eq(ht_arena_stats(table, &after), 0);
+    ck_assert_uint_eq(after.dead, 0);
+    ck_assert_uint_lt(after.reserved, before.reserved / 2);
+    ck_assert_uint_eq(ht_size(table), KEY_COUNT / 4);
+
+    ht_destroy(&table);
+    free(where);
+}
+END_TEST
+
+START_TEST(test_compact_finishes_compaction_under_way)
+{
+    htable_t * table = ht_create_arena(key_hash, key_eq, 0, 0);
+    Value_T    value;
+
+    ck_assert_ptr_nonnull(table);
+    for (uint64_t key = 0; key < KEY_COUNT; key++)
+    {
+        make_value(&value, key);
+        ck_assert_int_eq(
+            ht_set_copy(table, &key, sizeof(key), &value, sizeof(value)), 0);
+    }
+
+    /* Delete until a compaction starts, seen as the value of a survivor
+     * moving, then finish it at once. */
+    uint64_t kept  = KEY_COUNT - 1;
+    void *   where = ht_get(table, &kept);
+    uint64_t key   = 0;
+    for (; key < kept && ht_get(table, &kept) == where; key++)
+    {
+        ck_assert_int_eq(ht_delete(table, &key), 0);
+    }
+    ck_assert_uint_lt(key, kept);
+
+    ht_compact(table);
+    ht_arena_stats_t stats;
+    ck_assert_int_eq(ht_arena_stats(table, &stats), 0);
+    ck_assert_uint_eq(stats.dead, 0);
+    ck_assert_uint_eq(ht_size(table), KEY_COUNT - key);
+    for (; key < KEY_COUNT; key++)
+    {
+        check_value(table, key, VALUE_FILL);
+    }
+    ht_destroy(&table);
+}
+END_TEST
+
+/* Random inserts, overwrites with values of other sizes and deletes,
+ * checked against a reference map, with the arena kept from growing far
+ * past what the live entries need. */
+static void
+check_churn(unsigned flags)
+{
+    htable_t *    table     = ht_create_arena(key_hash, key_eq, 0, flags);
+    Reference_T * reference = calloc(1, sizeof(Reference_T));
+    Value_T       value;
+
+    ck_assert_ptr_nonnull(table);
+    ck_assert_ptr_nonnull(reference);
+    srand(40);
+    for (size_t op = 0; op < OPERATIONS; op++)
+    {
+        uint64_t key = (uint64_t)rand() % KEY_SPACE;
+        if (rand() % 3 == 0)
+        {
+            ck_assert_int_eq(ht_delete(table, &key),
+                             reference->present[key] ? 0 : -1);
+            reference->size -= reference->present[key];
+            reference->present[key] = false;
+        }
+        else
+        {
+            size_t fill_size = (size_t)rand() % VALUE_FILL;
+            make_value(&value, key);
+            ck_assert_int_eq(
+                ht_set_copy(table,
+                            &key,
+                            sizeof(key),
+                            &value,
+                            offsetof(Value_T, fill) + fill_size),
+                0);
+            reference->size += !reference->present[key];
+            reference->present[key]   = true;
+            reference->fill_size[key] = fill_size;
+        }
+        ck_assert_uint_eq(ht_size(table), reference->size);
+
+        if (op % 10000 == 0)
+        {
+            for (uint64_t k = 0; k < KEY_SPACE; k++)
+            {
+                if (reference->present[k])
+                {
+                    check_value(table, k, reference->fill_size[k]);
+                }
+                else
+                {
+                    ck_assert_ptr_null(ht_get(table, &k));
+                }
+            }
+        }
+    }
+
+    ht_arena_stats_t stats;
+    ck_assert_int_eq(ht_arena_stats(table, &stats), 0);
+    ck_assert_uint_lt(stats.reserved, 4 * stats.live + 4 * 64 * 1024);
+    ht_destroy(&table);
+    free(reference);
+}
+
+START_TEST(test_contents_survive_churn)
+{
+    check_churn(0);
+}
+END_TEST
+
+START_TEST(test_interned_contents_survive_churn)
+{
+    check_churn(HT_ARENA_INTERN);
+}
+END_TEST
+
+START_TEST(test_compact_ignores_other_tables)
+{
+    htable_t *       table = ht_create(key_hash, key_eq, NULL, NULL, 0);
+    ht_arena_stats_t stats;
+
+    ck_assert_ptr_nonnull(table);
+    ht_compact(table);
+    ck_assert_int_eq(ht_arena_stats(table, &stats), -1);
+    ht_destroy(&table);
+}
+END_TEST
+
+Suite *
+check_hashtable_arena_suite(void)
+{
+    Suite * suite      = suite_create("hashtable_arena_test");
+    TCase * tc_compact = tcase_create("Compact");
+    TCase * tc_churn   = tcase_create("Churn");
+
+    tcase_add_test(tc_compact, test_compaction_moves_a_few_buckets_per_call);
+    tcase_add_test(tc_compact, test_compact_finishes_compaction_under_way);
+    tcase_add_test(tc_compact, test_compact_ignores_other_tables);
+    tcase_add_test(tc_churn, test_contents_survive_churn);
+    tcase_add_test(tc_churn, test_interned_contents_survive_churn);
+    tcase_set_timeout(tc_compact, 60);
+    tcase_set_timeout(tc_churn, 60);
+
+    suite_add_tcase(suite, tc_compact);
+    suite_add_tcase(suite, tc_churn);
+    return suite;
+}
+
+int
+main(void)
+{
+    SRunner * runner = srunner_create(check_hashtable_arena_suite());
+
+    srunner_run_all(runner, CK_VERBOSE);
+
+    int no_failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+    return (no_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
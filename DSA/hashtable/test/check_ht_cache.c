@@ -0,0 +1,367 @@
+/** @file check_ht_cache.c
+ *
+ * @brief Tests for the caches: the order LRU and CLOCK evict in, the byte
+ *        limit holding under random charges, and the sharded cache
+ *        keeping within its shares.
+ *
+ * Build and run from DSA/hashtable with
+ *
+ *     gcc -std=c18 -O2 -D_DEFAULT_SOURCE -Iinclude src/hashtable.c \
+ *         src/ht_arena.c src/ht_hash.c src/ht_cache.c \
+ *         test/check_ht_cache.c -lcheck -lm -lrt -lsubunit -pthread \
+ *         -o check_ht_cache
+ *     ./check_ht_cache
+ *
+ */
+
+#include <check.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "../include/ht_cache.h"
+
+#define KEY_SPACE 512
+#define OPERATIONS 100000
+#define MAX_BYTES 4096
+#define MAX_CHARGE 300
+#define SHARD_COUNT 4
+#define SHARD_ENTRIES 64
+
+/* Keys are integers stored in the key pointers, starting from 1. */
+#define KEY(n) ((void *)(uintptr_t)(n))
+
+/* Values are allocated, and their release is recorded so that the test
+ * knows which entries the cache let go of. */
+typedef struct
+{
+    uintptr_t key;
+    size_t    charge;
+} Value_T;
+
+static bool   g_present[KEY_SPACE + 1];
+static size_t g_charge[KEY_SPACE + 1];
+
+static uint64_t
+key_hash(const void * key)
+{
+    return (uint64_t)(uintptr_t)key;
+}
+
+static bool
+key_eq(const void * lhs, const void * rhs)
+{
+    return lhs == rhs;
+}
+
+static void
+value_free(void * data)
+{
+    Value_T * value = data;
+    g_present[value->key] = false;
+    free(value);
+}
+
+static Value_T *
+make_value(uintptr_t key, size_t charge)
+{
+    Value_T * value = malloc(sizeof(Value_T));
+    ck_assert_ptr_nonnull(value);
+    value->key    = key;
+    value->charge = charge;
+    return value;
+}
+
+/* Store key with charge 1, and record it as present. */
+static void
+put(htcache_t * cache, uintptr_t key)
+{
+    ck_assert_int_eq(htc_set(cache, KEY(key), make_value(key, 1), 1), 0);
+    g_present[key] = true;
+}
+
+/* Check that exactly the listed keys, ended by 0, are present, without
+ * marking any of them as used. */
+static void
+check_present(const uintptr_t * keys)
+{
+    bool expected[KEY_SPACE + 1] = { false };
+    for (; *keys; keys++)
+    {
+        expected[*keys] = true;
+    }
+    for (uintptr_t key = 1; key <= KEY_SPACE; key++)
+    {
+        ck_assert_int_eq(g_present[key], expected[key]);
+    }
+}
+
+static htcache_t *
+make_cache(htc_policy_t policy, size_t max_entries, size_t max_bytes)
+{
+    htcache_t * cache = htc_create(
+        key_hash, key_eq, NULL, value_free, policy, max_entries, max_bytes);
+
+    ck_assert_ptr_nonnull(cache);
+    for (uintptr_t key = 0; key <= KEY_SPACE; key++)
+    {
+        g_present[key] = false;
+        g_charge[key]  = 0;
+    }
+    return cache;
+}
+
+START_TEST(test_lru_evicts_least_recently_used)
+{
+    htcache_t * cache = make_cache(HTC_LRU, 4, 0);
+
+    for (uintptr_t key = 1; key <= 4; key++)
+    {
+        put(cache, key);
+    }
+
+    /* A hit and a replace both count as uses. */
+    ck_assert_ptr_nonnull(htc_get(cache, KEY(1)));
+    put(cache, 5);
+    check_present((const uintptr_t[]) { 1, 3, 4, 5, 0 });
+
+    put(cache, 3);
+    put(cache, 6);
+    check_present((const uintptr_t[]) { 1, 3, 5, 6, 0 });
+
+    /* Misses and deletes do not disturb the order of the rest. */
+    ck_assert_ptr_null(htc_get(cache, KEY(2)));
+    ck_assert_int_eq(htc_delete(cache, KEY(5)), 0);
+    put(cache, 7);
+    put(cache, 8);
+    check_present((const uintptr_t[]) { 3, 6, 7, 8, 0 });
+
+    htc_stats_t stats;
+    htc_stats(cache, &stats);
+    ck_assert_uint_eq(stats.hits, 1);
+    ck_assert_uint_eq(stats.misses, 1);
+    ck_assert_uint_eq(stats.evictions, 3);
+    ck_assert_uint_eq(stats.entries, 4);
+    ck_assert_uint_eq(stats.bytes, 4);
+    htc_destroy(&cache);
+    check_present((const uintptr_t[]) { 0 });
+}
+END_TEST
+
+START_TEST(test_clock_gives_referenced_entries_a_second_chance)
+{
+    htcache_t * cache = make_cache(HTC_CLOCK, 4, 0);
+
+    for (uintptr_t key = 1; key <= 4; key++)
+    {
+        put(cache, key);
+    }
+
+    /* The hand starts at 1, clears its bit, and evicts 2, the first entry
+     * not referenced. */
+    ck_assert_ptr_nonnull(htc_get(cache, KEY(1)));
+    ck_assert_ptr_nonnull(htc_get(cache, KEY(3)));
+    put(cache, 5);
+    check_present((const uintptr_t[]) { 1, 3, 4, 5, 0 });
+
+    /* 4 took the slot of 2, behind the hand. The hand clears 3 and evicts
+     * 5, which was not used since it was stored. */
+    put(cache, 6);
+    check_present((const uintptr_t[]) { 1, 3, 4, 6, 0 });
+
+    /* Back at the start, 1 has used up its second chance. */
+    put(cache, 7);
+    check_present((const uintptr_t[]) { 3, 4, 6, 7, 0 });
+
+    /* With every bit set, the hand clears them all in one turn and comes
+     * back to the entry it started from. */
+    ck_assert_ptr_nonnull(htc_get(cache, KEY(3)));
+    ck_assert_ptr_nonnull(htc_get(cache, KEY(4)));
+    ck_assert_ptr_nonnull(htc_get(cache, KEY(6)));
+    ck_assert_ptr_nonnull(htc_get(cache, KEY(7)));
+    put(cache, 8);
+    ck_assert_uint_eq(htc_size(cache), 4);
+
+    htc_stats_t stats;
+    htc_stats(cache, &stats);
+    ck_assert_uint_eq(stats.evictions, 4);
+    htc_destroy(&cache);
+    check_present((const uintptr_t[]) { 0 });
+}
+END_TEST
+
+/* Random stores with random charges, replaces and deletes, with the
+ * bytes the cache reports checked against the charges of the entries it
+ * still holds. */
+static void
+check_byte_limit(htc_policy_t policy)
+{
+    htcache_t * cache = make_cache(policy, 0, MAX_BYTES);
+
+    srand(43);
+    for (size_t op = 0; op < OPERATIONS; op++)
+    {
+        uintptr_t key = 1 + (uintptr_t)rand() % KEY_SPACE;
+        if (rand() % 4 == 0)
+        {
+            int expected = g_present[key] ? 0 : -1;
+            ck_assert_int_eq(htc_delete(cache, KEY(key)), expected);
+            ck_assert(!g_present[key]);
+        }
+        else if (rand() % 4 == 0)
+        {
+            Value_T * value = htc_get(cache, KEY(key));
+            ck_assert_int_eq(value != NULL, g_present[key]);
+            ck_assert(value == NULL || value->key == key);
+        }
+        else
+        {
+            size_t charge = 1 + (size_t)rand() % MAX_CHARGE;
+            ck_assert_int_eq(
+                htc_set(cache, KEY(key), make_value(key, charge), charge),
+                0);
+            g_present[key] = true;
+            g_charge[key]  = charge;
+        }
+
+        htc_stats_t stats;
+        size_t      bytes   = 0;
+        size_t      entries = 0;
+        for (uintptr_t k = 1; k <= KEY_SPACE; k++)
+        {
+            bytes += g_present[k] ? g_charge[k] : 0;
+            entries += g_present[k];
+        }
+        htc_stats(cache, &stats);
+        ck_assert_uint_eq(stats.bytes, bytes);
+        ck_assert_uint_eq(stats.entries, entries);
+        ck_assert_uint_le(stats.bytes, MAX_BYTES);
+    }
+
+    /* A charge over the limit is refused and the caller keeps the value;
+     * one of exactly the limit pushes out everything else. */
+    Value_T * value = make_value(1, MAX_BYTES + 1);
+    ck_assert_int_eq(htc_set(cache, KEY(1), value, MAX_BYTES + 1), -1);
+    free(value);
+    ck_assert_int_eq(
+        htc_set(cache, KEY(2), make_value(2, MAX_BYTES), MAX_BYTES), 0);
+    ck_assert_uint_eq(htc_size(cache), 1);
+    ck_assert_ptr_nonnull(htc_get(cache, KEY(2)));
+    htc_destroy(&cache);
+}
+
+START_TEST(test_lru_byte_limit)
+{
+    check_byte_limit(HTC_LRU);
+}
+END_TEST
+
+START_TEST(test_clock_byte_limit)
+{
+    check_byte_limit(HTC_CLOCK);
+}
+END_TEST
+
+START_TEST(test_create_rejects_bad_arguments)
+{
+    ck_assert_ptr_null(htc_create(NULL, key_eq, NULL, NULL, HTC_LRU, 1, 0));
+    ck_assert_ptr_null(htc_create(key_hash, NULL, NULL, NULL, HTC_LRU, 1, 0));
+    ck_assert_ptr_null(
+        htc_create(key_hash, key_eq, NULL, NULL, HTC_LRU, 0, 0));
+    ck_assert_ptr_null(
+        shtc_create(key_hash, key_eq, NULL, NULL, HTC_LRU, 1, 0, 0));
+    htc_destroy(NULL);
+    shtc_destroy(NULL);
+}
+END_TEST
+
+static void
+count_hit(const void * key, void * value, void * ctx)
+{
+    (void)key;
+    (void)value;
+    (*(size_t *)ctx)++;
+}
+
+static void
+check_sharded(htc_policy_t policy)
+{
+    shtcache_t * cache = shtc_create(key_hash,
+                                     key_eq,
+                                     NULL,
+                                     value_free,
+                                     policy,
+                                     SHARD_COUNT * SHARD_ENTRIES,
+                                     0,
+                                     SHARD_COUNT);
+    ck_assert_ptr_nonnull(cache);
+
+    size_t stored = 0;
+    for (uintptr_t key = 1; key <= KEY_SPACE; key++)
+    {
+        ck_assert_int_eq(
+            shtc_set(cache, KEY(key), make_value(key, 1), 1), 0);
+        g_present[key] = true;
+        stored++;
+    }
+
+    size_t present = 0;
+    size_t hits    = 0;
+    for (uintptr_t key = 1; key <= KEY_SPACE; key++)
+    {
+        bool found = shtc_get(cache, KEY(key), count_hit, &hits);
+        ck_assert_int_eq(found, g_present[key]);
+        present += found;
+    }
+    ck_assert_uint_eq(hits, present);
+    ck_assert_uint_eq(shtc_size(cache), present);
+    ck_assert_uint_le(present, SHARD_COUNT * SHARD_ENTRIES);
+
+    htc_stats_t stats;
+    shtc_stats(cache, &stats);
+    ck_assert_uint_eq(stats.hits, present);
+    ck_assert_uint_eq(stats.misses, KEY_SPACE - present);
+    ck_assert_uint_eq(stats.evictions, stored - present);
+    ck_assert_uint_eq(stats.entries, present);
+    shtc_destroy(&cache);
+    check_present((const uintptr_t[]) { 0 });
+}
+
+START_TEST(test_sharded_caches_keep_their_shares)
+{
+    check_sharded(HTC_LRU);
+    check_sharded(HTC_CLOCK);
+}
+END_TEST
+
+Suite *
+check_ht_cache_suite(void)
+{
+    Suite * suite    = suite_create("ht_cache_test");
+    TCase * tc_order = tcase_create("Eviction");
+    TCase * tc_limit = tcase_create("Limits");
+
+    tcase_add_test(tc_order, test_lru_evicts_least_recently_used);
+    tcase_add_test(tc_order,
+                   test_clock_gives_referenced_entries_a_second_chance);
+    tcase_add_test(tc_limit, test_lru_byte_limit);
+    tcase_add_test(tc_limit, test_clock_byte_limit);
+    tcase_add_test(tc_limit, test_create_rejects_bad_arguments);
+    tcase_add_test(tc_limit, test_sharded_caches_keep_their_shares);
+    tcase_set_timeout(tc_limit, 60);
+
+    suite_add_tcase(suite, tc_order);
+    suite_add_tcase(suite, tc_limit);
+    return suite;
+}
+
+int
+main(void)
+{
+    SRunner * runner = srunner_create(check_ht_cache_suite());
+
+    srunner_run_all(runner, CK_VERBOSE);
+
+    int no_failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+    return (no_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
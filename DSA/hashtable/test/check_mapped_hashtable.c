@@ -0,0 +1,352 @@
+/** @file check_mapped_hashtable.c
+ *
+ * @brief Tests for table files: round trips of chained and perfect files,
+ *        and files that are truncated or damaged being refused rather than
+ *        read out of bounds.
+ *
+ * Build and run from DSA/hashtable with
+ *
+ *     gcc -std=c18 -O2 -D_DEFAULT_SOURCE -Iinclude src/hashtable.c \
+ *         src/ht_arena.c src/ht_hash.c src/perfect_hash.c \
+ *         src/mapped_hashtable.c test/check_mapped_hashtable.c \
+ *         -lcheck -lm -lrt -lsubunit -pthread -o check_mapped_hashtable
+ *     ./check_mapped_hashtable
+ *
+ */
+
+#include <check.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../include/mapped_hashtable.h"
+
+#define ENTRY_COUNT 10000
+/* sizeof(mht_header_t), private to mapped_hashtable.c. */
+#define HEADER_SIZE 112
+#define PATH_SIZE 64
+
+typedef int (*save_f)(htable_t *, const char *, ht_size_f, ht_size_f);
+
+typedef struct
+{
+    unsigned char * bytes;
+    size_t          length;
+} File_T;
+
+static char g_path[PATH_SIZE];
+static char g_damaged_path[PATH_SIZE];
+
+static void
+setup(void)
+{
+    snprintf(g_path, sizeof(g_path), "/tmp/check_mht_%ld", (long)getpid());
+    snprintf(g_damaged_path,
+             sizeof(g_damaged_path),
+             "/tmp/check_mht_damaged_%ld",
+             (long)getpid());
+}
+
+static void
+teardown(void)
+{
+    unlink(g_path);
+    unlink(g_damaged_path);
+}
+
+static bool
+address_eq(const void * lhs, const void * rhs)
+{
+    return lhs == rhs;
+}
+
+static char *
+format_string(const char * prefix, size_t n)
+{
+    char buffer[PATH_SIZE];
+    snprintf(buffer, sizeof(buffer), "%s%zu", prefix, n);
+
+    char * copy = strdup(buffer);
+    ck_assert_ptr_nonnull(copy);
+    return copy;
+}
+
+/* A table of count strings "key<n>" -> "value<n>", with values of growing
+ * length so that the data section is not uniform. */
+static htable_t *
+make_table(size_t count)
+{
+    htable_t * table = ht_create(ht_string_hash, ht_string_eq, free, free, 0);
+
+    ck_assert_ptr_nonnull(table);
+    for (size_t n = 0; n < count; n++)
+    {
+        char * key   = format_string("key", n);
+        char * value = format_string(n % 2 ? "value" : "a longer value ", n);
+        ck_assert_int_eq(ht_set(table, key, value), 0);
+    }
+    return table;
+}
+
+static void
+check_contents(const mhtable_t * mapped, size_t count)
+{
+    ck_assert_uint_eq(mht_size(mapped), count);
+    for (size_t n = 0; n < count + 100; n++)
+    {
+        char *       key   = format_string("key", n);
+        const char * value = mht_get_string(mapped, key);
+        if (n < count)
+        {
+            char * expected
+                = format_string(n % 2 ? "value" : "a longer value ", n);
+            ck_assert_ptr_nonnull(value);
+            ck_assert_str_eq(value, expected);
+
+            size_t       value_size = 0;
+            const void * raw
+                = mht_get(mapped, key, strlen(key) + 1, &value_size);
+            ck_assert_ptr_eq(raw, value);
+            ck_assert_uint_eq(value_size, strlen(expected) + 1);
+            free(expected);
+        }
+        else
+        {
+            ck_assert_ptr_null(value);
+        }
+        free(key);
+    }
+
+    /* A prefix of a key is a different key. */
+    ck_assert_ptr_null(mht_get(mapped, "key1", 4, NULL));
+}
+
+static void
+check_round_trip(save_f save, size_t count)
+{
+    htable_t * table = make_table(count);
+
+    ck_assert_int_eq(save(table, g_path, ht_string_size, ht_string_size), 0);
+    ht_destroy(&table);
+
+    mhtable_t * mapped = mht_open(g_path, MHT_VERIFY);
+    ck_assert_ptr_nonnull(mapped);
+    check_contents(mapped, count);
+    mht_close(&mapped);
+    ck_assert_ptr_null(mapped);
+    mht_close(&mapped);
+    mht_close(NULL);
+}
+
+START_TEST(test_chained_round_trip)
+{
+    check_round_trip(mht_save, ENTRY_COUNT);
+}
+END_TEST
+
+START_TEST(test_perfect_round_trip)
+{
+    check_round_trip(mht_save_perfect, ENTRY_COUNT);
+}
+END_TEST
+
+START_TEST(test_empty_round_trip)
+{
+    check_round_trip(mht_save, 0);
+    check_round_trip(mht_save_perfect, 0);
+}
+END_TEST
+
+START_TEST(test_perfect_refuses_duplicate_key_bytes)
+{
+    /* Keys compared by address, so equal bytes can be stored twice. */
+    htable_t *  table    = ht_create(ht_string_hash, address_eq, NULL, NULL, 0);
+    static char first[]  = "same";
+    static char second[] = "same";
+
+    ck_assert_ptr_nonnull(table);
+    ck_assert_int_eq(ht_set(table, first, first), 0);
+    ck_assert_int_eq(ht_set(table, second, second), 0);
+    ck_assert_uint_eq(ht_size(table), 2);
+
+    errno = 0;
+    ck_assert_int_eq(
+        mht_save_perfect(table, g_path, ht_string_size, ht_string_size), -1);
+    ck_assert_int_eq(errno, EINVAL);
+    ck_assert_ptr_null(mht_open(g_path, 0));
+    ht_destroy(&table);
+}
+END_TEST
+
+static void
+read_file(const char * path, File_T * file)
+{
+    FILE * stream = fopen(path, "rb");
+    ck_assert_ptr_nonnull(stream);
+    ck_assert_int_eq(fseek(stream, 0, SEEK_END), 0);
+    file->length = (size_t)ftell(stream);
+    rewind(stream);
+    file->bytes = malloc(file->length);
+    ck_assert_ptr_nonnull(file->bytes);
+    ck_assert_uint_eq(fread(file->bytes, 1, file->length, stream),
+                      file->length);
+    fclose(stream);
+}
+
+static void
+write_file(const char * path, const unsigned char * bytes, size_t length)
+{
+    FILE * stream = fopen(path, "wb");
+    ck_assert_ptr_nonnull(stream);
+    ck_assert_uint_eq(fwrite(bytes, 1, length, stream), length);
+    ck_assert_int_eq(fclose(stream), 0);
+}
+
+/* Save a small table of the given kind and read the file back. */
+static void
+saved_file(save_f save, File_T * file)
+{
+    htable_t * table = make_table(100);
+
+    ck_assert_int_eq(save(table, g_path, ht_string_size, ht_string_size), 0);
+    ht_destroy(&table);
+    read_file(g_path, file);
+    ck_assert_uint_gt(file->length, HEADER_SIZE);
+}
+
+static void
+check_truncated(save_f save)
+{
+    File_T file;
+
+    saved_file(save, &file);
+    size_t lengths[] = { 1, 8, HEADER_SIZE - 1, HEADER_SIZE,
+                         file.length / 2, file.length - 1 };
+    for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++)
+    {
+        write_file(g_damaged_path, file.bytes, lengths[i]);
+        ck_assert_ptr_null(mht_open(g_damaged_path, 0));
+        ck_assert_ptr_null(mht_open(g_damaged_path, MHT_VERIFY));
+    }
+
+    write_file(g_damaged_path, file.bytes, 0);
+    ck_assert_ptr_null(mht_open(g_damaged_path, 0));
+    ck_assert_ptr_null(mht_open("/nonexistent/table", 0));
+    free(file.bytes);
+}
+
+START_TEST(test_truncated_files_are_refused)
+{
+    check_truncated(mht_save);
+    check_truncated(mht_save_perfect);
+}
+END_TEST
+
+static void
+check_damaged_header(save_f save)
+{
+    File_T file;
+
+    /* Any changed byte of the header fails its checksum, whether in the
+     * magic, a size or an offset. */
+    saved_file(save, &file);
+    for (size_t i = 0; i < HEADER_SIZE; i++)
+    {
+        file.bytes[i] ^= 0x40;
+        write_file(g_damaged_path, file.bytes, file.length);
+        ck_assert_ptr_null(mht_open(g_damaged_path, 0));
+        file.bytes[i] ^= 0x40;
+    }
+
+    write_file(g_damaged_path, file.bytes, file.length);
+    mhtable_t * mapped = mht_open(g_damaged_path, 0);
+    ck_assert_ptr_nonnull(mapped);
+    mht_close(&mapped);
+    free(file.bytes);
+}
+
+START_TEST(test_damaged_headers_are_refused)
+{
+    check_damaged_header(mht_save);
+    check_damaged_header(mht_save_perfect);
+}
+END_TEST
+
+static void
+check_damaged_body(save_f save)
+{
+    File_T file;
+
+    saved_file(save, &file);
+    for (size_t i = HEADER_SIZE; i < file.length; i += 7)
+    {
+        file.bytes[i] ^= 0xff;
+        write_file(g_damaged_path, file.bytes, file.length);
+
+        /* Verified opens see the damage. Unverified ones are accepted, and
+         * lookups in them must stay within the mapping, whatever they
+         * answer. */
+        ck_assert_ptr_null(mht_open(g_damaged_path, MHT_VERIFY));
+        mhtable_t * mapped = mht_open(g_damaged_path, 0);
+        ck_assert_ptr_nonnull(mapped);
+        for (size_t n = 0; n < 100; n += 9)
+        {
+            char *       key   = format_string("key", n);
+            const char * value = mht_get_string(mapped, key);
+            if (value)
+            {
+                ck_assert_uint_gt(strlen(value), 0);
+            }
+            free(key);
+        }
+        mht_close(&mapped);
+        file.bytes[i] ^= 0xff;
+    }
+    free(file.bytes);
+}
+
+START_TEST(test_damaged_bodies_are_caught_or_contained)
+{
+    check_damaged_body(mht_save);
+    check_damaged_body(mht_save_perfect);
+}
+END_TEST
+
+Suite *
+check_mapped_hashtable_suite(void)
+{
+    Suite * suite      = suite_create("mapped_hashtable_test");
+    TCase * tc_round   = tcase_create("RoundTrip");
+    TCase * tc_damaged = tcase_create("Damaged");
+
+    tcase_add_checked_fixture(tc_round, setup, teardown);
+    tcase_add_checked_fixture(tc_damaged, setup, teardown);
+    tcase_add_test(tc_round, test_chained_round_trip);
+    tcase_add_test(tc_round, test_perfect_round_trip);
+    tcase_add_test(tc_round, test_empty_round_trip);
+    tcase_add_test(tc_round, test_perfect_refuses_duplicate_key_bytes);
+    tcase_add_test(tc_damaged, test_truncated_files_are_refused);
+    tcase_add_test(tc_damaged, test_damaged_headers_are_refused);
+    tcase_add_test(tc_damaged, test_damaged_bodies_are_caught_or_contained);
+    tcase_set_timeout(tc_round, 60);
+    tcase_set_timeout(tc_damaged, 60);
+
+    suite_add_tcase(suite, tc_round);
+    suite_add_tcase(suite, tc_damaged);
+    return suite;
+}
+
+int
+main(void)
+{
+    SRunner * runner = srunner_create(check_mapped_hashtable_suite());
+
+    srunner_run_all(runner, CK_VERBOSE);
+
+    int no_failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+    return (no_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,214 @@
+/** @file check_perfect_hash.c
+ *
+ * @brief Tests for minimal perfect hashes: every key set maps onto its
+ *        indices one to one, the empty and single key sets, keys of odd
+ *        lengths, and sets with a repeated key being refused.
+ *
+ * Build and run from DSA/hashtable with
+ *
+ *     gcc -std=c18 -O2 -D_DEFAULT_SOURCE -Iinclude src/ht_hash.c \
+ *         src/perfect_hash.c test/check_perfect_hash.c \
+ *         -lcheck -lm -lrt -lsubunit -pthread -o check_perfect_hash
+ *     ./check_perfect_hash
+ *
+ */
+
+#include <check.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "../include/perfect_hash.h"
+
+#define LARGE_COUNT 200000
+#define FOREIGN_KEYS 10000
+#define MAX_BITS_PER_KEY 5.0
+
+typedef struct
+{
+    uint64_t *    values; /* The bytes of key i are values[i]. */
+    const void ** keys;
+    size_t *      key_sizes;
+    size_t        count;
+} Keys_T;
+
+/* count keys of 8 bytes each, every one a distinct multiple of stride, so
+ * that sets differ in their low or their high bits. */
+static void
+make_keys(Keys_T * keys, size_t count, uint64_t stride)
+{
+    size_t slots    = count ? count : 1;
+    keys->values    = malloc(slots * sizeof(uint64_t));
+    keys->keys      = malloc(slots * sizeof(void *));
+    keys->key_sizes = malloc(slots * sizeof(size_t));
+    keys->count     = count;
+    ck_assert_ptr_nonnull(keys->values);
+    ck_assert_ptr_nonnull(keys->keys);
+    ck_assert_ptr_nonnull(keys->key_sizes);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        keys->values[i]    = (i + 1) * stride;
+        keys->keys[i]      = &keys->values[i];
+        keys->key_sizes[i] = sizeof(uint64_t);
+    }
+}
+
+static void
+free_keys(Keys_T * keys)
+{
+    free(keys->values);
+    free(keys->keys);
+    free(keys->key_sizes);
+}
+
+/* Every key gets an index below the count, and no two the same one. */
+static void
+check_bijective(const Keys_T * keys)
+{
+    mphash_t * mph  = mph_create(keys->keys, keys->key_sizes, keys->count);
+    bool *     seen = calloc(keys->count ? keys->count : 1, sizeof(bool));
+
+    ck_assert_ptr_nonnull(mph);
+    ck_assert_ptr_nonnull(seen);
+    ck_assert_uint_eq(mph_size(mph), keys->count);
+    for (size_t i = 0; i < keys->count; i++)
+    {
+        size_t index = mph_index(mph, keys->keys[i], keys->key_sizes[i]);
+        ck_assert_uint_lt(index, keys->count);
+        ck_assert(!seen[index]);
+        seen[index] = true;
+    }
+
+    /* Foreign keys get some index of the set. */
+    for (uint64_t foreign = 0; foreign < FOREIGN_KEYS; foreign++)
+    {
+        uint64_t value = ~foreign;
+        ck_assert_uint_lt(mph_index(mph, &value, sizeof(value)), keys->count);
+    }
+    free(seen);
+    mph_destroy(&mph);
+    ck_assert_ptr_null(mph);
+}
+
+START_TEST(test_small_sets_are_bijective)
+{
+    for (size_t count = 1; count <= 64; count++)
+    {
+        Keys_T keys;
+        make_keys(&keys, count, 1);
+        check_bijective(&keys);
+        free_keys(&keys);
+    }
+}
+END_TEST
+
+START_TEST(test_large_sets_are_bijective)
+{
+    uint64_t strides[] = { 1, 1ULL << 32, 0x9E3779B97F4A7C15ULL };
+
+    for (size_t s = 0; s < sizeof(strides) / sizeof(strides[0]); s++)
+    {
+        Keys_T keys;
+        make_keys(&keys, LARGE_COUNT, strides[s]);
+        check_bijective(&keys);
+
+        mphash_t * mph = mph_create(keys.keys, keys.key_sizes, keys.count);
+        ck_assert_ptr_nonnull(mph);
+        ck_assert(mph_bits_per_key(mph) < MAX_BITS_PER_KEY);
+        mph_destroy(&mph);
+        free_keys(&keys);
+    }
+}
+END_TEST
+
+START_TEST(test_keys_of_odd_lengths)
+{
+    /* The empty key, and keys that are prefixes of each other. */
+    static const char text[]    = "abcdefghijklmnopqrstuvwxyz";
+    const void *      keys[27]  = { 0 };
+    size_t            sizes[27] = { 0 };
+
+    for (size_t i = 0; i < 27; i++)
+    {
+        keys[i]  = text;
+        sizes[i] = i;
+    }
+
+    Keys_T set = { NULL, keys, sizes, 27 };
+    check_bijective(&set);
+}
+END_TEST
+
+START_TEST(test_empty_set_has_no_index)
+{
+    Keys_T keys;
+    make_keys(&keys, 0, 1);
+
+    mphash_t * mph = mph_create(keys.keys, keys.key_sizes, 0);
+    ck_assert_ptr_nonnull(mph);
+    ck_assert_uint_eq(mph_size(mph), 0);
+    ck_assert_uint_eq(mph_index(mph, "key", 3), MPH_NO_INDEX);
+    ck_assert_uint_eq(mph_index(mph, "", 0), MPH_NO_INDEX);
+    ck_assert(mph_bits_per_key(mph) == 0.0);
+    mph_destroy(&mph);
+    mph_destroy(NULL);
+    free_keys(&keys);
+}
+END_TEST
+
+START_TEST(test_repeated_key_is_refused)
+{
+    Keys_T keys;
+    make_keys(&keys, 1000, 1);
+
+    /* Same bytes at another address. */
+    keys.values[700] = keys.values[300];
+    errno            = 0;
+    ck_assert_ptr_null(mph_create(keys.keys, keys.key_sizes, keys.count));
+    ck_assert_int_eq(errno, EINVAL);
+
+    /* Same key, two entries. */
+    keys.values[700] = 701;
+    keys.keys[999]   = keys.keys[0];
+    errno            = 0;
+    ck_assert_ptr_null(mph_create(keys.keys, keys.key_sizes, keys.count));
+    ck_assert_int_eq(errno, EINVAL);
+
+    /* Distinct again. */
+    keys.keys[999] = &keys.values[999];
+    check_bijective(&keys);
+    free_keys(&keys);
+}
+END_TEST
+
+Suite *
+check_perfect_hash_suite(void)
+{
+    Suite * suite   = suite_create("perfect_hash_test");
+    TCase * tc_core = tcase_create("Core");
+    TCase * tc_big  = tcase_create("Large");
+
+    tcase_add_test(tc_core, test_small_sets_are_bijective);
+    tcase_add_test(tc_core, test_keys_of_odd_lengths);
+    tcase_add_test(tc_core, test_empty_set_has_no_index);
+    tcase_add_test(tc_core, test_repeated_key_is_refused);
+    tcase_add_test(tc_big, test_large_sets_are_bijective);
+    tcase_set_timeout(tc_big, 60);
+
+    suite_add_tcase(suite, tc_core);
+    suite_add_tcase(suite, tc_big);
+    return suite;
+}
+
+int
+main(void)
+{
+    SRunner * runner = srunner_create(check_perfect_hash_suite());
+
+    srunner_run_all(runner, CK_VERBOSE);
+
+    int no_failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+    return (no_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,294 @@
+/** @file indexed_heap.h
+ *
+ * @brief A 4-ary min-heap of integer handles, with an index from each
+ *        handle to its place in the heap.
+ *
+ * Handles are the integers 0 to capacity - 1, usually indexes into the
+ * caller's own arrays: node numbers for a shortest path search, job slots
+ * for a scheduler. The index lets a handle already in the heap be found in
+ * O(1), so its priority can change, or it can be removed, in O(log n).
+ *
+ * Two variants are provided. iheap_t holds handles alone and asks a
+ * callback to compare them, so priorities stay wherever the caller keeps
+ * them; after changing one, the caller tells the heap with
+ * iheap_decrease() or iheap_update(). kheap_t keeps a double key next to
+ * each handle, which saves a callback and a cache miss on every comparison
+ * and is the faster choice whenever the priority is a number.
+ *
+ * Four children per node halve the height of a binary heap. A sift down
+ * compares more children per level, but they sit side by side in memory,
+ * and kheap_t lays them out so that all four share one cache line.
+ *
+ * The smallest element comes out first. For a max-heap, such as the k
+ * largest of a stream, invert the callback or negate the keys.
+ *
+ */
+
+#ifndef INDEXED_HEAP_H
+#define INDEXED_HEAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @brief The largest capacity a heap can have.
+ *
+ */
+#define IHEAP_MAX_CAPACITY 0xfffffffeu
+
+typedef struct indexed_heap indexed_heap_t;
+typedef struct keyed_heap   keyed_heap_t;
+
+/**
+ * @brief User provided function that orders two handles.
+ *
+ * @param a the first handle
+ * @param b the second handle
+ * @param ctx the pointer given to iheap_create()
+ * @return true if a must come out of the heap before b
+ */
+typedef bool (*iheap_less_f)(size_t a, size_t b, void * ctx);
+
+/**
+ * @brief Creates an empty heap of handles ordered by a callback.
+ *
+ * @param capacity one more than the largest handle, at most
+ *        IHEAP_MAX_CAPACITY
+ * @param less the function ordering handles
+ * @param ctx passed to less, usually the array of priorities
+ * @return indexed_heap_t* a pointer to the new heap, or NULL on failure
+ */
+indexed_heap_t * iheap_create(size_t capacity, iheap_less_f less, void * ctx);
+
+/**
+ * @brief Destroy the heap. *heap == NULL is safe. The heap pointer is set
+ *        to NULL afterwards.
+ *
+ * @param heap a reference to a pointer to an allocated heap
+ */
+void iheap_destroy(indexed_heap_t ** heap);
+
+/**
+ * @brief Add a handle, placed by its current priority.
+ *
+ * @param heap a pointer to an allocated heap
+ * @param handle a handle below the capacity, not in the heap
+ * @return 0 on success, -1 if the handle is out of range or already in
+ *         the heap
+ */
+int iheap_push(indexed_heap_t * heap, size_t handle);
+
+/**
+ * @brief Remove the handle that comes first.
+ *
+ * @param heap a pointer to an allocated heap
+ * @param handle filled with the handle, unless NULL
+ * @return 0 on success, -1 if the heap is empty
+ */
+int iheap_pop(indexed_heap_t * heap, size_t * handle);
+
+/**
+ * @brief Look at the handle that comes first without removing it.
+ *
+ * @param heap a pointer to an allocated heap
+ * @param handle filled with the handle
+ * @return 0 on success, -1 if the heap is empty
+ */
+int iheap_peek(const indexed_heap_t * heap, size_t * handle);
+
+/**
+ * @brief Move a handle towards the front after its priority improved.
+ *        Cheaper than iheap_update() when the direction is known.
+ *
+ * @param heap a pointer to an allocated heap
+ * @param handle a handle in the heap
+ * @return 0 on success, -1 if the handle is not in the heap
+ */
+int iheap_decrease(indexed_heap_t * heap, size_t handle);
+
+/**
+ * @brief Move a handle to its place after its priority changed either way.
+ *
+ * @param heap a pointer to an allocated heap
+ * @param handle a handle in the heap
+ * @return 0 on success, -1 if the handle is not in the heap
+ */
+int iheap_update(indexed_heap_t * heap, size_t handle);
+
+/**
+ * @brief Remove a handle from anywhere in the heap.
+ *
+ * @param heap a pointer to an allocated heap
+ * @param handle a handle in the heap
+ * @return 0 on success, -1 if the handle is not in the heap
+ */
+int iheap_remove(indexed_heap_t * heap, size_t handle);
+
+/**
+ * @brief Replace the contents of the heap with a set of handles in O(n),
+ *        rather than O(n log n) for pushing them one at a time.
+ *
+ * @param heap a pointer to an allocated heap
+ * @param handles distinct handles below the capacity
+ * @param count the number of handles
+ * @return 0 on success, -1 if a handle is out of range or repeated, which
+ *         leaves the heap empty
+ */
+int iheap_heapify(indexed_heap_t * heap, const size_t * handles, size_t count);
+
+/**
+ * @brief Returns whether a handle is in the heap.
+ *
+ * @param heap a pointer to an allocated heap
+ * @param handle any handle
+ * @return true if the handle is in the heap
+ */
+bool iheap_contains(const indexed_heap_t * heap, size_t handle);
+
+/**
+ * @brief Returns the number of handles in the heap.
+ *
+ * @param heap a pointer to an allocated heap
+ * @return size_t the number of handles
+ */
+size_t iheap_size(const indexed_heap_t * heap);
+
+/**
+ * @brief Remove every handle, in O(size).
+ *
+ * @param heap a pointer to an allocated heap
+ */
+void iheap_clear(indexed_heap_t * heap);
+
+/**
+ * @brief Creates an empty heap of handles with inline keys.
+ *
+ * @param capacity one more than the largest handle, at most
+ *        IHEAP_MAX_CAPACITY
+ * @return keyed_heap_t* a pointer to the new heap, or NULL on failure
+ */
+keyed_heap_t * kheap_create(size_t capacity);
+
+/**
+ * @brief Destroy the heap. *heap == NULL is safe. The heap pointer is set
+ *        to NULL afterwards.
+ *
+ * @param heap a reference to a pointer to an allocated heap
+ */
+void kheap_destroy(keyed_heap_t ** heap);
+
+/**
+ * @brief Add a handle with a key. Keys must not be NaN.
+ *
+ * @param heap a pointer to an allocated heap
+ * @param handle a handle below the capacity, not in the heap
+ * @param key the handle's priority, smallest first
+ * @return 0 on success, -1 if the handle is out of range or already in
+ *         the heap
+ */
+int kheap_push(keyed_heap_t * heap, size_t handle, double key);
+
+/**
+ * @brief Remove the handle with the smallest key.
+ *
+ * @param heap a pointer to an allocated heap
+ * @param handle filled with the handle, unless NULL
+ * @param key filled with its key, unless NULL
+ * @return 0 on success, -1 if the heap is empty
+ */
+int kheap_pop(keyed_heap_t * heap, size_t * handle, double * key);
+
+/**
+ * @brief Look at the handle with the smallest key without removing it.
+ *
+ * @param heap a pointer to an allocated heap
+ * @param handle filled with the handle, unless NULL
+ * @param key filled with its key, unless NULL
+ * @return 0 on success, -1 if the heap is empty
+ */
+int kheap_peek(const keyed_heap_t * heap, size_t * handle, double * key);
+
+/**
+ * @brief Lower the key of a handle in the heap.
+ *
+ * @param heap a pointer to an allocated heap
+ * @param handle a handle in the heap
+ * @param key the new key, no larger than the old one
+ * @return 0 on success, -1 if the handle is not in the heap or the key is
+ *         larger
+ */
+int kheap_decrease_key(keyed_heap_t * heap, size_t handle, double key);
+
+/**
+ * @brief Change the key of a handle in the heap either way.
+ *
+ * @param heap a pointer to an allocated heap
+ * @param handle a handle in the heap
+ * @param key the new key
+ * @return 0 on success, -1 if the handle is not in the heap
+ */
+int kheap_update_key(keyed_heap_t * heap, size_t handle, double key);
+
+/**
+ * @brief Push a handle, or lower its key if it is in the heap with a larger
+ *        one: the relaxation step of Dijkstra's algorithm.
+ *
+ * @param heap a pointer to an allocated heap
+ * @param handle a handle below the capacity
+ * @param key the candidate key
+ * @return 1 if the handle was pushed or its key lowered, 0 if it already
+ *         had a key no larger, -1 if the handle is out of range
+ */
+int kheap_relax(keyed_heap_t * heap, size_t handle, double key);
+
+/**
+ * @brief Remove a handle from anywhere in the heap.
+ *
+ * @param heap a pointer to an allocated heap
+ * @param handle a handle in the heap
+ * @return 0 on success, -1 if the handle is not in the heap
+ */
+int kheap_remove(keyed_heap_t * heap, size_t handle);
+
+/**
+ * @brief Replace the contents of the heap with handles and their keys in
+ *        O(n).
+ *
+ * @param heap a pointer to an allocated heap
+ * @param handles distinct handles below the capacity
+ * @param keys the key of each handle
+ * @param count the number of handles
+ * @return 0 on success, -1 if a handle is out of range or repeated, which
+ *         leaves the heap empty
+ */
+int kheap_heapify(keyed_heap_t * heap,
+                  const size_t * handles,
+                  const double * keys,
+                  size_t         count);
+
+/**
+ * @brief Look up the key of a handle in the heap.
+ *
+ * @param heap a pointer to an allocated heap
+ * @param handle any handle
+ * @param key filled with its key, unless NULL
+ * @return true if the handle is in the heap
+ */
+bool kheap_contains(const keyed_heap_t * heap, size_t handle, double * key);
+
+/**
+ * @brief Returns the number of handles in the heap.
+ *
+ * @param heap a pointer to an allocated heap
+ * @return size_t the number of handles
+ */
+size_t kheap_size(const keyed_heap_t * heap);
+
+/**
+ * @brief Remove every handle, in O(size).
+ *
+ * @param heap a pointer to an allocated heap
+ */
+void kheap_clear(keyed_heap_t * heap);
+
+#endif
@@ -0,0 +1,18 @@
+/** @file heap_common.h
+ *
+ * @brief Layout shared by the heaps in indexed_heap.h. Internal.
+ *
+ */
+
+#ifndef HEAP_COMMON_H
+#define HEAP_COMMON_H
+
+#define HEAP_ARITY 4
+
+/* Marks a handle that is not in the heap. */
+#define IHEAP_ABSENT UINT32_MAX
+
+#define HEAP_PARENT(slot)      (((slot) - 1) / HEAP_ARITY)
+#define HEAP_FIRST_CHILD(slot) ((slot) * HEAP_ARITY + 1)
+
+#endif
@@ -0,0 +1,286 @@
+/** @file indexed_heap.c
+ *
+ * @brief A 4-ary heap of handles ordered by a callback.
+ *
+ * heap holds the handles in heap order, with the children of slot i in
+ * slots 4i + 1 to 4i + 4; position maps every handle back to its slot, or
+ * to IHEAP_ABSENT. Sifts carry the moving handle in a local and shift the
+ * others into the hole, writing each slot and position once per level.
+ *
+ */
+
+#include "../include/indexed_heap.h"
+#include "heap_common.h"
+#include <stdint.h>
+#include <stdlib.h>
+
+struct indexed_heap
+{
+    uint32_t *   heap;
+    uint32_t *   position; /* Slot of each handle, or IHEAP_ABSENT. */
+    size_t       size;
+    size_t       capacity;
+    iheap_less_f less;
+    void *       ctx;
+};
+
+static bool
+iheap_less(const indexed_heap_t * heap, uint32_t a, uint32_t b)
+{
+    return heap->less(a, b, heap->ctx);
+}
+
+static void
+iheap_place(indexed_heap_t * heap, size_t slot, uint32_t handle)
+{
+    heap->heap[slot]       = handle;
+    heap->position[handle] = (uint32_t)slot;
+}
+
+static void
+iheap_sift_up(indexed_heap_t * heap, size_t slot)
+{
+    uint32_t handle = heap->heap[slot];
+
+    while (slot > 0)
+    {
+        size_t parent = HEAP_PARENT(slot);
+        if (!iheap_less(heap, handle, heap->heap[parent]))
+        {
+            break;
+        }
+        iheap_place(heap, slot, heap->heap[parent]);
+        slot = parent;
+    }
+    iheap_place(heap, slot, handle);
+}
+
+static void
+iheap_sift_down(indexed_heap_t * heap, size_t slot)
+{
+    uint32_t handle = heap->heap[slot];
+
+    for (;;)
+    {
+        size_t first = HEAP_FIRST_CHILD(slot);
+        if (first >= heap->size)
+        {
+            break;
+        }
+        size_t last = first + HEAP_ARITY;
+        last        = last < heap->size ? last : heap->size;
+
+        size_t best = first;
+        for (size_t child = first + 1; child < last; child++)
+        {
+            if (iheap_less(heap, heap->heap[child], heap->heap[best]))
+            {
+                best = child;
+            }
+        }
+        if (!iheap_less(heap, heap->heap[best], handle))
+        {
+            break;
+        }
+        iheap_place(heap, slot, heap->heap[best]);
+        slot = best;
+    }
+    iheap_place(heap, slot, handle);
+}
+
+/* Fill the slot of a removed handle with the last one, and sift that into
+ * place. */
+static void
+iheap_unlink(indexed_heap_t * heap, size_t slot)
+{
+    heap->position[heap->heap[slot]] = IHEAP_ABSENT;
+    heap->size--;
+    if (slot == heap->size)
+    {
+        return;
+    }
+
+    iheap_place(heap, slot, heap->heap[heap->size]);
+    if (slot > 0
+        && iheap_less(heap, heap->heap[slot], heap->heap[HEAP_PARENT(slot)]))
+    {
+        iheap_sift_up(heap, slot);
+    }
+    else
+    {
+        iheap_sift_down(heap, slot);
+    }
+}
+
+indexed_heap_t *
+iheap_create(size_t capacity, iheap_less_f less, void * ctx)
+{
+    if (less == NULL || capacity > IHEAP_MAX_CAPACITY)
+    {
+        return NULL;
+    }
+
+    indexed_heap_t * heap = calloc(1, sizeof(indexed_heap_t));
+    if (heap == NULL)
+    {
+        return NULL;
+    }
+    heap->heap     = malloc((capacity ? capacity : 1) * sizeof(uint32_t));
+    heap->position = malloc((capacity ? capacity : 1) * sizeof(uint32_t));
+    if (heap->heap == NULL || heap->position == NULL)
+    {
+        iheap_destroy(&heap);
+        return NULL;
+    }
+    for (size_t i = 0; i < capacity; i++)
+    {
+        heap->position[i] = IHEAP_ABSENT;
+    }
+    heap->capacity = capacity;
+    heap->less     = less;
+    heap->ctx      = ctx;
+    return heap;
+}
+
+void
+iheap_destroy(indexed_heap_t ** heap)
+{
+    if (!heap || !*heap)
+    {
+        return;
+    }
+
+    free((*heap)->heap);
+    free((*heap)->position);
+    free(*heap);
+    *heap = NULL;
+}
+
+int
+iheap_push(indexed_heap_t * heap, size_t handle)
+{
+    if (handle >= heap->capacity || heap->position[handle] != IHEAP_ABSENT)
+    {
+        return -1;
+    }
+    heap->heap[heap->size] = (uint32_t)handle;
+    iheap_sift_up(heap, heap->size++);
+    return 0;
+}
+
+int
+iheap_pop(indexed_heap_t * heap, size_t * handle)
+{
+    if (heap->size == 0)
+    {
+        return -1;
+    }
+    if (handle)
+    {
+        *handle = heap->heap[0];
+    }
+    iheap_unlink(heap, 0);
+    return 0;
+}
+
+int
+iheap_peek(const indexed_heap_t * heap, size_t * handle)
+{
+    if (heap->size == 0)
+    {
+        return -1;
+    }
+    *handle = heap->heap[0];
+    return 0;
+}
+
+int
+iheap_decrease(indexed_heap_t * heap, size_t handle)
+{
+    if (!iheap_contains(heap, handle))
+    {
+        return -1;
+    }
+    iheap_sift_up(heap, heap->position[handle]);
+    return 0;
+}
+
+int
+iheap_update(indexed_heap_t * heap, size_t handle)
+{
+    if (!iheap_contains(heap, handle))
+    {
+        return -1;
+    }
+
+    size_t slot = heap->position[handle];
+    if (slot > 0
+        && iheap_less(heap, (uint32_t)handle, heap->heap[HEAP_PARENT(slot)]))
+    {
+        iheap_sift_up(heap, slot);
+    }
+    else
+    {
+        iheap_sift_down(heap, slot);
+    }
+    return 0;
+}
+
+int
+iheap_remove(indexed_heap_t * heap, size_t handle)
+{
+    if (!iheap_contains(heap, handle))
+    {
+        return -1;
+    }
+    iheap_unlink(heap, heap->position[handle]);
+    return 0;
+}
+
+int
+iheap_heapify(indexed_heap_t * heap, const size_t * handles, size_t count)
+{
+    iheap_clear(heap);
+    for (size_t i = 0; i < count; i++)
+    {
+        if (handles[i] >= heap->capacity
+            || heap->position[handles[i]] != IHEAP_ABSENT)
+        {
+            iheap_clear(heap);
+            return -1;
+        }
+        iheap_place(heap, i, (uint32_t)handles[i]);
+        heap->size++;
+    }
+
+    /* Sift down every parent, the last first: O(n) in all, as most of the
+     * slots are leaves or close to them. */
+    size_t parents = count > 1 ? HEAP_PARENT(count - 1) + 1 : 0;
+    for (size_t slot = parents; slot-- > 0;)
+    {
+        iheap_sift_down(heap, slot);
+    }
+    return 0;
+}
+
+bool
+iheap_contains(const indexed_heap_t * heap, size_t handle)
+{
+    return handle < heap->capacity && heap->position[handle] != IHEAP_ABSENT;
+}
+
+size_t
+iheap_size(const indexed_heap_t * heap)
+{
+    return heap->size;
+}
+
+void
+iheap_clear(indexed_heap_t * heap)
+{
+    for (size_t i = 0; i < heap->size; i++)
+    {
+        heap->position[heap->heap[i]] = IHEAP_ABSENT;
+    }
+    heap->size = 0;
+}
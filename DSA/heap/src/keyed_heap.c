@@ -0,0 +1,328 @@
+/** @file keyed_heap.c
+ *
+ * @brief A 4-ary heap of handles with their keys stored inline.
+ *
+ * Each slot holds a key and its handle, 16 bytes, so the four children of
+ * a slot fill 64 bytes. The slot array starts three slots into a cache
+ * line aligned allocation: the root sits alone at the end of the first
+ * line, and the children of every slot, from 4i + 1 to 4i + 4, then fill
+ * exactly one line. A sift down thus touches one cache line per level.
+ *
+ * position maps handles back to slots, as in indexed_heap.c.
+ *
+ */
+
+#include "../include/indexed_heap.h"
+#include "heap_common.h"
+#include <stdint.h>
+#include <stdlib.h>
+
+#define KHEAP_CACHE_LINE 64
+#define KHEAP_ROOT_OFFSET 3 /* Slots before the root in the allocation. */
+
+typedef struct kheap_slot
+{
+    double   key;
+    uint32_t handle;
+} kheap_slot_t;
+
+struct keyed_heap
+{
+    kheap_slot_t * block; /* The aligned allocation. */
+    kheap_slot_t * slots; /* block + KHEAP_ROOT_OFFSET. */
+    uint32_t *     position;
+    size_t         size;
+    size_t         capacity;
+};
+
+static void
+kheap_place(keyed_heap_t * heap, size_t slot, kheap_slot_t entry)
+{
+    heap->slots[slot]            = entry;
+    heap->position[entry.handle] = (uint32_t)slot;
+}
+
+static void
+kheap_sift_up(keyed_heap_t * heap, size_t slot)
+{
+    kheap_slot_t entry = heap->slots[slot];
+
+    while (slot > 0)
+    {
+        size_t parent = HEAP_PARENT(slot);
+        if (!(entry.key < heap->slots[parent].key))
+        {
+            break;
+        }
+        kheap_place(heap, slot, heap->slots[parent]);
+        slot = parent;
+    }
+    kheap_place(heap, slot, entry);
+}
+
+static void
+kheap_sift_down(keyed_heap_t * heap, size_t slot)
+{
+    kheap_slot_t entry = heap->slots[slot];
+
+    for (;;)
+    {
+        size_t first = HEAP_FIRST_CHILD(slot);
+        if (first >= heap->size)
+        {
+            break;
+        }
+        size_t last = first + HEAP_ARITY;
+        last        = last < heap->size ? last : heap->size;
+
+        size_t best = first;
+        for (size_t child = first + 1; child < last; child++)
+        {
+            if (heap->slots[child].key < heap->slots[best].key)
+            {
+                best = child;
+            }
+        }
+        if (!(heap->slots[best].key < entry.key))
+        {
+            break;
+        }
+        kheap_place(heap, slot, heap->slots[best]);
+        slot = best;
+    }
+    kheap_place(heap, slot, entry);
+}
+
+static void
+kheap_sift(keyed_heap_t * heap, size_t slot)
+{
+    if (slot > 0 && heap->slots[slot].key < heap->slots[HEAP_PARENT(slot)].key)
+    {
+        kheap_sift_up(heap, slot);
+    }
+    else
+    {
+        kheap_sift_down(heap, slot);
+    }
+}
+
+static void
+kheap_unlink(keyed_heap_t * heap, size_t slot)
+{
+    heap->position[heap->slots[slot].handle] = IHEAP_ABSENT;
+    heap->size--;
+    if (slot < heap->size)
+    {
+        kheap_place(heap, slot, heap->slots[heap->size]);
+        kheap_sift(heap, slot);
+    }
+}
+
+keyed_heap_t *
+kheap_create(size_t capacity)
+{
+    if (capacity > IHEAP_MAX_CAPACITY)
+    {
+        return NULL;
+    }
+
+    keyed_heap_t * heap = calloc(1, sizeof(keyed_heap_t));
+    if (heap == NULL)
+    {
+        return NULL;
+    }
+
+    /* aligned_alloc() wants a multiple of the alignment. */
+    size_t lines = ((capacity + KHEAP_ROOT_OFFSET) * sizeof(kheap_slot_t)
+                    + KHEAP_CACHE_LINE - 1)
+                 / KHEAP_CACHE_LINE;
+
+    heap->block    = aligned_alloc(KHEAP_CACHE_LINE, lines * KHEAP_CACHE_LINE);
+    heap->position = malloc((capacity ? capacity : 1) * sizeof(uint32_t));
+    if (heap->block == NULL || heap->position == NULL)
+    {
+        kheap_destroy(&heap);
+        return NULL;
+    }
+    for (size_t i = 0; i < capacity; i++)
+    {
+        heap->position[i] = IHEAP_ABSENT;
+    }
+    heap->slots    = heap->block + KHEAP_ROOT_OFFSET;
+    heap->capacity = capacity;
+    return heap;
+}
+
+void
+kheap_destroy(keyed_heap_t ** heap)
+{
+    if (!heap || !*heap)
+    {
+        return;
+    }
+
+    free((*heap)->block);
+    free((*heap)->position);
+    free(*heap);
+    *heap = NULL;
+}
+
+int
+kheap_push(keyed_heap_t * heap, size_t handle, double key)
+{
+    if (handle >= heap->capacity || heap->position[handle] != IHEAP_ABSENT)
+    {
+        return -1;
+    }
+    heap->slots[heap->size] = (kheap_slot_t) { key, (uint32_t)handle };
+    kheap_sift_up(heap, heap->size++);
+    return 0;
+}
+
+int
+kheap_pop(keyed_heap_t * heap, size_t * handle, double * key)
+{
+    if (kheap_peek(heap, handle, key))
+    {
+        return -1;
+    }
+    kheap_unlink(heap, 0);
+    return 0;
+}
+
+int
+kheap_peek(const keyed_heap_t * heap, size_t * handle, double * key)
+{
+    if (heap->size == 0)
+    {
+        return -1;
+    }
+    if (handle)
+    {
+        *handle = heap->slots[0].handle;
+    }
+    if (key)
+    {
+        *key = heap->slots[0].key;
+    }
+    return 0;
+}
+
+int
+kheap_decrease_key(keyed_heap_t * heap, size_t handle, double key)
+{
+    double old_key = 0;
+    if (!kheap_contains(heap, handle, &old_key) || key > old_key)
+    {
+        return -1;
+    }
+
+    size_t slot           = heap->position[handle];
+    heap->slots[slot].key = key;
+    kheap_sift_up(heap, slot);
+    return 0;
+}
+
+int
+kheap_update_key(keyed_heap_t * heap, size_t handle, double key)
+{
+    if (!kheap_contains(heap, handle, NULL))
+    {
+        return -1;
+    }
+
+    size_t slot           = heap->position[handle];
+    heap->slots[slot].key = key;
+    kheap_sift(heap, slot);
+    return 0;
+}
+
+int
+kheap_relax(keyed_heap_t * heap, size_t handle, double key)
+{
+    double old_key = 0;
+
+    if (handle >= heap->capacity)
+    {
+        return -1;
+    }
+    if (!kheap_contains(heap, handle, &old_key))
+    {
+        kheap_push(heap, handle, key);
+        return 1;
+    }
+    if (!(key < old_key))
+    {
+        return 0;
+    }
+    kheap_decrease_key(heap, handle, key);
+    return 1;
+}
+
+int
+kheap_remove(keyed_heap_t * heap, size_t handle)
+{
+    if (!kheap_contains(heap, handle, NULL))
+    {
+        return -1;
+    }
+    kheap_unlink(heap, heap->position[handle]);
+    return 0;
+}
+
+int
+kheap_heapify(keyed_heap_t * heap,
+              const size_t * handles,
+              const double * keys,
+              size_t         count)
+{
+    kheap_clear(heap);
+    for (size_t i = 0; i < count; i++)
+    {
+        if (handles[i] >= heap->capacity
+            || heap->position[handles[i]] != IHEAP_ABSENT)
+        {
+            kheap_clear(heap);
+            return -1;
+        }
+        kheap_place(heap, i, (kheap_slot_t) { keys[i], (uint32_t)handles[i] });
+        heap->size++;
+    }
+
+    size_t parents = count > 1 ? HEAP_PARENT(count - 1) + 1 : 0;
+    for (size_t slot = parents; slot-- > 0;)
+    {
+        kheap_sift_down(heap, slot);
+    }
+    return 0;
+}
+
+bool
+kheap_contains(const keyed_heap_t * heap, size_t handle, double * key)
+{
+    if (handle >= heap->capacity || heap->position[handle] == IHEAP_ABSENT)
+    {
+        return false;
+    }
+    if (key)
+    {
+        *key = heap->slots[heap->position[handle]].key;
+    }
+    return true;
+}
+
+size_t
+kheap_size(const keyed_heap_t * heap)
+{
+    return heap->size;
+}
+
+void
+kheap_clear(keyed_heap_t * heap)
+{
+    for (size_t i = 0; i < heap->size; i++)
+    {
+        heap->position[heap->slots[i].handle] = IHEAP_ABSENT;
+    }
+    heap->size = 0;
+}
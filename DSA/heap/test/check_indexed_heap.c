@@ -0,0 +1,413 @@
+/** @file check_indexed_heap.c
+ *
+ * @brief Tests for the indexed heaps against a reference: random pushes,
+ *        pops, priority changes either way and removals from anywhere,
+ *        heapify, and the errors for handles out of range or in the wrong
+ *        state.
+ *
+ * Build and run from DSA/heap with
+ *
+ *     gcc -std=c18 -O2 -D_DEFAULT_SOURCE -Iinclude src/indexed_heap.c \
+ *         src/keyed_heap.c test/check_indexed_heap.c \
+ *         -lcheck -lm -lrt -lsubunit -pthread -o check_indexed_heap
+ *     ./check_indexed_heap
+ *
+ */
+
+#include <check.h>
+#include <stdlib.h>
+
+#include "../include/indexed_heap.h"
+
+#define CAPACITY 1000
+#define OPERATIONS 200000
+#define PRIORITY_RANGE 100 /* Small, so that many priorities tie. */
+#define CHECK_EVERY 1000
+
+typedef struct
+{
+    double priority[CAPACITY];
+    bool   present[CAPACITY];
+    size_t size;
+} Reference_T;
+
+static bool
+priority_less(size_t a, size_t b, void * ctx)
+{
+    const Reference_T * reference = ctx;
+    return reference->priority[a] < reference->priority[b];
+}
+
+static double
+random_priority(void)
+{
+    return (double)(rand() % PRIORITY_RANGE);
+}
+
+/* The smallest priority of the handles present. */
+static double
+reference_min(const Reference_T * reference)
+{
+    double min = PRIORITY_RANGE;
+    for (size_t h = 0; h < CAPACITY; h++)
+    {
+        if (reference->present[h] && reference->priority[h] < min)
+        {
+            min = reference->priority[h];
+        }
+    }
+    return min;
+}
+
+/* Fill handles with a random subset of the handles, of random size, and
+ * make it the contents of the reference. */
+static size_t
+random_subset(Reference_T * reference, size_t * handles, double * keys)
+{
+    size_t count = 0;
+    for (size_t h = 0; h < CAPACITY; h++)
+    {
+        reference->present[h] = rand() % 3 == 0;
+        if (reference->present[h])
+        {
+            reference->priority[h] = random_priority();
+            handles[count]         = h;
+            keys[count++]          = reference->priority[h];
+        }
+    }
+    reference->size = count;
+
+    /* Shuffle, so that heapify gets the handles in no particular order. */
+    for (size_t i = count; i > 1; i--)
+    {
+        size_t j = (size_t)rand() % i;
+        size_t h = handles[i - 1];
+        double k = keys[i - 1];
+
+        handles[i - 1] = handles[j];
+        keys[i - 1]    = keys[j];
+        handles[j]     = h;
+        keys[j]        = k;
+    }
+    return count;
+}
+
+static void
+check_iheap_contents(const indexed_heap_t * heap,
+                     const Reference_T *    reference)
+{
+    ck_assert_uint_eq(iheap_size(heap), reference->size);
+    for (size_t h = 0; h < CAPACITY; h++)
+    {
+        ck_assert_int_eq(iheap_contains(heap, h), reference->present[h]);
+    }
+}
+
+START_TEST(test_iheap_matches_reference)
+{
+    Reference_T *    reference = calloc(1, sizeof(Reference_T));
+    size_t *         handles   = malloc(CAPACITY * sizeof(size_t));
+    double *         keys      = malloc(CAPACITY * sizeof(double));
+    indexed_heap_t * heap = iheap_create(CAPACITY, priority_less, reference);
+
+    ck_assert_ptr_nonnull(reference);
+    ck_assert_ptr_nonnull(handles);
+    ck_assert_ptr_nonnull(keys);
+    ck_assert_ptr_nonnull(heap);
+    srand(48);
+    for (size_t op = 0; op < OPERATIONS; op++)
+    {
+        size_t handle = (size_t)rand() % CAPACITY;
+        bool   here   = reference->present[handle];
+        size_t first  = 0;
+
+        switch (rand() % 8)
+        {
+        case 0:
+        case 1:
+            if (!here)
+            {
+                reference->priority[handle] = random_priority();
+            }
+            ck_assert_int_eq(iheap_push(heap, handle), here ? -1 : 0);
+            reference->size += !here;
+            reference->present[handle] = true;
+            break;
+        case 2:
+            if (reference->size == 0)
+            {
+                ck_assert_int_eq(iheap_pop(heap, &first), -1);
+                break;
+            }
+            ck_assert_int_eq(iheap_peek(heap, &first), 0);
+            ck_assert(reference->present[first]);
+            ck_assert(reference->priority[first] == reference_min(reference));
+            ck_assert_int_eq(iheap_pop(heap, &handle), 0);
+            ck_assert_uint_eq(handle, first);
+            reference->present[handle] = false;
+            reference->size--;
+            break;
+        case 3:
+            if (here)
+            {
+                reference->priority[handle] -= rand() % PRIORITY_RANGE;
+            }
+            ck_assert_int_eq(iheap_decrease(heap, handle), here ? 0 : -1);
+            break;
+        case 4:
+        case 5:
+            if (here)
+            {
+                reference->priority[handle] = random_priority();
+            }
+            ck_assert_int_eq(iheap_update(heap, handle), here ? 0 : -1);
+            break;
+        case 6:
+            ck_assert_int_eq(iheap_remove(heap, handle), here ? 0 : -1);
+            reference->size -= here;
+            reference->present[handle] = false;
+            break;
+        default:
+            if (rand() % 100 == 0)
+            {
+                size_t count = random_subset(reference, handles, keys);
+                ck_assert_int_eq(iheap_heapify(heap, handles, count), 0);
+            }
+            break;
+        }
+
+        if (op % CHECK_EVERY == 0)
+        {
+            check_iheap_contents(heap, reference);
+        }
+    }
+
+    /* Drain in order. */
+    check_iheap_contents(heap, reference);
+    double last = -1e300;
+    size_t handle;
+    while (iheap_pop(heap, &handle) == 0)
+    {
+        ck_assert(reference->present[handle]);
+        ck_assert(reference->priority[handle] >= last);
+        last                       = reference->priority[handle];
+        reference->present[handle] = false;
+    }
+    ck_assert_uint_eq(iheap_size(heap), 0);
+
+    iheap_destroy(&heap);
+    ck_assert_ptr_null(heap);
+    free(reference);
+    free(handles);
+    free(keys);
+}
+END_TEST
+
+static void
+check_kheap_contents(const keyed_heap_t * heap, const Reference_T * reference)
+{
+    ck_assert_uint_eq(kheap_size(heap), reference->size);
+    for (size_t h = 0; h < CAPACITY; h++)
+    {
+        double key = -1;
+        ck_assert_int_eq(kheap_contains(heap, h, &key), reference->present[h]);
+        ck_assert(!reference->present[h] || key == reference->priority[h]);
+    }
+}
+
+START_TEST(test_kheap_matches_reference)
+{
+    Reference_T *  reference = calloc(1, sizeof(Reference_T));
+    size_t *       handles   = malloc(CAPACITY * sizeof(size_t));
+    double *       keys      = malloc(CAPACITY * sizeof(double));
+    keyed_heap_t * heap      = kheap_create(CAPACITY);
+
+    ck_assert_ptr_nonnull(reference);
+    ck_assert_ptr_nonnull(handles);
+    ck_assert_ptr_nonnull(keys);
+    ck_assert_ptr_nonnull(heap);
+    srand(49);
+    for (size_t op = 0; op < OPERATIONS; op++)
+    {
+        size_t handle = (size_t)rand() % CAPACITY;
+        bool   here   = reference->present[handle];
+        double key    = random_priority();
+        double old    = reference->priority[handle];
+        size_t first  = 0;
+        double min    = 0;
+
+        switch (rand() % 9)
+        {
+        case 0:
+        case 1:
+            ck_assert_int_eq(kheap_push(heap, handle, key), here ? -1 : 0);
+            if (!here)
+            {
+                reference->priority[handle] = key;
+                reference->present[handle]  = true;
+                reference->size++;
+            }
+            break;
+        case 2:
+            if (reference->size == 0)
+            {
+                ck_assert_int_eq(kheap_pop(heap, &first, &min), -1);
+                break;
+            }
+            ck_assert_int_eq(kheap_pop(heap, &first, &min), 0);
+            ck_assert(reference->present[first]);
+            ck_assert(min == reference->priority[first]);
+            ck_assert(min == reference_min(reference));
+            reference->present[first] = false;
+            reference->size--;
+            break;
+        case 3:
+            /* Only a key no larger is accepted. */
+            ck_assert_int_eq(kheap_decrease_key(heap, handle, key),
+                             here && key <= old ? 0 : -1);
+            if (here && key <= old)
+            {
+                reference->priority[handle] = key;
+            }
+            break;
+        case 4:
+            ck_assert_int_eq(kheap_update_key(heap, handle, key),
+                             here ? 0 : -1);
+            if (here)
+            {
+                reference->priority[handle] = key;
+            }
+            break;
+        case 5:
+        case 6:
+            ck_assert_int_eq(kheap_relax(heap, handle, key),
+                             !here || key < old ? 1 : 0);
+            if (!here || key < old)
+            {
+                reference->priority[handle] = key;
+                reference->size += !here;
+                reference->present[handle] = true;
+            }
+            break;
+        case 7:
+            ck_assert_int_eq(kheap_remove(heap, handle), here ? 0 : -1);
+            reference->size -= here;
+            reference->present[handle] = false;
+            break;
+        default:
+            if (rand() % 100 == 0)
+            {
+                size_t count = random_subset(reference, handles, keys);
+                ck_assert_int_eq(kheap_heapify(heap, handles, keys, count),
+                                 0);
+            }
+            break;
+        }
+
+        if (op % CHECK_EVERY == 0)
+        {
+            check_kheap_contents(heap, reference);
+        }
+    }
+
+    check_kheap_contents(heap, reference);
+    double last = -1e300;
+    size_t handle;
+    double key;
+    while (kheap_pop(heap, &handle, &key) == 0)
+    {
+        ck_assert(key == reference->priority[handle]);
+        ck_assert(key >= last);
+        last = key;
+    }
+
+    kheap_destroy(&heap);
+    ck_assert_ptr_null(heap);
+    free(reference);
+    free(handles);
+    free(keys);
+}
+END_TEST
+
+START_TEST(test_errors_and_edge_cases)
+{
+    Reference_T *    reference = calloc(1, sizeof(Reference_T));
+    indexed_heap_t * iheap     = iheap_create(4, priority_less, reference);
+    keyed_heap_t *   kheap     = kheap_create(4);
+    size_t           handle    = 0;
+
+    ck_assert_ptr_nonnull(reference);
+    ck_assert_ptr_nonnull(iheap);
+    ck_assert_ptr_nonnull(kheap);
+
+    /* Empty heaps, and handles past the capacity. */
+    ck_assert_int_eq(iheap_pop(iheap, &handle), -1);
+    ck_assert_int_eq(iheap_peek(iheap, &handle), -1);
+    ck_assert_int_eq(kheap_pop(kheap, NULL, NULL), -1);
+    ck_assert_int_eq(kheap_peek(kheap, NULL, NULL), -1);
+    ck_assert_int_eq(iheap_push(iheap, 4), -1);
+    ck_assert_int_eq(kheap_push(kheap, 4, 1.0), -1);
+    ck_assert_int_eq(kheap_relax(kheap, 4, 1.0), -1);
+    ck_assert(!iheap_contains(iheap, 4));
+    ck_assert(!kheap_contains(kheap, 4, NULL));
+
+    /* A repeated or out of range handle empties the heap. */
+    size_t repeated[]  = { 0, 1, 0 };
+    size_t too_large[] = { 0, 4 };
+    double keys[]      = { 1.0, 2.0, 3.0 };
+    ck_assert_int_eq(iheap_heapify(iheap, repeated, 3), -1);
+    ck_assert_uint_eq(iheap_size(iheap), 0);
+    ck_assert_int_eq(kheap_heapify(kheap, too_large, keys, 2), -1);
+    ck_assert_uint_eq(kheap_size(kheap), 0);
+    ck_assert(!kheap_contains(kheap, 0, NULL));
+
+    /* The handle at the root removed, and the last one. */
+    ck_assert_int_eq(kheap_heapify(kheap, repeated, keys, 2), 0);
+    ck_assert_int_eq(kheap_remove(kheap, 0), 0);
+    ck_assert_int_eq(kheap_remove(kheap, 0), -1);
+    ck_assert_int_eq(kheap_peek(kheap, &handle, NULL), 0);
+    ck_assert_uint_eq(handle, 1);
+    ck_assert_int_eq(kheap_remove(kheap, 1), 0);
+    ck_assert_uint_eq(kheap_size(kheap), 0);
+
+    ck_assert_ptr_null(iheap_create(4, NULL, NULL));
+    ck_assert_ptr_null(iheap_create((size_t)IHEAP_MAX_CAPACITY + 1,
+                                    priority_less,
+                                    NULL));
+    ck_assert_ptr_null(kheap_create((size_t)IHEAP_MAX_CAPACITY + 1));
+    iheap_destroy(&iheap);
+    kheap_destroy(&kheap);
+    iheap_destroy(NULL);
+    kheap_destroy(NULL);
+    free(reference);
+}
+END_TEST
+
+Suite *
+check_indexed_heap_suite(void)
+{
+    Suite * suite        = suite_create("indexed_heap_test");
+    TCase * tc_core      = tcase_create("Core");
+    TCase * tc_reference = tcase_create("Reference");
+
+    tcase_add_test(tc_core, test_errors_and_edge_cases);
+    tcase_add_test(tc_reference, test_iheap_matches_reference);
+    tcase_add_test(tc_reference, test_kheap_matches_reference);
+    tcase_set_timeout(tc_reference, 60);
+
+    suite_add_tcase(suite, tc_core);
+    suite_add_tcase(suite, tc_reference);
+    return suite;
+}
+
+int
+main(void)
+{
+    SRunner * runner = srunner_create(check_indexed_heap_suite());
+
+    srunner_run_all(runner, CK_VERBOSE);
+
+    int no_failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+    return (no_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
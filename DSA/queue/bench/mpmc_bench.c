@@ -0,0 +1,342 @@
+/** @file mpmc_bench.c
+ *
+ * @brief Measures the throughput of the MPMC queue with several producers
+ *        and consumers contending for it, against queue.h behind a mutex
+ *        and two condition variables.
+ *
+ * Build and run from DSA/queue with
+ *
+ *     gcc -std=c18 -O2 -D_GNU_SOURCE -pthread src/queue.c src/mpmc_queue.c \
+ *         bench/mpmc_bench.c -o mpmc_bench
+ *     ./mpmc_bench [operations] [producers] [consumers] [capacity]
+ *
+ * The producers share out the numbers 1 to operations (10M by default)
+ * and push them through one queue of capacity slots (1024 by default);
+ * the consumers pop them, singly and then in drains of up to 64, and the
+ * sums they see are checked against the total. Four producers and four
+ * consumers run by default, each thread pinned to the next CPU in turn.
+ *
+ * Besides millions of elements per second, the bench reports the
+ * voluntary context switches per thousand elements, counted by
+ * getrusage(): each one is a thread that went to sleep in the kernel. The
+ * mutex baseline sleeps whenever threads collide on its lock, the MPMC
+ * queue only when it runs empty or full, which a small capacity makes more
+ * likely. Results need more CPUs than threads to mean anything.
+ *
+ */
+
+#include "../include/mpmc_queue.h"
+#include "../include/queue.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BATCH 64
+#define MAX_THREADS 64
+
+typedef struct bench_run
+{
+    const char * name;
+    void * (*producer)(void * arg);
+    void * (*consumer)(void * arg);
+    mpmc_queue_t *       mpmc;
+    queue_t *            locked;
+    pthread_mutex_t      lock;
+    pthread_cond_t       not_empty;
+    pthread_cond_t       not_full;
+    bool                 closed; /* Guarded by lock. */
+    size_t               capacity;
+    uint64_t             operations;
+    int                  producers;
+    int                  consumers;
+    int                  cpus;
+    atomic_int           next_cpu;
+    atomic_uint_fast64_t next_value; /* Handed out to producers in blocks. */
+    atomic_uint_fast64_t sum;        /* Added to by the consumers. */
+} bench_run_t;
+
+static double
+now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static void
+pin_next(bench_run_t * run)
+{
+    int       cpu = atomic_fetch_add(&run->next_cpu, 1) % run->cpus;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+    {
+        fprintf(stderr, "could not pin to cpu %d\n", cpu);
+    }
+}
+
+/* Claim the next block of up to BATCH values to send, returning how many
+ * there are from *first on. */
+static uint64_t
+claim_values(bench_run_t * run, uint64_t * first)
+{
+    *first = atomic_fetch_add(&run->next_value, BATCH);
+    if (*first > run->operations)
+    {
+        return 0;
+    }
+    uint64_t left = run->operations - *first + 1;
+    return left < BATCH ? left : BATCH;
+}
+
+static void *
+locked_producer(void * arg)
+{
+    bench_run_t * run   = arg;
+    uint64_t      first = 0;
+    pin_next(run);
+    for (uint64_t count = claim_values(run, &first); count > 0;
+         count          = claim_values(run, &first))
+    {
+        for (uint64_t i = first; i < first + count; i++)
+        {
+            pthread_mutex_lock(&run->lock);
+            while (queue_size(run->locked) >= run->capacity)
+            {
+                pthread_cond_wait(&run->not_full, &run->lock);
+            }
+            queue_push(run->locked, &i);
+            pthread_mutex_unlock(&run->lock);
+            pthread_cond_signal(&run->not_empty);
+        }
+    }
+    return NULL;
+}
+
+static void *
+locked_consumer(void * arg)
+{
+    bench_run_t * run = arg;
+    uint64_t      sum = 0;
+    pin_next(run);
+    for (;;)
+    {
+        uint64_t value = 0;
+        pthread_mutex_lock(&run->lock);
+        while (queue_is_empty(run->locked) && !run->closed)
+        {
+            pthread_cond_wait(&run->not_empty, &run->lock);
+        }
+        int status = queue_pop(run->locked, &value);
+        pthread_mutex_unlock(&run->lock);
+        if (status != 0)
+        {
+            break;
+        }
+        pthread_cond_signal(&run->not_full);
+        sum += value;
+    }
+    atomic_fetch_add(&run->sum, sum);
+    return NULL;
+}
+
+static void
+locked_shut_down(bench_run_t * run)
+{
+    pthread_mutex_lock(&run->lock);
+    run->closed = true;
+    pthread_mutex_unlock(&run->lock);
+    pthread_cond_broadcast(&run->not_empty);
+}
+
+static void *
+mpmc_producer(void * arg)
+{
+    bench_run_t * run   = arg;
+    uint64_t      first = 0;
+    pin_next(run);
+    for (uint64_t count = claim_values(run, &first); count > 0;
+         count          = claim_values(run, &first))
+    {
+        for (uint64_t i = first; i < first + count; i++)
+        {
+            mpmc_push(run->mpmc, &i);
+        }
+    }
+    return NULL;
+}
+
+static void *
+mpmc_consumer(void * arg)
+{
+    bench_run_t * run   = arg;
+    uint64_t      sum   = 0;
+    uint64_t      value = 0;
+    pin_next(run);
+    while (mpmc_pop(run->mpmc, &value) == 0)
+    {
+        sum += value;
+    }
+    atomic_fetch_add(&run->sum, sum);
+    return NULL;
+}
+
+static void *
+drain_consumer(void * arg)
+{
+    bench_run_t * run = arg;
+    uint64_t      sum = 0;
+    uint64_t      batch[BATCH];
+    pin_next(run);
+    for (size_t count = mpmc_drain(run->mpmc, batch, BATCH); count > 0;
+         count        = mpmc_drain(run->mpmc, batch, BATCH))
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            sum += batch[i];
+        }
+    }
+    atomic_fetch_add(&run->sum, sum);
+    return NULL;
+}
+
+static long
+context_switches(void)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_nvcsw;
+}
+
+static void
+run_bench(bench_run_t * run, void (*shut_down)(bench_run_t *))
+{
+    pthread_t producers[MAX_THREADS];
+    pthread_t consumers[MAX_THREADS];
+
+    atomic_store(&run->next_cpu, 0);
+    atomic_store(&run->next_value, 1);
+    atomic_store(&run->sum, 0);
+
+    long   switches = context_switches();
+    double start    = now_ns();
+    for (int i = 0; i < run->consumers; i++)
+    {
+        pthread_create(&consumers[i], NULL, run->consumer, run);
+    }
+    for (int i = 0; i < run->producers; i++)
+    {
+        pthread_create(&producers[i], NULL, run->producer, run);
+    }
+    for (int i = 0; i < run->producers; i++)
+    {
+        pthread_join(producers[i], NULL);
+    }
+    shut_down(run);
+    for (int i = 0; i < run->consumers; i++)
+    {
+        pthread_join(consumers[i], NULL);
+    }
+    double seconds = (now_ns() - start) / 1e9;
+    switches       = context_switches() - switches;
+
+    uint64_t n = run->operations;
+    printf("%-14s %12.1f %14.2f %9s\n",
+           run->name,
+           (double)n / seconds / 1e6,
+           (double)switches * 1000.0 / (double)n,
+           atomic_load(&run->sum) == n * (n + 1) / 2 ? "yes" : "NO");
+}
+
+static void
+mpmc_shut_down(bench_run_t * run)
+{
+    mpmc_close(run->mpmc);
+}
+
+int
+main(int argc, char ** argv)
+{
+    bench_run_t run = { 0 };
+    run.operations  = 10000000;
+    run.producers   = 4;
+    run.consumers   = 4;
+    run.capacity    = 1024;
+    run.cpus        = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (argc > 1)
+    {
+        run.operations = strtoull(argv[1], NULL, 10);
+    }
+    if (argc > 3)
+    {
+        run.producers = atoi(argv[2]);
+        run.consumers = atoi(argv[3]);
+    }
+    if (argc > 4)
+    {
+        run.capacity = strtoull(argv[4], NULL, 10);
+    }
+    if (run.producers < 1 || run.producers > MAX_THREADS
+        || run.consumers < 1 || run.consumers > MAX_THREADS
+        || run.capacity == 0 || run.cpus < 1)
+    {
+        fprintf(stderr, "1 to %d producers and consumers, capacity > 0\n",
+                MAX_THREADS);
+        return EXIT_FAILURE;
+    }
+
+    run.locked = queue_create(sizeof(uint64_t), run.capacity);
+    if (run.locked == NULL)
+    {
+        fprintf(stderr, "out of memory\n");
+        return EXIT_FAILURE;
+    }
+    pthread_mutex_init(&run.lock, NULL);
+    pthread_cond_init(&run.not_empty, NULL);
+    pthread_cond_init(&run.not_full, NULL);
+
+    printf("%d producers, %d consumers, capacity %zu\n",
+           run.producers,
+           run.consumers,
+           run.capacity);
+    printf("%-14s %12s %14s %9s\n",
+           "queue",
+           "M ops/s",
+           "sleeps/1000",
+           "complete");
+
+    run.name     = "mutex+queue";
+    run.producer = locked_producer;
+    run.consumer = locked_consumer;
+    run_bench(&run, locked_shut_down);
+
+    const char * names[] = { "mpmc", "mpmc drain 64" };
+    void * (*consumers[])(void *) = { mpmc_consumer, drain_consumer };
+    for (size_t i = 0; i < 2; i++)
+    {
+        run.mpmc = mpmc_create(sizeof(uint64_t), run.capacity);
+        if (run.mpmc == NULL)
+        {
+            fprintf(stderr, "out of memory\n");
+            return EXIT_FAILURE;
+        }
+        run.name     = names[i];
+        run.producer = mpmc_producer;
+        run.consumer = consumers[i];
+        run_bench(&run, mpmc_shut_down);
+        mpmc_destroy(&run.mpmc);
+    }
+
+    pthread_cond_destroy(&run.not_full);
+    pthread_cond_destroy(&run.not_empty);
+    pthread_mutex_destroy(&run.lock);
+    queue_destroy(&run.locked);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,265 @@
+/** @file spsc_bench.c
+ *
+ * @brief Measures the throughput of the lock-free SPSC queue between two
+ *        pinned threads, against queue.h behind a mutex.
+ *
+ * Build and run from DSA/queue with
+ *
+ *     gcc -std=c18 -O2 -D_GNU_SOURCE -pthread src/queue.c src/spsc_queue.c \
+ *         bench/spsc_bench.c -o spsc_bench
+ *     ./spsc_bench [operations] [producer_cpu] [consumer_cpu]
+ *
+ * The producer sends the numbers 1 to operations (100M by default) through
+ * a 64K slot queue and the consumer checks their order. Threads are pinned
+ * to CPUs 0 and 1 unless told otherwise; pick two physical cores, ideally
+ * on one socket. Results are in millions of elements per second, which
+ * needs at least two CPUs to mean anything.
+ *
+ */
+
+#include "../include/queue.h"
+#include "../include/spsc_queue.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define CAPACITY (1u << 16)
+#define BATCH 64
+
+typedef struct bench_run
+{
+    const char * name;
+    void * (*producer)(void * arg);
+    void * (*consumer)(void * arg);
+    spsc_queue_t *  spsc;
+    queue_t *       locked;
+    pthread_mutex_t lock;
+    uint64_t        operations;
+    int             cpus[2];
+    bool            ordered; /* Set by the consumer. */
+} bench_run_t;
+
+static double
+now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static void
+pin(int cpu)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+    {
+        fprintf(stderr, "could not pin to cpu %d\n", cpu);
+    }
+}
+
+static void *
+locked_producer(void * arg)
+{
+    bench_run_t * run = arg;
+    pin(run->cpus[0]);
+    for (uint64_t i = 1; i <= run->operations;)
+    {
+        pthread_mutex_lock(&run->lock);
+        if (queue_size(run->locked) < CAPACITY)
+        {
+            queue_push(run->locked, &i);
+            i++;
+        }
+        pthread_mutex_unlock(&run->lock);
+    }
+    return NULL;
+}
+
+static void *
+locked_consumer(void * arg)
+{
+    bench_run_t * run = arg;
+    pin(run->cpus[1]);
+    run->ordered = true;
+    for (uint64_t expected = 1; expected <= run->operations;)
+    {
+        uint64_t value = 0;
+        pthread_mutex_lock(&run->lock);
+        int status = queue_pop(run->locked, &value);
+        pthread_mutex_unlock(&run->lock);
+        if (status == 0)
+        {
+            run->ordered = run->ordered && value == expected;
+            expected++;
+        }
+    }
+    return NULL;
+}
+
+static void *
+spsc_producer(void * arg)
+{
+    bench_run_t * run = arg;
+    pin(run->cpus[0]);
+    for (uint64_t i = 1; i <= run->operations;)
+    {
+        if (spsc_push(run->spsc, &i))
+        {
+            i++;
+        }
+        else
+        {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+static void *
+spsc_consumer(void * arg)
+{
+    bench_run_t * run = arg;
+    pin(run->cpus[1]);
+    run->ordered = true;
+    for (uint64_t expected = 1; expected <= run->operations;)
+    {
+        uint64_t value = 0;
+        if (spsc_pop(run->spsc, &value))
+        {
+            run->ordered = run->ordered && value == expected;
+            expected++;
+        }
+        else
+        {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+static void *
+batch_producer(void * arg)
+{
+    bench_run_t * run = arg;
+    uint64_t      batch[BATCH];
+    pin(run->cpus[0]);
+    for (uint64_t next = 1; next <= run->operations;)
+    {
+        uint64_t count = run->operations - next + 1;
+        count          = count < BATCH ? count : BATCH;
+        for (uint64_t i = 0; i < count; i++)
+        {
+            batch[i] = next + i;
+        }
+
+        size_t sent = 0;
+        while (sent < count)
+        {
+            size_t pushed
+                = spsc_push_n(run->spsc, batch + sent, (size_t)count - sent);
+            if (pushed == 0)
+            {
+                sched_yield();
+            }
+            sent += pushed;
+        }
+        next += count;
+    }
+    return NULL;
+}
+
+static void *
+batch_consumer(void * arg)
+{
+    bench_run_t * run = arg;
+    uint64_t      batch[BATCH];
+    pin(run->cpus[1]);
+    run->ordered = true;
+    for (uint64_t expected = 1; expected <= run->operations;)
+    {
+        size_t count = spsc_pop_n(run->spsc, batch, BATCH);
+        if (count == 0)
+        {
+            sched_yield();
+        }
+        for (size_t i = 0; i < count; i++)
+        {
+            run->ordered = run->ordered && batch[i] == expected;
+            expected++;
+        }
+    }
+    return NULL;
+}
+
+static void
+run_bench(bench_run_t * run)
+{
+    pthread_t producer;
+    pthread_t consumer;
+
+    double start = now_ns();
+    pthread_create(&consumer, NULL, run->consumer, run);
+    pthread_create(&producer, NULL, run->producer, run);
+    pthread_join(producer, NULL);
+    pthread_join(consumer, NULL);
+    double seconds = (now_ns() - start) / 1e9;
+
+    printf("%-14s %12.1f %8s\n",
+           run->name,
+           (double)run->operations / seconds / 1e6,
+           run->ordered ? "yes" : "NO");
+}
+
+int
+main(int argc, char ** argv)
+{
+    bench_run_t run = { 0 };
+    run.operations  = 100000000;
+    run.cpus[0]     = 0;
+    run.cpus[1]     = 1;
+    if (argc > 1)
+    {
+        run.operations = strtoull(argv[1], NULL, 10);
+    }
+    if (argc > 3)
+    {
+        run.cpus[0] = atoi(argv[2]);
+        run.cpus[1] = atoi(argv[3]);
+    }
+
+    run.spsc   = spsc_create(sizeof(uint64_t), CAPACITY);
+    run.locked = queue_create(sizeof(uint64_t), CAPACITY);
+    if (run.spsc == NULL || run.locked == NULL)
+    {
+        fprintf(stderr, "out of memory\n");
+        return EXIT_FAILURE;
+    }
+    pthread_mutex_init(&run.lock, NULL);
+
+    printf("%-14s %12s %8s\n", "queue", "M ops/s", "ordered");
+
+    run.name     = "mutex+queue";
+    run.producer = locked_producer;
+    run.consumer = locked_consumer;
+    run_bench(&run);
+
+    run.name     = "spsc";
+    run.producer = spsc_producer;
+    run.consumer = spsc_consumer;
+    run_bench(&run);
+
+    run.name     = "spsc batch 64";
+    run.producer = batch_producer;
+    run.consumer = batch_consumer;
+    run_bench(&run);
+
+    pthread_mutex_destroy(&run.lock);
+    queue_destroy(&run.locked);
+    spsc_destroy(&run.spsc);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,135 @@
+/** @file deque.h
+ *
+ * @brief An unbounded double-ended queue of fixed size elements, stored in
+ *        a list of fixed size chunks.
+ *
+ * Pushing and popping at either end is O(1) in the worst case, not just
+ * amortized: when the end chunk fills, a new one is linked on, and no
+ * element is ever moved again once pushed. A deque that grows to millions
+ * of elements thus never stalls to copy them, and never holds more than
+ * two partly used chunks.
+ *
+ * Chunks emptied by pops are kept on a short freelist and reused by later
+ * pushes, so a deque that hovers around a chunk boundary does not call
+ * malloc() and free() on every crossing. deque_shrink() hands them back.
+ *
+ * Elements are copied in and out by value, element_size bytes at a time,
+ * as with queue.h. Unlike queue_t, the deque does not keep its elements in
+ * one buffer, so it has no bulk copies or random access; use it where the
+ * size is unpredictable or the latency of a doubling matters.
+ *
+ */
+
+#ifndef DEQUE_H
+#define DEQUE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct deque deque_t;
+
+/**
+ * @brief Creates an empty deque.
+ *
+ * @param element_size the size of each element in bytes
+ * @param chunk_elements the number of elements per chunk, or 0 for as many
+ *        as fit in about 4KB
+ * @return deque_t* a pointer to the new deque, or NULL on failure or if
+ *         element_size is 0
+ */
+deque_t * deque_create(size_t element_size, size_t chunk_elements);
+
+/**
+ * @brief Destroy the deque. *deque == NULL is safe. The deque pointer is
+ *        set to NULL afterwards.
+ *
+ * @param deque a reference to a pointer to an allocated deque
+ */
+void deque_destroy(deque_t ** deque);
+
+/**
+ * @brief Copy an element onto the back of the deque.
+ *
+ * @param deque a pointer to an allocated deque
+ * @param element a pointer to element_size bytes
+ * @return 0 on success, -1 if a chunk could not be allocated
+ */
+int deque_push_back(deque_t * deque, const void * element);
+
+/**
+ * @brief Copy an element onto the front of the deque.
+ *
+ * @param deque a pointer to an allocated deque
+ * @param element a pointer to element_size bytes
+ * @return 0 on success, -1 if a chunk could not be allocated
+ */
+int deque_push_front(deque_t * deque, const void * element);
+
+/**
+ * @brief Copy the back element out of the deque and remove it.
+ *
+ * @param deque a pointer to an allocated deque
+ * @param element filled with the element, unless NULL
+ * @return 0 on success, -1 if the deque is empty
+ */
+int deque_pop_back(deque_t * deque, void * element);
+
+/**
+ * @brief Copy the front element out of the deque and remove it.
+ *
+ * @param deque a pointer to an allocated deque
+ * @param element filled with the element, unless NULL
+ * @return 0 on success, -1 if the deque is empty
+ */
+int deque_pop_front(deque_t * deque, void * element);
+
+/**
+ * @brief Returns the front element in place. Elements never move, so the
+ *        pointer stays valid for as long as the element is in the deque.
+ *
+ * @param deque a pointer to an allocated deque
+ * @return void* a pointer to the element, or NULL if the deque is empty
+ */
+void * deque_front(const deque_t * deque);
+
+/**
+ * @brief Returns the back element in place. Elements never move, so the
+ *        pointer stays valid for as long as the element is in the deque.
+ *
+ * @param deque a pointer to an allocated deque
+ * @return void* a pointer to the element, or NULL if the deque is empty
+ */
+void * deque_back(const deque_t * deque);
+
+/**
+ * @brief Remove every element. The chunks go to the freelist, up to its
+ *        limit.
+ *
+ * @param deque a pointer to an allocated deque
+ */
+void deque_clear(deque_t * deque);
+
+/**
+ * @brief Free the chunks on the freelist.
+ *
+ * @param deque a pointer to an allocated deque
+ */
+void deque_shrink(deque_t * deque);
+
+/**
+ * @brief Returns whether the deque is empty.
+ *
+ * @param deque a pointer to an allocated deque
+ * @return true if the deque holds no elements
+ */
+bool deque_is_empty(const deque_t * deque);
+
+/**
+ * @brief Returns the number of elements in the deque.
+ *
+ * @param deque a pointer to an allocated deque
+ * @return size_t the number of elements
+ */
+size_t deque_size(const deque_t * deque);
+
+#endif
@@ -0,0 +1,149 @@
+/** @file mpmc_queue.h
+ *
+ * @brief A bounded blocking queue for any number of producer and consumer
+ *        threads.
+ *
+ * Pushing to a full queue waits for room and popping from an empty one
+ * waits for an element; the timed variants give up after a timeout, and
+ * the try variants never wait. The queue is a lock-free ring: while it is
+ * neither empty nor full, pushes and pops claim cells with atomic
+ * operations only and take no lock. A thread only sleeps in the kernel
+ * when it has to wait, and is only woken when another thread knows it is
+ * waiting.
+ *
+ * mpmc_drain() takes up to n elements for the price of one, for consumers
+ * that process work in batches.
+ *
+ * mpmc_close() shuts the queue down: pushes fail from then on, and pops
+ * take the elements left, then fail instead of waiting. A push that has
+ * already claimed its cell when the queue closes still succeeds, and its
+ * element is delivered like the others.
+ *
+ * Elements are copied in and out by value, element_size bytes at a time,
+ * as with queue.h. Functions that fail return -1 and set errno to EAGAIN
+ * when the queue was full or empty, to ETIMEDOUT when a timed wait ran out,
+ * or to EPIPE when the queue is closed.
+ *
+ */
+
+#ifndef MPMC_QUEUE_H
+#define MPMC_QUEUE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct mpmc_queue mpmc_queue_t;
+
+/**
+ * @brief Creates an empty queue.
+ *
+ * @param element_size the size of each element in bytes
+ * @param capacity the number of elements the queue holds at most
+ * @return mpmc_queue_t* a pointer to the new queue, or NULL on failure or
+ *         if element_size or capacity is 0
+ */
+mpmc_queue_t * mpmc_create(size_t element_size, size_t capacity);
+
+/**
+ * @brief Destroy the queue, once no thread uses it or waits on it any
+ *        more. *queue == NULL is safe. The queue pointer is set to NULL
+ *        afterwards.
+ *
+ * @param queue a reference to a pointer to an allocated queue
+ */
+void mpmc_destroy(mpmc_queue_t ** queue);
+
+/**
+ * @brief Copy an element onto the back of the queue, waiting for room.
+ *
+ * @param queue a pointer to an allocated queue
+ * @param element a pointer to element_size bytes
+ * @return 0 on success, -1 if the queue is closed
+ */
+int mpmc_push(mpmc_queue_t * queue, const void * element);
+
+/**
+ * @brief Copy an element onto the back of the queue, waiting for room at
+ *        most timeout_ns nanoseconds.
+ *
+ * @param queue a pointer to an allocated queue
+ * @param element a pointer to element_size bytes
+ * @param timeout_ns the longest time to wait
+ * @return 0 on success, -1 if the wait timed out or the queue is closed
+ */
+int mpmc_timed_push(mpmc_queue_t * queue,
+                    const void *   element,
+                    uint64_t       timeout_ns);
+
+/**
+ * @brief Copy an element onto the back of the queue if there is room.
+ *
+ * @param queue a pointer to an allocated queue
+ * @param element a pointer to element_size bytes
+ * @return 0 on success, -1 if the queue is full or closed
+ */
+int mpmc_try_push(mpmc_queue_t * queue, const void * element);
+
+/**
+ * @brief Copy the front element out of the queue and remove it, waiting
+ *        for one.
+ *
+ * @param queue a pointer to an allocated queue
+ * @param element filled with the element
+ * @return 0 on success, -1 if the queue is closed and empty
+ */
+int mpmc_pop(mpmc_queue_t * queue, void * element);
+
+/**
+ * @brief Copy the front element out of the queue and remove it, waiting
+ *        for one at most timeout_ns nanoseconds.
+ *
+ * @param queue a pointer to an allocated queue
+ * @param element filled with the element
+ * @param timeout_ns the longest time to wait
+ * @return 0 on success, -1 if the wait timed out or the queue is closed
+ *         and empty
+ */
+int mpmc_timed_pop(mpmc_queue_t * queue, void * element, uint64_t timeout_ns);
+
+/**
+ * @brief Copy the front element out of the queue and remove it, if there
+ *        is one.
+ *
+ * @param queue a pointer to an allocated queue
+ * @param element filled with the element
+ * @return 0 on success, -1 if the queue is empty
+ */
+int mpmc_try_pop(mpmc_queue_t * queue, void * element);
+
+/**
+ * @brief Wait for at least one element, then take up to count of them at
+ *        once.
+ *
+ * @param queue a pointer to an allocated queue
+ * @param elements room for count contiguous elements
+ * @param count the number of elements wanted, at least 1
+ * @return size_t the number of elements taken, 0 only once the queue is
+ *         closed and empty
+ */
+size_t mpmc_drain(mpmc_queue_t * queue, void * elements, size_t count);
+
+/**
+ * @brief Close the queue, waking every waiting thread. Closing twice is
+ *        safe.
+ *
+ * @param queue a pointer to an allocated queue
+ */
+void mpmc_close(mpmc_queue_t * queue);
+
+/**
+ * @brief Returns the number of elements in the queue, which other threads
+ *        may have changed by the time it is used.
+ *
+ * @param queue a pointer to an allocated queue
+ * @return size_t the number of elements
+ */
+size_t mpmc_size(mpmc_queue_t * queue);
+
+#endif
@@ -1,26 +1,151 @@
 /** @file queue.h
-* 
-* @brief A description of the module's purpose. *****CHANGE ME*****
-*
-*/
- 
+ *
+ * @brief A growable FIFO queue of fixed size elements, stored in a ring
+ *        buffer.
+ *
+ * Elements are copied in and out by value, element_size bytes at a time,
+ * so a queue can hold structs directly. Queues of pointers can use
+ * queue_enqueue() and queue_dequeue() instead of passing their addresses.
+ *
+ * The capacity is always a power of two, so positions wrap with a mask
+ * rather than a division. When the ring is full it doubles, and the
+ * elements are copied into the new buffer in queue order, at most two
+ * memcpy() calls however the old ring wrapped. The bulk functions move
+ * runs of elements the same way.
+ *
+ */
+
 #ifndef QUEUE_H
 #define QUEUE_H
 
 #include <stdbool.h>
-#include <stdlib.h>
-
-typedef struct position position_t;
-typedef struct queue_node_s queue_node_t;
-typedef struct queue_s queue_t;
-
- // Prototypes for the queue functions
-queue_t *queue_create(int capacity);
-bool is_empty(queue_t *queue);
-bool is_full(queue_t * queue);
-int get_size(queue_t *queue);
-void enqueue(queue_t *queue, position_t element);
-// void queue_destroy(queue_t **queue);
-void * dequeue(queue_t *queue);
+#include <stddef.h>
+
+typedef struct queue queue_t;
+
+/**
+ * @brief Creates an empty queue.
+ *
+ * @param element_size the size of each element in bytes
+ * @param capacity the number of elements expected, or 0; rounded up to a
+ *        power of two
+ * @return queue_t* a pointer to the new queue, or NULL on failure or if
+ *         element_size is 0
+ */
+queue_t * queue_create(size_t element_size, size_t capacity);
+
+/**
+ * @brief Destroy the queue. *queue == NULL is safe. The queue pointer is
+ *        set to NULL afterwards.
+ *
+ * @param queue a reference to a pointer to an allocated queue
+ */
+void queue_destroy(queue_t ** queue);
+
+/**
+ * @brief Copy an element onto the back of the queue.
+ *
+ * @param queue a pointer to an allocated queue
+ * @param element a pointer to element_size bytes
+ * @return 0 on success, -1 if the queue was full and could not grow
+ */
+int queue_push(queue_t * queue, const void * element);
+
+/**
+ * @brief Copy the front element out of the queue and remove it.
+ *
+ * @param queue a pointer to an allocated queue
+ * @param element filled with the element, or NULL to drop it
+ * @return 0 on success, -1 if the queue is empty
+ */
+int queue_pop(queue_t * queue, void * element);
+
+/**
+ * @brief Copy count elements onto the back of the queue, in order. Either
+ *        all of them are added or none.
+ *
+ * @param queue a pointer to an allocated queue
+ * @param elements a pointer to count contiguous elements
+ * @param count the number of elements
+ * @return 0 on success, -1 if the queue could not grow
+ */
+int queue_push_n(queue_t * queue, const void * elements, size_t count);
+
+/**
+ * @brief Copy up to count elements from the front of the queue and remove
+ *        them.
+ *
+ * @param queue a pointer to an allocated queue
+ * @param elements room for count contiguous elements, or NULL to drop them
+ * @param count the number of elements wanted
+ * @return size_t the number of elements removed
+ */
+size_t queue_pop_n(queue_t * queue, void * elements, size_t count);
+
+/**
+ * @brief Returns the front element without removing it.
+ *
+ * @param queue a pointer to an allocated queue
+ * @return void* a pointer to the element inside the queue, valid until the
+ *         next call that modifies the queue, or NULL if it is empty
+ */
+void * queue_peek(const queue_t * queue);
+
+/**
+ * @brief Push a pointer onto a queue of pointers.
+ *
+ * @param queue a pointer to a queue made with sizeof(void *) elements
+ * @param item the pointer to store
+ * @return 0 on success, -1 if the queue could not grow
+ */
+int queue_enqueue(queue_t * queue, void * item);
+
+/**
+ * @brief Pop a pointer from a queue of pointers.
+ *
+ * @param queue a pointer to a queue made with sizeof(void *) elements
+ * @return void* the front pointer, or NULL if the queue is empty
+ */
+void * queue_dequeue(queue_t * queue);
+
+/**
+ * @brief Make room for at least capacity elements in total.
+ *
+ * @param queue a pointer to an allocated queue
+ * @param capacity the number of elements to make room for
+ * @return 0 on success, -1 if memory could not be allocated
+ */
+int queue_reserve(queue_t * queue, size_t capacity);
+
+/**
+ * @brief Remove every element, keeping the buffer.
+ *
+ * @param queue a pointer to an allocated queue
+ */
+void queue_clear(queue_t * queue);
+
+/**
+ * @brief Check whether the queue holds no elements.
+ *
+ * @param queue a pointer to an allocated queue
+ * @return true if the queue is empty
+ */
+bool queue_is_empty(const queue_t * queue);
+
+/**
+ * @brief Returns the number of elements in the queue.
+ *
+ * @param queue a pointer to an allocated queue
+ * @return size_t the number of elements
+ */
+size_t queue_size(const queue_t * queue);
+
+/**
+ * @brief Returns the number of elements the queue holds before growing.
+ *
+ * @param queue a pointer to an allocated queue
+ * @return size_t the capacity, a power of two
+ */
+size_t queue_capacity(const queue_t * queue);
 
 #endif
@@ -0,0 +1,104 @@
+/** @file spsc_queue.h
+ *
+ * @brief A bounded lock-free queue between one producer thread and one
+ *        consumer thread.
+ *
+ * Exactly one thread may push and exactly one other thread may pop; each
+ * side only writes its own index, so neither ever waits for a lock. The
+ * functions never block: pushing to a full queue or popping from an empty
+ * one fails at once, and the caller decides whether to spin, yield or do
+ * other work.
+ *
+ * Elements are copied in and out by value, element_size bytes at a time,
+ * as with queue.h. The batch functions move as many elements as fit in one
+ * exchange of indices, which is how the queue reaches its best throughput.
+ *
+ */
+
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct spsc_queue spsc_queue_t;
+
+/**
+ * @brief Creates an empty queue.
+ *
+ * @param element_size the size of each element in bytes
+ * @param capacity the number of elements the queue holds, rounded up to a
+ *        power of two
+ * @return spsc_queue_t* a pointer to the new queue, or NULL on failure or
+ *         if element_size or capacity is 0
+ */
+spsc_queue_t * spsc_create(size_t element_size, size_t capacity);
+
+/**
+ * @brief Destroy the queue, once neither thread uses it any more.
+ *        *queue == NULL is safe. The queue pointer is set to NULL
+ *        afterwards.
+ *
+ * @param queue a reference to a pointer to an allocated queue
+ */
+void spsc_destroy(spsc_queue_t ** queue);
+
+/**
+ * @brief Copy an element onto the back of the queue. Producer only.
+ *
+ * @param queue a pointer to an allocated queue
+ * @param element a pointer to element_size bytes
+ * @return true on success, false if the queue is full
+ */
+bool spsc_push(spsc_queue_t * queue, const void * element);
+
+/**
+ * @brief Copy the front element out of the queue and remove it. Consumer
+ *        only.
+ *
+ * @param queue a pointer to an allocated queue
+ * @param element filled with the element
+ * @return true on success, false if the queue is empty
+ */
+bool spsc_pop(spsc_queue_t * queue, void * element);
+
+/**
+ * @brief Copy up to count elements onto the back of the queue, as many as
+ *        there is room for. Producer only.
+ *
+ * @param queue a pointer to an allocated queue
+ * @param elements a pointer to count contiguous elements
+ * @param count the number of elements offered
+ * @return size_t the number of elements pushed, the first ones of elements
+ */
+size_t spsc_push_n(spsc_queue_t * queue, const void * elements, size_t count);
+
+/**
+ * @brief Copy up to count elements from the front of the queue and remove
+ *        them. Consumer only.
+ *
+ * @param queue a pointer to an allocated queue
+ * @param elements room for count contiguous elements
+ * @param count the number of elements wanted
+ * @return size_t the number of elements popped
+ */
+size_t spsc_pop_n(spsc_queue_t * queue, void * elements, size_t count);
+
+/**
+ * @brief Returns the number of elements in the queue. Exact from either
+ *        side when the other is idle, a snapshot otherwise.
+ *
+ * @param queue a pointer to an allocated queue
+ * @return size_t the number of elements
+ */
+size_t spsc_size(const spsc_queue_t * queue);
+
+/**
+ * @brief Returns the number of elements the queue holds.
+ *
+ * @param queue a pointer to an allocated queue
+ * @return size_t the capacity, a power of two
+ */
+size_t spsc_capacity(const spsc_queue_t * queue);
+
+#endif
@@ -0,0 +1,319 @@
+/** @file deque.c
+ *
+ * @brief A doubly linked list of chunks, each an array of chunk_elements
+ *        elements.
+ *
+ * The elements run from slot front of front_chunk, through every chunk
+ * between, to just before slot back of back_chunk. There is always at
+ * least one chunk, and when the deque empties, front and back move to the
+ * middle of the one left, so that pushes at either end fill it before
+ * another chunk is needed.
+ *
+ * A chunk is unlinked as soon as its last element is popped, and goes on
+ * the freelist unless DEQUE_MAX_SPARE chunks are already there.
+ *
+ */
+
+#include "../include/deque.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEQUE_CHUNK_BYTES 4096
+#define DEQUE_MIN_CHUNK_ELEMENTS 8
+#define DEQUE_MAX_SPARE 4
+
+typedef struct deque_chunk
+{
+    struct deque_chunk *              prev;
+    struct deque_chunk *              next; /* Also links the freelist. */
+    _Alignas(max_align_t) unsigned char data[];
+} deque_chunk_t;
+
+struct deque
+{
+    deque_chunk_t * front_chunk;
+    deque_chunk_t * back_chunk;
+    size_t          front; /* Slot of the first element. */
+    size_t          back;  /* Slot after the last element. */
+    size_t          size;
+    size_t          element_size;
+    size_t          chunk_elements;
+    deque_chunk_t * spare;
+    size_t          spare_count;
+};
+
+static unsigned char *
+deque_slot(const deque_t * deque, deque_chunk_t * chunk, size_t slot)
+{
+    return chunk->data + slot * deque->element_size;
+}
+
+static deque_chunk_t *
+deque_chunk_get(deque_t * deque)
+{
+    deque_chunk_t * chunk = deque->spare;
+
+    if (chunk != NULL)
+    {
+        deque->spare = chunk->next;
+        deque->spare_count--;
+    }
+    else
+    {
+        chunk = malloc(sizeof(deque_chunk_t)
+                       + deque->chunk_elements * deque->element_size);
+        if (chunk == NULL)
+        {
+            return NULL;
+        }
+    }
+    chunk->prev = NULL;
+    chunk->next = NULL;
+    return chunk;
+}
+
+static void
+deque_chunk_put(deque_t * deque, deque_chunk_t * chunk)
+{
+    if (deque->spare_count >= DEQUE_MAX_SPARE)
+    {
+        free(chunk);
+        return;
+    }
+    chunk->next  = deque->spare;
+    deque->spare = chunk;
+    deque->spare_count++;
+}
+
+/* Centre front and back in the only chunk left. */
+static void
+deque_recentre(deque_t * deque)
+{
+    deque->front = deque->chunk_elements / 2;
+    deque->back  = deque->front;
+}
+
+deque_t *
+deque_create(size_t element_size, size_t chunk_elements)
+{
+    if (element_size == 0)
+    {
+        return NULL;
+    }
+    if (chunk_elements == 0)
+    {
+        chunk_elements = (DEQUE_CHUNK_BYTES - sizeof(deque_chunk_t))
+                       / element_size;
+    }
+    if (chunk_elements < DEQUE_MIN_CHUNK_ELEMENTS)
+    {
+        chunk_elements = DEQUE_MIN_CHUNK_ELEMENTS;
+    }
+    if (chunk_elements > (SIZE_MAX - sizeof(deque_chunk_t)) / element_size)
+    {
+        return NULL;
+    }
+
+    deque_t * deque = calloc(1, sizeof(deque_t));
+    if (deque == NULL)
+    {
+        return NULL;
+    }
+    deque->element_size   = element_size;
+    deque->chunk_elements = chunk_elements;
+    if ((deque->front_chunk = deque_chunk_get(deque)) == NULL)
+    {
+        free(deque);
+        return NULL;
+    }
+    deque->back_chunk = deque->front_chunk;
+    deque_recentre(deque);
+    return deque;
+}
+
+void
+deque_destroy(deque_t ** deque)
+{
+    if (!deque || !*deque)
+    {
+        return;
+    }
+
+    deque_shrink(*deque);
+    for (deque_chunk_t * chunk = (*deque)->front_chunk; chunk != NULL;)
+    {
+        deque_chunk_t * next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    free(*deque);
+    *deque = NULL;
+}
+
+int
+deque_push_back(deque_t * deque, const void * element)
+{
+    if (deque->back == deque->chunk_elements)
+    {
+        deque_chunk_t * chunk = deque_chunk_get(deque);
+        if (chunk == NULL)
+        {
+            return -1;
+        }
+        chunk->prev             = deque->back_chunk;
+        deque->back_chunk->next = chunk;
+        deque->back_chunk       = chunk;
+        deque->back             = 0;
+    }
+    memcpy(deque_slot(deque, deque->back_chunk, deque->back),
+           element,
+           deque->element_size);
+    deque->back++;
+    deque->size++;
+    return 0;
+}
+
+int
+deque_push_front(deque_t * deque, const void * element)
+{
+    if (deque->front == 0)
+    {
+        deque_chunk_t * chunk = deque_chunk_get(deque);
+        if (chunk == NULL)
+        {
+            return -1;
+        }
+        chunk->next              = deque->front_chunk;
+        deque->front_chunk->prev = chunk;
+        deque->front_chunk       = chunk;
+        deque->front             = deque->chunk_elements;
+    }
+    deque->front--;
+    memcpy(deque_slot(deque, deque->front_chunk, deque->front),
+           element,
+           deque->element_size);
+    deque->size++;
+    return 0;
+}
+
+int
+deque_pop_back(deque_t * deque, void * element)
+{
+    if (deque->size == 0)
+    {
+        return -1;
+    }
+    deque->back--;
+    deque->size--;
+    if (element)
+    {
+        memcpy(element,
+               deque_slot(deque, deque->back_chunk, deque->back),
+               deque->element_size);
+    }
+
+    if (deque->back == 0 && deque->back_chunk != deque->front_chunk)
+    {
+        deque_chunk_t * chunk   = deque->back_chunk;
+        deque->back_chunk       = chunk->prev;
+        deque->back_chunk->next = NULL;
+        deque->back             = deque->chunk_elements;
+        deque_chunk_put(deque, chunk);
+    }
+    if (deque->size == 0)
+    {
+        deque_recentre(deque);
+    }
+    return 0;
+}
+
+int
+deque_pop_front(deque_t * deque, void * element)
+{
+    if (deque->size == 0)
+    {
+        return -1;
+    }
+    if (element)
+    {
+        memcpy(element,
+               deque_slot(deque, deque->front_chunk, deque->front),
+               deque->element_size);
+    }
+    deque->front++;
+    deque->size--;
+
+    if (deque->front == deque->chunk_elements
+        && deque->front_chunk != deque->back_chunk)
+    {
+        deque_chunk_t * chunk    = deque->front_chunk;
+        deque->front_chunk       = chunk->next;
+        deque->front_chunk->prev = NULL;
+        deque->front             = 0;
+        deque_chunk_put(deque, chunk);
+    }
+    if (deque->size == 0)
+    {
+        deque_recentre(deque);
+    }
+    return 0;
+}
+
+void *
+deque_front(const deque_t * deque)
+{
+    if (deque->size == 0)
+    {
+        return NULL;
+    }
+    return deque_slot(deque, deque->front_chunk, deque->front);
+}
+
+void *
+deque_back(const deque_t * deque)
+{
+    if (deque->size == 0)
+    {
+        return NULL;
+    }
+    return deque_slot(deque, deque->back_chunk, deque->back - 1);
+}
+
+void
+deque_clear(deque_t * deque)
+{
+    while (deque->back_chunk != deque->front_chunk)
+    {
+        deque_chunk_t * chunk = deque->back_chunk;
+        deque->back_chunk     = chunk->prev;
+        deque_chunk_put(deque, chunk);
+    }
+    deque->front_chunk->next = NULL;
+    deque->size              = 0;
+    deque_recentre(deque);
+}
+
+void
+deque_shrink(deque_t * deque)
+{
+    while (deque->spare != NULL)
+    {
+        deque_chunk_t * chunk = deque->spare;
+        deque->spare          = chunk->next;
+        free(chunk);
+    }
+    deque->spare_count = 0;
+}
+
+bool
+deque_is_empty(const deque_t * deque)
+{
+    return deque->size == 0;
+}
+
+size_t
+deque_size(const deque_t * deque)
+{
+    return deque->size;
+}
@@ -0,0 +1,545 @@
+/** @file mpmc_queue.c
+ *
+ * @brief A bounded lock-free ring in which every cell carries a sequence
+ *        number, with an event count for each side to sleep on.
+ *
+ * head and tail count every pop and push ever made, and position p lives
+ * in cell p % capacity. A cell's sequence number says whose turn it is:
+ * 2p while it waits for the push at position p, 2p + 1 once that push has
+ * written it, and 2(p + capacity) once the pop at p has emptied it, which
+ * is the turn of the next push to land on it. A thread claims a position by
+ * moving head or tail on with a compare and swap, but only after the cell's
+ * sequence number shows the cell is ready, so a claimed cell never has to
+ * be waited for; the release store of the new sequence number publishes
+ * the copy to the thread that takes the next turn. Doubling the positions
+ * keeps the turns of the push and the pop at one position apart, so any
+ * capacity works, even 1.
+ *
+ * A pop may claim a run of ready cells in one compare and swap, which is
+ * what makes mpmc_drain() cheap.
+ *
+ * Closing sets a bit in tail, so that no push can claim a position after
+ * it. A pop reports the queue closed only once head has caught up with the
+ * last position claimed, so elements whose push was under way are still
+ * delivered.
+ *
+ * Waiting is the only thing that takes a lock. A thread that finds the
+ * queue full (or empty) announces itself in the waiter count of the side
+ * it waits for, reads that side's epoch, tries once more, and only then
+ * sleeps on the condition variable until the epoch changes. A thread that
+ * pushes (or pops) bumps the epoch and signals only when the waiter count
+ * is non-zero; the fences on both sides make sure one of the two sees the
+ * other. While the queue is neither empty nor full, no thread touches a
+ * mutex or makes a system call.
+ *
+ * Timed waits run on CLOCK_MONOTONIC, so changes to the wall clock neither
+ * cut them short nor stretch them.
+ *
+ */
+
+#include "../include/mpmc_queue.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MPMC_NS_PER_SEC 1000000000ull
+#define MPMC_CACHE_LINE 64
+#define MPMC_CLOSED ((size_t)1 << (sizeof(size_t) * 8 - 1))
+
+typedef struct mpmc_cell
+{
+    atomic_size_t sequence;
+    unsigned char data[];
+} mpmc_cell_t;
+
+/* Threads waiting for one side of the queue to change. */
+typedef struct mpmc_waiters
+{
+    _Alignas(MPMC_CACHE_LINE) atomic_size_t count;
+    atomic_uint     epoch; /* Changed under lock. */
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+} mpmc_waiters_t;
+
+struct mpmc_queue
+{
+    /* Next position to push, with MPMC_CLOSED once closed. */
+    _Alignas(MPMC_CACHE_LINE) atomic_size_t tail;
+
+    /* Next position to pop. */
+    _Alignas(MPMC_CACHE_LINE) atomic_size_t head;
+
+    /* Read only. */
+    _Alignas(MPMC_CACHE_LINE) unsigned char * cells;
+    size_t cell_size;
+    size_t element_size;
+    size_t capacity;
+    size_t mask; /* capacity - 1 if that is a power of two, else 0. */
+
+    mpmc_waiters_t not_empty;
+    mpmc_waiters_t not_full;
+};
+
+/* How long a call may wait: not at all, until its deadline, or for as long
+ * as it takes. */
+typedef enum mpmc_wait
+{
+    MPMC_TRY,
+    MPMC_TIMED,
+    MPMC_BLOCK
+} mpmc_wait_t;
+
+static mpmc_cell_t *
+mpmc_cell(const mpmc_queue_t * queue, size_t position)
+{
+    size_t index = queue->mask ? position & queue->mask
+                               : position % queue->capacity;
+    return (mpmc_cell_t *)(queue->cells + index * queue->cell_size);
+}
+
+/* How far a cell's sequence number is past turn, as a signed distance. */
+static long long
+mpmc_turn_distance(const mpmc_cell_t * cell, size_t turn)
+{
+    return (long long)(atomic_load_explicit(&cell->sequence,
+                                            memory_order_acquire)
+                       - turn);
+}
+
+static void
+mpmc_deadline(struct timespec * deadline, uint64_t timeout_ns)
+{
+    clock_gettime(CLOCK_MONOTONIC, deadline);
+
+    uint64_t nsec = (uint64_t)deadline->tv_nsec + timeout_ns % MPMC_NS_PER_SEC;
+    uint64_t sec  = timeout_ns / MPMC_NS_PER_SEC + nsec / MPMC_NS_PER_SEC;
+    deadline->tv_sec += (time_t)sec;
+    deadline->tv_nsec = (long)(nsec % MPMC_NS_PER_SEC);
+}
+
+static void
+mpmc_waiters_init(mpmc_waiters_t * waiters)
+{
+    pthread_condattr_t attr;
+
+    atomic_init(&waiters->count, 0);
+    atomic_init(&waiters->epoch, 0);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_mutex_init(&waiters->lock, NULL);
+    pthread_cond_init(&waiters->cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+static void
+mpmc_waiters_destroy(mpmc_waiters_t * waiters)
+{
+    pthread_cond_destroy(&waiters->cond);
+    pthread_mutex_destroy(&waiters->lock);
+}
+
+/* Announce a waiter and return the epoch to sleep on. The caller must try
+ * its operation once more before calling mpmc_sleep(). */
+static unsigned
+mpmc_prepare(mpmc_waiters_t * waiters)
+{
+    atomic_fetch_add_explicit(&waiters->count, 1, memory_order_seq_cst);
+    atomic_thread_fence(memory_order_seq_cst);
+    return atomic_load_explicit(&waiters->epoch, memory_order_acquire);
+}
+
+static void
+mpmc_cancel(mpmc_waiters_t * waiters)
+{
+    atomic_fetch_sub_explicit(&waiters->count, 1, memory_order_relaxed);
+}
+
+/* Sleep until the epoch moves on from key, and return 0, or ETIMEDOUT once
+ * the deadline has passed. Either way the waiter is withdrawn. */
+static int
+mpmc_sleep(mpmc_waiters_t *        waiters,
+           unsigned                key,
+           mpmc_wait_t             wait,
+           const struct timespec * deadline)
+{
+    int status = 0;
+
+    pthread_mutex_lock(&waiters->lock);
+    while (status == 0
+           && atomic_load_explicit(&waiters->epoch, memory_order_relaxed)
+                  == key)
+    {
+        if (wait == MPMC_TIMED)
+        {
+            status = pthread_cond_timedwait(
+                &waiters->cond, &waiters->lock, deadline);
+        }
+        else
+        {
+            pthread_cond_wait(&waiters->cond, &waiters->lock);
+        }
+    }
+    pthread_mutex_unlock(&waiters->lock);
+    mpmc_cancel(waiters);
+    return status == ETIMEDOUT ? ETIMEDOUT : 0;
+}
+
+/* Move the epoch on and wake one waiter, or all of them. The release store
+ * lets a waiter that reads the new epoch see what changed before it. */
+static void
+mpmc_advance(mpmc_waiters_t * waiters, bool all)
+{
+    pthread_mutex_lock(&waiters->lock);
+    atomic_store_explicit(
+        &waiters->epoch,
+        atomic_load_explicit(&waiters->epoch, memory_order_relaxed) + 1,
+        memory_order_release);
+    pthread_mutex_unlock(&waiters->lock);
+    if (all)
+    {
+        pthread_cond_broadcast(&waiters->cond);
+    }
+    else
+    {
+        pthread_cond_signal(&waiters->cond);
+    }
+}
+
+/* Wake one waiter, or all of them, if there are any. Called after the
+ * change they wait for has been published. */
+static void
+mpmc_wake(mpmc_waiters_t * waiters, bool all)
+{
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&waiters->count, memory_order_relaxed) > 0)
+    {
+        mpmc_advance(waiters, all);
+    }
+}
+
+/* Push one element if a cell is free. Returns 0, EAGAIN or EPIPE. */
+static int
+mpmc_try_put(mpmc_queue_t * queue, const void * element)
+{
+    size_t        position = atomic_load_explicit(&queue->tail,
+                                           memory_order_relaxed);
+    mpmc_cell_t * cell     = NULL;
+
+    for (;;)
+    {
+        if (position & MPMC_CLOSED)
+        {
+            return EPIPE;
+        }
+        cell               = mpmc_cell(queue, position);
+        long long distance = mpmc_turn_distance(cell, 2 * position);
+        if (distance == 0)
+        {
+            if (atomic_compare_exchange_weak_explicit(&queue->tail,
+                                                      &position,
+                                                      position + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (distance < 0)
+        {
+            /* The cell still holds the element pushed a lap ago. */
+            return EAGAIN;
+        }
+        else
+        {
+            position
+                = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+        }
+    }
+
+    memcpy(cell->data, element, queue->element_size);
+    atomic_store_explicit(
+        &cell->sequence, 2 * position + 1, memory_order_release);
+    mpmc_wake(&queue->not_empty, false);
+    return 0;
+}
+
+/* Pop the run of up to count written cells at head. Returns how many were
+ * taken, or 0 with *error set to EAGAIN or EPIPE. */
+static size_t
+mpmc_try_take(mpmc_queue_t * queue,
+              void *         elements,
+              size_t         count,
+              int *          error)
+{
+    size_t position = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    size_t taken    = 0;
+
+    for (;;)
+    {
+        long long distance
+            = mpmc_turn_distance(mpmc_cell(queue, position), 2 * position + 1);
+        if (distance == 0)
+        {
+            taken = 1;
+            while (taken < count
+                   && mpmc_turn_distance(mpmc_cell(queue, position + taken),
+                                         2 * (position + taken) + 1)
+                          == 0)
+            {
+                taken++;
+            }
+            if (atomic_compare_exchange_weak_explicit(&queue->head,
+                                                      &position,
+                                                      position + taken,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (distance < 0)
+        {
+            /* Empty, or the push at head is still copying its element. */
+            size_t tail
+                = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+            *error = tail == (position | MPMC_CLOSED) ? EPIPE : EAGAIN;
+            return 0;
+        }
+        else
+        {
+            position
+                = atomic_load_explicit(&queue->head, memory_order_relaxed);
+        }
+    }
+
+    unsigned char * out = elements;
+    for (size_t i = 0; i < taken; i++)
+    {
+        mpmc_cell_t * cell = mpmc_cell(queue, position + i);
+        memcpy(out + i * queue->element_size, cell->data, queue->element_size);
+        atomic_store_explicit(&cell->sequence,
+                              2 * (position + i + queue->capacity),
+                              memory_order_release);
+    }
+    mpmc_wake(&queue->not_full, taken > 1);
+    return taken;
+}
+
+static int
+mpmc_put(mpmc_queue_t * queue,
+         const void *   element,
+         mpmc_wait_t    wait,
+         uint64_t       timeout_ns)
+{
+    struct timespec deadline = { 0 };
+    int             error    = mpmc_try_put(queue, element);
+
+    if (error == EAGAIN && wait == MPMC_TIMED)
+    {
+        mpmc_deadline(&deadline, timeout_ns);
+    }
+    while (error == EAGAIN && wait != MPMC_TRY)
+    {
+        unsigned key = mpmc_prepare(&queue->not_full);
+        if ((error = mpmc_try_put(queue, element)) != EAGAIN)
+        {
+            mpmc_cancel(&queue->not_full);
+            break;
+        }
+        if (mpmc_sleep(&queue->not_full, key, wait, &deadline) == ETIMEDOUT)
+        {
+            /* The wake-up may have come with the timeout; use it. */
+            if ((error = mpmc_try_put(queue, element)) == EAGAIN)
+            {
+                error = ETIMEDOUT;
+            }
+            break;
+        }
+        error = mpmc_try_put(queue, element);
+    }
+
+    if (error != 0)
+    {
+        errno = error;
+        return -1;
+    }
+    return 0;
+}
+
+/* Take between 1 and count elements, or return 0 with errno set. */
+static size_t
+mpmc_take(mpmc_queue_t * queue,
+          void *         elements,
+          size_t         count,
+          mpmc_wait_t    wait,
+          uint64_t       timeout_ns)
+{
+    struct timespec deadline = { 0 };
+    int             error    = 0;
+    size_t          taken    = mpmc_try_take(queue, elements, count, &error);
+
+    if (taken == 0 && error == EAGAIN && wait == MPMC_TIMED)
+    {
+        mpmc_deadline(&deadline, timeout_ns);
+    }
+    while (taken == 0 && error == EAGAIN && wait != MPMC_TRY)
+    {
+        unsigned key = mpmc_prepare(&queue->not_empty);
+        taken        = mpmc_try_take(queue, elements, count, &error);
+        if (taken > 0 || error != EAGAIN)
+        {
+            mpmc_cancel(&queue->not_empty);
+            break;
+        }
+        if (mpmc_sleep(&queue->not_empty, key, wait, &deadline) == ETIMEDOUT)
+        {
+            taken = mpmc_try_take(queue, elements, count, &error);
+            if (taken == 0 && error == EAGAIN)
+            {
+                error = ETIMEDOUT;
+            }
+            break;
+        }
+        taken = mpmc_try_take(queue, elements, count, &error);
+    }
+
+    if (taken == 0)
+    {
+        errno = error;
+    }
+    return taken;
+}
+
+mpmc_queue_t *
+mpmc_create(size_t element_size, size_t capacity)
+{
+    if (element_size == 0 || capacity == 0
+        || element_size > SIZE_MAX / 2 - sizeof(mpmc_cell_t))
+    {
+        return NULL;
+    }
+
+    size_t align     = _Alignof(mpmc_cell_t);
+    size_t cell_size = (sizeof(mpmc_cell_t) + element_size + align - 1)
+                     & ~(align - 1);
+    if (capacity > SIZE_MAX / cell_size || capacity >= MPMC_CLOSED / 2)
+    {
+        return NULL;
+    }
+
+    mpmc_queue_t * queue = aligned_alloc(MPMC_CACHE_LINE, sizeof(mpmc_queue_t));
+    if (queue == NULL)
+    {
+        return NULL;
+    }
+    if ((queue->cells = malloc(capacity * cell_size)) == NULL)
+    {
+        free(queue);
+        return NULL;
+    }
+
+    queue->cell_size    = cell_size;
+    queue->element_size = element_size;
+    queue->capacity     = capacity;
+    queue->mask         = (capacity & (capacity - 1)) == 0 ? capacity - 1 : 0;
+    for (size_t i = 0; i < capacity; i++)
+    {
+        atomic_init(&mpmc_cell(queue, i)->sequence, 2 * i);
+    }
+    atomic_init(&queue->tail, 0);
+    atomic_init(&queue->head, 0);
+    mpmc_waiters_init(&queue->not_empty);
+    mpmc_waiters_init(&queue->not_full);
+    return queue;
+}
+
+void
+mpmc_destroy(mpmc_queue_t ** queue)
+{
+    if (!queue || !*queue)
+    {
+        return;
+    }
+
+    mpmc_waiters_destroy(&(*queue)->not_full);
+    mpmc_waiters_destroy(&(*queue)->not_empty);
+    free((*queue)->cells);
+    free(*queue);
+    *queue = NULL;
+}
+
+int
+mpmc_push(mpmc_queue_t * queue, const void * element)
+{
+    return mpmc_put(queue, element, MPMC_BLOCK, 0);
+}
+
+int
+mpmc_timed_push(mpmc_queue_t * queue,
+                const void *   element,
+                uint64_t       timeout_ns)
+{
+    return mpmc_put(queue, element, MPMC_TIMED, timeout_ns);
+}
+
+int
+mpmc_try_push(mpmc_queue_t * queue, const void * element)
+{
+    return mpmc_put(queue, element, MPMC_TRY, 0);
+}
+
+int
+mpmc_pop(mpmc_queue_t * queue, void * element)
+{
+    return mpmc_take(queue, element, 1, MPMC_BLOCK, 0) == 1 ? 0 : -1;
+}
+
+int
+mpmc_timed_pop(mpmc_queue_t * queue, void * element, uint64_t timeout_ns)
+{
+    return mpmc_take(queue, element, 1, MPMC_TIMED, timeout_ns) == 1 ? 0 : -1;
+}
+
+int
+mpmc_try_pop(mpmc_queue_t * queue, void * element)
+{
+    return mpmc_take(queue, element, 1, MPMC_TRY, 0) == 1 ? 0 : -1;
+}
+
+size_t
+mpmc_drain(mpmc_queue_t * queue, void * elements, size_t count)
+{
+    if (count == 0)
+    {
+        return 0;
+    }
+    return mpmc_take(queue, elements, count, MPMC_BLOCK, 0);
+}
+
+void
+mpmc_close(mpmc_queue_t * queue)
+{
+    atomic_fetch_or_explicit(&queue->tail, MPMC_CLOSED, memory_order_seq_cst);
+
+    /* Wake everyone, whether or not they have announced themselves yet:
+     * those that have not will see the closed bit on their next try. */
+    mpmc_advance(&queue->not_empty, true);
+    mpmc_advance(&queue->not_full, true);
+}
+
+size_t
+mpmc_size(mpmc_queue_t * queue)
+{
+    size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed)
+                & ~MPMC_CLOSED;
+
+    if (tail <= head)
+    {
+        return 0;
+    }
+    return tail - head < queue->capacity ? tail - head : queue->capacity;
+}
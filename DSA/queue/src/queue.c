@@ -1,98 +1,245 @@
-#define INITIAL_CAPACITY 1024
+/** @file queue.c
+ *
+ * @brief A ring buffer queue of fixed size elements.
+ *
+ * head and tail count every element ever popped and pushed; they are never
+ * reduced, and only their low bits, under the mask, index the buffer. The
+ * queue holds tail - head elements, so full and empty need no flag or
+ * wasted slot.
+ *
+ */
 
 #include "../include/queue.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 
-// Structure to represent a position in the grid
-typedef struct position {
-    int row;
-    int col;
-    int elevation;
-}position_t;
-
-// Queue data structure for BFS
-typedef struct queue_node_t {
-    position_t pos; // node position within a grid. Added just to have for different implementations.
-    queue_node_t *next;
-}queue_node_t;
-
-// Structure to represent a queue
-typedef struct queue_t {
-    void ** queue; // queue to hold data.
-    position_t * elements;
-    int front;  // Index of the front element in the queue
-    int rear;  // Index of the next available position in the queue
-    int size;  // Current number of elements in the queue
-    int capacity;  // Maximum capacity of the queue
-}queue_t;
-
-// Function to create a queue
-queue_t *queue_create(int capacity) {
-    queue_t *queue = calloc(1, sizeof(queue_t));
-    if (queue == NULL) {
+#define QUEUE_MIN_CAPACITY 16
+
+struct queue
+{
+    unsigned char * buffer;
+    size_t          element_size;
+    size_t          mask; /* Capacity - 1. */
+    size_t          head; /* Elements popped so far. */
+    size_t          tail; /* Elements pushed so far. */
+};
+
+static unsigned char *
+queue_slot(const queue_t * queue, size_t position)
+{
+    return queue->buffer + (position & queue->mask) * queue->element_size;
+}
+
+/* Copy count elements between the ring, from position on, and a flat
+ * array: in two runs when they wrap past the end of the buffer. */
+static void
+queue_copy_out(const queue_t * queue,
+               size_t          position,
+               void *          elements,
+               size_t          count)
+{
+    size_t first = queue->mask + 1 - (position & queue->mask);
+    first        = first < count ? first : count;
+
+    memcpy(elements, queue_slot(queue, position), first * queue->element_size);
+    memcpy((unsigned char *)elements + first * queue->element_size,
+           queue->buffer,
+           (count - first) * queue->element_size);
+}
+
+static void
+queue_copy_in(queue_t *    queue,
+              size_t       position,
+              const void * elements,
+              size_t       count)
+{
+    size_t first = queue->mask + 1 - (position & queue->mask);
+    first        = first < count ? first : count;
+
+    memcpy(queue_slot(queue, position), elements, first * queue->element_size);
+    memcpy(queue->buffer,
+           (const unsigned char *)elements + first * queue->element_size,
+           (count - first) * queue->element_size);
+}
+
+queue_t *
+queue_create(size_t element_size, size_t capacity)
+{
+    if (element_size == 0)
+    {
         return NULL;
     }
-    queue->capacity = capacity;
-    queue->elements = calloc(queue->capacity, sizeof(queue_node_t));
-    if (queue->elements == NULL) {
+
+    queue_t * queue = calloc(1, sizeof(queue_t));
+    if (queue == NULL)
+    {
+        return NULL;
+    }
+    queue->element_size = element_size;
+    if (queue_reserve(queue, capacity < QUEUE_MIN_CAPACITY ? QUEUE_MIN_CAPACITY
+                                                           : capacity))
+    {
         free(queue);
         return NULL;
     }
-    queue->front = 0;
-    queue->rear = capacity - 1;
-    queue->size = 0;
     return queue;
 }
 
-// Function to destroy a queue
-void queue_destroy(queue_t **queue) {
-    free((*queue)->elements);
+void
+queue_destroy(queue_t ** queue)
+{
+    if (!queue || !*queue)
+    {
+        return;
+    }
+
+    free((*queue)->buffer);
     free(*queue);
     *queue = NULL;
 }
 
-// Function to check if a queue is empty
-bool is_empty(queue_t *queue) {
-    return (queue->size == 0);
-}
-bool is_full(queue_t * queue)
+int
+queue_reserve(queue_t * queue, size_t capacity)
 {
- return (queue->size == queue->capacity);
+    size_t old_capacity = queue->buffer ? queue->mask + 1 : 0;
+    size_t new_capacity = old_capacity ? old_capacity : 1;
+
+    if (capacity <= old_capacity)
+    {
+        return 0;
+    }
+    while (new_capacity < capacity)
+    {
+        if (new_capacity > SIZE_MAX / 2 / queue->element_size)
+        {
+            return -1;
+        }
+        new_capacity *= 2;
+    }
+
+    unsigned char * buffer = malloc(new_capacity * queue->element_size);
+    if (buffer == NULL)
+    {
+        return -1;
+    }
+
+    /* Lay the elements out from the start of the new buffer, in order. */
+    size_t size = queue->tail - queue->head;
+    if (size > 0)
+    {
+        queue_copy_out(queue, queue->head, buffer, size);
+    }
+    free(queue->buffer);
+    queue->buffer = buffer;
+    queue->mask   = new_capacity - 1;
+    queue->head   = 0;
+    queue->tail   = size;
+    return 0;
 }
 
-// Function to get the size of a queue
-int get_size(queue_t *queue) {
-    return queue->size;
+int
+queue_push(queue_t * queue, const void * element)
+{
+    if (queue->tail - queue->head > queue->mask
+        && queue_reserve(queue, (queue->mask + 1) * 2))
+    {
+        return -1;
+    }
+    memcpy(queue_slot(queue, queue->tail), element, queue->element_size);
+    queue->tail++;
+    return 0;
 }
 
-// Function to add an element to the end of a queue
-void enqueue(queue_t *queue, position_t element) {
-    // Check if the queue is full
-    if (queue->size == queue->capacity) {
-        // Increase the capacity of the queue
-        queue->capacity *= 2;
-        queue->elements = realloc(queue->elements, queue->capacity * sizeof(position_t)); // maybe think about using a temp. Could lose pointer here and cause leaks.
-        if (queue->elements == NULL) {
-            // Failed to allocate memory, abort
-            exit(1);
-        }
+int
+queue_pop(queue_t * queue, void * element)
+{
+    if (queue->head == queue->tail)
+    {
+        return -1;
+    }
+    if (element)
+    {
+        memcpy(element, queue_slot(queue, queue->head), queue->element_size);
     }
-    // Add the element to the queue
-    queue->elements[queue->front] = element;
-    queue->front = (queue->front + 1) % queue->capacity;
-    queue->size++;
+    queue->head++;
+    return 0;
 }
 
-// Function to remove an element from the front of a queue
-void * dequeue(queue_t *queue) {
-    // Check if the queue is empty
-    if (queue->size == 0) {
-        // Return invalid
+int
+queue_push_n(queue_t * queue, const void * elements, size_t count)
+{
+    size_t size = queue->tail - queue->head;
+    if (count > SIZE_MAX - size || queue_reserve(queue, size + count))
+    {
         return -1;
     }
-    // Remove the front element from the queue
-    void * element = queue->queue[queue->front];
-    queue->front = (queue->front + 1) % queue->capacity;
-    queue->size--;
-    return element;
+    if (count > 0)
+    {
+        queue_copy_in(queue, queue->tail, elements, count);
+    }
+    queue->tail += count;
+    return 0;
 }
 
+size_t
+queue_pop_n(queue_t * queue, void * elements, size_t count)
+{
+    size_t size = queue->tail - queue->head;
+    count       = count < size ? count : size;
+    if (elements && count > 0)
+    {
+        queue_copy_out(queue, queue->head, elements, count);
+    }
+    queue->head += count;
+    return count;
+}
+
+void *
+queue_peek(const queue_t * queue)
+{
+    if (queue->head == queue->tail)
+    {
+        return NULL;
+    }
+    return queue_slot(queue, queue->head);
+}
+
+int
+queue_enqueue(queue_t * queue, void * item)
+{
+    return queue_push(queue, &item);
+}
+
+void *
+queue_dequeue(queue_t * queue)
+{
+    void * item = NULL;
+    queue_pop(queue, &item);
+    return item;
+}
+
+void
+queue_clear(queue_t * queue)
+{
+    queue->head = 0;
+    queue->tail = 0;
+}
+
+bool
+queue_is_empty(const queue_t * queue)
+{
+    return queue->head == queue->tail;
+}
+
+size_t
+queue_size(const queue_t * queue)
+{
+    return queue->tail - queue->head;
+}
+
+size_t
+queue_capacity(const queue_t * queue)
+{
+    return queue->mask + 1;
+}
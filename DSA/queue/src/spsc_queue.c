@@ -0,0 +1,222 @@
+/** @file spsc_queue.c
+ *
+ * @brief A single producer, single consumer ring buffer.
+ *
+ * tail is written only by the producer and head only by the consumer, each
+ * on its own cache line. Each side also keeps, on its own line, the last
+ * value it read of the other's index, and reads the shared one again only
+ * when that copy says the queue is full (or empty). A steady stream of
+ * pushes and pops therefore reads the other side's line once per lap of
+ * the ring rather than once per element.
+ *
+ * The producer publishes elements with a release store of tail, which the
+ * consumer's acquire load pairs with before copying them out; head works
+ * the same way in the other direction to hand slots back.
+ *
+ */
+
+#include "../include/spsc_queue.h"
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SPSC_CACHE_LINE 64
+
+struct spsc_queue
+{
+    /* Written by the producer. */
+    _Alignas(SPSC_CACHE_LINE) atomic_size_t tail;
+    size_t head_cache;
+
+    /* Written by the consumer. */
+    _Alignas(SPSC_CACHE_LINE) atomic_size_t head;
+    size_t tail_cache;
+
+    /* Read only. */
+    _Alignas(SPSC_CACHE_LINE) unsigned char * buffer;
+    size_t element_size;
+    size_t mask;
+};
+
+static unsigned char *
+spsc_slot(const spsc_queue_t * queue, size_t position)
+{
+    return queue->buffer + (position & queue->mask) * queue->element_size;
+}
+
+/* Copy one element, letting the compiler inline the common word sized
+ * case. */
+static void
+spsc_copy(const spsc_queue_t * queue, void * to, const void * from)
+{
+    if (queue->element_size == sizeof(uint64_t))
+    {
+        memcpy(to, from, sizeof(uint64_t));
+    }
+    else
+    {
+        memcpy(to, from, queue->element_size);
+    }
+}
+
+spsc_queue_t *
+spsc_create(size_t element_size, size_t capacity)
+{
+    if (element_size == 0 || capacity == 0)
+    {
+        return NULL;
+    }
+
+    size_t count = 1;
+    while (count < capacity)
+    {
+        if (count > SIZE_MAX / 2 / element_size)
+        {
+            return NULL;
+        }
+        count *= 2;
+    }
+
+    spsc_queue_t * queue = aligned_alloc(SPSC_CACHE_LINE, sizeof(spsc_queue_t));
+    if (queue == NULL)
+    {
+        return NULL;
+    }
+    if ((queue->buffer = malloc(count * element_size)) == NULL)
+    {
+        free(queue);
+        return NULL;
+    }
+    atomic_init(&queue->tail, 0);
+    atomic_init(&queue->head, 0);
+    queue->head_cache   = 0;
+    queue->tail_cache   = 0;
+    queue->element_size = element_size;
+    queue->mask         = count - 1;
+    return queue;
+}
+
+void
+spsc_destroy(spsc_queue_t ** queue)
+{
+    if (!queue || !*queue)
+    {
+        return;
+    }
+
+    free((*queue)->buffer);
+    free(*queue);
+    *queue = NULL;
+}
+
+bool
+spsc_push(spsc_queue_t * queue, const void * element)
+{
+    size_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+
+    if (tail - queue->head_cache > queue->mask)
+    {
+        queue->head_cache
+            = atomic_load_explicit(&queue->head, memory_order_acquire);
+        if (tail - queue->head_cache > queue->mask)
+        {
+            return false;
+        }
+    }
+    spsc_copy(queue, spsc_slot(queue, tail), element);
+    atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+    return true;
+}
+
+bool
+spsc_pop(spsc_queue_t * queue, void * element)
+{
+    size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+
+    if (head == queue->tail_cache)
+    {
+        queue->tail_cache
+            = atomic_load_explicit(&queue->tail, memory_order_acquire);
+        if (head == queue->tail_cache)
+        {
+            return false;
+        }
+    }
+    spsc_copy(queue, element, spsc_slot(queue, head));
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+    return true;
+}
+
+size_t
+spsc_push_n(spsc_queue_t * queue, const void * elements, size_t count)
+{
+    size_t tail     = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    size_t capacity = queue->mask + 1;
+
+    if (capacity - (tail - queue->head_cache) < count)
+    {
+        queue->head_cache
+            = atomic_load_explicit(&queue->head, memory_order_acquire);
+    }
+    size_t room = capacity - (tail - queue->head_cache);
+    count       = count < room ? count : room;
+    if (count == 0)
+    {
+        return 0;
+    }
+
+    /* Up to the end of the buffer, then from its start. */
+    size_t first = capacity - (tail & queue->mask);
+    first        = first < count ? first : count;
+    memcpy(spsc_slot(queue, tail), elements, first * queue->element_size);
+    memcpy(queue->buffer,
+           (const unsigned char *)elements + first * queue->element_size,
+           (count - first) * queue->element_size);
+
+    atomic_store_explicit(&queue->tail, tail + count, memory_order_release);
+    return count;
+}
+
+size_t
+spsc_pop_n(spsc_queue_t * queue, void * elements, size_t count)
+{
+    size_t head     = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    size_t capacity = queue->mask + 1;
+
+    if (queue->tail_cache - head < count)
+    {
+        queue->tail_cache
+            = atomic_load_explicit(&queue->tail, memory_order_acquire);
+    }
+    size_t available = queue->tail_cache - head;
+    count            = count < available ? count : available;
+    if (count == 0)
+    {
+        return 0;
+    }
+
+    size_t first = capacity - (head & queue->mask);
+    first        = first < count ? first : count;
+    memcpy(elements, spsc_slot(queue, head), first * queue->element_size);
+    memcpy((unsigned char *)elements + first * queue->element_size,
+           queue->buffer,
+           (count - first) * queue->element_size);
+
+    atomic_store_explicit(&queue->head, head + count, memory_order_release);
+    return count;
+}
+
+size_t
+spsc_size(const spsc_queue_t * queue)
+{
+    size_t head = atomic_load_explicit(&queue->head, memory_order_acquire);
+    size_t tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+    return tail - head;
+}
+
+size_t
+spsc_capacity(const spsc_queue_t * queue)
+{
+    return queue->mask + 1;
+}
@@ -0,0 +1,284 @@
+/** @file check_deque.c
+ *
+ * @brief Tests for the chunked deque against a reference, with chunks
+ *        small enough that the ends cross chunk boundaries all the time:
+ *        growth at one end and drain from the other, oscillation around a
+ *        boundary, elements of odd sizes, and elements staying in place.
+ *
+ * Build and run from DSA/queue with
+ *
+ *     gcc -std=c18 -O2 -D_DEFAULT_SOURCE src/deque.c test/check_deque.c \
+ *         -lcheck -lm -lrt -lsubunit -pthread -o check_deque
+ *     ./check_deque
+ *
+ */
+
+#include <check.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/deque.h"
+
+#define CHUNK_ELEMENTS 8
+#define REFERENCE_CAPACITY (1u << 16)
+#define OPERATIONS 400000
+#define PHASE_LENGTH 3000
+#define PINNED_PUSHES 1000
+
+/* An element whose size is not a power of two, with its sequence number
+ * repeated in the padding so that a partial copy shows up. */
+typedef struct
+{
+    uint64_t sequence;
+    uint8_t  pad[5];
+} Odd_T;
+
+/* A ring buffer holding what the deque should, front first. */
+typedef struct
+{
+    uint64_t items[REFERENCE_CAPACITY];
+    size_t   head;
+    size_t   size;
+} Reference_T;
+
+static void
+make_odd(Odd_T * element, uint64_t sequence)
+{
+    element->sequence = sequence;
+    memset(element->pad, (int)(sequence & 0xff), sizeof(element->pad));
+}
+
+static void
+check_odd(const Odd_T * element, uint64_t sequence)
+{
+    ck_assert_uint_eq(element->sequence, sequence);
+    for (size_t i = 0; i < sizeof(element->pad); i++)
+    {
+        ck_assert_uint_eq(element->pad[i], sequence & 0xff);
+    }
+}
+
+static uint64_t
+reference_at(const Reference_T * reference, size_t i)
+{
+    return reference->items[(reference->head + i) % REFERENCE_CAPACITY];
+}
+
+static void
+check_ends(const deque_t * deque, const Reference_T * reference)
+{
+    ck_assert_uint_eq(deque_size(deque), reference->size);
+    ck_assert_int_eq(deque_is_empty(deque), reference->size == 0);
+    if (reference->size == 0)
+    {
+        ck_assert_ptr_null(deque_front(deque));
+        ck_assert_ptr_null(deque_back(deque));
+        return;
+    }
+    check_odd(deque_front(deque), reference_at(reference, 0));
+    check_odd(deque_back(deque), reference_at(reference, reference->size - 1));
+}
+
+/* Random pushes and pops, in phases that favour one pattern each: growth
+ * at the back drained from the front, the reverse, and both ends at once
+ * hovering near a chunk boundary. */
+static void
+check_reference(size_t chunk_elements)
+{
+    deque_t *     deque     = deque_create(sizeof(Odd_T), chunk_elements);
+    Reference_T * reference = calloc(1, sizeof(Reference_T));
+    uint64_t      sequence  = 0;
+    Odd_T         element;
+
+    ck_assert_ptr_nonnull(deque);
+    ck_assert_ptr_nonnull(reference);
+    srand(49);
+    for (size_t op = 0; op < OPERATIONS; op++)
+    {
+        int  phase     = (int)(op / PHASE_LENGTH % 4);
+        int  push_odds = phase == 3 ? 50 : 60;
+        bool push      = rand() % 100 < push_odds;
+        bool at_back   = rand() % 2 == 0;
+
+        /* Phases 0 and 1 push at one end and pop at the other. */
+        if (phase == 0)
+        {
+            at_back = push;
+        }
+        else if (phase == 1)
+        {
+            at_back = !push;
+        }
+        else if (phase == 2 && reference->size > 0 && op % PHASE_LENGTH == 0)
+        {
+            deque_clear(deque);
+            reference->size = 0;
+        }
+
+        if (push && reference->size < REFERENCE_CAPACITY)
+        {
+            make_odd(&element, sequence);
+            if (at_back)
+            {
+                ck_assert_int_eq(deque_push_back(deque, &element), 0);
+                reference->items[(reference->head + reference->size)
+                                 % REFERENCE_CAPACITY] = sequence;
+            }
+            else
+            {
+                ck_assert_int_eq(deque_push_front(deque, &element), 0);
+                reference->head = (reference->head + REFERENCE_CAPACITY - 1)
+                                  % REFERENCE_CAPACITY;
+                reference->items[reference->head] = sequence;
+            }
+            reference->size++;
+            sequence++;
+        }
+        else if (reference->size == 0)
+        {
+            ck_assert_int_eq(deque_pop_back(deque, &element), -1);
+            ck_assert_int_eq(deque_pop_front(deque, NULL), -1);
+        }
+        else if (at_back)
+        {
+            ck_assert_int_eq(deque_pop_back(deque, &element), 0);
+            reference->size--;
+            check_odd(&element, reference_at(reference, reference->size));
+        }
+        else
+        {
+            ck_assert_int_eq(deque_pop_front(deque, &element), 0);
+            check_odd(&element, reference_at(reference, 0));
+            reference->head = (reference->head + 1) % REFERENCE_CAPACITY;
+            reference->size--;
+        }
+        check_ends(deque, reference);
+
+        if (op % 50000 == 0)
+        {
+            deque_shrink(deque);
+        }
+    }
+
+    /* Drain everything from the front, in order. */
+    for (size_t i = 0; i < reference->size; i++)
+    {
+        ck_assert_int_eq(deque_pop_front(deque, &element), 0);
+        check_odd(&element, reference_at(reference, i));
+    }
+    ck_assert(deque_is_empty(deque));
+    deque_destroy(&deque);
+    ck_assert_ptr_null(deque);
+    free(reference);
+}
+
+START_TEST(test_small_chunks_match_reference)
+{
+    check_reference(CHUNK_ELEMENTS);
+}
+END_TEST
+
+START_TEST(test_default_chunks_match_reference)
+{
+    check_reference(0);
+}
+END_TEST
+
+START_TEST(test_boundary_oscillation)
+{
+    deque_t * deque = deque_create(sizeof(Odd_T), CHUNK_ELEMENTS);
+    Odd_T     element;
+
+    /* Fill the first chunk from its middle to its back end, then cross
+     * the boundary and come back many times, at both ends. */
+    ck_assert_ptr_nonnull(deque);
+    for (uint64_t i = 0; i < CHUNK_ELEMENTS / 2; i++)
+    {
+        make_odd(&element, i);
+        ck_assert_int_eq(deque_push_back(deque, &element), 0);
+    }
+    for (uint64_t lap = 0; lap < 10000; lap++)
+    {
+        make_odd(&element, 100 + lap);
+        ck_assert_int_eq(deque_push_back(deque, &element), 0);
+        ck_assert_int_eq(deque_push_front(deque, &element), 0);
+        check_odd(deque_back(deque), 100 + lap);
+        check_odd(deque_front(deque), 100 + lap);
+        ck_assert_int_eq(deque_pop_back(deque, &element), 0);
+        check_odd(&element, 100 + lap);
+        ck_assert_int_eq(deque_pop_front(deque, &element), 0);
+        check_odd(&element, 100 + lap);
+        check_odd(deque_back(deque), CHUNK_ELEMENTS / 2 - 1);
+        check_odd(deque_front(deque), 0);
+    }
+    ck_assert_uint_eq(deque_size(deque), CHUNK_ELEMENTS / 2);
+    deque_destroy(&deque);
+}
+END_TEST
+
+START_TEST(test_elements_stay_in_place)
+{
+    deque_t * deque = deque_create(sizeof(Odd_T), CHUNK_ELEMENTS);
+    Odd_T     element;
+
+    ck_assert_ptr_nonnull(deque);
+    make_odd(&element, 7);
+    ck_assert_int_eq(deque_push_back(deque, &element), 0);
+
+    Odd_T * pinned = deque_front(deque);
+    for (uint64_t i = 0; i < PINNED_PUSHES; i++)
+    {
+        make_odd(&element, 1000 + i);
+        ck_assert_int_eq(deque_push_back(deque, &element), 0);
+        ck_assert_int_eq(deque_push_front(deque, &element), 0);
+    }
+    for (uint64_t i = 0; i < PINNED_PUSHES; i++)
+    {
+        ck_assert_int_eq(deque_pop_front(deque, NULL), 0);
+    }
+    ck_assert_ptr_eq(deque_front(deque), pinned);
+    check_odd(pinned, 7);
+
+    deque_clear(deque);
+    ck_assert(deque_is_empty(deque));
+    ck_assert_ptr_null(deque_front(deque));
+    make_odd(&element, 9);
+    ck_assert_int_eq(deque_push_front(deque, &element), 0);
+    check_odd(deque_back(deque), 9);
+    deque_destroy(&deque);
+    deque_destroy(NULL);
+    ck_assert_ptr_null(deque_create(0, CHUNK_ELEMENTS));
+}
+END_TEST
+
+Suite *
+check_deque_suite(void)
+{
+    Suite * suite        = suite_create("deque_test");
+    TCase * tc_core      = tcase_create("Core");
+    TCase * tc_reference = tcase_create("Reference");
+
+    tcase_add_test(tc_core, test_boundary_oscillation);
+    tcase_add_test(tc_core, test_elements_stay_in_place);
+    tcase_add_test(tc_reference, test_small_chunks_match_reference);
+    tcase_add_test(tc_reference, test_default_chunks_match_reference);
+    tcase_set_timeout(tc_reference, 60);
+
+    suite_add_tcase(suite, tc_core);
+    suite_add_tcase(suite, tc_reference);
+    return suite;
+}
+
+int
+main(void)
+{
+    SRunner * runner = srunner_create(check_deque_suite());
+
+    srunner_run_all(runner, CK_VERBOSE);
+
+    int no_failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+    return (no_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,501 @@
+/** @file check_mpmc_queue.c
+ *
+ * @brief Tests for the MPMC queue: exact capacity, the try, timed and
+ *        draining calls, closing with threads waiting on both sides, and
+ *        several producers and consumers passing every element exactly
+ *        once.
+ *
+ * Build and run from DSA/queue with
+ *
+ *     gcc -std=c18 -O2 -D_DEFAULT_SOURCE -pthread src/mpmc_queue.c \
+ *         test/check_mpmc_queue.c -lcheck -lm -lrt -lsubunit \
+ *         -o check_mpmc_queue
+ *     ./check_mpmc_queue
+ *
+ */
+
+#include <check.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../include/mpmc_queue.h"
+
+#define SMALL_CAPACITY 6
+#define SHORT_WAIT_NS 20000000ull
+#define LONG_WAIT_NS 10000000000ull
+#define PRODUCERS 4
+#define CONSUMERS 4
+#define PER_PRODUCER 100000
+#define WAITERS 3
+
+typedef struct
+{
+    mpmc_queue_t * queue;
+    uint64_t       first; /* First value a producer sends. */
+    uint64_t       count;
+    uint8_t *      seen;  /* How often each value arrived. */
+    atomic_long    errors;
+} Shared_T;
+
+typedef struct
+{
+    Shared_T * shared;
+    uint64_t   first;
+} Producer_T;
+
+/* A waiting call and what it returned. */
+typedef struct
+{
+    mpmc_queue_t * queue;
+    int            result;
+    int            error;
+} Waiter_T;
+
+static uint64_t
+now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static mpmc_queue_t *
+queue_new(size_t capacity)
+{
+    mpmc_queue_t * queue = mpmc_create(sizeof(uint64_t), capacity);
+    ck_assert_ptr_nonnull(queue);
+    return queue;
+}
+
+static void
+fill(mpmc_queue_t * queue, uint64_t first, size_t count)
+{
+    for (uint64_t i = first; i < first + count; i++)
+    {
+        ck_assert_int_eq(mpmc_try_push(queue, &i), 0);
+    }
+}
+
+/* Let the thread just started get as far as its wait. */
+static void
+let_block(void)
+{
+    struct timespec pause = { 0, (long)SHORT_WAIT_NS };
+    nanosleep(&pause, NULL);
+}
+
+START_TEST(test_create_and_destroy)
+{
+    mpmc_queue_t * queue = queue_new(SMALL_CAPACITY);
+
+    ck_assert_ptr_null(mpmc_create(0, SMALL_CAPACITY));
+    ck_assert_ptr_null(mpmc_create(sizeof(uint64_t), 0));
+    ck_assert_uint_eq(mpmc_size(queue), 0);
+
+    mpmc_destroy(&queue);
+    ck_assert_ptr_null(queue);
+    mpmc_destroy(&queue);
+    mpmc_destroy(NULL);
+}
+END_TEST
+
+START_TEST(test_exact_capacity)
+{
+    /* Capacities that are not powers of two are kept as asked, and a
+     * queue of one works. */
+    size_t   capacities[] = { 1, 2, 3, SMALL_CAPACITY, 8 };
+    uint64_t value        = 0;
+
+    for (size_t c = 0; c < sizeof(capacities) / sizeof(capacities[0]); c++)
+    {
+        mpmc_queue_t * queue = queue_new(capacities[c]);
+        uint64_t       want  = 0;
+
+        for (uint64_t lap = 0; lap < 4; lap++)
+        {
+            fill(queue, lap * capacities[c], capacities[c]);
+            ck_assert_uint_eq(mpmc_size(queue), capacities[c]);
+            ck_assert_int_eq(mpmc_try_push(queue, &value), -1);
+            ck_assert_int_eq(errno, EAGAIN);
+
+            for (size_t i = 0; i < capacities[c]; i++)
+            {
+                ck_assert_int_eq(mpmc_try_pop(queue, &value), 0);
+                ck_assert_uint_eq(value, want);
+                want++;
+            }
+            ck_assert_int_eq(mpmc_try_pop(queue, &value), -1);
+            ck_assert_int_eq(errno, EAGAIN);
+        }
+        mpmc_destroy(&queue);
+    }
+}
+END_TEST
+
+START_TEST(test_large_elements)
+{
+    typedef struct
+    {
+        uint64_t sequence;
+        char     text[53];
+    } Record_T;
+
+    mpmc_queue_t * queue = mpmc_create(sizeof(Record_T), 3);
+    Record_T       in;
+    Record_T       out;
+
+    ck_assert_ptr_nonnull(queue);
+    for (uint64_t i = 0; i < 10; i++)
+    {
+        memset(&in, (int)('a' + i), sizeof(in));
+        in.sequence = i;
+        ck_assert_int_eq(mpmc_push(queue, &in), 0);
+        ck_assert_int_eq(mpmc_pop(queue, &out), 0);
+        ck_assert_mem_eq(&out, &in, sizeof(in));
+    }
+    mpmc_destroy(&queue);
+}
+END_TEST
+
+START_TEST(test_timed_waits_time_out)
+{
+    mpmc_queue_t * queue = queue_new(SMALL_CAPACITY);
+    uint64_t       value = 0;
+    uint64_t       start = now_ns();
+
+    ck_assert_int_eq(mpmc_timed_pop(queue, &value, SHORT_WAIT_NS), -1);
+    ck_assert_int_eq(errno, ETIMEDOUT);
+    ck_assert_uint_ge(now_ns() - start, SHORT_WAIT_NS);
+
+    fill(queue, 0, SMALL_CAPACITY);
+    start = now_ns();
+    ck_assert_int_eq(mpmc_timed_push(queue, &value, SHORT_WAIT_NS), -1);
+    ck_assert_int_eq(errno, ETIMEDOUT);
+    ck_assert_uint_ge(now_ns() - start, SHORT_WAIT_NS);
+
+    ck_assert_int_eq(mpmc_timed_pop(queue, &value, SHORT_WAIT_NS), 0);
+    ck_assert_uint_eq(value, 0);
+    ck_assert_int_eq(mpmc_timed_push(queue, &value, SHORT_WAIT_NS), 0);
+    mpmc_destroy(&queue);
+}
+END_TEST
+
+static void *
+timed_pop(void * arg)
+{
+    Waiter_T * waiter = arg;
+    uint64_t   value  = 0;
+
+    waiter->result = mpmc_timed_pop(waiter->queue, &value, LONG_WAIT_NS);
+    waiter->error  = waiter->result == 0 ? (int)value : errno;
+    return NULL;
+}
+
+static void *
+timed_push(void * arg)
+{
+    Waiter_T * waiter = arg;
+    uint64_t   value  = 42;
+
+    waiter->result = mpmc_timed_push(waiter->queue, &value, LONG_WAIT_NS);
+    waiter->error  = waiter->result == 0 ? 0 : errno;
+    return NULL;
+}
+
+START_TEST(test_timed_waits_succeed)
+{
+    mpmc_queue_t * queue  = queue_new(1);
+    Waiter_T       waiter = { queue, -1, 0 };
+    pthread_t      thread;
+    uint64_t       value = 7;
+
+    /* A pop waiting on an empty queue takes the element pushed to it. */
+    ck_assert_int_eq(pthread_create(&thread, NULL, timed_pop, &waiter), 0);
+    let_block();
+    ck_assert_int_eq(mpmc_push(queue, &value), 0);
+    ck_assert_int_eq(pthread_join(thread, NULL), 0);
+    ck_assert_int_eq(waiter.result, 0);
+    ck_assert_int_eq(waiter.error, 7);
+
+    /* A push waiting on a full queue gets the cell freed for it. */
+    ck_assert_int_eq(mpmc_push(queue, &value), 0);
+    ck_assert_int_eq(pthread_create(&thread, NULL, timed_push, &waiter), 0);
+    let_block();
+    ck_assert_int_eq(mpmc_pop(queue, &value), 0);
+    ck_assert_uint_eq(value, 7);
+    ck_assert_int_eq(pthread_join(thread, NULL), 0);
+    ck_assert_int_eq(waiter.result, 0);
+    ck_assert_int_eq(mpmc_pop(queue, &value), 0);
+    ck_assert_uint_eq(value, 42);
+    mpmc_destroy(&queue);
+}
+END_TEST
+
+START_TEST(test_drain_takes_batches)
+{
+    mpmc_queue_t * queue = queue_new(SMALL_CAPACITY);
+    uint64_t       out[SMALL_CAPACITY * 2];
+    uint64_t       want = 0;
+
+    ck_assert_uint_eq(mpmc_drain(queue, out, 0), 0);
+
+    /* The run of ready cells wraps around the end of the ring. */
+    fill(queue, 0, 4);
+    ck_assert_uint_eq(mpmc_drain(queue, out, 3), 3);
+    fill(queue, 4, 5);
+    ck_assert_uint_eq(mpmc_size(queue), SMALL_CAPACITY);
+    ck_assert_uint_eq(mpmc_drain(queue, out + 3, SMALL_CAPACITY * 2),
+                      SMALL_CAPACITY);
+    for (size_t i = 0; i < 3 + SMALL_CAPACITY; i++)
+    {
+        ck_assert_uint_eq(out[i], want);
+        want++;
+    }
+
+    fill(queue, want, 2);
+    mpmc_close(queue);
+    ck_assert_uint_eq(mpmc_drain(queue, out, SMALL_CAPACITY), 2);
+    ck_assert_uint_eq(out[0], want);
+    ck_assert_uint_eq(out[1], want + 1);
+    ck_assert_uint_eq(mpmc_drain(queue, out, SMALL_CAPACITY), 0);
+    ck_assert_int_eq(errno, EPIPE);
+    mpmc_destroy(&queue);
+}
+END_TEST
+
+START_TEST(test_close_keeps_elements)
+{
+    mpmc_queue_t * queue = queue_new(SMALL_CAPACITY);
+    uint64_t       value = 0;
+
+    fill(queue, 0, 3);
+    mpmc_close(queue);
+    mpmc_close(queue);
+
+    ck_assert_int_eq(mpmc_try_push(queue, &value), -1);
+    ck_assert_int_eq(errno, EPIPE);
+    ck_assert_int_eq(mpmc_push(queue, &value), -1);
+    ck_assert_int_eq(errno, EPIPE);
+    ck_assert_int_eq(mpmc_timed_push(queue, &value, SHORT_WAIT_NS), -1);
+    ck_assert_int_eq(errno, EPIPE);
+    ck_assert_uint_eq(mpmc_size(queue), 3);
+
+    for (uint64_t i = 0; i < 3; i++)
+    {
+        ck_assert_int_eq(mpmc_pop(queue, &value), 0);
+        ck_assert_uint_eq(value, i);
+    }
+    ck_assert_int_eq(mpmc_pop(queue, &value), -1);
+    ck_assert_int_eq(errno, EPIPE);
+    ck_assert_int_eq(mpmc_try_pop(queue, &value), -1);
+    ck_assert_int_eq(errno, EPIPE);
+    ck_assert_int_eq(mpmc_timed_pop(queue, &value, SHORT_WAIT_NS), -1);
+    ck_assert_int_eq(errno, EPIPE);
+    mpmc_destroy(&queue);
+}
+END_TEST
+
+static void *
+blocking_pop(void * arg)
+{
+    Waiter_T * waiter = arg;
+    uint64_t   value  = 0;
+
+    waiter->result = mpmc_pop(waiter->queue, &value);
+    waiter->error  = errno;
+    return NULL;
+}
+
+static void *
+blocking_push(void * arg)
+{
+    Waiter_T * waiter = arg;
+    uint64_t   value  = 0;
+
+    waiter->result = mpmc_push(waiter->queue, &value);
+    waiter->error  = errno;
+    return NULL;
+}
+
+/* Start WAITERS threads running wait, let them block, close the queue and
+ * check that each of them returns EPIPE. */
+static void
+close_wakes(mpmc_queue_t * queue, void * (*wait)(void *))
+{
+    pthread_t threads[WAITERS];
+    Waiter_T  waiters[WAITERS];
+
+    for (int i = 0; i < WAITERS; i++)
+    {
+        waiters[i] = (Waiter_T){ queue, 0, 0 };
+        ck_assert_int_eq(
+            pthread_create(&threads[i], NULL, wait, &waiters[i]), 0);
+    }
+    let_block();
+    mpmc_close(queue);
+    for (int i = 0; i < WAITERS; i++)
+    {
+        ck_assert_int_eq(pthread_join(threads[i], NULL), 0);
+        ck_assert_int_eq(waiters[i].result, -1);
+        ck_assert_int_eq(waiters[i].error, EPIPE);
+    }
+}
+
+START_TEST(test_close_wakes_poppers)
+{
+    mpmc_queue_t * queue = queue_new(SMALL_CAPACITY);
+
+    close_wakes(queue, blocking_pop);
+    mpmc_destroy(&queue);
+}
+END_TEST
+
+START_TEST(test_close_wakes_pushers)
+{
+    mpmc_queue_t * queue = queue_new(SMALL_CAPACITY);
+
+    fill(queue, 0, SMALL_CAPACITY);
+    close_wakes(queue, blocking_push);
+    ck_assert_uint_eq(mpmc_size(queue), SMALL_CAPACITY);
+    mpmc_destroy(&queue);
+}
+END_TEST
+
+static void *
+produce(void * arg)
+{
+    Producer_T * producer = arg;
+
+    for (uint64_t i = 0; i < producer->shared->count; i++)
+    {
+        uint64_t value = producer->first + i;
+        if (mpmc_push(producer->shared->queue, &value) != 0)
+        {
+            atomic_fetch_add(&producer->shared->errors, 1);
+        }
+    }
+    return NULL;
+}
+
+/* Take until the queue is closed and empty, alternating single pops and
+ * drains, and count every value seen. */
+static void *
+consume(void * arg)
+{
+    Shared_T * shared = arg;
+    uint64_t   batch[SMALL_CAPACITY];
+    size_t     got = 0;
+    int        turn = 0;
+
+    do
+    {
+        got = turn++ % 2 ? mpmc_drain(shared->queue, batch, SMALL_CAPACITY)
+                         : (mpmc_pop(shared->queue, batch) == 0);
+        for (size_t i = 0; i < got; i++)
+        {
+            uint64_t index = batch[i] - shared->first;
+            if (index >= PRODUCERS * shared->count)
+            {
+                atomic_fetch_add(&shared->errors, 1);
+            }
+            else
+            {
+                /* Values are distinct, so no two consumers share a byte. */
+                shared->seen[index]++;
+            }
+        }
+    } while (got > 0);
+
+    if (errno != EPIPE)
+    {
+        atomic_fetch_add(&shared->errors, 1);
+    }
+    return NULL;
+}
+
+START_TEST(test_every_element_arrives_once)
+{
+    Shared_T   shared = { queue_new(SMALL_CAPACITY),
+                          1000,
+                          PER_PRODUCER,
+                          calloc(PRODUCERS * PER_PRODUCER, 1),
+                          0 };
+    pthread_t  producers[PRODUCERS];
+    pthread_t  consumers[CONSUMERS];
+    Producer_T ranges[PRODUCERS];
+
+    ck_assert_ptr_nonnull(shared.seen);
+    for (int i = 0; i < CONSUMERS; i++)
+    {
+        ck_assert_int_eq(
+            pthread_create(&consumers[i], NULL, consume, &shared), 0);
+    }
+    for (int i = 0; i < PRODUCERS; i++)
+    {
+        ranges[i].shared = &shared;
+        ranges[i].first  = shared.first + (uint64_t)i * shared.count;
+        ck_assert_int_eq(
+            pthread_create(&producers[i], NULL, produce, &ranges[i]), 0);
+    }
+    for (int i = 0; i < PRODUCERS; i++)
+    {
+        ck_assert_int_eq(pthread_join(producers[i], NULL), 0);
+    }
+    mpmc_close(shared.queue);
+    for (int i = 0; i < CONSUMERS; i++)
+    {
+        ck_assert_int_eq(pthread_join(consumers[i], NULL), 0);
+    }
+
+    ck_assert_int_eq(atomic_load(&shared.errors), 0);
+    for (size_t i = 0; i < PRODUCERS * PER_PRODUCER; i++)
+    {
+        ck_assert_uint_eq(shared.seen[i], 1);
+    }
+    ck_assert_uint_eq(mpmc_size(shared.queue), 0);
+    free(shared.seen);
+    mpmc_destroy(&shared.queue);
+}
+END_TEST
+
+Suite *
+check_mpmc_queue_suite(void)
+{
+    Suite * suite     = suite_create("mpmc_queue_test");
+    TCase * tc_core   = tcase_create("Core");
+    TCase * tc_thread = tcase_create("Threads");
+
+    tcase_add_test(tc_core, test_create_and_destroy);
+    tcase_add_test(tc_core, test_exact_capacity);
+    tcase_add_test(tc_core, test_large_elements);
+    tcase_add_test(tc_core, test_timed_waits_time_out);
+    tcase_add_test(tc_core, test_drain_takes_batches);
+    tcase_add_test(tc_core, test_close_keeps_elements);
+    tcase_add_test(tc_thread, test_timed_waits_succeed);
+    tcase_add_test(tc_thread, test_close_wakes_poppers);
+    tcase_add_test(tc_thread, test_close_wakes_pushers);
+    tcase_add_test(tc_thread, test_every_element_arrives_once);
+    tcase_set_timeout(tc_thread, 60);
+
+    suite_add_tcase(suite, tc_core);
+    suite_add_tcase(suite, tc_thread);
+    return suite;
+}
+
+int
+main(void)
+{
+    SRunner * runner = srunner_create(check_mpmc_queue_suite());
+
+    srunner_run_all(runner, CK_VERBOSE);
+
+    int no_failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+    return (no_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,290 @@
+/** @file check_spsc_queue.c
+ *
+ * @brief Tests for the SPSC queue, above all that elements keep their
+ *        order as the ring wraps around, one at a time and in batches that
+ *        straddle the end of the buffer.
+ *
+ * Build and run from DSA/queue with
+ *
+ *     gcc -std=c18 -O2 -D_DEFAULT_SOURCE -pthread src/spsc_queue.c \
+ *         test/check_spsc_queue.c -lcheck -lm -lrt -lsubunit \
+ *         -o check_spsc_queue
+ *     ./check_spsc_queue
+ *
+ */
+
+#include <check.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/spsc_queue.h"
+
+#define SMALL_CAPACITY 8
+#define LAPS 1000
+#define STREAM_LENGTH 2000000
+
+/* An element whose size is not a power of two. */
+typedef struct
+{
+    uint64_t sequence;
+    uint8_t  pad[5];
+} Odd_T;
+
+typedef struct
+{
+    spsc_queue_t * queue;
+    uint64_t       count;
+    uint64_t       errors;
+} Stream_T;
+
+START_TEST(test_create_rounds_capacity)
+{
+    spsc_queue_t * queue = spsc_create(sizeof(uint64_t), 5);
+
+    ck_assert_ptr_nonnull(queue);
+    ck_assert_uint_eq(spsc_capacity(queue), SMALL_CAPACITY);
+    ck_assert_uint_eq(spsc_size(queue), 0);
+
+    spsc_destroy(&queue);
+    ck_assert_ptr_null(queue);
+    spsc_destroy(&queue);
+    spsc_destroy(NULL);
+}
+END_TEST
+
+START_TEST(test_full_and_empty)
+{
+    spsc_queue_t * queue = spsc_create(sizeof(uint64_t), SMALL_CAPACITY);
+    uint64_t       value = 0;
+
+    ck_assert(!spsc_pop(queue, &value));
+    for (uint64_t i = 0; i < SMALL_CAPACITY; i++)
+    {
+        ck_assert(spsc_push(queue, &i));
+    }
+    ck_assert(!spsc_push(queue, &value));
+    ck_assert_uint_eq(spsc_size(queue), SMALL_CAPACITY);
+
+    for (uint64_t i = 0; i < SMALL_CAPACITY; i++)
+    {
+        ck_assert(spsc_pop(queue, &value));
+        ck_assert_uint_eq(value, i);
+    }
+    ck_assert(!spsc_pop(queue, &value));
+    spsc_destroy(&queue);
+}
+END_TEST
+
+START_TEST(test_order_across_wraparound)
+{
+    spsc_queue_t * queue = spsc_create(sizeof(uint64_t), SMALL_CAPACITY);
+    uint64_t       next  = 0;
+    uint64_t       want  = 0;
+    uint64_t       value = 0;
+
+    /* Keep the queue between one and capacity - 1 full, so every lap
+     * starts at a different offset into the buffer. */
+    for (int lap = 0; lap < LAPS; lap++)
+    {
+        size_t fill = 1 + (size_t)lap % (SMALL_CAPACITY - 1);
+        while (spsc_size(queue) < fill)
+        {
+            ck_assert(spsc_push(queue, &next));
+            next++;
+        }
+        while (spsc_size(queue) > 1)
+        {
+            ck_assert(spsc_pop(queue, &value));
+            ck_assert_uint_eq(value, want);
+            want++;
+        }
+    }
+    while (spsc_pop(queue, &value))
+    {
+        ck_assert_uint_eq(value, want);
+        want++;
+    }
+    ck_assert_uint_eq(want, next);
+    spsc_destroy(&queue);
+}
+END_TEST
+
+START_TEST(test_batches_straddle_the_end)
+{
+    spsc_queue_t * queue = spsc_create(sizeof(Odd_T), SMALL_CAPACITY);
+    Odd_T          in[SMALL_CAPACITY];
+    Odd_T          out[SMALL_CAPACITY];
+    uint64_t       next = 0;
+    uint64_t       want = 0;
+
+    memset(in, 0, sizeof(in));
+    for (size_t start = 0; start < 4 * SMALL_CAPACITY; start++)
+    {
+        /* Batches of 8, 7 and 6 plus the single element below move the
+         * ring by 9, 8 and 7 slots, so batches start at every offset and
+         * most of them run over the end of the buffer. */
+        size_t count = SMALL_CAPACITY - start % 3;
+        for (size_t i = 0; i < count; i++)
+        {
+            in[i].sequence = next + i;
+            in[i].pad[4]   = (uint8_t)(next + i);
+        }
+        ck_assert_uint_eq(spsc_push_n(queue, in, count), count);
+        next += count;
+        ck_assert_uint_eq(spsc_pop_n(queue, out, SMALL_CAPACITY), count);
+        for (size_t i = 0; i < count; i++)
+        {
+            ck_assert_uint_eq(out[i].sequence, want);
+            ck_assert_uint_eq(out[i].pad[4], (uint8_t)want);
+            want++;
+        }
+
+        in[0].sequence = next;
+        in[0].pad[4]   = (uint8_t)next;
+        ck_assert(spsc_push(queue, &in[0]));
+        next++;
+        ck_assert(spsc_pop(queue, &out[0]));
+        ck_assert_uint_eq(out[0].sequence, want);
+        want++;
+    }
+    ck_assert_uint_eq(spsc_pop_n(queue, out, SMALL_CAPACITY), 0);
+    spsc_destroy(&queue);
+}
+END_TEST
+
+START_TEST(test_partial_batches)
+{
+    spsc_queue_t * queue = spsc_create(sizeof(uint64_t), SMALL_CAPACITY);
+    uint64_t       in[SMALL_CAPACITY * 2];
+    uint64_t       out[SMALL_CAPACITY * 2];
+
+    for (uint64_t i = 0; i < SMALL_CAPACITY * 2; i++)
+    {
+        in[i] = i;
+    }
+    ck_assert_uint_eq(spsc_push_n(queue, in, 3), 3);
+    ck_assert_uint_eq(spsc_push_n(queue, in + 3, SMALL_CAPACITY * 2),
+                      SMALL_CAPACITY - 3);
+    ck_assert_uint_eq(spsc_pop_n(queue, out, SMALL_CAPACITY * 2),
+                      SMALL_CAPACITY);
+    for (uint64_t i = 0; i < SMALL_CAPACITY; i++)
+    {
+        ck_assert_uint_eq(out[i], i);
+    }
+    spsc_destroy(&queue);
+}
+END_TEST
+
+/* Send 0 to count - 1, in batches of varying size that wrap the small
+ * ring at every offset. Both sides yield when they make no progress, so
+ * the test also runs on one CPU. */
+static void *
+produce(void * arg)
+{
+    Stream_T * stream = arg;
+    uint64_t   batch[SMALL_CAPACITY];
+    uint64_t   next = 0;
+
+    while (next < stream->count)
+    {
+        size_t want = 1 + (size_t)next % SMALL_CAPACITY;
+        if (want > stream->count - next)
+        {
+            want = (size_t)(stream->count - next);
+        }
+        for (size_t i = 0; i < want; i++)
+        {
+            batch[i] = next + i;
+        }
+        size_t pushed = spsc_push_n(stream->queue, batch, want);
+        if (pushed == 0)
+        {
+            sched_yield();
+        }
+        next += pushed;
+    }
+    return NULL;
+}
+
+static void *
+consume(void * arg)
+{
+    Stream_T * stream = arg;
+    uint64_t   batch[SMALL_CAPACITY];
+    uint64_t   want = 0;
+
+    while (want < stream->count)
+    {
+        size_t got = want % 2
+                         ? spsc_pop_n(stream->queue, batch, SMALL_CAPACITY)
+                         : spsc_pop(stream->queue, batch);
+        if (got == 0)
+        {
+            sched_yield();
+        }
+        for (size_t i = 0; i < got; i++)
+        {
+            if (batch[i] != want)
+            {
+                stream->errors++;
+            }
+            want++;
+        }
+    }
+    return NULL;
+}
+
+START_TEST(test_two_threads_keep_order)
+{
+    Stream_T  stream = { spsc_create(sizeof(uint64_t), SMALL_CAPACITY),
+                         STREAM_LENGTH,
+                         0 };
+    pthread_t producer;
+    pthread_t consumer;
+
+    ck_assert_ptr_nonnull(stream.queue);
+    ck_assert_int_eq(pthread_create(&consumer, NULL, consume, &stream), 0);
+    ck_assert_int_eq(pthread_create(&producer, NULL, produce, &stream), 0);
+    ck_assert_int_eq(pthread_join(producer, NULL), 0);
+    ck_assert_int_eq(pthread_join(consumer, NULL), 0);
+
+    ck_assert_uint_eq(stream.errors, 0);
+    ck_assert_uint_eq(spsc_size(stream.queue), 0);
+    spsc_destroy(&stream.queue);
+}
+END_TEST
+
+Suite *
+check_spsc_queue_suite(void)
+{
+    Suite * suite     = suite_create("spsc_queue_test");
+    TCase * tc_core   = tcase_create("Core");
+    TCase * tc_thread = tcase_create("Threads");
+
+    tcase_add_test(tc_core, test_create_rounds_capacity);
+    tcase_add_test(tc_core, test_full_and_empty);
+    tcase_add_test(tc_core, test_order_across_wraparound);
+    tcase_add_test(tc_core, test_batches_straddle_the_end);
+    tcase_add_test(tc_core, test_partial_batches);
+    tcase_add_test(tc_thread, test_two_threads_keep_order);
+    tcase_set_timeout(tc_thread, 60);
+
+    suite_add_tcase(suite, tc_core);
+    suite_add_tcase(suite, tc_thread);
+    return suite;
+}
+
+int
+main(void)
+{
+    SRunner * runner = srunner_create(check_spsc_queue_suite());
+
+    srunner_run_all(runner, CK_VERBOSE);
+
+    int no_failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+    return (no_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,77 @@
+/**
+ * @file
+ * @brief On-disk format of the binary heap dumps written by CustomHeapDump.
+ *
+ * A dump is a MemDumpHeader_T followed by a stream of records, each a
+ * MemDumpRecord_T giving the record type and the length of the payload that
+ * follows it. Readers skip records of unknown type. Integers are stored in
+ * the byte order of the process that wrote the dump.
+ *
+ * Payloads by record type:
+ *
+ *   MEM_DUMP_MAPS    A piece of the text of /proc/self/maps, so that stack
+ *                    frames can be resolved to module offsets offline. The
+ *                    payloads of all MAPS records concatenate to the text.
+ *   MEM_DUMP_FILE    uint32_t id followed by the file name, not terminated.
+ *   MEM_DUMP_TAG     uint32_t tag followed by the tag name, not terminated.
+ *   MEM_DUMP_STACK   uint32_t id, uint32_t depth, then depth uint64_t return
+ *                    addresses, innermost first.
+ *   MEM_DUMP_BLOCKS  An array of MemDumpBlock_T.
+ *   MEM_DUMP_END     uint64_t number of blocks written. A dump without this
+ *                    record was cut short.
+ *
+ * File and stack records always come before the first block that refers to
+ * them.
+ */
+
+#ifndef MEM_DUMP_H
+#define MEM_DUMP_H
+
+#include <stdint.h>
+
+/** @brief Magic bytes at the start of every dump. */
+#define MEM_DUMP_MAGIC "MMHEAPDP"
+
+/** @brief Version of the format described in this file. */
+#define MEM_DUMP_VERSION 1
+
+/** @brief Record types. */
+enum MemDumpType
+{
+    MEM_DUMP_END    = 0,
+    MEM_DUMP_MAPS   = 1,
+    MEM_DUMP_FILE   = 2,
+    MEM_DUMP_TAG    = 3,
+    MEM_DUMP_STACK  = 4,
+    MEM_DUMP_BLOCKS = 5,
+};
+
+/** @brief Header at the start of a dump. */
+typedef struct MemDumpHeader_Tag
+{
+    char     magic[8]; /**< MEM_DUMP_MAGIC, not terminated. */
+    uint32_t version;  /**< MEM_DUMP_VERSION. */
+    uint32_t pid;      /**< Process that wrote the dump. */
+    uint64_t time;     /**< Wall clock time of the dump, in seconds. */
+} MemDumpHeader_T;
+
+/** @brief Header in front of every record. */
+typedef struct MemDumpRecord_Tag
+{
+    uint32_t type;   /**< One of enum MemDumpType. */
+    uint32_t length; /**< Number of payload bytes that follow. */
+} MemDumpRecord_T;
+
+/** @brief One tracked block. */
+typedef struct MemDumpBlock_Tag
+{
+    uint64_t address;  /**< User pointer of the block. */
+    uint64_t size;     /**< Requested size in bytes. */
+    uint64_t weight;   /**< Bytes the block stands for when sampled. */
+    uint32_t file_id;  /**< Id of a MEM_DUMP_FILE record. */
+    int32_t  line;     /**< Line number of the allocation. */
+    uint32_t stack_id; /**< Id of a MEM_DUMP_STACK record, 0 for none. */
+    uint32_t tag;      /**< Allocation tag, 0 for none. */
+} MemDumpBlock_T;
+
+#endif
@@ -6,18 +6,114 @@
 #ifndef MEM_MGMT_H
 #define MEM_MGMT_H
 
-#define MALLOC(size)      CustomMalloc((size), __FILE__, __LINE__)
-#define CALLOC(num, size) CustomCalloc((num), (size), __FILE__, __LINE__)
-#define FREE(ptr)         CustomFree((ptr))
-#define CLEAN(ptr)        CustomClean((ptr))
+/*
+ * Build modes, selected at compile time:
+ *
+ *   default           MALLOC and friends track every allocation.
+ *   MEM_MGMT_FAST     MALLOC and friends go straight to the thread cache
+ *                     allocator with no tracking, sampling or locking.
+ *   MEM_MGMT_RELEASE  MALLOC and friends are the C library functions.
+ *
+ * Building the library itself with either switch (make fast, make release)
+ * compiles the tracking code out altogether; the tracking functions remain
+ * as thin wrappers around the fast path.
+ */
+#if defined(MEM_MGMT_FAST) || defined(MEM_MGMT_RELEASE)
+#define MEM_MGMT_NO_TRACKING
+#endif
+
+#if defined(MEM_MGMT_RELEASE)
+#include <stdlib.h>
+#define MALLOC(size)       malloc((size))
+#define CALLOC(num, size)  calloc((num), (size))
+#define REALLOC(ptr, size) realloc((ptr), (size))
+#define FREE(ptr)          free((ptr))
+#define CLEAN(ptr)         ((void)(ptr))
+#elif defined(MEM_MGMT_FAST)
+#define MALLOC(size)       CustomFastMalloc((size))
+#define CALLOC(num, size)  CustomFastCalloc((num), (size))
+#define REALLOC(ptr, size) CustomFastRealloc((ptr), (size))
+#define FREE(ptr)          CustomFastFree((ptr))
+#define CLEAN(ptr)         ((void)(ptr))
+#else
+#define MALLOC(size)       CustomMalloc((size), __FILE__, __LINE__)
+#define CALLOC(num, size)  CustomCalloc((num), (size), __FILE__, __LINE__)
+#define REALLOC(ptr, size) CustomRealloc((ptr), (size), __FILE__, __LINE__)
+#define FREE(ptr)          CustomFree((ptr))
+#define CLEAN(ptr)         CustomClean((ptr))
+#endif
 
 #include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Aggregated statistics for one allocation site.
+ *
+ * In sampling mode the byte and block counts are estimates scaled from the
+ * samples taken.
+ */
+typedef struct MemSiteStats_Tag
+{
+    const char * file;         /**< File name of the allocation site. */
+    int          line;         /**< Line number of the allocation site. */
+    uint32_t     id;           /**< Stable id of the site. */
+    int64_t      live_bytes;   /**< Bytes allocated and not yet freed. */
+    int64_t      live_count;   /**< Blocks allocated and not yet freed. */
+    uint64_t     total_allocs; /**< Cumulative number of allocations. */
+    uint64_t     total_bytes;  /**< Cumulative number of bytes allocated. */
+    int64_t      peak_bytes;   /**< Highest live byte count seen. */
+} MemSiteStats_T;
+
+/**
+ * @brief A point in time copy of the per-site statistics.
+ */
+typedef struct MemSnapshot_Tag
+{
+    size_t           count; /**< Number of entries in sites. */
+    MemSiteStats_T * sites; /**< Statistics, one entry per site. */
+} MemSnapshot_T;
+
+/** @brief Number of allocation tags, including tag 0 for untagged memory. */
+#define MEM_TAG_COUNT 64
+
+/**
+ * @brief Callback invoked when an allocation tag goes over a limit.
+ *
+ * The callback runs on the allocating thread. Allocations it makes are never
+ * refused, but it should stay short.
+ *
+ * @param tag Tag that went over its limit.
+ * @param live_bytes Bytes charged to the tag, the refused allocation
+ * excluded.
+ * @param hard true if an allocation was refused by the hard limit, false if
+ * the soft limit was crossed.
+ * @param arg Argument given to CustomTagSetLimits.
+ */
+typedef void (*MemTagLimitFunc_T)(uint32_t tag,
+                                  int64_t  live_bytes,
+                                  bool     hard,
+                                  void *   arg);
+
+/**
+ * @brief Statistics for one allocation tag.
+ */
+typedef struct MemTagStats_Tag
+{
+    const char * name;          /**< Name given to CustomTagCreate. */
+    int64_t      live_bytes;    /**< Bytes currently charged to the tag. */
+    int64_t      peak_bytes;    /**< Highest live byte count seen. */
+    int64_t      soft_limit;    /**< Soft limit in bytes, 0 for none. */
+    int64_t      hard_limit;    /**< Hard limit in bytes, 0 for none. */
+    uint64_t     denied_allocs; /**< Allocations refused by the hard limit. */
+} MemTagStats_T;
 /**
  * @brief Allocate memory and track the allocation in the hash table.
  *
- * This function allocates memory of the specified size using malloc and
- * adds the allocation information to the hash table. The file name and line
- * number of the allocation are also stored.
+ * This function allocates memory of the specified size from the calling
+ * thread's block cache and adds the allocation information to the hash table.
+ * The file name and line number of the allocation are also stored.
  *
  * @param size Size of the memory block to be allocated in bytes.
  * @param file File name where the memory block is being allocated.
@@ -30,7 +126,8 @@ void * CustomMalloc(size_t size, const char * file, int line);
  * @brief Free memory and update the hash table
  * This function frees the memory block pointed to
  * by the specified pointer and removes the corresponding
- * allocation information from the hash table
+ * allocation information from the hash table. A pointer that did not come
+ * from this library, such as one from the system malloc, is ignored.
  *
  * @param ptr Pointer to the memory block to be freed.
  */
@@ -54,6 +151,28 @@ void CustomFree(void * ptr);
  */
 void * CustomCalloc(size_t num, size_t size, const char * file, int line);
 
+/**
+ * @brief Resize a memory block and update its tracking information.
+ *
+ * This function behaves like realloc. A block is grown in place whenever its
+ * size class still has room for the new size, a block shrunk to half its
+ * size class or less moves to the smaller class, and large blocks are
+ * resized with mremap so their contents are never copied. The block's
+ * allocation tag is charged or credited for the change. A tracked block
+ * keeps the file and line of its original allocation; its recorded size is
+ * updated.
+ *
+ * @param ptr Pointer to the memory block to resize, or NULL to allocate.
+ * @param size New size of the memory block in bytes. A size of zero frees
+ * the block and returns NULL.
+ * @param file File name where the memory block is being allocated.
+ * @param line Line number where the memory block is being allocated.
+ * @return Pointer to the resized memory block, or NULL on failure, in which
+ * case the original block is left untouched. A pointer that did not come
+ * from this library is left alone and NULL is returned.
+ */
+void * CustomRealloc(void * ptr, size_t size, const char * file, int line);
+
 /**
  * @brief Free all allocated memory blocks stored in the hash table.
  *
@@ -63,6 +182,222 @@ void * CustomCalloc(size_t num, size_t size, const char * file, int line);
  */
 void CustomFreeAll(void);
 
+/**
+ * @brief Switch between full tracking and sampled tracking.
+ *
+ * With an interval of zero, the default, every allocation is recorded. With
+ * a non-zero interval the tracker records roughly one allocation per
+ * mean_bytes allocated, choosing sample points at geometrically distributed
+ * byte distances as heap profilers do. An allocation that is not sampled
+ * costs a single thread local counter decrement. Leak reports show the
+ * estimated number of bytes each sample stands for, so totals remain
+ * statistically accurate.
+ *
+ * @param mean_bytes Mean number of allocated bytes between samples, or 0 to
+ * track every allocation.
+ */
+void CustomSetSamplingInterval(size_t mean_bytes);
+
+/**
+ * @brief Enable or disable call stack capture for tracked allocations.
+ *
+ * When enabled, every tracked allocation (every sampled one in sampling mode)
+ * also records its call stack, so allocations made through wrapper functions
+ * can be told apart. Stacks are interned in a deduplicated table and each
+ * allocation only stores a 32-bit stack id; return addresses are resolved to
+ * symbols only when a leak report is printed.
+ *
+ * @param enabled true to capture stacks, false to stop capturing.
+ */
+void CustomSetStackCapture(bool enabled);
+
+/**
+ * @brief Allocate memory from the thread cache allocator without tracking.
+ *
+ * @param size Size of the memory block to be allocated in bytes.
+ * @return Pointer to the newly allocated memory block, or NULL on failure.
+ */
+void * CustomFastMalloc(size_t size);
+
+/**
+ * @brief Allocate zeroed memory from the thread cache allocator without
+ * tracking.
+ *
+ * @param num Number of elements to be allocated.
+ * @param size Size of each element in bytes.
+ * @return Pointer to the newly allocated memory block, or NULL on failure.
+ */
+void * CustomFastCalloc(size_t num, size_t size);
+
+/**
+ * @brief Resize a memory block without tracking.
+ *
+ * @param ptr Pointer to the memory block to resize, or NULL to allocate.
+ * @param size New size of the memory block in bytes.
+ * @return Pointer to the resized memory block, or NULL on failure or if ptr
+ * did not come from this library.
+ */
+void * CustomFastRealloc(void * ptr, size_t size);
+
+/**
+ * @brief Free a memory block obtained from either the fast or the tracking
+ * allocation functions. A pointer that did not come from this library is
+ * ignored.
+ *
+ * @param ptr Pointer to the memory block to be freed, or NULL.
+ */
+void CustomFastFree(void * ptr);
+
+/**
+ * @brief Return the calling thread's cached free blocks to the global depot.
+ *
+ * Each thread keeps a small cache of free blocks per size class and exchanges
+ * them with a global depot in batches. Caches are flushed automatically when
+ * a thread exits; long lived threads that go idle after a burst of
+ * allocations can call this to make the cached memory available to other
+ * threads straight away. It also folds the thread's pending allocation tag
+ * charges into the shared tag counters.
+ */
+void CustomThreadCacheFlush(void);
+
+/**
+ * @brief Take a snapshot of the per allocation site statistics.
+ *
+ * Counters are read without stopping other threads, so a snapshot taken
+ * while allocations are in flight may be off by those allocations. Entries
+ * are ordered by site id.
+ *
+ * @return Newly allocated snapshot to be released with CustomSnapshotFree,
+ * or NULL on failure.
+ */
+MemSnapshot_T * CustomSnapshot(void);
+
+/**
+ * @brief Compute the change in per-site statistics between two snapshots.
+ *
+ * The live and cumulative counters of the result hold the difference
+ * after - before; peak_bytes is taken from after. Sites that did not change
+ * are left out, and the remaining entries are sorted by live byte growth,
+ * largest first.
+ *
+ * @param before The earlier snapshot.
+ * @param after The later snapshot.
+ * @return Newly allocated snapshot to be released with CustomSnapshotFree,
+ * or NULL on failure.
+ */
+MemSnapshot_T * CustomSnapshotDiff(const MemSnapshot_T * before,
+                                   const MemSnapshot_T * after);
+
+/**
+ * @brief Release a snapshot returned by CustomSnapshot or CustomSnapshotDiff.
+ *
+ * @param snapshot Snapshot to release, or NULL.
+ */
+void CustomSnapshotFree(MemSnapshot_T * snapshot);
+
+/**
+ * @brief Print one line per allocation site that still has live blocks.
+ *
+ * Sites are sorted by live bytes, largest first. Unlike PrintMemoryLeaks
+ * this never holds a lock, and its output grows with the number of sites
+ * rather than the number of blocks.
+ */
+void PrintMemorySites(void);
+
+/**
+ * @brief Create an allocation tag for a subsystem.
+ *
+ * Every block is charged, at its full size including allocator overhead, to
+ * the tag its allocating thread had selected with CustomTagSwitch, and
+ * credited back when it is freed, by whichever thread frees it. Accounting
+ * works in every build mode except MEM_MGMT_RELEASE callers, whose MALLOC
+ * bypasses this library.
+ *
+ * @param name Name of the tag. The string is not copied and must outlive the
+ * tag.
+ * @return The new tag, or 0 if all MEM_TAG_COUNT - 1 tags are in use.
+ */
+uint32_t CustomTagCreate(const char * name);
+
+/**
+ * @brief Select the tag that the calling thread's allocations are charged to.
+ *
+ * Subsystems typically switch to their tag on entry and switch back to the
+ * returned tag on exit.
+ *
+ * @param tag Tag returned by CustomTagCreate, or 0 to stop charging.
+ * @return The previously selected tag. An invalid tag is ignored.
+ */
+uint32_t CustomTagSwitch(uint32_t tag);
+
+/**
+ * @brief Set the byte limits of an allocation tag.
+ *
+ * Each thread batches its charges and only adds them to the tag's shared
+ * count once they add up to 64 KiB. Every allocation is checked against
+ * the hard limit, counting the allocating thread's own pending charges, so
+ * a tag can only run over it by the charges other threads have pending:
+ * less than 64 KiB per other thread. Going over the hard limit makes the
+ * allocation fail and invokes the callback with hard set. The soft limit is
+ * only checked when charges are added to the shared count, so it may be
+ * overrun by up to 64 KiB per thread before the callback runs; crossing it
+ * invokes the callback once, and again only after the tag has dropped back
+ * under it.
+ *
+ * @param tag Tag returned by CustomTagCreate.
+ * @param soft_limit Soft limit in bytes, or 0 for none.
+ * @param hard_limit Hard limit in bytes, or 0 for none.
+ * @param callback Function to call when a limit is crossed, or NULL.
+ * @param arg Argument passed to the callback.
+ * @return 0 on success, -1 if tag is not a valid tag.
+ */
+int CustomTagSetLimits(uint32_t          tag,
+                       int64_t           soft_limit,
+                       int64_t           hard_limit,
+                       MemTagLimitFunc_T callback,
+                       void *            arg);
+
+/**
+ * @brief Read the statistics of an allocation tag.
+ *
+ * The calling thread's pending charges are folded in first; those of other
+ * threads may still be outstanding, up to 64 KiB per thread.
+ *
+ * @param tag Tag returned by CustomTagCreate.
+ * @param stats Receives the statistics.
+ * @return 0 on success, -1 if tag is not a valid tag.
+ */
+int CustomTagGetStats(uint32_t tag, MemTagStats_T * stats);
+
+/**
+ * @brief Print one line per allocation tag with its usage and limits.
+ */
+void PrintMemoryTags(void);
+
+/**
+ * @brief Write every tracked block to a file descriptor in binary form.
+ *
+ * Unlike PrintMemoryLeaks, which formats every block in the process, this
+ * writes compact records through a buffer and holds each lock of the
+ * tracking table only while copying out that lock's bucket. The dump can be
+ * aggregated, sorted and compared with tools/mem-dump-analyze; its format is
+ * described in mem-dump.h. With tracking compiled out the dump holds no
+ * blocks.
+ *
+ * @param fd File descriptor open for writing.
+ * @return 0 on success, -1 if writing or allocating failed.
+ */
+int CustomHeapDump(int fd);
+
+/**
+ * @brief Write every tracked block to a file in binary form.
+ *
+ * @param path File to create or truncate.
+ * @return 0 on success, -1 on failure.
+ * @see CustomHeapDump
+ */
+int CustomHeapDumpFile(const char * path);
+
 /**
  * @brief Print memory leaks before the program exits.
  *
@@ -0,0 +1,411 @@
+/**
+ * @file
+ * @brief LD_PRELOAD shim routing the C allocation functions through the
+ * memory management library.
+ *
+ * Build with "make preload" and run any binary as
+ *
+ *     LD_PRELOAD=bin/libmem-mgmt-preload.so ./program
+ *
+ * By default every allocation is served by the thread cache allocator with
+ * no tracking. The following environment variables, read once at load time,
+ * turn tracking on:
+ *
+ *     MEM_MGMT_TRACK=1        track every allocation
+ *     MEM_MGMT_SAMPLE=<bytes> track one allocation per <bytes> on average
+ *     MEM_MGMT_STACKS=1       capture call stacks of tracked allocations
+ *     MEM_MGMT_REPORT=leaks   print every live block at exit
+ *     MEM_MGMT_REPORT=sites   print live bytes per allocation site at exit
+ *     MEM_MGMT_REPORT=tags    print usage per allocation tag at exit
+ *     MEM_MGMT_DUMP=<path>    write a binary heap dump to <path> at exit,
+ *                             for tools/mem-dump-analyze
+ *
+ * Reports go to stderr so they never mix with the program's own output.
+ *
+ * Call stacks captured through the shim start at the program's call to
+ * malloc and friends: frames of this shared object are left out.
+ *
+ * Allocations made while the shim is already running on the same thread,
+ * for instance by backtrace(3) loading its unwinder, or made before the
+ * allocator can serve them, come from a static bootstrap arena. Arena
+ * blocks are never reused.
+ */
+
+#define _GNU_SOURCE
+#include "../include/mem-mgmt.h"
+#include "../src/mem-internal.h"
+#include <errno.h>
+#include <link.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/** @brief Size of the bootstrap arena. */
+#define BOOTSTRAP_ARENA_SIZE (4 * 1024 * 1024)
+
+/** @brief Alignment of bootstrap arena blocks. */
+#define BOOTSTRAP_ALIGN 16
+
+/** @brief File name recorded for allocations tracked through the shim. */
+#define PRELOAD_FILE "(preload)"
+
+/** @brief Memory handed out before the allocator can be used. */
+static _Alignas(BOOTSTRAP_ALIGN) char g_arena[BOOTSTRAP_ARENA_SIZE];
+
+/** @brief Bytes of the bootstrap arena already handed out. */
+static atomic_size_t g_arena_used = 0;
+
+/** @brief Whether allocations go through the tracking functions. */
+static bool g_tracking = false;
+
+/** @brief File the exit time heap dump goes to, or NULL for none. */
+static const char * g_dump_path = NULL;
+
+/** @brief Non-zero while the calling thread is inside the shim. */
+static _Thread_local int t_in_shim
+    __attribute__((tls_model("initial-exec"))) = 0;
+
+/* Bump allocate from the arena. Each block is preceded by its size so
+ * realloc can copy it out. */
+static void *
+arena_alloc(size_t size)
+{
+    size_t total = (size + 2 * BOOTSTRAP_ALIGN - 1) & ~(size_t)(BOOTSTRAP_ALIGN - 1);
+    if (total < size)
+    {
+        return NULL;
+    }
+
+    size_t offset = atomic_fetch_add(&g_arena_used, total);
+    if (offset + total > BOOTSTRAP_ARENA_SIZE)
+    {
+        return NULL;
+    }
+
+    char * block      = g_arena + offset;
+    *(size_t *)block = size;
+    return block + BOOTSTRAP_ALIGN;
+}
+
+static bool
+in_arena(const void * ptr)
+{
+    return (const char *)ptr >= g_arena
+           && (const char *)ptr < g_arena + BOOTSTRAP_ARENA_SIZE;
+}
+
+static size_t
+arena_size(const void * ptr)
+{
+    return *(const size_t *)((const char *)ptr - BOOTSTRAP_ALIGN);
+}
+
+static void *
+shim_alloc(size_t size)
+{
+    if (t_in_shim)
+    {
+        return arena_alloc(size);
+    }
+
+    t_in_shim++;
+    void * ptr = g_tracking ? CustomMalloc(size, PRELOAD_FILE, 0)
+                            : CustomFastMalloc(size);
+    t_in_shim--;
+    return ptr;
+}
+
+static void
+shim_free(void * ptr)
+{
+    if (!ptr || in_arena(ptr))
+    {
+        return;
+    }
+
+    t_in_shim++;
+    /* CustomFree releases untracked blocks as well. */
+    CustomFree(mm_aligned_base(ptr));
+    t_in_shim--;
+}
+
+static size_t
+shim_usable_size(void * ptr)
+{
+    if (!ptr)
+    {
+        return 0;
+    }
+    if (in_arena(ptr))
+    {
+        return arena_size(ptr);
+    }
+    return mm_usable_size(ptr);
+}
+
+static void *
+shim_aligned(size_t alignment, size_t size)
+{
+    if (alignment <= 16)
+    {
+        return shim_alloc(size);
+    }
+
+    size_t padded = size + alignment + sizeof(BlockHeader_T);
+    if (padded < size)
+    {
+        return NULL;
+    }
+
+    void * base = shim_alloc(padded);
+    if (!base)
+    {
+        return NULL;
+    }
+    if (in_arena(base))
+    {
+        /* Arena blocks are never freed, so the view only needs a size slot
+         * in front of it. */
+        char * view = (char *)(((uintptr_t)base + alignment - 1)
+                               & ~(uintptr_t)(alignment - 1));
+        *(size_t *)(view - BOOTSTRAP_ALIGN) = size;
+        return view;
+    }
+    return mm_align_block(base, alignment);
+}
+
+static bool
+is_power_of_two(size_t value)
+{
+    return value && !(value & (value - 1));
+}
+
+/* The report functions print to stdout; point it at stderr once the program
+ * is done with it. */
+static void
+redirect_report(void)
+{
+    fflush(stdout);
+    dup2(STDERR_FILENO, STDOUT_FILENO);
+}
+
+static void
+report_leaks(void)
+{
+    redirect_report();
+    PrintMemoryLeaks();
+    fflush(stdout);
+}
+
+static void
+report_sites(void)
+{
+    redirect_report();
+    PrintMemorySites();
+    fflush(stdout);
+}
+
+static void
+report_tags(void)
+{
+    redirect_report();
+    PrintMemoryTags();
+    fflush(stdout);
+}
+
+static void
+dump_heap(void)
+{
+    CustomHeapDumpFile(g_dump_path);
+}
+
+/* Report the executable segment of the object that holds this function,
+ * which is the shim with the whole library linked in. */
+static int
+find_own_code(struct dl_phdr_info * info, size_t size, void * data)
+{
+    (void)size;
+    uintptr_t self = (uintptr_t)find_own_code;
+    for (ElfW(Half) i = 0; i < info->dlpi_phnum; i++)
+    {
+        const ElfW(Phdr) * segment = &info->dlpi_phdr[i];
+        uintptr_t start            = info->dlpi_addr + segment->p_vaddr;
+        uintptr_t end              = start + segment->p_memsz;
+        if (segment->p_type == PT_LOAD && (segment->p_flags & PF_X)
+            && self >= start && self < end)
+        {
+            ((uintptr_t *)data)[0] = start;
+            ((uintptr_t *)data)[1] = end;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+__attribute__((constructor)) static void
+preload_init(void)
+{
+    uintptr_t code[2] = { 0, 0 };
+    if (dl_iterate_phdr(find_own_code, code))
+    {
+        mm_stack_skip_code(code[0], code[1]);
+    }
+
+    const char * value = getenv("MEM_MGMT_SAMPLE");
+    if (value && *value)
+    {
+        CustomSetSamplingInterval(strtoull(value, NULL, 10));
+        g_tracking = true;
+    }
+
+    value = getenv("MEM_MGMT_TRACK");
+    if (value && *value == '1')
+    {
+        g_tracking = true;
+    }
+
+    value = getenv("MEM_MGMT_STACKS");
+    if (value && *value == '1')
+    {
+        CustomSetStackCapture(true);
+    }
+
+    value = getenv("MEM_MGMT_REPORT");
+    if (value && !strcmp(value, "leaks"))
+    {
+        atexit(report_leaks);
+    }
+    else if (value && !strcmp(value, "sites"))
+    {
+        atexit(report_sites);
+    }
+    else if (value && !strcmp(value, "tags"))
+    {
+        atexit(report_tags);
+    }
+
+    value = getenv("MEM_MGMT_DUMP");
+    if (value && *value)
+    {
+        g_dump_path = value;
+        atexit(dump_heap);
+    }
+}
+
+void *
+malloc(size_t size)
+{
+    return shim_alloc(size);
+}
+
+void
+free(void * ptr)
+{
+    shim_free(ptr);
+}
+
+void *
+calloc(size_t num, size_t size)
+{
+    if (size && num > SIZE_MAX / size)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    /* Arena memory is zero from the start and never reused. */
+    void * ptr = shim_alloc(num * size);
+    if (ptr && !in_arena(ptr))
+    {
+        memset(ptr, 0, num * size);
+    }
+    return ptr;
+}
+
+void *
+realloc(void * ptr, size_t size)
+{
+    if (!ptr)
+    {
+        return shim_alloc(size);
+    }
+    if (!size)
+    {
+        shim_free(ptr);
+        return NULL;
+    }
+
+    if (!in_arena(ptr) && mm_aligned_base(ptr) == ptr && !t_in_shim)
+    {
+        t_in_shim++;
+        void * new_ptr = g_tracking
+                             ? CustomRealloc(ptr, size, PRELOAD_FILE, 0)
+                             : CustomFastRealloc(ptr, size);
+        t_in_shim--;
+        return new_ptr;
+    }
+
+    /* Arena blocks and aligned views are moved into a fresh block. */
+    size_t old_size = shim_usable_size(ptr);
+    void * new_ptr  = shim_alloc(size);
+    if (new_ptr)
+    {
+        memcpy(new_ptr, ptr, old_size < size ? old_size : size);
+        shim_free(ptr);
+    }
+    return new_ptr;
+}
+
+int
+posix_memalign(void ** memptr, size_t alignment, size_t size)
+{
+    if (!is_power_of_two(alignment) || alignment % sizeof(void *))
+    {
+        return EINVAL;
+    }
+
+    void * ptr = shim_aligned(alignment, size);
+    if (!ptr)
+    {
+        return ENOMEM;
+    }
+    *memptr = ptr;
+    return 0;
+}
+
+void *
+aligned_alloc(size_t alignment, size_t size)
+{
+    if (!is_power_of_two(alignment))
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+    return shim_aligned(alignment, size);
+}
+
+void *
+memalign(size_t alignment, size_t size)
+{
+    return aligned_alloc(alignment, size);
+}
+
+void *
+valloc(size_t size)
+{
+    return shim_aligned(4096, size);
+}
+
+void *
+pvalloc(size_t size)
+{
+    return shim_aligned(4096, (size + 4095) & ~(size_t)4095);
+}
+
+size_t
+malloc_usable_size(void * ptr)
+{
+    return shim_usable_size(ptr);
+}
@@ -0,0 +1,924 @@
+/**
+ * @file
+ * @brief Size-class block allocator with per-thread caches.
+ *
+ * Every thread owns a cache holding a short free list per size class. Free
+ * lists are refilled from, and flushed to, a global depot in batches, so the
+ * depot lock is taken once per batch rather than once per block. A block
+ * freed by a thread other than the one that allocated it is pushed onto the
+ * owning cache's lock-free remote-free list and reclaimed by the owner the
+ * next time it refills.
+ *
+ * Memory for small blocks is carved out of spans mapped with mmap and never
+ * returned to the system. Blocks larger than MM_MAX_SMALL get a mapping of
+ * their own, which lets them grow with mremap.
+ *
+ * So that a pointer the library did not hand out can be told apart without
+ * reading memory in front of it, spans are aligned to their size and marked
+ * in a two level bitmap indexed by span number, and large mappings are kept
+ * in a small hash set keyed by their address. See mm_owns.
+ */
+
+#define _GNU_SOURCE
+#include "mem-internal.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/mman.h>
+
+/** @brief Size of every span carved into small blocks. */
+#define MM_SPAN_SIZE (256 * 1024)
+
+/** @brief Approximate number of bytes moved per depot batch. */
+#define MM_BATCH_BYTES 16384
+
+/** @brief Bounds on the number of blocks in a depot batch. */
+#define MM_BATCH_MIN 2
+#define MM_BATCH_MAX 64
+
+/** @brief Page size used to round large mappings. */
+#define MM_PAGE_SIZE 4096
+
+/** @brief log2 of MM_SPAN_SIZE, the granularity of the span bitmap. */
+#define MM_SPAN_SHIFT 18
+
+/** @brief Bits of user space addresses covered by the span bitmap. */
+#define MM_ADDRESS_BITS 48
+
+/** @brief Spans per leaf of the span bitmap, as a power of two. */
+#define MM_SPAN_LEAF_BITS 16
+
+/** @brief Number of leaves the root of the span bitmap points to. */
+#define MM_SPAN_ROOT_SIZE \
+    ((size_t)1 << (MM_ADDRESS_BITS - MM_SPAN_SHIFT - MM_SPAN_LEAF_BITS))
+
+/** @brief Smallest capacity of the large block set. */
+#define MM_LARGE_MIN_CAPACITY 256
+
+/**
+ * @brief A free block, linked through the memory of the block itself.
+ *
+ * Only the first word is used while a block sits in a thread cache or on a
+ * remote-free list, which leaves the header's size_class intact. The second
+ * word links batches together once they reach the depot.
+ */
+typedef struct FreeBlock_Tag
+{
+    struct FreeBlock_Tag * next;       /**< Next block in the same list. */
+    struct FreeBlock_Tag * next_batch; /**< Next batch in the depot. */
+} FreeBlock_T;
+
+/** @brief Free list for a single size class inside a thread cache. */
+typedef struct CacheBin_Tag
+{
+    FreeBlock_T * head;  /**< First free block. */
+    uint32_t      count; /**< Number of blocks on the list. */
+} CacheBin_T;
+
+/** @brief Per-thread cache of free blocks. */
+typedef struct ThreadCache_Tag
+{
+    CacheBin_T                bins[MM_NUM_CLASSES]; /**< Local free lists. */
+    _Atomic(FreeBlock_T *)    remote_free; /**< Blocks freed by others. */
+    struct ThreadCache_Tag *  next_orphan; /**< Link in the orphan list. */
+} ThreadCache_T;
+
+/** @brief Global store of free blocks for one size class. */
+typedef struct Depot_Tag
+{
+    pthread_mutex_t lock;      /**< Protects every field below. */
+    FreeBlock_T *   batches;   /**< Stack of batches ready for reuse. */
+    char *          bump;      /**< Next uncarved byte of the span. */
+    char *          bump_end;  /**< End of the current span. */
+} Depot_T;
+
+/** @brief One depot per size class. */
+static Depot_T g_depot[MM_NUM_CLASSES];
+
+/** @brief Block size of every class, filled in once at start up. */
+static size_t g_class_size[MM_NUM_CLASSES];
+
+/** @brief Blocks per depot batch for every class. */
+static uint32_t g_class_batch[MM_NUM_CLASSES];
+
+/** @brief Caches left behind by exited threads, ready to be adopted. */
+static ThreadCache_T * g_orphans = NULL;
+
+/** @brief Mutex protecting the orphan list. */
+static pthread_mutex_t g_orphan_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/** @brief Key whose destructor retires a cache when its thread exits. */
+static pthread_key_t g_cache_key;
+
+/** @brief Guard for the one time initialisation of the depot. */
+static pthread_once_t g_cache_once = PTHREAD_ONCE_INIT;
+
+/** @brief Leaves of the span bitmap, one bit per span, mapped on demand. */
+static _Atomic uint64_t * _Atomic g_span_map[MM_SPAN_ROOT_SIZE];
+
+/** @brief Mutex serialising the creation of span bitmap leaves. */
+static pthread_mutex_t g_span_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/** @brief Open addressing set of the headers of live large blocks. */
+static uintptr_t * g_large_table = NULL;
+
+/** @brief Number of slots in g_large_table, a power of two. */
+static size_t g_large_capacity = 0;
+
+/** @brief Number of headers in g_large_table. */
+static size_t g_large_count = 0;
+
+/** @brief Mutex protecting the large block set. */
+static pthread_mutex_t g_large_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/** @brief Cache of the calling thread, NULL until its first allocation. */
+static _Thread_local ThreadCache_T * t_cache = NULL;
+
+static void cache_retire(void * arg);
+
+static size_t
+class_size(unsigned cls)
+{
+    if (cls < 8)
+    {
+        return (cls + 1) * 16;
+    }
+    unsigned shift = 7 + (cls - 8) / 4;
+    unsigned step  = (cls - 8) % 4;
+    return ((size_t)1 << shift) + (step + 1) * ((size_t)1 << (shift - 2));
+}
+
+/* Sizes up to 128 bytes use 16 byte steps, larger sizes use four classes
+ * per power of two, which bounds internal fragmentation at 25%. */
+static unsigned
+size_to_class(size_t total)
+{
+    if (total <= 128)
+    {
+        return total ? (unsigned)((total - 1) >> 4) : 0;
+    }
+    unsigned shift = 63 - (unsigned)__builtin_clzll(total - 1);
+    unsigned step  = (unsigned)((total - 1) >> (shift - 2)) & 3;
+    return 8 + (shift - 7) * 4 + step;
+}
+
+static uint32_t
+compute_batch(unsigned cls)
+{
+    size_t batch = MM_BATCH_BYTES / class_size(cls);
+    if (batch < MM_BATCH_MIN)
+    {
+        batch = MM_BATCH_MIN;
+    }
+    if (batch > MM_BATCH_MAX)
+    {
+        batch = MM_BATCH_MAX;
+    }
+    return (uint32_t)batch;
+}
+
+static void *
+map_pages(size_t length)
+{
+    void * mem = mmap(
+        NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return (mem == MAP_FAILED) ? NULL : mem;
+}
+
+/* Map length bytes aligned to alignment, a power of two no smaller than a
+ * page, by over-mapping and trimming both ends. */
+static void *
+map_aligned(size_t length, size_t alignment)
+{
+    char * mem = map_pages(length + alignment);
+    if (!mem)
+    {
+        return NULL;
+    }
+
+    char * start = (char *)(((uintptr_t)mem + alignment - 1)
+                            & ~(uintptr_t)(alignment - 1));
+    if (start > mem)
+    {
+        munmap(mem, (size_t)(start - mem));
+    }
+    munmap(start + length, (size_t)(mem + alignment - start));
+    return start;
+}
+
+/* Mark the span starting at span in the span bitmap. Spans are never
+ * unmapped, so bits are never cleared. */
+static bool
+span_register(const char * span)
+{
+    uintptr_t index = (uintptr_t)span >> MM_SPAN_SHIFT;
+    size_t    root  = index >> MM_SPAN_LEAF_BITS;
+    size_t    bit   = index & (((size_t)1 << MM_SPAN_LEAF_BITS) - 1);
+
+    if (root >= MM_SPAN_ROOT_SIZE)
+    {
+        return false;
+    }
+
+    _Atomic uint64_t * leaf
+        = atomic_load_explicit(&g_span_map[root], memory_order_acquire);
+    if (!leaf)
+    {
+        pthread_mutex_lock(&g_span_mutex);
+        leaf = atomic_load_explicit(&g_span_map[root], memory_order_relaxed);
+        if (!leaf)
+        {
+            leaf = map_pages(((size_t)1 << MM_SPAN_LEAF_BITS) / 8);
+            if (leaf)
+            {
+                atomic_store_explicit(
+                    &g_span_map[root], leaf, memory_order_release);
+            }
+        }
+        pthread_mutex_unlock(&g_span_mutex);
+        if (!leaf)
+        {
+            return false;
+        }
+    }
+    atomic_fetch_or_explicit(
+        &leaf[bit / 64], (uint64_t)1 << (bit % 64), memory_order_release);
+    return true;
+}
+
+static bool
+span_contains(uintptr_t address)
+{
+    uintptr_t index = address >> MM_SPAN_SHIFT;
+    size_t    root  = index >> MM_SPAN_LEAF_BITS;
+    size_t    bit   = index & (((size_t)1 << MM_SPAN_LEAF_BITS) - 1);
+
+    if (root >= MM_SPAN_ROOT_SIZE)
+    {
+        return false;
+    }
+
+    _Atomic uint64_t * leaf
+        = atomic_load_explicit(&g_span_map[root], memory_order_acquire);
+    return leaf
+           && (atomic_load_explicit(&leaf[bit / 64], memory_order_acquire)
+               & ((uint64_t)1 << (bit % 64)));
+}
+
+/* Home slot of a large block header. Headers are page aligned. */
+static size_t
+large_slot(uintptr_t header)
+{
+    uint64_t key = (uint64_t)header >> 12;
+    return (size_t)((key * 0x9E3779B97F4A7C15ULL) >> 32)
+           & (g_large_capacity - 1);
+}
+
+/* Slot holding header, or the empty slot where it would go. Called with
+ * g_large_mutex held and a non-empty table. */
+static size_t
+large_find(uintptr_t header)
+{
+    size_t slot = large_slot(header);
+    while (g_large_table[slot] && g_large_table[slot] != header)
+    {
+        slot = (slot + 1) & (g_large_capacity - 1);
+    }
+    return slot;
+}
+
+/* Double the large block set, or create it. Called with g_large_mutex
+ * held. */
+static bool
+large_grow(void)
+{
+    size_t      old_capacity = g_large_capacity;
+    uintptr_t * old_table    = g_large_table;
+    size_t      capacity
+        = old_capacity ? 2 * old_capacity : MM_LARGE_MIN_CAPACITY;
+
+    uintptr_t * table = map_pages(capacity * sizeof(uintptr_t));
+    if (!table)
+    {
+        return false;
+    }
+    g_large_table    = table;
+    g_large_capacity = capacity;
+    for (size_t i = 0; i < old_capacity; i++)
+    {
+        if (old_table[i])
+        {
+            g_large_table[large_find(old_table[i])] = old_table[i];
+        }
+    }
+    if (old_table)
+    {
+        munmap(old_table, old_capacity * sizeof(uintptr_t));
+    }
+    return true;
+}
+
+/* Remove a header with backward shift deletion, so lookups never need
+ * tombstones. Called with g_large_mutex held. */
+static void
+large_erase(uintptr_t header)
+{
+    if (!g_large_count)
+    {
+        return;
+    }
+
+    size_t mask = g_large_capacity - 1;
+    size_t hole = large_find(header);
+    if (!g_large_table[hole])
+    {
+        return;
+    }
+    for (size_t slot = (hole + 1) & mask; g_large_table[slot];
+         slot        = (slot + 1) & mask)
+    {
+        size_t home = large_slot(g_large_table[slot]);
+        /* Move the entry back unless its home lies in (hole, slot]. */
+        if (((slot - home) & mask) >= ((slot - hole) & mask))
+        {
+            g_large_table[hole] = g_large_table[slot];
+            hole                = slot;
+        }
+    }
+    g_large_table[hole] = 0;
+    g_large_count--;
+}
+
+/* Add a header, growing the set past half full. Called with g_large_mutex
+ * held. */
+static bool
+large_insert(uintptr_t header)
+{
+    if (2 * (g_large_count + 1) > g_large_capacity && !large_grow())
+    {
+        return false;
+    }
+    g_large_table[large_find(header)] = header;
+    g_large_count++;
+    return true;
+}
+
+static bool
+large_register(const BlockHeader_T * header)
+{
+    pthread_mutex_lock(&g_large_mutex);
+    bool added = large_insert((uintptr_t)header);
+    pthread_mutex_unlock(&g_large_mutex);
+    return added;
+}
+
+/* Called before the mapping goes, so that a new mapping at the same address
+ * is never registered while the old one still is. */
+static void
+large_unregister(const BlockHeader_T * header)
+{
+    pthread_mutex_lock(&g_large_mutex);
+    large_erase((uintptr_t)header);
+    pthread_mutex_unlock(&g_large_mutex);
+}
+
+static bool
+large_contains(uintptr_t header)
+{
+    bool found = false;
+
+    pthread_mutex_lock(&g_large_mutex);
+    if (g_large_count)
+    {
+        found = g_large_table[large_find(header)] != 0;
+    }
+    pthread_mutex_unlock(&g_large_mutex);
+    return found;
+}
+
+/* Fork handlers: hold every allocator lock across fork so the child never
+ * inherits one that a vanished thread was holding. */
+static void
+cache_before_fork(void)
+{
+    pthread_mutex_lock(&g_orphan_mutex);
+    for (unsigned i = 0; i < MM_NUM_CLASSES; i++)
+    {
+        pthread_mutex_lock(&g_depot[i].lock);
+    }
+    pthread_mutex_lock(&g_span_mutex);
+    pthread_mutex_lock(&g_large_mutex);
+}
+
+static void
+cache_after_fork(void)
+{
+    pthread_mutex_unlock(&g_large_mutex);
+    pthread_mutex_unlock(&g_span_mutex);
+    for (unsigned i = 0; i < MM_NUM_CLASSES; i++)
+    {
+        pthread_mutex_unlock(&g_depot[i].lock);
+    }
+    pthread_mutex_unlock(&g_orphan_mutex);
+}
+
+static void
+cache_init_once(void)
+{
+    for (unsigned i = 0; i < MM_NUM_CLASSES; i++)
+    {
+        pthread_mutex_init(&g_depot[i].lock, NULL);
+        g_class_size[i]  = class_size(i);
+        g_class_batch[i] = compute_batch(i);
+    }
+    pthread_key_create(&g_cache_key, cache_retire);
+    pthread_atfork(cache_before_fork, cache_after_fork, cache_after_fork);
+}
+
+/* Pop one batch from the depot, carving fresh blocks from a span when the
+ * depot has none to give back. */
+static FreeBlock_T *
+depot_take(unsigned cls)
+{
+    Depot_T *     depot = &g_depot[cls];
+    size_t        size  = g_class_size[cls];
+    uint32_t      batch = g_class_batch[cls];
+    FreeBlock_T * head  = NULL;
+
+    pthread_mutex_lock(&depot->lock);
+    if (depot->batches)
+    {
+        head            = depot->batches;
+        depot->batches  = head->next_batch;
+        head->next_batch = NULL;
+        pthread_mutex_unlock(&depot->lock);
+        return head;
+    }
+
+    if ((size_t)(depot->bump_end - depot->bump) < size)
+    {
+        char * span = map_aligned(MM_SPAN_SIZE, MM_SPAN_SIZE);
+        if (span && !span_register(span))
+        {
+            munmap(span, MM_SPAN_SIZE);
+            span = NULL;
+        }
+        if (!span)
+        {
+            pthread_mutex_unlock(&depot->lock);
+            return NULL;
+        }
+        depot->bump     = span;
+        depot->bump_end = span + MM_SPAN_SIZE;
+    }
+
+    FreeBlock_T ** link = &head;
+    for (uint32_t i = 0; i < batch && (size_t)(depot->bump_end - depot->bump) >= size;
+         i++)
+    {
+        FreeBlock_T * block = (FreeBlock_T *)depot->bump;
+        depot->bump += size;
+        *link = block;
+        link  = &block->next;
+    }
+    *link = NULL;
+    pthread_mutex_unlock(&depot->lock);
+
+    return head;
+}
+
+static void
+depot_give(unsigned cls, FreeBlock_T * batch)
+{
+    Depot_T * depot = &g_depot[cls];
+
+    pthread_mutex_lock(&depot->lock);
+    batch->next_batch = depot->batches;
+    depot->batches    = batch;
+    pthread_mutex_unlock(&depot->lock);
+}
+
+/* Move up to count blocks from the front of a bin to the depot as one
+ * batch. */
+static void
+bin_flush(CacheBin_T * bin, unsigned cls, uint32_t count)
+{
+    FreeBlock_T * first = bin->head;
+    FreeBlock_T * last  = first;
+    uint32_t      moved = 1;
+
+    if (!first)
+    {
+        return;
+    }
+    while (moved < count && last->next)
+    {
+        last = last->next;
+        moved++;
+    }
+    bin->head  = last->next;
+    bin->count -= moved;
+    last->next = NULL;
+    depot_give(cls, first);
+}
+
+/* Take ownership of every block other threads have freed into this cache. */
+static void
+cache_drain_remote(ThreadCache_T * cache)
+{
+    FreeBlock_T * block
+        = atomic_exchange_explicit(&cache->remote_free, NULL, memory_order_acquire);
+    while (block)
+    {
+        FreeBlock_T * next = block->next;
+        unsigned      cls  = ((BlockHeader_T *)block)->size_class;
+        CacheBin_T *  bin  = &cache->bins[cls];
+        block->next        = bin->head;
+        bin->head          = block;
+        bin->count++;
+        block = next;
+    }
+}
+
+static void
+cache_refill(ThreadCache_T * cache, unsigned cls)
+{
+    CacheBin_T * bin = &cache->bins[cls];
+
+    cache_drain_remote(cache);
+    if (bin->head)
+    {
+        return;
+    }
+
+    FreeBlock_T * batch = depot_take(cls);
+    uint32_t      count = 0;
+    for (FreeBlock_T * block = batch; block; block = block->next)
+    {
+        count++;
+    }
+    bin->head  = batch;
+    bin->count = count;
+}
+
+static void
+cache_flush_all(ThreadCache_T * cache)
+{
+    cache_drain_remote(cache);
+    for (unsigned cls = 0; cls < MM_NUM_CLASSES; cls++)
+    {
+        CacheBin_T * bin   = &cache->bins[cls];
+        uint32_t     batch = g_class_batch[cls];
+        while (bin->head)
+        {
+            bin_flush(bin, cls, batch);
+        }
+    }
+}
+
+/* Thread exit hook: hand every cached block back to the depot and park the
+ * cache on the orphan list. The cache itself is kept alive because other
+ * threads may still free blocks it handed out. */
+static void
+cache_retire(void * arg)
+{
+    ThreadCache_T * cache = arg;
+
+    cache_flush_all(cache);
+    t_cache = NULL;
+
+    pthread_mutex_lock(&g_orphan_mutex);
+    cache->next_orphan = g_orphans;
+    g_orphans          = cache;
+    pthread_mutex_unlock(&g_orphan_mutex);
+}
+
+static ThreadCache_T *
+cache_create(void)
+{
+    ThreadCache_T * cache = NULL;
+
+    pthread_once(&g_cache_once, cache_init_once);
+
+    pthread_mutex_lock(&g_orphan_mutex);
+    if (g_orphans)
+    {
+        cache              = g_orphans;
+        g_orphans          = cache->next_orphan;
+        cache->next_orphan = NULL;
+    }
+    pthread_mutex_unlock(&g_orphan_mutex);
+
+    if (!cache)
+    {
+        cache = map_pages(
+            (sizeof(ThreadCache_T) + MM_PAGE_SIZE - 1) & ~(size_t)(MM_PAGE_SIZE - 1));
+        if (!cache)
+        {
+            return NULL;
+        }
+        atomic_init(&cache->remote_free, NULL);
+    }
+
+    pthread_setspecific(g_cache_key, cache);
+    t_cache = cache;
+    return cache;
+}
+
+static ThreadCache_T *
+get_cache(void)
+{
+    ThreadCache_T * cache = t_cache;
+    if (__builtin_expect(cache != NULL, 1))
+    {
+        return cache;
+    }
+    return cache_create();
+}
+
+static void *
+large_alloc(size_t size, uint32_t tag)
+{
+    size_t length = size + sizeof(BlockHeader_T);
+    if (length < size)
+    {
+        return NULL;
+    }
+    length = (length + MM_PAGE_SIZE - 1) & ~(size_t)(MM_PAGE_SIZE - 1);
+
+    if (tag && !mm_tag_charge(tag, length))
+    {
+        return NULL;
+    }
+
+    BlockHeader_T * header = map_pages(length);
+    if (header && !large_register(header))
+    {
+        munmap(header, length);
+        header = NULL;
+    }
+    if (!header)
+    {
+        if (tag)
+        {
+            mm_tag_discharge(tag, length);
+        }
+        return NULL;
+    }
+    header->map_size   = length;
+    header->size_class = MM_LARGE_CLASS;
+    header->flags      = 0;
+    header->tag        = tag;
+    return header + 1;
+}
+
+void *
+mm_alloc_tagged(size_t size, uint32_t tag)
+{
+    size_t total = size + sizeof(BlockHeader_T);
+    if (total < size || total > MM_MAX_SMALL)
+    {
+        return large_alloc(size, tag);
+    }
+
+    ThreadCache_T * cache = get_cache();
+    if (!cache)
+    {
+        return NULL;
+    }
+
+    unsigned     cls = size_to_class(total);
+    CacheBin_T * bin = &cache->bins[cls];
+    if (tag && !mm_tag_charge(tag, g_class_size[cls]))
+    {
+        return NULL;
+    }
+    if (!bin->head)
+    {
+        cache_refill(cache, cls);
+        if (!bin->head)
+        {
+            if (tag)
+            {
+                mm_tag_discharge(tag, g_class_size[cls]);
+            }
+            return NULL;
+        }
+    }
+
+    FreeBlock_T * block = bin->head;
+    bin->head           = block->next;
+    bin->count--;
+
+    BlockHeader_T * header = (BlockHeader_T *)block;
+    header->owner          = cache;
+    header->size_class     = (uint16_t)cls;
+    header->flags          = 0;
+    header->tag            = tag;
+    return header + 1;
+}
+
+void *
+mm_alloc(size_t size)
+{
+    return mm_alloc_tagged(size, mm_thread_tag);
+}
+
+void
+mm_free(void * ptr)
+{
+    if (!ptr)
+    {
+        return;
+    }
+
+    BlockHeader_T * header = MM_HEADER(ptr);
+    if (header->size_class == MM_LARGE_CLASS)
+    {
+        if (header->tag)
+        {
+            mm_tag_discharge(header->tag, header->map_size);
+        }
+        large_unregister(header);
+        munmap(header, header->map_size);
+        return;
+    }
+    if (header->tag)
+    {
+        mm_tag_discharge(header->tag, g_class_size[header->size_class]);
+    }
+
+    ThreadCache_T * owner = header->owner;
+    FreeBlock_T *   block = (FreeBlock_T *)header;
+    if (owner != t_cache)
+    {
+        FreeBlock_T * head
+            = atomic_load_explicit(&owner->remote_free, memory_order_relaxed);
+        do
+        {
+            block->next = head;
+        } while (!atomic_compare_exchange_weak_explicit(&owner->remote_free,
+                                                        &head,
+                                                        block,
+                                                        memory_order_release,
+                                                        memory_order_relaxed));
+        return;
+    }
+
+    unsigned     cls = header->size_class;
+    CacheBin_T * bin = &owner->bins[cls];
+    block->next      = bin->head;
+    bin->head        = block;
+    bin->count++;
+
+    uint32_t batch = g_class_batch[cls];
+    if (bin->count >= 2 * batch)
+    {
+        bin_flush(bin, cls, batch);
+    }
+}
+
+void *
+mm_realloc(void * ptr, size_t size)
+{
+    if (!ptr)
+    {
+        return mm_alloc(size);
+    }
+
+    BlockHeader_T * header = MM_HEADER(ptr);
+    size_t          total  = size + sizeof(BlockHeader_T);
+    if (total < size)
+    {
+        return NULL;
+    }
+
+    if (header->size_class == MM_LARGE_CLASS)
+    {
+        size_t length = (total + MM_PAGE_SIZE - 1) & ~(size_t)(MM_PAGE_SIZE - 1);
+        size_t   old_length = header->map_size;
+        uint32_t tag        = header->tag;
+        if (length == old_length)
+        {
+            return ptr;
+        }
+        if (tag && length > old_length
+            && !mm_tag_charge(tag, length - old_length))
+        {
+            return NULL;
+        }
+        /* The set is updated under the same lock as the move, before the
+         * old address can be mapped again by another thread. Erasing first
+         * means the insert never has to grow the set, so cannot fail. */
+        pthread_mutex_lock(&g_large_mutex);
+        BlockHeader_T * moved
+            = mremap(header, old_length, length, MREMAP_MAYMOVE);
+        if (moved != MAP_FAILED && moved != header)
+        {
+            large_erase((uintptr_t)header);
+            large_insert((uintptr_t)moved);
+        }
+        pthread_mutex_unlock(&g_large_mutex);
+        if (moved == MAP_FAILED)
+        {
+            if (tag && length > old_length)
+            {
+                mm_tag_discharge(tag, length - old_length);
+            }
+            return NULL;
+        }
+        if (tag && length < old_length)
+        {
+            mm_tag_discharge(tag, old_length - length);
+        }
+        moved->map_size = length;
+        return moved + 1;
+    }
+
+    /* A block that shrinks to half its class or less moves to the smaller
+     * class, so that the cache gets the difference back and the tag is
+     * credited for it. Smaller shrinks stay in place, charged as before. */
+    size_t class_size = g_class_size[header->size_class];
+    size_t usable     = class_size - sizeof(BlockHeader_T);
+    if (size <= usable && g_class_size[size_to_class(total)] > class_size / 2)
+    {
+        return ptr;
+    }
+
+    void * new_ptr = mm_alloc_tagged(size, header->tag);
+    if (!new_ptr)
+    {
+        return size <= usable ? ptr : NULL;
+    }
+    memcpy(new_ptr, ptr, size < usable ? size : usable);
+    MM_HEADER(new_ptr)->flags = header->flags;
+    mm_free(ptr);
+    return new_ptr;
+}
+
+void *
+mm_align_block(void * base, size_t alignment)
+{
+    uintptr_t start = (uintptr_t)base + sizeof(BlockHeader_T);
+    uintptr_t user  = (start + alignment - 1) & ~(uintptr_t)(alignment - 1);
+
+    BlockHeader_T * header = MM_HEADER((void *)user);
+    header->map_size       = user - (uintptr_t)base;
+    header->size_class     = MM_ALIGNED_CLASS;
+    header->flags          = 0;
+    header->tag            = 0;
+    return (void *)user;
+}
+
+void *
+mm_aligned_base(void * ptr)
+{
+    BlockHeader_T * header = MM_HEADER(ptr);
+    if (header->size_class != MM_ALIGNED_CLASS)
+    {
+        return ptr;
+    }
+    return (char *)ptr - header->map_size;
+}
+
+size_t
+mm_usable_size(const void * ptr)
+{
+    const BlockHeader_T * header = (const BlockHeader_T *)ptr - 1;
+    if (header->size_class == MM_ALIGNED_CLASS)
+    {
+        const char * base = (const char *)ptr - header->map_size;
+        return mm_usable_size(base) - header->map_size;
+    }
+    if (header->size_class == MM_LARGE_CLASS)
+    {
+        return header->map_size - sizeof(BlockHeader_T);
+    }
+    return g_class_size[header->size_class] - sizeof(BlockHeader_T);
+}
+
+bool
+mm_owns(const void * ptr)
+{
+    uintptr_t address = (uintptr_t)ptr;
+
+    if (span_contains(address))
+    {
+        return true;
+    }
+    if ((address - sizeof(BlockHeader_T)) & (MM_PAGE_SIZE - 1))
+    {
+        return false;
+    }
+    return large_contains(address - sizeof(BlockHeader_T));
+}
+
+void
+mm_cache_flush(void)
+{
+    if (t_cache)
+    {
+        cache_flush_all(t_cache);
+    }
+}
@@ -0,0 +1,363 @@
+/**
+ * @file
+ * @brief Streaming binary dump of the tracked blocks.
+ *
+ * The dump is written through a buffered writer while walking the tracking
+ * table one bucket at a time: each bucket is copied out under its lock and
+ * encoded after the lock is released, so allocating threads are held up for
+ * no longer than a copy of one bucket. Nothing is formatted or symbolized in
+ * the process; tools/mem-dump-analyze does that offline. The format is
+ * described in include/mem-dump.h.
+ */
+
+#include "../include/mem-dump.h"
+#include "../include/mem-mgmt.h"
+#include "mem-internal.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/** @brief Size of the write buffer. */
+#define DUMP_BUFFER_SIZE (64 * 1024)
+
+/** @brief Initial number of slots in the file name table. */
+#define DUMP_FILE_SLOTS 256
+
+/** @brief A file name already written to the dump. */
+typedef struct DumpFile_Tag
+{
+    const char * file; /**< File name, compared by address. */
+    uint32_t     id;   /**< Id of its MEM_DUMP_FILE record. */
+} DumpFile_T;
+
+/** @brief State of a dump in progress. */
+typedef struct DumpWriter_Tag
+{
+    int          fd;             /**< Destination. */
+    bool         failed;         /**< A write or allocation failed. */
+    size_t       used;           /**< Bytes waiting in buffer. */
+    char *       buffer;         /**< Write buffer. */
+    DumpFile_T * files;          /**< Open addressing table of file names. */
+    size_t       file_slots;     /**< Number of slots in files. */
+    uint32_t     file_count;     /**< Number of file names written. */
+    uint8_t *    stacks_written; /**< Bitmap of stack ids written. */
+    size_t       stack_bytes;    /**< Size of stacks_written in bytes. */
+    uint64_t     block_count;    /**< Number of blocks written. */
+} DumpWriter_T;
+
+static void
+writer_flush(DumpWriter_T * writer)
+{
+    const char * data = writer->buffer;
+    size_t       left = writer->used;
+    while (left && !writer->failed)
+    {
+        ssize_t written = write(writer->fd, data, left);
+        if (written < 0)
+        {
+            if (errno != EINTR)
+            {
+                writer->failed = true;
+            }
+            continue;
+        }
+        data += written;
+        left -= (size_t)written;
+    }
+    writer->used = 0;
+}
+
+static void
+writer_put(DumpWriter_T * writer, const void * data, size_t length)
+{
+    const char * bytes = data;
+    while (length && !writer->failed)
+    {
+        if (writer->used == DUMP_BUFFER_SIZE)
+        {
+            writer_flush(writer);
+        }
+        size_t chunk = DUMP_BUFFER_SIZE - writer->used;
+        if (chunk > length)
+        {
+            chunk = length;
+        }
+        memcpy(writer->buffer + writer->used, bytes, chunk);
+        writer->used += chunk;
+        bytes += chunk;
+        length -= chunk;
+    }
+}
+
+static void
+writer_record(DumpWriter_T * writer, uint32_t type, size_t length)
+{
+    MemDumpRecord_T record = { .type = type, .length = (uint32_t)length };
+    writer_put(writer, &record, sizeof(record));
+}
+
+/* Write a record holding an id followed by a name. */
+static void
+write_named(DumpWriter_T * writer,
+            uint32_t       type,
+            uint32_t       id,
+            const char *   name)
+{
+    size_t length = name ? strlen(name) : 0;
+    writer_record(writer, type, sizeof(id) + length);
+    writer_put(writer, &id, sizeof(id));
+    writer_put(writer, name, length);
+}
+
+static void
+write_maps(DumpWriter_T * writer)
+{
+    int fd = open("/proc/self/maps", O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return;
+    }
+
+    /* Every chunk becomes a record of its own; readers concatenate them. */
+    char    chunk[4096];
+    ssize_t length;
+    while ((length = read(fd, chunk, sizeof(chunk))) != 0)
+    {
+        if (length < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            break;
+        }
+        writer_record(writer, MEM_DUMP_MAPS, (size_t)length);
+        writer_put(writer, chunk, (size_t)length);
+    }
+    close(fd);
+}
+
+static void
+write_tags(DumpWriter_T * writer)
+{
+    for (uint32_t tag = 1; tag < MEM_TAG_COUNT; tag++)
+    {
+        MemTagStats_T stats;
+        if (CustomTagGetStats(tag, &stats))
+        {
+            break;
+        }
+        write_named(writer, MEM_DUMP_TAG, tag, stats.name);
+    }
+}
+
+static size_t
+hash_file(const char * file, size_t slots)
+{
+    uint64_t key = (uint64_t)(uintptr_t)file;
+    return (size_t)((key * 0x9E3779B97F4A7C15ULL) >> 32) & (slots - 1);
+}
+
+static bool
+grow_files(DumpWriter_T * writer)
+{
+    size_t       slots = writer->file_slots ? 2 * writer->file_slots
+                                            : DUMP_FILE_SLOTS;
+    DumpFile_T * files = mm_alloc_tagged(slots * sizeof(DumpFile_T), 0);
+    if (!files)
+    {
+        return false;
+    }
+    memset(files, 0, slots * sizeof(DumpFile_T));
+
+    for (size_t i = 0; i < writer->file_slots; i++)
+    {
+        if (writer->files[i].file)
+        {
+            size_t slot = hash_file(writer->files[i].file, slots);
+            while (files[slot].file)
+            {
+                slot = (slot + 1) & (slots - 1);
+            }
+            files[slot] = writer->files[i];
+        }
+    }
+
+    mm_free(writer->files);
+    writer->files      = files;
+    writer->file_slots = slots;
+    return true;
+}
+
+/* Id of a file name, writing its record the first time it is seen. */
+static uint32_t
+file_id(DumpWriter_T * writer, const char * file)
+{
+    if (2 * (writer->file_count + 1) > writer->file_slots
+        && !grow_files(writer))
+    {
+        writer->failed = true;
+        return 0;
+    }
+
+    size_t slot = hash_file(file, writer->file_slots);
+    while (writer->files[slot].file)
+    {
+        if (writer->files[slot].file == file)
+        {
+            return writer->files[slot].id;
+        }
+        slot = (slot + 1) & (writer->file_slots - 1);
+    }
+
+    uint32_t id              = writer->file_count++;
+    writer->files[slot].file = file;
+    writer->files[slot].id   = id;
+    write_named(writer, MEM_DUMP_FILE, id, file);
+    return id;
+}
+
+/* Write a stack record the first time a stack id is seen. */
+static void
+write_stack(DumpWriter_T * writer, uint32_t id)
+{
+    size_t byte = id / 8;
+    if (byte >= writer->stack_bytes)
+    {
+        size_t    size   = 2 * byte + 64;
+        uint8_t * bitmap = mm_alloc_tagged(size, 0);
+        if (!bitmap)
+        {
+            writer->failed = true;
+            return;
+        }
+        memset(bitmap, 0, size);
+        if (writer->stack_bytes)
+        {
+            memcpy(bitmap, writer->stacks_written, writer->stack_bytes);
+        }
+        mm_free(writer->stacks_written);
+        writer->stacks_written = bitmap;
+        writer->stack_bytes    = size;
+    }
+
+    uint8_t bit = (uint8_t)(1u << (id % 8));
+    if (writer->stacks_written[byte] & bit)
+    {
+        return;
+    }
+    writer->stacks_written[byte] |= bit;
+
+    void * const * frames = NULL;
+    uint32_t       depth  = (uint32_t)mm_stack_get(id, &frames);
+    writer_record(writer,
+                  MEM_DUMP_STACK,
+                  2 * sizeof(uint32_t) + depth * sizeof(uint64_t));
+    writer_put(writer, &id, sizeof(id));
+    writer_put(writer, &depth, sizeof(depth));
+    for (uint32_t i = 0; i < depth; i++)
+    {
+        uint64_t frame = (uint64_t)(uintptr_t)frames[i];
+        writer_put(writer, &frame, sizeof(frame));
+    }
+}
+
+static void
+write_blocks(DumpWriter_T * writer, const TrackedBlock_T * blocks, size_t count)
+{
+    /* File and stack records go out ahead of the blocks that use them. */
+    for (size_t i = 0; i < count; i++)
+    {
+        file_id(writer, blocks[i].file);
+        if (blocks[i].stack_id)
+        {
+            write_stack(writer, blocks[i].stack_id);
+        }
+    }
+
+    writer_record(writer, MEM_DUMP_BLOCKS, count * sizeof(MemDumpBlock_T));
+    for (size_t i = 0; i < count; i++)
+    {
+        MemDumpBlock_T block = {
+            .address  = (uint64_t)(uintptr_t)blocks[i].ptr,
+            .size     = blocks[i].size,
+            .weight   = blocks[i].weight,
+            .file_id  = file_id(writer, blocks[i].file),
+            .line     = blocks[i].line,
+            .stack_id = blocks[i].stack_id,
+            .tag      = blocks[i].tag,
+        };
+        writer_put(writer, &block, sizeof(block));
+    }
+    writer->block_count += count;
+}
+
+int
+CustomHeapDump(int fd)
+{
+    DumpWriter_T writer = { .fd = fd };
+    writer.buffer       = mm_alloc_tagged(DUMP_BUFFER_SIZE, 0);
+    if (!writer.buffer)
+    {
+        return -1;
+    }
+
+    MemDumpHeader_T header = {
+        .version = MEM_DUMP_VERSION,
+        .pid     = (uint32_t)getpid(),
+        .time    = (uint64_t)time(NULL),
+    };
+    memcpy(header.magic, MEM_DUMP_MAGIC, sizeof(header.magic));
+    writer_put(&writer, &header, sizeof(header));
+    write_maps(&writer);
+    write_tags(&writer);
+
+    TrackedBlock_T * blocks   = NULL;
+    size_t           capacity = 0;
+    size_t           count    = 0;
+    int              status   = 0;
+    for (size_t bucket = 0; !writer.failed; bucket++)
+    {
+        status = mm_track_copy(bucket, &blocks, &capacity, &count);
+        if (status <= 0)
+        {
+            break;
+        }
+        if (count)
+        {
+            write_blocks(&writer, blocks, count);
+        }
+    }
+
+    if (status == 0)
+    {
+        writer_record(&writer, MEM_DUMP_END, sizeof(writer.block_count));
+        writer_put(&writer, &writer.block_count, sizeof(writer.block_count));
+    }
+    writer_flush(&writer);
+
+    mm_free(blocks);
+    mm_free(writer.files);
+    mm_free(writer.stacks_written);
+    mm_free(writer.buffer);
+    return (status < 0 || writer.failed) ? -1 : 0;
+}
+
+int
+CustomHeapDumpFile(const char * path)
+{
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    int status = CustomHeapDump(fd);
+    if (close(fd) && !status)
+    {
+        status = -1;
+    }
+    return status;
+}
@@ -0,0 +1,290 @@
+/**
+ * @file
+ * @brief Internal interface shared between the tracking front end and the
+ * block allocator of the memory management library.
+ */
+
+#ifndef MEM_INTERNAL_H
+#define MEM_INTERNAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** @brief Number of small size classes served from thread caches. */
+#define MM_NUM_CLASSES 40
+
+/** @brief Largest block (header included) served from a size class. */
+#define MM_MAX_SMALL 32768
+
+/** @brief Size class value marking a block that owns its own mapping. */
+#define MM_LARGE_CLASS 0xFFFF
+
+/** @brief Size class value marking an aligned view into a larger block. */
+#define MM_ALIGNED_CLASS 0xFFFE
+
+/** @brief Header flag: the block has a record in the tracking table. */
+#define MM_FLAG_TRACKED 0x0001
+
+struct ThreadCache_Tag;
+struct AllocSite_Tag;
+
+/** @brief Copy of a tracking record, as handed out by mm_track_copy. */
+typedef struct TrackedBlock_Tag
+{
+    void *       ptr;      /**< User pointer of the block. */
+    size_t       size;     /**< Requested size in bytes. */
+    size_t       weight;   /**< Bytes the record stands for when sampled. */
+    const char * file;     /**< File name of the allocation. */
+    int          line;     /**< Line number of the allocation. */
+    uint32_t     stack_id; /**< Interned call stack, 0 for none. */
+    uint32_t     tag;      /**< Allocation tag of the block. */
+} TrackedBlock_T;
+
+/**
+ * @brief Header placed immediately in front of every user pointer.
+ *
+ * The header is 16 bytes so user pointers keep the alignment malloc
+ * guarantees.
+ */
+typedef struct BlockHeader_Tag
+{
+    union
+    {
+        struct ThreadCache_Tag * owner; /**< Cache that handed out the block. */
+        size_t map_size; /**< Mapping length of a large block, or offset
+                            from the enclosing block of an aligned view. */
+    };
+    uint16_t size_class; /**< Size class, or MM_LARGE_CLASS. */
+    uint16_t flags;      /**< MM_FLAG_* bits. */
+    uint32_t tag;        /**< Tag the block is charged to, 0 for none. */
+} BlockHeader_T;
+
+/** @brief Recover the header of a block from its user pointer. */
+#define MM_HEADER(ptr) ((BlockHeader_T *)(ptr)-1)
+
+/** @brief Allocation tag selected by the calling thread. */
+extern _Thread_local uint32_t mm_thread_tag;
+
+/**
+ * @brief Allocate a block of at least size bytes.
+ *
+ * Small blocks come from the calling thread's cache, large blocks are mapped
+ * directly. The block is charged to the calling thread's allocation tag and
+ * its header flags are cleared.
+ *
+ * @param size Number of usable bytes requested.
+ * @return User pointer, or NULL on failure, including when the tag's hard
+ * limit refuses the allocation.
+ */
+void * mm_alloc(size_t size);
+
+/**
+ * @brief Allocate a block charged to an explicit allocation tag.
+ *
+ * The library allocates its own bookkeeping with tag 0 so that it is never
+ * charged to, or refused by, the budget of the caller's subsystem.
+ *
+ * @param size Number of usable bytes requested.
+ * @param tag Tag to charge the block to, or 0 for none.
+ * @return User pointer, or NULL on failure.
+ */
+void * mm_alloc_tagged(size_t size, uint32_t tag);
+
+/**
+ * @brief Release a block obtained from mm_alloc.
+ *
+ * Blocks owned by another thread's cache are handed back through that
+ * cache's remote-free list.
+ *
+ * @param ptr User pointer returned by mm_alloc, or NULL.
+ */
+void mm_free(void * ptr);
+
+/**
+ * @brief Resize a block obtained from mm_alloc.
+ *
+ * A small block is kept in place while the new size fits its size class,
+ * unless it shrinks to a class of half the size or less, in which case it
+ * moves there. A large block is resized with mremap, which extends the
+ * mapping in place when the address space allows and otherwise moves its
+ * pages without copying.
+ * The header flags and tag carry over to the resized block, and the tag is
+ * charged for the change in size.
+ *
+ * @param ptr User pointer returned by mm_alloc.
+ * @param size New number of usable bytes.
+ * @return User pointer to the resized block, or NULL on failure, in which
+ * case ptr is left untouched.
+ */
+void * mm_realloc(void * ptr, size_t size);
+
+/**
+ * @brief Number of usable bytes in a block obtained from mm_alloc.
+ *
+ * @param ptr User pointer returned by mm_alloc.
+ * @return Usable size of the block in bytes.
+ */
+size_t mm_usable_size(const void * ptr);
+
+/**
+ * @brief Whether ptr is the user pointer of a live block from mm_alloc.
+ *
+ * Reads nothing in front of ptr, so it is safe on any pointer: small blocks
+ * are found by the span they fall in, large blocks by their address in the
+ * set of live large mappings. Aligned views of large blocks are not
+ * recognised.
+ *
+ * @param ptr Any pointer.
+ * @return true if ptr lies in a span of small blocks or is the user pointer
+ * of a live large block.
+ */
+bool mm_owns(const void * ptr);
+
+/**
+ * @brief Carve an aligned view out of a block.
+ *
+ * The view gets a header of its own, with size class MM_ALIGNED_CLASS, that
+ * records its distance from the enclosing block. The block must have room
+ * for alignment + sizeof(BlockHeader_T) bytes more than the view needs.
+ *
+ * @param base User pointer of the enclosing block.
+ * @param alignment Power of two alignment of the view.
+ * @return User pointer of the aligned view.
+ */
+void * mm_align_block(void * base, size_t alignment);
+
+/**
+ * @brief Map an aligned view back to its enclosing block.
+ *
+ * @param ptr User pointer of a block or of an aligned view.
+ * @return User pointer of the enclosing block, or ptr itself when ptr is not
+ * an aligned view.
+ */
+void * mm_aligned_base(void * ptr);
+
+/**
+ * @brief Return every block cached by the calling thread to the depot.
+ */
+void mm_cache_flush(void);
+
+/**
+ * @brief Charge bytes to an allocation tag.
+ *
+ * The charge goes to the calling thread's private delta for the tag and is
+ * only folded into the shared counter, and checked against the soft limit,
+ * once the delta grows past the fold threshold. The hard limit is checked
+ * on every charge.
+ *
+ * @param tag Tag to charge, not 0.
+ * @param bytes Number of bytes about to be allocated.
+ * @return false if the tag's hard limit refuses the charge, in which case
+ * nothing is charged.
+ */
+bool mm_tag_charge(uint32_t tag, size_t bytes);
+
+/**
+ * @brief Give back bytes charged to an allocation tag.
+ *
+ * @param tag Tag to credit, not 0.
+ * @param bytes Number of bytes released.
+ */
+void mm_tag_discharge(uint32_t tag, size_t bytes);
+
+/**
+ * @brief Fold the calling thread's pending tag deltas into the shared
+ * counters.
+ */
+void mm_tag_flush(void);
+
+/**
+ * @brief Find or create the statistics record of an allocation site.
+ *
+ * @param file File name of the site, compared by address.
+ * @param line Line number of the site.
+ * @return The site, or NULL if a new site could not be allocated.
+ */
+struct AllocSite_Tag * mm_site_lookup(const char * file, int line);
+
+/**
+ * @brief Account for allocations made at a site.
+ *
+ * @param site Site returned by mm_site_lookup, or NULL.
+ * @param bytes Number of bytes allocated.
+ * @param count Number of blocks allocated.
+ */
+void mm_site_alloc(struct AllocSite_Tag * site, size_t bytes, size_t count);
+
+/**
+ * @brief Account for a block allocated at a site changing size.
+ *
+ * @param site Site returned by mm_site_lookup, or NULL.
+ * @param old_bytes Number of bytes before the resize.
+ * @param new_bytes Number of bytes after the resize.
+ */
+void mm_site_resize(struct AllocSite_Tag * site,
+                    size_t                 old_bytes,
+                    size_t                 new_bytes);
+
+/**
+ * @brief Account for the release of blocks allocated at a site.
+ *
+ * @param site Site returned by mm_site_lookup, or NULL.
+ * @param bytes Number of bytes released.
+ * @param count Number of blocks released.
+ */
+void mm_site_free(struct AllocSite_Tag * site, size_t bytes, size_t count);
+
+/**
+ * @brief Copy the tracking records of one bucket of the tracking table.
+ *
+ * The bucket's lock is only held while the records are copied. The copy
+ * buffer is grown with mm_alloc_tagged and mm_free as needed.
+ *
+ * @param bucket Index of the bucket, counting from 0.
+ * @param blocks Copy buffer, may point to NULL.
+ * @param capacity Number of entries the copy buffer holds.
+ * @param count Receives the number of records copied.
+ * @return 1 if the bucket was copied, 0 if bucket is past the last bucket or
+ * tracking is compiled out, -1 if the buffer could not be grown.
+ */
+int mm_track_copy(size_t           bucket,
+                  TrackedBlock_T ** blocks,
+                  size_t *         capacity,
+                  size_t *         count);
+
+/**
+ * @brief Intern a call stack and return its id.
+ *
+ * Equal stacks always map to the same id.
+ *
+ * @param frames Return addresses, innermost first.
+ * @param depth Number of entries in frames.
+ * @return Id of the stack, or 0 if depth is 0 or the stack could not be
+ * stored.
+ */
+uint32_t mm_stack_intern(void * const * frames, int depth);
+
+/**
+ * @brief Leave frames of a range of code out of captured stacks.
+ *
+ * Frames at the top of a captured stack whose return addresses fall in the
+ * range are dropped, so that an allocation is attributed to the code that
+ * called into a wrapper such as the preload shim rather than to the
+ * wrapper.
+ *
+ * @param start First address of the code.
+ * @param end Address just past the code.
+ */
+void mm_stack_skip_code(uintptr_t start, uintptr_t end);
+
+/**
+ * @brief Look up the frames of an interned stack.
+ *
+ * @param id Id returned by mm_stack_intern.
+ * @param frames Receives a pointer to the stored return addresses.
+ * @return Number of frames, or 0 if id does not name a stack.
+ */
+int mm_stack_get(uint32_t id, void * const ** frames);
+
+#endif
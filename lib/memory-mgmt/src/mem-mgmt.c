@@ -4,9 +4,87 @@
  */
 
 #include "../include/mem-mgmt.h"
+#include "mem-internal.h"
+#include <execinfo.h>
+#include <math.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+void *
+CustomFastMalloc(size_t size)
+{
+    return mm_alloc(size);
+}
+
+void *
+CustomFastCalloc(size_t num, size_t size)
+{
+    if (size && num > SIZE_MAX / size)
+    {
+        return NULL;
+    }
+
+    void * ptr = mm_alloc(num * size);
+    if (ptr)
+    {
+        memset(ptr, 0, num * size);
+    }
+
+    return ptr;
+}
+
+void *
+CustomFastRealloc(void * ptr, size_t size)
+{
+    if (ptr && !mm_owns(ptr))
+    {
+        return NULL;
+    }
+#ifndef MEM_MGMT_NO_TRACKING
+    if (ptr && (MM_HEADER(ptr)->flags & MM_FLAG_TRACKED))
+    {
+        return CustomRealloc(ptr, size, __FILE__, __LINE__);
+    }
+#endif
+    if (ptr && !size)
+    {
+        mm_free(ptr);
+        return NULL;
+    }
+
+    return mm_realloc(ptr, size);
+}
+
+void
+CustomFastFree(void * ptr)
+{
+    if (!ptr || !mm_owns(ptr))
+    {
+        return;
+    }
+#ifndef MEM_MGMT_NO_TRACKING
+    if (MM_HEADER(ptr)->flags & MM_FLAG_TRACKED)
+    {
+        CustomFree(ptr);
+        return;
+    }
+#endif
+    mm_free(ptr);
+}
+
+void
+CustomThreadCacheFlush(void)
+{
+    mm_cache_flush();
+    mm_tag_flush();
+}
+
+#ifndef MEM_MGMT_NO_TRACKING
 
 /**
  * @brief Structure for holding information about each allocated memory block.
@@ -17,61 +95,168 @@ typedef struct MemoryBlock_Tag
     size_t       size; /**< Size of the allocated memory block in bytes. */
     const char * file; /**< File name where the memory block was allocated. */
     int          line; /**< Line number where the memory block was allocated. */
+    uint32_t     stack_id; /**< Interned call stack, 0 if not captured. */
+    size_t       weight; /**< Bytes this record stands for when sampled. */
+    struct AllocSite_Tag * site; /**< Statistics of the allocation site. */
     struct MemoryBlock_Tag * next; /**< Next MemoryBlock in the linked list. */
 } MemoryBlock_T;
 
+/** @brief Deepest call stack captured for a tracked allocation. */
+#define MAX_STACK_DEPTH 32
+
 /** @brief Hash table size parameter. */
 #define HASH_TABLE_SIZE 1024
 
+/** @brief Number of mutexes the hash table buckets are striped across. */
+#define HASH_TABLE_STRIPES 64
+
 /** @brief Global hash table for keeping track of allocated memory. */
 static MemoryBlock_T * g_memory_table[HASH_TABLE_SIZE] = { 0 };
 
-/** @brief Mutex for synchronizing access to the hash table. */
-static pthread_mutex_t g_memory_mutex = PTHREAD_MUTEX_INITIALIZER;
+/** @brief Mutexes for synchronizing access to the hash table, one per stripe
+ * of buckets. */
+static pthread_mutex_t g_memory_mutex[HASH_TABLE_STRIPES];
+
+/** @brief Guard for the one time initialisation of the stripe mutexes. */
+static pthread_once_t g_memory_once = PTHREAD_ONCE_INIT;
+
+/** @brief Mean bytes between samples, 0 when every allocation is tracked. */
+static _Atomic size_t g_sample_interval = 0;
+
+/** @brief Whether tracked allocations record their call stack. */
+static atomic_bool g_capture_stacks = false;
+
+/** @brief Code whose frames are dropped from the top of captured stacks. */
+static _Atomic uintptr_t g_skip_start = 0;
+
+/** @brief End of the code range in g_skip_start. */
+static _Atomic uintptr_t g_skip_end = 0;
+
+/** @brief Bytes the calling thread may allocate before its next sample. */
+static _Thread_local int64_t t_bytes_until_sample = 0;
+
+/** @brief Whether the calling thread has drawn its first sampling interval. */
+static _Thread_local bool t_sample_started = false;
+
+/** @brief State of the calling thread's sampling random number generator. */
+static _Thread_local uint64_t t_sample_rng = 0;
+
+static void
+memory_before_fork(void)
+{
+    for (size_t i = 0; i < HASH_TABLE_STRIPES; i++)
+    {
+        pthread_mutex_lock(&g_memory_mutex[i]);
+    }
+}
+
+static void
+memory_after_fork(void)
+{
+    for (size_t i = 0; i < HASH_TABLE_STRIPES; i++)
+    {
+        pthread_mutex_unlock(&g_memory_mutex[i]);
+    }
+}
+
+static void
+memory_init_once(void)
+{
+    for (size_t i = 0; i < HASH_TABLE_STRIPES; i++)
+    {
+        pthread_mutex_init(&g_memory_mutex[i], NULL);
+    }
+    pthread_atfork(memory_before_fork, memory_after_fork, memory_after_fork);
+}
 
 static size_t
 hash_ptr(void * ptr)
 {
-    return ((size_t)ptr) % HASH_TABLE_SIZE;
+    /* Blocks are 16 byte aligned, so drop the low bits and let a Fibonacci
+     * multiply spread the rest across the table. */
+    uint64_t key = (uint64_t)(uintptr_t)ptr >> 4;
+    return (size_t)((key * 0x9E3779B97F4A7C15ULL) >> 54) % HASH_TABLE_SIZE;
 }
 
-void *
-CustomMalloc(size_t size, const char * file, int line)
+static pthread_mutex_t *
+bucket_lock(size_t hash_value)
 {
-    void * ptr = malloc(size);
-    if (ptr)
+    return &g_memory_mutex[hash_value % HASH_TABLE_STRIPES];
+}
+
+/* xorshift64* generator, seeded per thread on first use. */
+static uint64_t
+sample_random(void)
+{
+    if (!t_sample_rng)
     {
-        MemoryBlock_T * new_block = malloc(sizeof(MemoryBlock_T));
-        if (new_block)
-        {
-            new_block->ptr  = ptr;
-            new_block->size = size;
-            new_block->file = file;
-            new_block->line = line;
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        t_sample_rng = ((uint64_t)(uintptr_t)&t_sample_rng
+                        ^ (uint64_t)now.tv_nsec ^ ((uint64_t)now.tv_sec << 32))
+                       | 1;
+    }
+    t_sample_rng ^= t_sample_rng >> 12;
+    t_sample_rng ^= t_sample_rng << 25;
+    t_sample_rng ^= t_sample_rng >> 27;
+    return t_sample_rng * 0x2545F4914F6CDD1DULL;
+}
 
-            size_t hash_value = hash_ptr(ptr);
+/* Distance to the next sample, drawn from an exponential distribution so
+ * that samples form a Poisson process over allocated bytes. Every byte is
+ * then equally likely to be sampled no matter how allocations are sized. */
+static int64_t
+sample_next_interval(size_t mean)
+{
+    double uniform = ((double)(sample_random() >> 11) + 1.0) / 9007199254740993.0;
+    double bytes   = -log(uniform) * (double)mean;
+    return (bytes >= (double)INT64_MAX) ? INT64_MAX : (int64_t)bytes + 1;
+}
 
-            pthread_mutex_lock(&g_memory_mutex);
-            new_block->next            = g_memory_table[hash_value];
-            g_memory_table[hash_value] = new_block;
-            pthread_mutex_unlock(&g_memory_mutex);
-        }
+/* Estimated number of bytes a sampled allocation stands for: the size
+ * divided by the probability an allocation of that size gets sampled. */
+static size_t
+sample_weight(size_t size, size_t mean)
+{
+    if (!mean || !size)
+    {
+        return size;
     }
-
-    return ptr;
+    double probability = 1.0 - exp(-(double)size / (double)mean);
+    return (size_t)((double)size / probability);
 }
 
-void
-CustomFree(void * ptr)
+/* Number of blocks a record stands for, derived from its weight. */
+static size_t
+record_count(const MemoryBlock_T * block)
 {
-    if (!ptr)
+    if (!block->size || block->weight <= block->size)
     {
-        return;
+        return 1;
     }
+    return block->weight / block->size;
+}
+
+static void
+insert_record(MemoryBlock_T * block)
+{
+    size_t hash_value = hash_ptr(block->ptr);
+
+    pthread_mutex_lock(bucket_lock(hash_value));
+    block->next                = g_memory_table[hash_value];
+    g_memory_table[hash_value] = block;
+    pthread_mutex_unlock(bucket_lock(hash_value));
+}
 
-    size_t hash_value = hash_ptr(ptr);
+/* Unlink and return the record of a tracked block, or NULL if there is
+ * none. */
+static MemoryBlock_T *
+remove_record(void * ptr)
+{
+    size_t          hash_value = hash_ptr(ptr);
+    MemoryBlock_T * found      = NULL;
 
-    pthread_mutex_lock(&g_memory_mutex);
+    pthread_mutex_lock(bucket_lock(hash_value));
     MemoryBlock_T * prev    = NULL;
     MemoryBlock_T * current = g_memory_table[hash_value];
     while (current)
@@ -86,19 +271,188 @@ CustomFree(void * ptr)
             {
                 g_memory_table[hash_value] = current->next;
             }
-            free(current->ptr);
-            free(current);
+            found = current;
             break;
         }
         prev    = current;
         current = current->next;
     }
-    pthread_mutex_unlock(&g_memory_mutex);
+    pthread_mutex_unlock(bucket_lock(hash_value));
+
+    return found;
+}
+
+/* Record an allocation in the hash table. Failure to allocate the record
+ * only costs the allocation its tracking. Kept out of line so the captured
+ * stack always starts with this function and CustomMalloc. */
+__attribute__((noinline)) static void
+track_block(void * ptr, size_t size, const char * file, int line, size_t mean)
+{
+    pthread_once(&g_memory_once, memory_init_once);
+
+    MemoryBlock_T * new_block = mm_alloc_tagged(sizeof(MemoryBlock_T), 0);
+    if (!new_block)
+    {
+        return;
+    }
+    new_block->ptr         = ptr;
+    new_block->size        = size;
+    new_block->file        = file;
+    new_block->line        = line;
+    new_block->weight      = sample_weight(size, mean);
+    new_block->stack_id    = 0;
+    new_block->site        = mm_site_lookup(file, line);
+    mm_site_alloc(new_block->site, new_block->weight, record_count(new_block));
+
+    if (atomic_load_explicit(&g_capture_stacks, memory_order_relaxed))
+    {
+        void * frames[MAX_STACK_DEPTH];
+        int    depth = backtrace(frames, MAX_STACK_DEPTH);
+        /* Drop this function and CustomMalloc from the top of the stack,
+         * then any frames of the code that called CustomMalloc for the
+         * program, such as the preload shim. */
+        int       skip  = 2;
+        uintptr_t start
+            = atomic_load_explicit(&g_skip_start, memory_order_relaxed);
+        uintptr_t end = atomic_load_explicit(&g_skip_end, memory_order_relaxed);
+        while (skip < depth && (uintptr_t)frames[skip] >= start
+               && (uintptr_t)frames[skip] < end)
+        {
+            skip++;
+        }
+        if (depth > skip)
+        {
+            new_block->stack_id
+                = mm_stack_intern(frames + skip, depth - skip);
+        }
+    }
+    MM_HEADER(ptr)->flags |= MM_FLAG_TRACKED;
+
+    insert_record(new_block);
+}
+
+static void
+release_record(MemoryBlock_T * block)
+{
+    if (block)
+    {
+        mm_site_free(block->site, block->weight, record_count(block));
+        mm_free(block);
+    }
+}
+
+void *
+CustomMalloc(size_t size, const char * file, int line)
+{
+    void * ptr = mm_alloc(size);
+    if (!ptr)
+    {
+        return NULL;
+    }
+
+    size_t mean
+        = atomic_load_explicit(&g_sample_interval, memory_order_relaxed);
+    if (mean)
+    {
+        /* Unsampled allocations pay for nothing but this countdown. */
+        t_bytes_until_sample -= (int64_t)size;
+        if (__builtin_expect(t_bytes_until_sample > 0, 1))
+        {
+            return ptr;
+        }
+        if (!t_sample_started)
+        {
+            /* A thread's first allocation draws the first interval instead
+             * of being sampled outright, which would count it with a
+             * weight it was not sampled at. */
+            t_sample_started     = true;
+            t_bytes_until_sample = sample_next_interval(mean) - (int64_t)size;
+            if (t_bytes_until_sample > 0)
+            {
+                return ptr;
+            }
+        }
+        t_bytes_until_sample = sample_next_interval(mean);
+    }
+    track_block(ptr, size, file, line, mean);
+
+    return ptr;
+}
+
+void
+CustomFree(void * ptr)
+{
+    /* The header in front of a pointer the library did not hand out may not
+     * be mapped, so ownership is settled before it is read. */
+    if (!ptr || !mm_owns(ptr))
+    {
+        return;
+    }
+
+    if (!(MM_HEADER(ptr)->flags & MM_FLAG_TRACKED))
+    {
+        mm_free(ptr);
+        return;
+    }
+
+    MemoryBlock_T * found = remove_record(ptr);
+    release_record(found);
+    mm_free(ptr);
+}
+
+void *
+CustomRealloc(void * ptr, size_t size, const char * file, int line)
+{
+    if (!ptr)
+    {
+        return CustomMalloc(size, file, line);
+    }
+    if (!size)
+    {
+        CustomFree(ptr);
+        return NULL;
+    }
+    if (!mm_owns(ptr))
+    {
+        return NULL;
+    }
+
+    if (!(MM_HEADER(ptr)->flags & MM_FLAG_TRACKED))
+    {
+        return mm_realloc(ptr, size);
+    }
+
+    /* The record keeps its original site and stack; only the block's
+     * address and size change. */
+    MemoryBlock_T * record  = remove_record(ptr);
+    void *          new_ptr = mm_realloc(ptr, size);
+    if (!record)
+    {
+        return new_ptr;
+    }
+    if (new_ptr)
+    {
+        size_t mean
+            = atomic_load_explicit(&g_sample_interval, memory_order_relaxed);
+        size_t old_weight = record->weight;
+        record->ptr       = new_ptr;
+        record->size      = size;
+        record->weight    = sample_weight(size, mean);
+        mm_site_resize(record->site, old_weight, record->weight);
+    }
+    insert_record(record);
+
+    return new_ptr;
 }
 
 void *
 CustomCalloc(size_t num, size_t size, const char * file, int line)
 {
+    if (size && num > SIZE_MAX / size)
+    {
+        return NULL;
+    }
+
     size_t total_size = num * size;
     void * ptr        = CustomMalloc(total_size, file, line);
     if (ptr)
@@ -109,45 +463,215 @@ CustomCalloc(size_t num, size_t size, const char * file, int line)
     return ptr;
 }
 
+void
+CustomSetSamplingInterval(size_t mean_bytes)
+{
+    atomic_store(&g_sample_interval, mean_bytes);
+}
+
+void
+CustomSetStackCapture(bool enabled)
+{
+    atomic_store(&g_capture_stacks, enabled);
+}
+
+void
+mm_stack_skip_code(uintptr_t start, uintptr_t end)
+{
+    atomic_store_explicit(&g_skip_start, start, memory_order_relaxed);
+    atomic_store_explicit(&g_skip_end, end, memory_order_relaxed);
+}
+
 void
 PrintMemoryLeaks(void)
 {
-    pthread_mutex_lock(&g_memory_mutex);
+    pthread_once(&g_memory_once, memory_init_once);
+
     for (size_t i = 0; i < HASH_TABLE_SIZE; i++)
     {
+        pthread_mutex_lock(bucket_lock(i));
         MemoryBlock_T * current = g_memory_table[i];
         while (current)
         {
-            printf("Leak: %zu bytes at %p, allocated in %s:%d\n",
+            printf("Leak: %zu bytes at %p, allocated in %s:%d",
                    current->size,
                    current->ptr,
                    current->file,
                    current->line);
+            if (current->weight != current->size)
+            {
+                printf(" (sampled, ~%zu bytes)", current->weight);
+            }
+            printf("\n");
+            void * const * frames = NULL;
+            int            depth  = mm_stack_get(current->stack_id, &frames);
+            if (depth)
+            {
+                /* Symbols are only resolved here, at report time. */
+                fflush(stdout);
+                backtrace_symbols_fd(frames, depth, STDOUT_FILENO);
+            }
             current = current->next;
         }
+        pthread_mutex_unlock(bucket_lock(i));
     }
-    pthread_mutex_unlock(&g_memory_mutex);
 }
 
 void
 CustomClean(void)
 {
-    pthread_mutex_lock(&g_memory_mutex);
+    pthread_once(&g_memory_once, memory_init_once);
+
     for (size_t i = 0; i < HASH_TABLE_SIZE; i++)
     {
+        pthread_mutex_lock(bucket_lock(i));
         MemoryBlock_T * current = g_memory_table[i];
         while (current)
         {
             MemoryBlock_T * next_block = current->next;
-            free(current->ptr);
-            free(current);
+            mm_free(current->ptr);
+            release_record(current);
             current = next_block;
         }
         g_memory_table[i] = NULL;
+        pthread_mutex_unlock(bucket_lock(i));
+    }
+}
+
+int
+mm_track_copy(size_t           bucket,
+              TrackedBlock_T ** blocks,
+              size_t *         capacity,
+              size_t *         count)
+{
+    if (bucket >= HASH_TABLE_SIZE)
+    {
+        return 0;
+    }
+    pthread_once(&g_memory_once, memory_init_once);
+
+    for (;;)
+    {
+        size_t needed = 0;
+        pthread_mutex_lock(bucket_lock(bucket));
+        for (MemoryBlock_T * current = g_memory_table[bucket]; current;
+             current                 = current->next)
+        {
+            if (needed < *capacity)
+            {
+                TrackedBlock_T * copy = &(*blocks)[needed];
+                copy->ptr             = current->ptr;
+                copy->size            = current->size;
+                copy->weight          = current->weight;
+                copy->file            = current->file;
+                copy->line            = current->line;
+                copy->stack_id        = current->stack_id;
+                copy->tag             = MM_HEADER(current->ptr)->tag;
+            }
+            needed++;
+        }
+        pthread_mutex_unlock(bucket_lock(bucket));
+
+        if (needed <= *capacity)
+        {
+            *count = needed;
+            return 1;
+        }
+
+        /* The bucket outgrew the buffer; grow it without holding the lock
+         * and copy again. */
+        TrackedBlock_T * grown
+            = mm_alloc_tagged(2 * needed * sizeof(TrackedBlock_T), 0);
+        if (!grown)
+        {
+            return -1;
+        }
+        mm_free(*blocks);
+        *blocks   = grown;
+        *capacity = 2 * needed;
     }
-    pthread_mutex_unlock(&g_memory_mutex);
 }
 
+#else /* MEM_MGMT_NO_TRACKING */
+
+/* Tracking is compiled out. The tracking entry points stay available for
+ * callers built against the tracking macros, and behave like the fast
+ * ones. */
+
+void *
+CustomMalloc(size_t size, const char * file, int line)
+{
+    (void)file;
+    (void)line;
+    return CustomFastMalloc(size);
+}
+
+void
+CustomFree(void * ptr)
+{
+    CustomFastFree(ptr);
+}
+
+void *
+CustomRealloc(void * ptr, size_t size, const char * file, int line)
+{
+    (void)file;
+    (void)line;
+    return CustomFastRealloc(ptr, size);
+}
+
+void *
+CustomCalloc(size_t num, size_t size, const char * file, int line)
+{
+    (void)file;
+    (void)line;
+    return CustomFastCalloc(num, size);
+}
+
+void
+CustomSetSamplingInterval(size_t mean_bytes)
+{
+    (void)mean_bytes;
+}
+
+void
+CustomSetStackCapture(bool enabled)
+{
+    (void)enabled;
+}
+
+void
+mm_stack_skip_code(uintptr_t start, uintptr_t end)
+{
+    (void)start;
+    (void)end;
+}
+
+void
+PrintMemoryLeaks(void)
+{
+}
+
+int
+mm_track_copy(size_t           bucket,
+              TrackedBlock_T ** blocks,
+              size_t *         capacity,
+              size_t *         count)
+{
+    (void)bucket;
+    (void)blocks;
+    (void)capacity;
+    *count = 0;
+    return 0;
+}
+
+void
+CustomClean(void)
+{
+}
+
+#endif /* MEM_MGMT_NO_TRACKING */
+
 /* ----------------------------------------------------------------------------
 
 Example usage
@@ -0,0 +1,354 @@
+/**
+ * @file
+ * @brief Per allocation site statistics and snapshots.
+ *
+ * Every (file, line) pair that makes a tracked allocation gets a site record
+ * holding atomic counters. Sites are never removed, so lookups walk the site
+ * table without a lock and snapshots read the counters while allocations
+ * carry on in other threads. Only the creation of a new site takes a mutex.
+ *
+ * Sites are keyed on the address of the file name string. __FILE__ expands to
+ * one string per translation unit, so a header included from several files
+ * may show up as several sites with the same name.
+ */
+
+#include "../include/mem-mgmt.h"
+#include "mem-internal.h"
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef MEM_MGMT_NO_TRACKING
+
+/** @brief Number of buckets in the site table. */
+#define SITE_TABLE_SIZE 4096
+
+/** @brief Counters for a single allocation site. */
+typedef struct AllocSite_Tag
+{
+    const char *          file;         /**< File name of the site. */
+    int                   line;         /**< Line number of the site. */
+    uint32_t              id;           /**< Dense id, in creation order. */
+    _Atomic int64_t       live_bytes;   /**< Bytes currently allocated. */
+    _Atomic int64_t       live_count;   /**< Blocks currently allocated. */
+    _Atomic uint64_t      total_allocs; /**< Allocations ever made. */
+    _Atomic uint64_t      total_bytes;  /**< Bytes ever allocated. */
+    _Atomic int64_t       peak_bytes;   /**< Highest value of live_bytes. */
+    struct AllocSite_Tag * next;        /**< Next site in the same bucket. */
+    struct AllocSite_Tag * older;       /**< Site created just before. */
+} AllocSite_T;
+
+/** @brief Hash table of sites keyed on (file, line). */
+static _Atomic(AllocSite_T *) g_site_table[SITE_TABLE_SIZE];
+
+/** @brief Most recently created site; sites chain back to the first one. */
+static _Atomic(AllocSite_T *) g_newest_site = NULL;
+
+/** @brief Mutex serializing the creation of sites. */
+static pthread_mutex_t g_site_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static size_t
+hash_site(const char * file, int line)
+{
+    uint64_t key = (uint64_t)(uintptr_t)file ^ ((uint64_t)(unsigned)line << 40);
+    return (size_t)((key * 0x9E3779B97F4A7C15ULL) >> 52) % SITE_TABLE_SIZE;
+}
+
+static AllocSite_T *
+find_site(AllocSite_T * site, const char * file, int line)
+{
+    while (site && (site->file != file || site->line != line))
+    {
+        site = site->next;
+    }
+    return site;
+}
+
+struct AllocSite_Tag *
+mm_site_lookup(const char * file, int line)
+{
+    size_t        bucket = hash_site(file, line);
+    AllocSite_T * site   = find_site(
+        atomic_load_explicit(&g_site_table[bucket], memory_order_acquire),
+        file,
+        line);
+    if (site)
+    {
+        return site;
+    }
+
+    pthread_mutex_lock(&g_site_mutex);
+    site = find_site(
+        atomic_load_explicit(&g_site_table[bucket], memory_order_relaxed),
+        file,
+        line);
+    if (!site)
+    {
+        site = mm_alloc_tagged(sizeof(AllocSite_T), 0);
+        if (site)
+        {
+            AllocSite_T * newest = atomic_load_explicit(&g_newest_site,
+                                                        memory_order_relaxed);
+            memset(site, 0, sizeof(AllocSite_T));
+            site->file  = file;
+            site->line  = line;
+            site->id    = newest ? newest->id + 1 : 0;
+            site->older = newest;
+            site->next  = atomic_load_explicit(&g_site_table[bucket],
+                                              memory_order_relaxed);
+            atomic_store_explicit(
+                &g_site_table[bucket], site, memory_order_release);
+            atomic_store_explicit(&g_newest_site, site, memory_order_release);
+        }
+    }
+    pthread_mutex_unlock(&g_site_mutex);
+
+    return site;
+}
+
+/* Raise the site's peak to live if it is higher. */
+static void
+update_peak(AllocSite_T * site, int64_t live)
+{
+    int64_t peak = atomic_load_explicit(&site->peak_bytes, memory_order_relaxed);
+    while (live > peak
+           && !atomic_compare_exchange_weak_explicit(&site->peak_bytes,
+                                                     &peak,
+                                                     live,
+                                                     memory_order_relaxed,
+                                                     memory_order_relaxed))
+    {
+    }
+}
+
+void
+mm_site_alloc(struct AllocSite_Tag * site, size_t bytes, size_t count)
+{
+    if (!site)
+    {
+        return;
+    }
+
+    int64_t live = atomic_fetch_add_explicit(
+                       &site->live_bytes, (int64_t)bytes, memory_order_relaxed)
+                   + (int64_t)bytes;
+    atomic_fetch_add_explicit(
+        &site->live_count, (int64_t)count, memory_order_relaxed);
+    atomic_fetch_add_explicit(&site->total_allocs, count, memory_order_relaxed);
+    atomic_fetch_add_explicit(&site->total_bytes, bytes, memory_order_relaxed);
+    update_peak(site, live);
+}
+
+void
+mm_site_resize(struct AllocSite_Tag * site, size_t old_bytes, size_t new_bytes)
+{
+    if (!site)
+    {
+        return;
+    }
+
+    int64_t delta = (int64_t)new_bytes - (int64_t)old_bytes;
+    int64_t live
+        = atomic_fetch_add_explicit(&site->live_bytes, delta, memory_order_relaxed)
+          + delta;
+    if (delta > 0)
+    {
+        atomic_fetch_add_explicit(
+            &site->total_bytes, (uint64_t)delta, memory_order_relaxed);
+        update_peak(site, live);
+    }
+}
+
+void
+mm_site_free(struct AllocSite_Tag * site, size_t bytes, size_t count)
+{
+    if (!site)
+    {
+        return;
+    }
+
+    atomic_fetch_sub_explicit(
+        &site->live_bytes, (int64_t)bytes, memory_order_relaxed);
+    atomic_fetch_sub_explicit(
+        &site->live_count, (int64_t)count, memory_order_relaxed);
+}
+
+MemSnapshot_T *
+CustomSnapshot(void)
+{
+    MemSnapshot_T * snapshot = calloc(1, sizeof(MemSnapshot_T));
+    if (!snapshot)
+    {
+        return NULL;
+    }
+
+    AllocSite_T * site
+        = atomic_load_explicit(&g_newest_site, memory_order_acquire);
+    if (!site)
+    {
+        return snapshot;
+    }
+
+    snapshot->count = (size_t)site->id + 1;
+    snapshot->sites = calloc(snapshot->count, sizeof(MemSiteStats_T));
+    if (!snapshot->sites)
+    {
+        free(snapshot);
+        return NULL;
+    }
+
+    /* Sites are created with consecutive ids, so each lands in its own slot
+     * and the array ends up ordered by id. */
+    for (; site; site = site->older)
+    {
+        MemSiteStats_T * stats = &snapshot->sites[site->id];
+        stats->file            = site->file;
+        stats->line            = site->line;
+        stats->id              = site->id;
+        stats->live_bytes
+            = atomic_load_explicit(&site->live_bytes, memory_order_relaxed);
+        stats->live_count
+            = atomic_load_explicit(&site->live_count, memory_order_relaxed);
+        stats->total_allocs
+            = atomic_load_explicit(&site->total_allocs, memory_order_relaxed);
+        stats->total_bytes
+            = atomic_load_explicit(&site->total_bytes, memory_order_relaxed);
+        stats->peak_bytes
+            = atomic_load_explicit(&site->peak_bytes, memory_order_relaxed);
+    }
+
+    return snapshot;
+}
+
+static int
+compare_growth(const void * lhs, const void * rhs)
+{
+    const MemSiteStats_T * a = lhs;
+    const MemSiteStats_T * b = rhs;
+    if (a->live_bytes != b->live_bytes)
+    {
+        return (a->live_bytes < b->live_bytes) ? 1 : -1;
+    }
+    return (a->id > b->id) - (a->id < b->id);
+}
+
+MemSnapshot_T *
+CustomSnapshotDiff(const MemSnapshot_T * before, const MemSnapshot_T * after)
+{
+    if (!before || !after)
+    {
+        return NULL;
+    }
+
+    MemSnapshot_T * diff = calloc(1, sizeof(MemSnapshot_T));
+    if (!diff)
+    {
+        return NULL;
+    }
+    if (!after->count)
+    {
+        return diff;
+    }
+
+    diff->sites = calloc(after->count, sizeof(MemSiteStats_T));
+    if (!diff->sites)
+    {
+        free(diff);
+        return NULL;
+    }
+
+    /* Both snapshots are indexed by site id, and a site present in the
+     * earlier snapshot is present in the later one. */
+    for (size_t i = 0; i < after->count; i++)
+    {
+        MemSiteStats_T delta = after->sites[i];
+        if (i < before->count)
+        {
+            delta.live_bytes -= before->sites[i].live_bytes;
+            delta.live_count -= before->sites[i].live_count;
+            delta.total_allocs -= before->sites[i].total_allocs;
+            delta.total_bytes -= before->sites[i].total_bytes;
+        }
+        if (delta.live_bytes || delta.live_count || delta.total_allocs)
+        {
+            diff->sites[diff->count++] = delta;
+        }
+    }
+
+    qsort(diff->sites, diff->count, sizeof(MemSiteStats_T), compare_growth);
+    return diff;
+}
+
+void
+CustomSnapshotFree(MemSnapshot_T * snapshot)
+{
+    if (snapshot)
+    {
+        free(snapshot->sites);
+        free(snapshot);
+    }
+}
+
+void
+PrintMemorySites(void)
+{
+    MemSnapshot_T * snapshot = CustomSnapshot();
+    if (!snapshot)
+    {
+        return;
+    }
+
+    qsort(snapshot->sites,
+          snapshot->count,
+          sizeof(MemSiteStats_T),
+          compare_growth);
+    for (size_t i = 0; i < snapshot->count; i++)
+    {
+        const MemSiteStats_T * stats = &snapshot->sites[i];
+        if (!stats->live_count)
+        {
+            continue;
+        }
+        printf("Site %s:%d: %lld bytes in %lld blocks live, %llu allocs, "
+               "peak %lld bytes\n",
+               stats->file,
+               stats->line,
+               (long long)stats->live_bytes,
+               (long long)stats->live_count,
+               (unsigned long long)stats->total_allocs,
+               (long long)stats->peak_bytes);
+    }
+
+    CustomSnapshotFree(snapshot);
+}
+
+#else /* MEM_MGMT_NO_TRACKING */
+
+MemSnapshot_T *
+CustomSnapshot(void)
+{
+    return calloc(1, sizeof(MemSnapshot_T));
+}
+
+MemSnapshot_T *
+CustomSnapshotDiff(const MemSnapshot_T * before, const MemSnapshot_T * after)
+{
+    (void)before;
+    (void)after;
+    return calloc(1, sizeof(MemSnapshot_T));
+}
+
+void
+CustomSnapshotFree(MemSnapshot_T * snapshot)
+{
+    free(snapshot);
+}
+
+void
+PrintMemorySites(void)
+{
+}
+
+#endif /* MEM_MGMT_NO_TRACKING */
@@ -0,0 +1,198 @@
+/**
+ * @file
+ * @brief Interned table of allocation call stacks.
+ *
+ * Identical call stacks are stored once and referred to by a 32-bit id, so a
+ * tracked allocation only carries that id. Stacks are kept as raw return
+ * addresses and are only turned into symbols when a report is printed.
+ *
+ * Entries are never removed. Lookups by hash and by id walk the table
+ * without a lock; only inserting a new stack takes a mutex.
+ */
+
+#include "mem-internal.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+
+#ifndef MEM_MGMT_NO_TRACKING
+
+/** @brief Number of buckets in the stack hash table. */
+#define STACK_TABLE_SIZE 16384
+
+/** @brief Number of id slots per chunk of the id directory. */
+#define STACK_CHUNK_SIZE 1024
+
+/** @brief Number of chunks in the id directory; caps the number of stacks. */
+#define STACK_DIR_SIZE 1024
+
+/** @brief An interned call stack. */
+typedef struct StackEntry_Tag
+{
+    uint64_t                hash;     /**< Hash of the frames. */
+    uint32_t                id;       /**< Id handed out for the stack. */
+    uint32_t                depth;    /**< Number of frames. */
+    struct StackEntry_Tag * next;     /**< Next entry in the same bucket. */
+    void *                  frames[]; /**< Return addresses, innermost first. */
+} StackEntry_T;
+
+/** @brief Hash table of interned stacks. */
+static _Atomic(StackEntry_T *) g_stack_table[STACK_TABLE_SIZE];
+
+/** @brief Two level directory mapping stack ids to entries. */
+static _Atomic(_Atomic(StackEntry_T *) *) g_stack_dir[STACK_DIR_SIZE];
+
+/** @brief Next id to hand out. Id 0 means "no stack". */
+static uint32_t g_next_stack_id = 1;
+
+/** @brief Mutex serializing the insertion of stacks. */
+static pthread_mutex_t g_stack_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t
+hash_frames(void * const * frames, int depth)
+{
+    uint64_t hash = (uint64_t)depth;
+    for (int i = 0; i < depth; i++)
+    {
+        hash ^= (uint64_t)(uintptr_t)frames[i];
+        hash *= 0x9E3779B97F4A7C15ULL;
+        hash ^= hash >> 29;
+    }
+    return hash;
+}
+
+static StackEntry_T *
+find_stack(StackEntry_T * entry,
+           uint64_t       hash,
+           void * const * frames,
+           int            depth)
+{
+    for (; entry; entry = entry->next)
+    {
+        if (entry->hash == hash && entry->depth == (uint32_t)depth
+            && !memcmp(entry->frames, frames, (size_t)depth * sizeof(void *)))
+        {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+/* Publish an entry under a fresh id. Called with g_stack_mutex held. */
+static uint32_t
+assign_id(StackEntry_T * entry)
+{
+    uint32_t id    = g_next_stack_id;
+    uint32_t chunk = id / STACK_CHUNK_SIZE;
+    if (chunk >= STACK_DIR_SIZE)
+    {
+        return 0;
+    }
+
+    _Atomic(StackEntry_T *) * slots
+        = atomic_load_explicit(&g_stack_dir[chunk], memory_order_relaxed);
+    if (!slots)
+    {
+        slots = mm_alloc_tagged(STACK_CHUNK_SIZE * sizeof(*slots), 0);
+        if (!slots)
+        {
+            return 0;
+        }
+        memset(slots, 0, STACK_CHUNK_SIZE * sizeof(*slots));
+        atomic_store_explicit(&g_stack_dir[chunk], slots, memory_order_release);
+    }
+
+    entry->id = id;
+    atomic_store_explicit(
+        &slots[id % STACK_CHUNK_SIZE], entry, memory_order_release);
+    g_next_stack_id++;
+    return id;
+}
+
+uint32_t
+mm_stack_intern(void * const * frames, int depth)
+{
+    if (depth <= 0)
+    {
+        return 0;
+    }
+
+    uint64_t       hash   = hash_frames(frames, depth);
+    size_t         bucket = (size_t)(hash % STACK_TABLE_SIZE);
+    StackEntry_T * entry  = find_stack(
+        atomic_load_explicit(&g_stack_table[bucket], memory_order_acquire),
+        hash,
+        frames,
+        depth);
+    if (entry)
+    {
+        return entry->id;
+    }
+
+    uint32_t id = 0;
+    pthread_mutex_lock(&g_stack_mutex);
+    entry = find_stack(
+        atomic_load_explicit(&g_stack_table[bucket], memory_order_relaxed),
+        hash,
+        frames,
+        depth);
+    if (entry)
+    {
+        id = entry->id;
+    }
+    else
+    {
+        entry = mm_alloc_tagged(
+            sizeof(StackEntry_T) + (size_t)depth * sizeof(void *), 0);
+        if (entry)
+        {
+            entry->hash  = hash;
+            entry->depth = (uint32_t)depth;
+            memcpy(entry->frames, frames, (size_t)depth * sizeof(void *));
+            id = assign_id(entry);
+            if (id)
+            {
+                entry->next = atomic_load_explicit(&g_stack_table[bucket],
+                                                   memory_order_relaxed);
+                atomic_store_explicit(
+                    &g_stack_table[bucket], entry, memory_order_release);
+            }
+            else
+            {
+                mm_free(entry);
+            }
+        }
+    }
+    pthread_mutex_unlock(&g_stack_mutex);
+
+    return id;
+}
+
+int
+mm_stack_get(uint32_t id, void * const ** frames)
+{
+    uint32_t chunk = id / STACK_CHUNK_SIZE;
+    if (!id || chunk >= STACK_DIR_SIZE)
+    {
+        return 0;
+    }
+
+    _Atomic(StackEntry_T *) * slots
+        = atomic_load_explicit(&g_stack_dir[chunk], memory_order_acquire);
+    if (!slots)
+    {
+        return 0;
+    }
+
+    StackEntry_T * entry = atomic_load_explicit(&slots[id % STACK_CHUNK_SIZE],
+                                                memory_order_acquire);
+    if (!entry)
+    {
+        return 0;
+    }
+
+    *frames = entry->frames;
+    return (int)entry->depth;
+}
+
+#endif /* MEM_MGMT_NO_TRACKING */
@@ -0,0 +1,342 @@
+/**
+ * @file
+ * @brief Allocation tags with per-tag byte budgets.
+ *
+ * The allocator charges every block to the tag selected by its allocating
+ * thread. So that this costs no shared write per allocation, each thread
+ * collects its charges in a private delta per tag and only folds the delta
+ * into the tag's shared counter once it grows past TAG_FOLD_BYTES in either
+ * direction, when the thread exits, or on CustomThreadCacheFlush. The soft
+ * limit is checked when a charge is folded. The hard limit is checked on
+ * every charge, against the folded count plus the calling thread's own
+ * delta, which costs a shared read but no shared write; only the other
+ * threads' unfolded deltas, each under TAG_FOLD_BYTES, can take a tag past
+ * it.
+ */
+
+#include "../include/mem-mgmt.h"
+#include "mem-internal.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+
+/** @brief Size of the per-thread delta that triggers a fold. */
+#define TAG_FOLD_BYTES (64 * 1024)
+
+/** @brief Shared state of one allocation tag. */
+typedef struct TagState_Tag
+{
+    const char *               name;         /**< Name of the tag. */
+    _Atomic int64_t            live_bytes;   /**< Folded live byte count. */
+    _Atomic int64_t            peak_bytes;   /**< Highest folded live bytes. */
+    _Atomic int64_t            soft_limit;   /**< Soft limit, 0 for none. */
+    _Atomic int64_t            hard_limit;   /**< Hard limit, 0 for none. */
+    _Atomic uint64_t           denied;       /**< Allocations refused. */
+    atomic_bool                over_soft;    /**< Soft limit reported. */
+    _Atomic(MemTagLimitFunc_T) callback;     /**< Limit callback. */
+    _Atomic(void *)            callback_arg; /**< Argument of the callback. */
+} TagState_T;
+
+/** @brief Tag states, indexed by tag. Tag 0 is never charged. */
+static TagState_T g_tags[MEM_TAG_COUNT];
+
+/** @brief Number of tags handed out, tag 0 included. */
+static _Atomic uint32_t g_tag_count = 1;
+
+/** @brief Mutex serializing the creation of tags. */
+static pthread_mutex_t g_tag_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/** @brief Key whose destructor folds a thread's deltas when it exits. */
+static pthread_key_t g_tag_key;
+
+/** @brief Guards creation of g_tag_key. */
+static pthread_once_t g_tag_once = PTHREAD_ONCE_INIT;
+
+_Thread_local uint32_t mm_thread_tag = 0;
+
+/** @brief Charges not yet folded into the shared counters. */
+static _Thread_local int64_t t_tag_delta[MEM_TAG_COUNT];
+
+/** @brief Whether the thread exit hook is armed for the calling thread. */
+static _Thread_local bool t_tag_exit_armed = false;
+
+/** @brief Non-zero while the calling thread runs a limit callback. */
+static _Thread_local int t_in_callback = 0;
+
+static void
+tag_thread_exit(void * arg)
+{
+    (void)arg;
+    /* Destructors registered after this one may still free tagged blocks;
+     * disarming lets them set the key again so those credits get folded on
+     * the next destructor round. */
+    t_tag_exit_armed = false;
+    mm_tag_flush();
+}
+
+static void
+tag_init_once(void)
+{
+    pthread_key_create(&g_tag_key, tag_thread_exit);
+}
+
+/* Make sure the calling thread folds its deltas before it exits. */
+static void
+arm_exit_hook(void)
+{
+    pthread_once(&g_tag_once, tag_init_once);
+    t_tag_exit_armed = true;
+    pthread_setspecific(g_tag_key, &t_tag_exit_armed);
+}
+
+static void
+notify(TagState_T * state, uint32_t tag, int64_t live, bool hard)
+{
+    MemTagLimitFunc_T callback
+        = atomic_load_explicit(&state->callback, memory_order_acquire);
+    if (!callback)
+    {
+        return;
+    }
+
+    t_in_callback++;
+    callback(tag,
+             live,
+             hard,
+             atomic_load_explicit(&state->callback_arg, memory_order_relaxed));
+    t_in_callback--;
+}
+
+/* Raise the tag's peak to live if it is higher. */
+static void
+update_peak(TagState_T * state, int64_t live)
+{
+    int64_t peak = atomic_load_explicit(&state->peak_bytes, memory_order_relaxed);
+    while (live > peak
+           && !atomic_compare_exchange_weak_explicit(&state->peak_bytes,
+                                                     &peak,
+                                                     live,
+                                                     memory_order_relaxed,
+                                                     memory_order_relaxed))
+    {
+    }
+}
+
+/* Count a charge refused by the hard limit, live bytes being the tag's
+ * usage as the charging thread sees it without the refused charge. */
+static void
+refuse(uint32_t tag, int64_t live)
+{
+    TagState_T * state = &g_tags[tag];
+
+    atomic_fetch_add_explicit(&state->denied, 1, memory_order_relaxed);
+    notify(state, tag, live, true);
+}
+
+/* Fold delta into the shared counter of tag. pending is the part of delta
+ * belonging to an allocation that the hard limit may still refuse; the rest
+ * was checked when it was charged. */
+static bool
+fold(uint32_t tag, int64_t delta, int64_t pending)
+{
+    TagState_T * state = &g_tags[tag];
+    int64_t      live
+        = atomic_fetch_add_explicit(&state->live_bytes, delta, memory_order_relaxed)
+          + delta;
+
+    int64_t hard = atomic_load_explicit(&state->hard_limit, memory_order_relaxed);
+    if (pending && hard && live > hard && !t_in_callback)
+    {
+        live = atomic_fetch_sub_explicit(
+                   &state->live_bytes, pending, memory_order_relaxed)
+               - pending;
+        update_peak(state, live);
+        refuse(tag, live);
+        return false;
+    }
+    update_peak(state, live);
+
+    int64_t soft = atomic_load_explicit(&state->soft_limit, memory_order_relaxed);
+    if (soft && live > soft)
+    {
+        if (!atomic_exchange_explicit(
+                &state->over_soft, true, memory_order_relaxed))
+        {
+            notify(state, tag, live, false);
+        }
+    }
+    else if (atomic_load_explicit(&state->over_soft, memory_order_relaxed))
+    {
+        atomic_store_explicit(&state->over_soft, false, memory_order_relaxed);
+    }
+    return true;
+}
+
+bool
+mm_tag_charge(uint32_t tag, size_t bytes)
+{
+    TagState_T * state = &g_tags[tag];
+    int64_t      delta = t_tag_delta[tag] + (int64_t)bytes;
+
+    int64_t hard = atomic_load_explicit(&state->hard_limit, memory_order_relaxed);
+    if (hard && !t_in_callback)
+    {
+        int64_t live
+            = atomic_load_explicit(&state->live_bytes, memory_order_relaxed)
+              + t_tag_delta[tag];
+        if (live + (int64_t)bytes > hard)
+        {
+            refuse(tag, live);
+            return false;
+        }
+    }
+
+    if (delta < TAG_FOLD_BYTES)
+    {
+        t_tag_delta[tag] = delta;
+        if (!t_tag_exit_armed)
+        {
+            arm_exit_hook();
+        }
+        return true;
+    }
+
+    t_tag_delta[tag] = 0;
+    return fold(tag, delta, (int64_t)bytes);
+}
+
+void
+mm_tag_discharge(uint32_t tag, size_t bytes)
+{
+    int64_t delta = t_tag_delta[tag] - (int64_t)bytes;
+    if (delta > -TAG_FOLD_BYTES)
+    {
+        t_tag_delta[tag] = delta;
+        if (!t_tag_exit_armed)
+        {
+            arm_exit_hook();
+        }
+        return;
+    }
+
+    t_tag_delta[tag] = 0;
+    fold(tag, delta, 0);
+}
+
+void
+mm_tag_flush(void)
+{
+    uint32_t count = atomic_load_explicit(&g_tag_count, memory_order_acquire);
+    for (uint32_t tag = 1; tag < count; tag++)
+    {
+        int64_t delta = t_tag_delta[tag];
+        if (delta)
+        {
+            t_tag_delta[tag] = 0;
+            fold(tag, delta, 0);
+        }
+    }
+}
+
+static bool
+valid_tag(uint32_t tag)
+{
+    return tag && tag < atomic_load_explicit(&g_tag_count, memory_order_acquire);
+}
+
+uint32_t
+CustomTagCreate(const char * name)
+{
+    uint32_t tag = 0;
+
+    pthread_mutex_lock(&g_tag_mutex);
+    uint32_t count = atomic_load_explicit(&g_tag_count, memory_order_relaxed);
+    if (count < MEM_TAG_COUNT)
+    {
+        tag              = count;
+        g_tags[tag].name = name;
+        atomic_store_explicit(&g_tag_count, count + 1, memory_order_release);
+    }
+    pthread_mutex_unlock(&g_tag_mutex);
+
+    return tag;
+}
+
+uint32_t
+CustomTagSwitch(uint32_t tag)
+{
+    uint32_t previous = mm_thread_tag;
+    if (!tag || valid_tag(tag))
+    {
+        mm_thread_tag = tag;
+    }
+    return previous;
+}
+
+int
+CustomTagSetLimits(uint32_t          tag,
+                   int64_t           soft_limit,
+                   int64_t           hard_limit,
+                   MemTagLimitFunc_T callback,
+                   void *            arg)
+{
+    if (!valid_tag(tag))
+    {
+        return -1;
+    }
+
+    TagState_T * state = &g_tags[tag];
+    atomic_store_explicit(&state->callback_arg, arg, memory_order_relaxed);
+    atomic_store_explicit(&state->callback, callback, memory_order_release);
+    atomic_store_explicit(&state->soft_limit, soft_limit, memory_order_relaxed);
+    atomic_store_explicit(&state->hard_limit, hard_limit, memory_order_relaxed);
+    atomic_store_explicit(&state->over_soft, false, memory_order_relaxed);
+    return 0;
+}
+
+int
+CustomTagGetStats(uint32_t tag, MemTagStats_T * stats)
+{
+    if (!valid_tag(tag) || !stats)
+    {
+        return -1;
+    }
+
+    mm_tag_flush();
+
+    TagState_T * state = &g_tags[tag];
+    stats->name        = state->name;
+    stats->live_bytes
+        = atomic_load_explicit(&state->live_bytes, memory_order_relaxed);
+    stats->peak_bytes
+        = atomic_load_explicit(&state->peak_bytes, memory_order_relaxed);
+    stats->soft_limit
+        = atomic_load_explicit(&state->soft_limit, memory_order_relaxed);
+    stats->hard_limit
+        = atomic_load_explicit(&state->hard_limit, memory_order_relaxed);
+    stats->denied_allocs
+        = atomic_load_explicit(&state->denied, memory_order_relaxed);
+    return 0;
+}
+
+void
+PrintMemoryTags(void)
+{
+    uint32_t count = atomic_load_explicit(&g_tag_count, memory_order_acquire);
+    for (uint32_t tag = 1; tag < count; tag++)
+    {
+        MemTagStats_T stats;
+        if (CustomTagGetStats(tag, &stats))
+        {
+            continue;
+        }
+        printf("Tag %s: %lld bytes live, peak %lld bytes, soft limit %lld, "
+               "hard limit %lld, %llu allocations denied\n",
+               stats.name,
+               (long long)stats.live_bytes,
+               (long long)stats.peak_bytes,
+               (long long)stats.soft_limit,
+               (long long)stats.hard_limit,
+               (unsigned long long)stats.denied_allocs);
+    }
+}
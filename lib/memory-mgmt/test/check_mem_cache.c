@@ -0,0 +1,219 @@
+/** @file check_mem_cache.c
+ *
+ * @brief Tests for the thread caches and block ownership: blocks freed by
+ *        other threads, caches adopted from exited threads, and pointers
+ *        the library never handed out.
+ *
+ */
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+
+#include "../include/mem-mgmt.h"
+#include "../src/mem-internal.h"
+#include "check_mem_mgmt.h"
+
+#define BLOCK_COUNT 256
+#define BLOCK_SIZE 48
+#define LARGE_SIZE (1 << 20)
+
+/* Allocations a cache may hand out from its bin and the depot before it
+ * gets round to blocks freed into it by other threads. */
+#define MAX_DETOUR 8192
+
+typedef struct
+{
+    void *                   blocks[BLOCK_COUNT];
+    struct ThreadCache_Tag * owner;
+    size_t                   reclaimed;
+} Batch_T;
+
+static bool
+in_batch(const Batch_T * batch, const void * ptr)
+{
+    for (size_t i = 0; i < BLOCK_COUNT; i++)
+    {
+        if (batch->blocks[i] == ptr)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Allocate until every block of the batch has come back, or give up after
+ * MAX_DETOUR others, and free everything again. */
+static size_t
+reclaim(const Batch_T * batch)
+{
+    void ** taken    = malloc((BLOCK_COUNT + MAX_DETOUR) * sizeof(void *));
+    size_t  count    = 0;
+    size_t  returned = 0;
+
+    ck_assert_ptr_nonnull(taken);
+    while (returned < BLOCK_COUNT && count < BLOCK_COUNT + MAX_DETOUR)
+    {
+        taken[count] = CustomFastMalloc(BLOCK_SIZE);
+        ck_assert_ptr_nonnull(taken[count]);
+        if (in_batch(batch, taken[count]))
+        {
+            returned++;
+        }
+        count++;
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        CustomFastFree(taken[i]);
+    }
+    free(taken);
+    return returned;
+}
+
+static void *
+allocate_batch(void * arg)
+{
+    Batch_T * batch = arg;
+
+    for (size_t i = 0; i < BLOCK_COUNT; i++)
+    {
+        batch->blocks[i] = CustomFastMalloc(BLOCK_SIZE);
+        ck_assert_ptr_nonnull(batch->blocks[i]);
+    }
+    batch->owner = MM_HEADER(batch->blocks[0])->owner;
+    return NULL;
+}
+
+static void *
+free_batch(void * arg)
+{
+    Batch_T * batch = arg;
+
+    for (size_t i = 0; i < BLOCK_COUNT; i++)
+    {
+        CustomFastFree(batch->blocks[i]);
+    }
+    return NULL;
+}
+
+static void *
+adopt_and_reclaim(void * arg)
+{
+    Batch_T * batch = arg;
+    void *    probe = CustomFastMalloc(BLOCK_SIZE);
+
+    ck_assert_ptr_nonnull(probe);
+    ck_assert_ptr_eq(MM_HEADER(probe)->owner, batch->owner);
+    CustomFastFree(probe);
+    batch->reclaimed = reclaim(batch);
+    return NULL;
+}
+
+START_TEST(test_remote_free_is_reclaimed)
+{
+    Batch_T   batch = { 0 };
+    pthread_t freer;
+
+    allocate_batch(&batch);
+    ck_assert_int_eq(pthread_create(&freer, NULL, free_batch, &batch), 0);
+    ck_assert_int_eq(pthread_join(freer, NULL), 0);
+
+    ck_assert_uint_eq(reclaim(&batch), BLOCK_COUNT);
+}
+END_TEST
+
+START_TEST(test_orphan_cache_is_adopted)
+{
+    Batch_T   batch = { 0 };
+    pthread_t thread;
+
+    /* The allocating thread exits and leaves its cache on the orphan list.
+     * Its blocks, freed here, go to that cache's remote-free list. */
+    ck_assert_int_eq(pthread_create(&thread, NULL, allocate_batch, &batch), 0);
+    ck_assert_int_eq(pthread_join(thread, NULL), 0);
+    free_batch(&batch);
+
+    /* The next thread to allocate adopts the cache and its blocks. */
+    ck_assert_int_eq(
+        pthread_create(&thread, NULL, adopt_and_reclaim, &batch), 0);
+    ck_assert_int_eq(pthread_join(thread, NULL), 0);
+    ck_assert_uint_eq(batch.reclaimed, BLOCK_COUNT);
+}
+END_TEST
+
+START_TEST(test_foreign_pointers_are_ignored)
+{
+    void * system = malloc(BLOCK_SIZE);
+    char   stack[64];
+    char * page = mmap(NULL,
+                       4096,
+                       PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS,
+                       -1,
+                       0);
+
+    ck_assert_ptr_nonnull(system);
+    ck_assert_ptr_ne(page, MAP_FAILED);
+    ck_assert(!mm_owns(system));
+    ck_assert(!mm_owns(stack + 16));
+    ck_assert(!mm_owns(page + 16));
+
+    CustomFree(system);
+    CustomFastFree(system);
+    CustomFree(page + 16);
+    CustomFastFree(stack + 16);
+    ck_assert_ptr_null(CustomRealloc(system, 128, __FILE__, __LINE__));
+    ck_assert_ptr_null(CustomFastRealloc(page + 16, 128));
+
+    free(system);
+    munmap(page, 4096);
+}
+END_TEST
+
+START_TEST(test_owned_blocks_are_recognised)
+{
+    void * small   = CustomFastMalloc(BLOCK_SIZE);
+    void * tracked = CustomMalloc(BLOCK_SIZE, __FILE__, __LINE__);
+    void * large   = CustomFastMalloc(LARGE_SIZE);
+
+    ck_assert(mm_owns(small));
+    ck_assert(mm_owns(tracked));
+    ck_assert(mm_owns(large));
+
+    /* Grow the large block until mremap has to move it. */
+    for (size_t size = 2 * LARGE_SIZE; size <= 64 * LARGE_SIZE; size *= 2)
+    {
+        void * grown = CustomFastRealloc(large, size);
+        ck_assert_ptr_nonnull(grown);
+        ck_assert(mm_owns(grown));
+        if (grown != large)
+        {
+            ck_assert(!mm_owns(large));
+        }
+        large = grown;
+    }
+
+    CustomFastFree(small);
+    CustomFree(tracked);
+    CustomFastFree(large);
+    ck_assert(!mm_owns(large));
+}
+END_TEST
+
+Suite *
+check_mem_cache_suite(void)
+{
+    Suite * suite      = suite_create("mem_cache_test");
+    TCase * tc_threads = tcase_create("Threads");
+    TCase * tc_owners  = tcase_create("Ownership");
+
+    tcase_add_test(tc_threads, test_remote_free_is_reclaimed);
+    tcase_add_test(tc_threads, test_orphan_cache_is_adopted);
+    tcase_add_test(tc_owners, test_foreign_pointers_are_ignored);
+    tcase_add_test(tc_owners, test_owned_blocks_are_recognised);
+
+    suite_add_tcase(suite, tc_threads);
+    suite_add_tcase(suite, tc_owners);
+    return suite;
+}
@@ -0,0 +1,400 @@
+/** @file check_mem_dump.c
+ *
+ * @brief Tests for binary heap dumps: the records written for tracked
+ *        blocks read back as described in mem-dump.h, and the analyzer
+ *        summarizes them and turns away corrupt dumps.
+ *
+ * The analyzer is run from the module directory, where make check runs
+ * the tests.
+ *
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../include/mem-dump.h"
+#include "../include/mem-mgmt.h"
+#include "check_mem_mgmt.h"
+
+#define ANALYZER "bin/mem-dump-analyze"
+#define BLOCK_COUNT 16
+#define BLOCK_SIZE 300
+#define COMMAND_SIZE 512
+#define MAX_FILES 256
+#define OUTPUT_SIZE 4096
+
+static const char g_dump_site[] = "dump-test.c";
+static const char g_dump_tag[]  = "dump-test-tag";
+
+#define DUMP_LINE 42
+
+typedef struct
+{
+    unsigned char * data;
+    size_t          size;
+} File_T;
+
+/* Create an empty temporary file, its name written to path. */
+static void
+make_temp(char * path, size_t size)
+{
+    snprintf(path, size, "/tmp/check_mem_dump_XXXXXX");
+    int fd = mkstemp(path);
+    ck_assert_int_ge(fd, 0);
+    close(fd);
+}
+
+static void
+read_file(const char * path, File_T * file)
+{
+    FILE * stream = fopen(path, "rb");
+    ck_assert_ptr_nonnull(stream);
+    ck_assert_int_eq(fseek(stream, 0, SEEK_END), 0);
+    long length = ftell(stream);
+    ck_assert_int_gt(length, 0);
+    rewind(stream);
+
+    file->size = (size_t)length;
+    file->data = malloc(file->size);
+    ck_assert_ptr_nonnull(file->data);
+    ck_assert_uint_eq(fread(file->data, 1, file->size, stream), file->size);
+    fclose(stream);
+}
+
+static void
+write_file(const char * path, const unsigned char * data, size_t size)
+{
+    FILE * stream = fopen(path, "wb");
+    ck_assert_ptr_nonnull(stream);
+    ck_assert_uint_eq(fwrite(data, 1, size, stream), size);
+    ck_assert_int_eq(fclose(stream), 0);
+}
+
+/* Run the analyzer on a dump with the given options, stderr included in
+ * output, and return its exit status. */
+static int
+analyze(const char * options, const char * path, char * output)
+{
+    char command[COMMAND_SIZE];
+    snprintf(command,
+             sizeof(command),
+             "%s %s %s 2>&1",
+             ANALYZER,
+             options,
+             path);
+
+    FILE * pipe = popen(command, "r");
+    ck_assert_ptr_nonnull(pipe);
+    size_t length  = fread(output, 1, OUTPUT_SIZE - 1, pipe);
+    output[length] = '\0';
+    return pclose(pipe);
+}
+
+/* Offset of the first record of a type in a dump, 0 if there is none. */
+static size_t
+find_record(const File_T * file, uint32_t type)
+{
+    size_t offset = sizeof(MemDumpHeader_T);
+    while (offset + sizeof(MemDumpRecord_T) <= file->size)
+    {
+        MemDumpRecord_T record;
+        memcpy(&record, file->data + offset, sizeof(record));
+        if (record.type == type)
+        {
+            return offset;
+        }
+        offset += sizeof(record) + record.length;
+    }
+    return 0;
+}
+
+/* Allocate the test's blocks under its tag, with their stacks. */
+static uint32_t
+allocate_blocks(void ** blocks)
+{
+    static uint32_t tag = 0;
+    if (!tag)
+    {
+        tag = CustomTagCreate(g_dump_tag);
+    }
+    ck_assert_uint_ne(tag, 0);
+
+    uint32_t previous = CustomTagSwitch(tag);
+    CustomSetStackCapture(true);
+    for (size_t i = 0; i < BLOCK_COUNT; i++)
+    {
+        blocks[i] = CustomMalloc(BLOCK_SIZE, g_dump_site, DUMP_LINE);
+        ck_assert_ptr_nonnull(blocks[i]);
+    }
+    CustomSetStackCapture(false);
+    CustomTagSwitch(previous);
+    return tag;
+}
+
+static void
+free_blocks(void ** blocks)
+{
+    for (size_t i = 0; i < BLOCK_COUNT; i++)
+    {
+        CustomFree(blocks[i]);
+    }
+}
+
+START_TEST(test_dump_reads_back)
+{
+    void *   blocks[BLOCK_COUNT];
+    char     path[64];
+    uint32_t tag = allocate_blocks(blocks);
+    make_temp(path, sizeof(path));
+    ck_assert_int_eq(CustomHeapDumpFile(path), 0);
+    File_T file;
+    read_file(path, &file);
+    unlink(path);
+
+    MemDumpHeader_T header;
+    ck_assert_uint_ge(file.size, sizeof(header));
+    memcpy(&header, file.data, sizeof(header));
+    ck_assert_mem_eq(header.magic, MEM_DUMP_MAGIC, sizeof(header.magic));
+    ck_assert_uint_eq(header.version, MEM_DUMP_VERSION);
+    ck_assert_uint_eq(header.pid, (uint32_t)getpid());
+
+    /* Records are read in order: names and stacks must come before the
+     * blocks that refer to them. */
+    bool     files[MAX_FILES] = { false };
+    bool     tag_seen         = false;
+    bool     stack_seen       = false;
+    bool     ended            = false;
+    size_t   found            = 0;
+    uint64_t written          = 0;
+    uint32_t site_file        = UINT32_MAX;
+    size_t   offset           = sizeof(header);
+    size_t   stack_count      = 0;
+    uint32_t stacks[BLOCK_COUNT];
+    while (offset + sizeof(MemDumpRecord_T) <= file.size && !ended)
+    {
+        MemDumpRecord_T record;
+        memcpy(&record, file.data + offset, sizeof(record));
+        offset += sizeof(record);
+        ck_assert_uint_le(record.length, file.size - offset);
+        const unsigned char * payload = file.data + offset;
+        uint32_t              id      = 0;
+        if (record.length >= sizeof(id))
+        {
+            memcpy(&id, payload, sizeof(id));
+        }
+
+        switch (record.type)
+        {
+            case MEM_DUMP_FILE:
+                ck_assert_uint_lt(id, MAX_FILES);
+                files[id] = true;
+                if (record.length - sizeof(id) == strlen(g_dump_site)
+                    && !memcmp(payload + sizeof(id),
+                               g_dump_site,
+                               strlen(g_dump_site)))
+                {
+                    site_file = id;
+                }
+                break;
+            case MEM_DUMP_TAG:
+                if (id == tag)
+                {
+                    ck_assert_uint_eq(record.length - sizeof(id),
+                                      strlen(g_dump_tag));
+                    ck_assert_mem_eq(
+                        payload + sizeof(id), g_dump_tag, strlen(g_dump_tag));
+                    tag_seen = true;
+                }
+                break;
+            case MEM_DUMP_STACK:
+                if (stack_count < BLOCK_COUNT)
+                {
+                    stacks[stack_count++] = id;
+                }
+                break;
+            case MEM_DUMP_BLOCKS:
+                ck_assert_uint_eq(record.length % sizeof(MemDumpBlock_T), 0);
+                for (size_t i = 0; i < record.length / sizeof(MemDumpBlock_T);
+                     i++)
+                {
+                    MemDumpBlock_T block;
+                    memcpy(&block, payload + i * sizeof(block), sizeof(block));
+                    ck_assert_uint_lt(block.file_id, MAX_FILES);
+                    ck_assert(files[block.file_id]);
+                    written++;
+                    for (size_t j = 0; j < BLOCK_COUNT; j++)
+                    {
+                        if (block.address != (uintptr_t)blocks[j])
+                        {
+                            continue;
+                        }
+                        ck_assert_uint_eq(block.file_id, site_file);
+                        ck_assert_int_eq(block.line, DUMP_LINE);
+                        ck_assert_uint_eq(block.size, BLOCK_SIZE);
+                        ck_assert_uint_eq(block.weight, BLOCK_SIZE);
+                        ck_assert_uint_eq(block.tag, tag);
+                        ck_assert_uint_ne(block.stack_id, 0);
+                        for (size_t k = 0; k < stack_count; k++)
+                        {
+                            stack_seen |= stacks[k] == block.stack_id;
+                        }
+                        found++;
+                    }
+                }
+                break;
+            case MEM_DUMP_END:
+            {
+                uint64_t count = 0;
+                ck_assert_uint_eq(record.length, sizeof(count));
+                memcpy(&count, payload, sizeof(count));
+                ck_assert_uint_eq(count, written);
+                ended = true;
+                break;
+            }
+            default:
+                break;
+        }
+        offset += record.length;
+    }
+
+    ck_assert(ended);
+    ck_assert(tag_seen);
+    ck_assert(stack_seen);
+    ck_assert_uint_eq(found, BLOCK_COUNT);
+    ck_assert_uint_gt(find_record(&file, MEM_DUMP_MAPS), 0);
+    free(file.data);
+    free_blocks(blocks);
+}
+END_TEST
+
+START_TEST(test_analyzer_groups_blocks)
+{
+    void * blocks[BLOCK_COUNT];
+    char   path[64];
+    char   output[OUTPUT_SIZE];
+    char   expected[128];
+    allocate_blocks(blocks);
+    make_temp(path, sizeof(path));
+    ck_assert_int_eq(CustomHeapDumpFile(path), 0);
+
+    snprintf(expected,
+             sizeof(expected),
+             "%14d %10d  %s:%d\n",
+             BLOCK_COUNT * BLOCK_SIZE,
+             BLOCK_COUNT,
+             g_dump_site,
+             DUMP_LINE);
+    ck_assert_int_eq(analyze("-n 0", path, output), 0);
+    ck_assert_ptr_nonnull(strstr(output, expected));
+
+    snprintf(expected,
+             sizeof(expected),
+             "%14d %10d  %s\n",
+             BLOCK_COUNT * BLOCK_SIZE,
+             BLOCK_COUNT,
+             g_dump_tag);
+    ck_assert_int_eq(analyze("-t -n 0", path, output), 0);
+    ck_assert_ptr_nonnull(strstr(output, expected));
+
+    /* Blocks freed since the first dump show up as a loss in the diff. */
+    char after[64];
+    char paths[2 * sizeof(path) + 1];
+    make_temp(after, sizeof(after));
+    free_blocks(blocks);
+    ck_assert_int_eq(CustomHeapDumpFile(after), 0);
+    snprintf(paths, sizeof(paths), "%s %s", path, after);
+    snprintf(expected,
+             sizeof(expected),
+             "%+14d %+10d  %s:%d\n",
+             -BLOCK_COUNT * BLOCK_SIZE,
+             -BLOCK_COUNT,
+             g_dump_site,
+             DUMP_LINE);
+    ck_assert_int_eq(analyze("-n 0 -d", paths, output), 0);
+    ck_assert_ptr_nonnull(strstr(output, expected));
+
+    unlink(after);
+    unlink(path);
+}
+END_TEST
+
+START_TEST(test_analyzer_rejects_corrupt_dumps)
+{
+    void * blocks[BLOCK_COUNT];
+    char   path[64];
+    char   output[OUTPUT_SIZE];
+    allocate_blocks(blocks);
+    make_temp(path, sizeof(path));
+    ck_assert_int_eq(CustomHeapDumpFile(path), 0);
+    free_blocks(blocks);
+    File_T file;
+    read_file(path, &file);
+
+    /* A file id no dump can hold is refused rather than allocated for. */
+    size_t offset = find_record(&file, MEM_DUMP_FILE);
+    ck_assert_uint_gt(offset, 0);
+    uint32_t id = UINT32_MAX - 1;
+    memcpy(file.data + offset + sizeof(MemDumpRecord_T), &id, sizeof(id));
+    write_file(path, file.data, file.size);
+    ck_assert_int_ne(analyze("", path, output), 0);
+    ck_assert_ptr_nonnull(strstr(output, "corrupt record"));
+
+    /* So is a stack whose depth runs past its record. */
+    free(file.data);
+    ck_assert_int_eq(CustomHeapDumpFile(path), 0);
+    read_file(path, &file);
+    offset = find_record(&file, MEM_DUMP_STACK);
+    if (offset)
+    {
+        uint32_t depth = UINT32_MAX;
+        memcpy(file.data + offset + sizeof(MemDumpRecord_T) + sizeof(id),
+               &depth,
+               sizeof(depth));
+        write_file(path, file.data, file.size);
+        ck_assert_int_ne(analyze("", path, output), 0);
+        ck_assert_ptr_nonnull(strstr(output, "corrupt record"));
+    }
+
+    /* A record longer than the rest of the file marks a cut short dump,
+     * which is analyzed as far as it goes. */
+    free(file.data);
+    ck_assert_int_eq(CustomHeapDumpFile(path), 0);
+    read_file(path, &file);
+    MemDumpRecord_T record = { .type = MEM_DUMP_MAPS, .length = UINT32_MAX };
+    memcpy(file.data + sizeof(MemDumpHeader_T), &record, sizeof(record));
+    write_file(path, file.data, file.size);
+    ck_assert_int_eq(analyze("", path, output), 0);
+    ck_assert_ptr_nonnull(strstr(output, "truncated"));
+
+    write_file(path, file.data, file.size / 2);
+    ck_assert_int_eq(analyze("", path, output), 0);
+    ck_assert_ptr_nonnull(strstr(output, "truncated"));
+
+    /* Anything else is not a dump at all. */
+    write_file(path, (const unsigned char *)"not a dump", 10);
+    ck_assert_int_ne(analyze("", path, output), 0);
+    ck_assert_ptr_nonnull(strstr(output, "not a version"));
+
+    free(file.data);
+    unlink(path);
+}
+END_TEST
+
+Suite *
+check_mem_dump_suite(void)
+{
+    Suite * suite   = suite_create("mem_dump_test");
+    TCase * tc_dump = tcase_create("Dump");
+
+    tcase_add_test(tc_dump, test_dump_reads_back);
+    tcase_add_test(tc_dump, test_analyzer_groups_blocks);
+    tcase_add_test(tc_dump, test_analyzer_rejects_corrupt_dumps);
+    tcase_set_timeout(tc_dump, 30);
+
+    suite_add_tcase(suite, tc_dump);
+    return suite;
+}
@@ -0,0 +1,111 @@
+/** @file check_mem_fast.c
+ *
+ * @brief Tests for the MEM_MGMT_FAST build mode of callers: MALLOC and
+ *        friends come from the thread cache allocator, are not tracked, and
+ *        mix with blocks from the tracking functions.
+ *
+ */
+
+#define MEM_MGMT_FAST
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/mem-mgmt.h"
+#include "../src/mem-internal.h"
+#include "check_mem_mgmt.h"
+
+#define BLOCK_SIZE 200
+#define GROWN_SIZE 5000
+
+static const char g_fast_site[] = "fast-test";
+
+#define FAST_LINE 1
+
+/* Blocks live at all sites together. */
+static int64_t
+tracked_blocks(void)
+{
+    MemSnapshot_T * snapshot = CustomSnapshot();
+    int64_t         count    = 0;
+
+    ck_assert_ptr_nonnull(snapshot);
+    for (size_t i = 0; i < snapshot->count; i++)
+    {
+        count += snapshot->sites[i].live_count;
+    }
+    CustomSnapshotFree(snapshot);
+    return count;
+}
+
+START_TEST(test_fast_blocks_are_untracked)
+{
+    int64_t before = tracked_blocks();
+
+    unsigned char * data = MALLOC(BLOCK_SIZE);
+    ck_assert_ptr_nonnull(data);
+    ck_assert(mm_owns(data));
+    ck_assert(!(MM_HEADER(data)->flags & MM_FLAG_TRACKED));
+    ck_assert_int_eq(tracked_blocks(), before);
+
+    memset(data, 0x5A, BLOCK_SIZE);
+    data = REALLOC(data, GROWN_SIZE);
+    ck_assert_ptr_nonnull(data);
+    ck_assert(!(MM_HEADER(data)->flags & MM_FLAG_TRACKED));
+    for (size_t i = 0; i < BLOCK_SIZE; i++)
+    {
+        ck_assert_uint_eq(data[i], 0x5A);
+    }
+    ck_assert_int_eq(tracked_blocks(), before);
+    FREE(data);
+
+    unsigned char * zeroed = CALLOC(BLOCK_SIZE, 2);
+    ck_assert_ptr_nonnull(zeroed);
+    for (size_t i = 0; i < 2 * BLOCK_SIZE; i++)
+    {
+        ck_assert_uint_eq(zeroed[i], 0);
+    }
+    FREE(zeroed);
+    ck_assert_ptr_null(CALLOC(SIZE_MAX / 2, 4));
+    CLEAN(NULL);
+}
+END_TEST
+
+START_TEST(test_fast_free_releases_tracked_blocks)
+{
+    int64_t before = tracked_blocks();
+
+    /* A block from a tracking caller, resized and freed by a fast one,
+     * keeps its record up to date. */
+    void * data = CustomMalloc(BLOCK_SIZE, g_fast_site, FAST_LINE);
+    ck_assert_ptr_nonnull(data);
+    ck_assert_int_eq(tracked_blocks(), before + 1);
+    data = REALLOC(data, GROWN_SIZE);
+    ck_assert_ptr_nonnull(data);
+    ck_assert(MM_HEADER(data)->flags & MM_FLAG_TRACKED);
+    ck_assert_int_eq(tracked_blocks(), before + 1);
+    FREE(data);
+    ck_assert_int_eq(tracked_blocks(), before);
+
+    /* Pointers the library never handed out are ignored. */
+    void * foreign = malloc(BLOCK_SIZE);
+    ck_assert_ptr_nonnull(foreign);
+    ck_assert_ptr_null(REALLOC(foreign, GROWN_SIZE));
+    FREE(foreign);
+    free(foreign);
+}
+END_TEST
+
+Suite *
+check_mem_fast_suite(void)
+{
+    Suite * suite   = suite_create("mem_fast_test");
+    TCase * tc_fast = tcase_create("Fast");
+
+    tcase_add_test(tc_fast, test_fast_blocks_are_untracked);
+    tcase_add_test(tc_fast, test_fast_free_releases_tracked_blocks);
+
+    suite_add_tcase(suite, tc_fast);
+    return suite;
+}
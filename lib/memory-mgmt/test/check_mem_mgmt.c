@@ -0,0 +1,37 @@
+/** @file check_mem_mgmt.c
+ *
+ * @brief Runs every memory management test suite in one process.
+ *
+ * The library keeps process wide state, such as its thread caches, sites
+ * and tags, so the suites run without forking and each test puts back any
+ * setting it changes.
+ *
+ */
+
+#include <stdlib.h>
+
+#include "check_mem_mgmt.h"
+
+int
+main(void)
+{
+    SRunner * runner = srunner_create(check_mem_cache_suite());
+
+    srunner_add_suite(runner, check_mem_sampling_suite());
+    srunner_add_suite(runner, check_mem_sites_suite());
+    srunner_add_suite(runner, check_mem_realloc_suite());
+    srunner_add_suite(runner, check_mem_fast_suite());
+    srunner_add_suite(runner, check_mem_release_suite());
+    srunner_add_suite(runner, check_mem_stacks_suite());
+    srunner_add_suite(runner, check_mem_preload_suite());
+    srunner_add_suite(runner, check_mem_tags_suite());
+    srunner_add_suite(runner, check_mem_dump_suite());
+
+    /* The orphan test relies on thread exits in this process only. */
+    srunner_set_fork_status(runner, CK_NOFORK);
+    srunner_run_all(runner, CK_VERBOSE);
+
+    int no_failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+    return (no_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,24 @@
+/** @file check_mem_mgmt.h
+ *
+ * @brief Suites of the memory management tests, run together by
+ *        check_mem_mgmt.c.
+ *
+ */
+
+#ifndef CHECK_MEM_MGMT_H
+#define CHECK_MEM_MGMT_H
+
+#include <check.h>
+
+Suite * check_mem_cache_suite(void);
+Suite * check_mem_sampling_suite(void);
+Suite * check_mem_sites_suite(void);
+Suite * check_mem_realloc_suite(void);
+Suite * check_mem_fast_suite(void);
+Suite * check_mem_release_suite(void);
+Suite * check_mem_stacks_suite(void);
+Suite * check_mem_preload_suite(void);
+Suite * check_mem_tags_suite(void);
+Suite * check_mem_dump_suite(void);
+
+#endif
@@ -0,0 +1,199 @@
+/** @file check_mem_preload.c
+ *
+ * @brief Tests for the LD_PRELOAD shim: programs run under it behave as
+ *        usual in every tracking mode, and the stacks it captures start in
+ *        the program rather than in the shim.
+ *
+ * The programs are run through the shell, with the shim given relative to
+ * the module directory, where make check runs the tests.
+ *
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../include/mem-dump.h"
+#include "check_mem_mgmt.h"
+
+#define PRELOAD_LIB "bin/libmem-mgmt-preload.so"
+#define PRELOAD_NAME "libmem-mgmt-preload.so"
+#define COMMAND_SIZE 512
+#define OUTPUT_SIZE 256
+#define MAX_RANGES 8
+
+static const char * const g_modes[] = {
+    "",
+    "MEM_MGMT_TRACK=1",
+    "MEM_MGMT_TRACK=1 MEM_MGMT_STACKS=1",
+    "MEM_MGMT_SAMPLE=4096 MEM_MGMT_STACKS=1",
+};
+
+#define MODE_COUNT (sizeof(g_modes) / sizeof(g_modes[0]))
+
+typedef struct
+{
+    uintptr_t start;
+    uintptr_t end;
+} Range_T;
+
+/* Whole contents of a file, with its size in *size. */
+static unsigned char *
+read_file(const char * path, size_t * size)
+{
+    FILE * file = fopen(path, "rb");
+    ck_assert_ptr_nonnull(file);
+    ck_assert_int_eq(fseek(file, 0, SEEK_END), 0);
+    long length = ftell(file);
+    ck_assert_int_gt(length, 0);
+    rewind(file);
+
+    unsigned char * data = malloc((size_t)length);
+    ck_assert_ptr_nonnull(data);
+    ck_assert_uint_eq(fread(data, 1, (size_t)length, file), (size_t)length);
+    fclose(file);
+    *size = (size_t)length;
+    return data;
+}
+
+/* Executable mappings of the shim listed in the text of /proc/pid/maps. */
+static size_t
+find_shim_code(const char * maps, Range_T * ranges)
+{
+    size_t count = 0;
+
+    for (const char * line = maps; line && *line && count < MAX_RANGES;)
+    {
+        const char *       end = strchr(line, '\n');
+        unsigned long long start;
+        unsigned long long stop;
+        char               perms[5];
+        if (sscanf(line, "%llx-%llx %4s", &start, &stop, perms) == 3
+            && strchr(perms, 'x'))
+        {
+            const char * name = strstr(line, PRELOAD_NAME);
+            if (name && (!end || name < end))
+            {
+                ranges[count].start = (uintptr_t)start;
+                ranges[count].end   = (uintptr_t)stop;
+                count++;
+            }
+        }
+        line = end ? end + 1 : NULL;
+    }
+    return count;
+}
+
+START_TEST(test_programs_run_unchanged)
+{
+    for (size_t i = 0; i < MODE_COUNT; i++)
+    {
+        char command[COMMAND_SIZE];
+        char output[OUTPUT_SIZE] = { 0 };
+        snprintf(command,
+                 sizeof(command),
+                 "printf 'pear\\napple\\nfig\\n' | env LD_PRELOAD=%s %s sort",
+                 PRELOAD_LIB,
+                 g_modes[i]);
+
+        FILE * pipe = popen(command, "r");
+        ck_assert_ptr_nonnull(pipe);
+        size_t length = fread(output, 1, sizeof(output) - 1, pipe);
+        ck_assert_int_eq(pclose(pipe), 0);
+        ck_assert_uint_eq(length, strlen("apple\nfig\npear\n"));
+        ck_assert_str_eq(output, "apple\nfig\npear\n");
+    }
+}
+END_TEST
+
+START_TEST(test_stacks_leave_out_the_shim)
+{
+    char path[] = "/tmp/check_mem_preload_XXXXXX";
+    int  fd     = mkstemp(path);
+    ck_assert_int_ge(fd, 0);
+    close(fd);
+
+    /* ls holds on to some memory at exit and closes stderr, so the blocks
+     * and their stacks are read from a heap dump. */
+    char command[COMMAND_SIZE];
+    snprintf(command,
+             sizeof(command),
+             "env LD_PRELOAD=%s MEM_MGMT_TRACK=1 MEM_MGMT_STACKS=1 "
+             "MEM_MGMT_DUMP=%s ls / > /dev/null",
+             PRELOAD_LIB,
+             path);
+    ck_assert_int_eq(system(command), 0);
+
+    size_t          size = 0;
+    unsigned char * dump = read_file(path, &size);
+    unlink(path);
+    ck_assert_uint_ge(size, sizeof(MemDumpHeader_T));
+    ck_assert_mem_eq(dump, MEM_DUMP_MAGIC, 8);
+
+    char * maps   = calloc(size, 1);
+    size_t mapped = 0;
+    size_t stacks = 0;
+    size_t offset = sizeof(MemDumpHeader_T);
+    ck_assert_ptr_nonnull(maps);
+    while (offset + sizeof(MemDumpRecord_T) <= size)
+    {
+        MemDumpRecord_T record;
+        memcpy(&record, dump + offset, sizeof(record));
+        offset += sizeof(record);
+        ck_assert_uint_le(record.length, size - offset);
+        if (record.type == MEM_DUMP_MAPS)
+        {
+            memcpy(maps + mapped, dump + offset, record.length);
+            mapped += record.length;
+        }
+        offset += record.length;
+    }
+
+    Range_T ranges[MAX_RANGES];
+    size_t  range_count = find_shim_code(maps, ranges);
+    ck_assert_uint_gt(range_count, 0);
+
+    /* Maps come first, so a second pass sees every stack with them. */
+    offset = sizeof(MemDumpHeader_T);
+    while (offset + sizeof(MemDumpRecord_T) <= size)
+    {
+        MemDumpRecord_T record;
+        memcpy(&record, dump + offset, sizeof(record));
+        offset += sizeof(record);
+        if (record.type == MEM_DUMP_STACK)
+        {
+            uint32_t depth = 0;
+            uint64_t frame = 0;
+            memcpy(&depth, dump + offset + sizeof(uint32_t), sizeof(depth));
+            ck_assert_uint_gt(depth, 0);
+            memcpy(&frame, dump + offset + 2 * sizeof(uint32_t), sizeof(frame));
+            for (size_t i = 0; i < range_count; i++)
+            {
+                ck_assert(frame < ranges[i].start || frame >= ranges[i].end);
+            }
+            stacks++;
+        }
+        offset += record.length;
+    }
+    ck_assert_uint_gt(stacks, 0);
+
+    free(maps);
+    free(dump);
+}
+END_TEST
+
+Suite *
+check_mem_preload_suite(void)
+{
+    Suite * suite      = suite_create("mem_preload_test");
+    TCase * tc_preload = tcase_create("Preload");
+
+    tcase_add_test(tc_preload, test_programs_run_unchanged);
+    tcase_add_test(tc_preload, test_stacks_leave_out_the_shim);
+    tcase_set_timeout(tc_preload, 30);
+
+    suite_add_tcase(suite, tc_preload);
+    return suite;
+}
@@ -0,0 +1,215 @@
+/** @file check_mem_realloc.c
+ *
+ * @brief Tests for CustomRealloc: growth inside the block, shrinks that
+ *        stay or move to a smaller class, moves to a larger class, large
+ *        blocks resized by mremap, and the site statistics that follow the
+ *        block.
+ *
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/mem-mgmt.h"
+#include "../src/mem-internal.h"
+#include "check_mem_mgmt.h"
+
+#define SMALL_SIZE 100
+#define MEDIUM_SIZE 2000
+#define LARGE_SIZE (256 * 1024)
+#define HUGE_SIZE (4 * 1024 * 1024)
+
+static const char g_realloc_site[] = "realloc-test";
+
+#define REALLOC_LINE 1
+
+/* Live bytes and blocks of the test site. */
+static void
+site_live(int64_t * bytes, int64_t * count)
+{
+    MemSnapshot_T * snapshot = CustomSnapshot();
+
+    ck_assert_ptr_nonnull(snapshot);
+    *bytes = 0;
+    *count = 0;
+    for (size_t i = 0; i < snapshot->count; i++)
+    {
+        if (snapshot->sites[i].file == g_realloc_site)
+        {
+            *bytes = snapshot->sites[i].live_bytes;
+            *count = snapshot->sites[i].live_count;
+        }
+    }
+    CustomSnapshotFree(snapshot);
+}
+
+static void
+assert_site_holds(size_t size)
+{
+    int64_t bytes = 0;
+    int64_t count = 0;
+
+    site_live(&bytes, &count);
+    ck_assert_int_eq(bytes, (int64_t)size);
+    ck_assert_int_eq(count, size ? 1 : 0);
+}
+
+/* Fill size bytes with a pattern that depends on the offset. */
+static void
+fill(unsigned char * data, size_t size)
+{
+    for (size_t i = 0; i < size; i++)
+    {
+        data[i] = (unsigned char)(i * 31 + 7);
+    }
+}
+
+static void
+assert_filled(const unsigned char * data, size_t size)
+{
+    for (size_t i = 0; i < size; i++)
+    {
+        ck_assert_uint_eq(data[i], (unsigned char)(i * 31 + 7));
+    }
+}
+
+START_TEST(test_grow_within_block_stays)
+{
+    unsigned char * data
+        = CustomMalloc(SMALL_SIZE, g_realloc_site, REALLOC_LINE);
+    ck_assert_ptr_nonnull(data);
+    size_t usable = mm_usable_size(data);
+    ck_assert_uint_ge(usable, SMALL_SIZE);
+    fill(data, SMALL_SIZE);
+
+    unsigned char * grown
+        = CustomRealloc(data, usable, g_realloc_site, REALLOC_LINE);
+    ck_assert_ptr_eq(grown, data);
+    assert_filled(grown, SMALL_SIZE);
+    assert_site_holds(usable);
+
+    CustomFree(grown);
+    assert_site_holds(0);
+}
+END_TEST
+
+START_TEST(test_grow_moves_to_larger_class)
+{
+    unsigned char * data
+        = CustomMalloc(SMALL_SIZE, g_realloc_site, REALLOC_LINE);
+    ck_assert_ptr_nonnull(data);
+    fill(data, SMALL_SIZE);
+
+    unsigned char * grown
+        = CustomRealloc(data, MEDIUM_SIZE, g_realloc_site, REALLOC_LINE);
+    ck_assert_ptr_nonnull(grown);
+    ck_assert_ptr_ne(grown, data);
+    ck_assert_uint_ge(mm_usable_size(grown), MEDIUM_SIZE);
+    assert_filled(grown, SMALL_SIZE);
+    assert_site_holds(MEDIUM_SIZE);
+
+    /* The old block went back to the cache, so is no longer tracked. */
+    CustomFree(grown);
+    assert_site_holds(0);
+}
+END_TEST
+
+START_TEST(test_shrink_moves_to_smaller_class)
+{
+    unsigned char * data
+        = CustomMalloc(MEDIUM_SIZE, g_realloc_site, REALLOC_LINE);
+    ck_assert_ptr_nonnull(data);
+    size_t usable = mm_usable_size(data);
+    fill(data, MEDIUM_SIZE);
+
+    /* Shrinking by less than half stays in place. */
+    unsigned char * kept
+        = CustomRealloc(data, usable * 3 / 4, g_realloc_site, REALLOC_LINE);
+    ck_assert_ptr_eq(kept, data);
+    assert_site_holds(usable * 3 / 4);
+
+    unsigned char * shrunk
+        = CustomRealloc(kept, SMALL_SIZE, g_realloc_site, REALLOC_LINE);
+    ck_assert_ptr_nonnull(shrunk);
+    ck_assert_ptr_ne(shrunk, kept);
+    ck_assert_uint_ge(mm_usable_size(shrunk), SMALL_SIZE);
+    ck_assert_uint_lt(mm_usable_size(shrunk), usable / 2);
+    assert_filled(shrunk, SMALL_SIZE);
+    assert_site_holds(SMALL_SIZE);
+
+    CustomFree(shrunk);
+    assert_site_holds(0);
+}
+END_TEST
+
+START_TEST(test_large_block_is_remapped)
+{
+    unsigned char * data
+        = CustomMalloc(LARGE_SIZE, g_realloc_site, REALLOC_LINE);
+    ck_assert_ptr_nonnull(data);
+    ck_assert_uint_eq(MM_HEADER(data)->size_class, MM_LARGE_CLASS);
+    fill(data, LARGE_SIZE);
+
+    unsigned char * grown
+        = CustomRealloc(data, HUGE_SIZE, g_realloc_site, REALLOC_LINE);
+    ck_assert_ptr_nonnull(grown);
+    ck_assert(mm_owns(grown));
+    ck_assert_uint_eq(MM_HEADER(grown)->size_class, MM_LARGE_CLASS);
+    ck_assert_uint_ge(mm_usable_size(grown), HUGE_SIZE);
+    assert_filled(grown, LARGE_SIZE);
+    assert_site_holds(HUGE_SIZE);
+    if (grown != data)
+    {
+        ck_assert(!mm_owns(data));
+    }
+
+    /* Shrinking unmaps the tail of the mapping, contents stay. */
+    unsigned char * shrunk
+        = CustomRealloc(grown, LARGE_SIZE, g_realloc_site, REALLOC_LINE);
+    ck_assert_ptr_nonnull(shrunk);
+    ck_assert(mm_owns(shrunk));
+    ck_assert_uint_ge(mm_usable_size(shrunk), LARGE_SIZE);
+    ck_assert_uint_lt(mm_usable_size(shrunk), HUGE_SIZE);
+    assert_filled(shrunk, LARGE_SIZE);
+    assert_site_holds(LARGE_SIZE);
+
+    CustomFree(shrunk);
+    assert_site_holds(0);
+}
+END_TEST
+
+START_TEST(test_null_and_zero_size)
+{
+    unsigned char * data
+        = CustomRealloc(NULL, SMALL_SIZE, g_realloc_site, REALLOC_LINE);
+    ck_assert_ptr_nonnull(data);
+    assert_site_holds(SMALL_SIZE);
+
+    ck_assert_ptr_null(CustomRealloc(data, 0, g_realloc_site, REALLOC_LINE));
+    assert_site_holds(0);
+
+    /* Memory the library did not hand out is left alone. */
+    void * foreign = malloc(SMALL_SIZE);
+    ck_assert_ptr_nonnull(foreign);
+    ck_assert_ptr_null(
+        CustomRealloc(foreign, MEDIUM_SIZE, g_realloc_site, REALLOC_LINE));
+    free(foreign);
+}
+END_TEST
+
+Suite *
+check_mem_realloc_suite(void)
+{
+    Suite * suite      = suite_create("mem_realloc_test");
+    TCase * tc_realloc = tcase_create("Realloc");
+
+    tcase_add_test(tc_realloc, test_grow_within_block_stays);
+    tcase_add_test(tc_realloc, test_grow_moves_to_larger_class);
+    tcase_add_test(tc_realloc, test_shrink_moves_to_smaller_class);
+    tcase_add_test(tc_realloc, test_large_block_is_remapped);
+    tcase_add_test(tc_realloc, test_null_and_zero_size);
+
+    suite_add_tcase(suite, tc_realloc);
+    return suite;
+}
@@ -0,0 +1,59 @@
+/** @file check_mem_release.c
+ *
+ * @brief Tests for the MEM_MGMT_RELEASE build mode of callers: MALLOC and
+ *        friends are the C library functions and never touch this library.
+ *
+ */
+
+#define MEM_MGMT_RELEASE
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/mem-mgmt.h"
+#include "../src/mem-internal.h"
+#include "check_mem_mgmt.h"
+
+#define BLOCK_SIZE 200
+#define GROWN_SIZE 5000
+
+START_TEST(test_release_blocks_come_from_libc)
+{
+    unsigned char * data = MALLOC(BLOCK_SIZE);
+    ck_assert_ptr_nonnull(data);
+    memset(data, 0x5A, BLOCK_SIZE);
+    ck_assert(!mm_owns(data));
+
+    data = REALLOC(data, GROWN_SIZE);
+    ck_assert_ptr_nonnull(data);
+    ck_assert(!mm_owns(data));
+    for (size_t i = 0; i < BLOCK_SIZE; i++)
+    {
+        ck_assert_uint_eq(data[i], 0x5A);
+    }
+    CLEAN(data);
+    FREE(data);
+
+    unsigned char * zeroed = CALLOC(BLOCK_SIZE, 2);
+    ck_assert_ptr_nonnull(zeroed);
+    ck_assert(!mm_owns(zeroed));
+    for (size_t i = 0; i < 2 * BLOCK_SIZE; i++)
+    {
+        ck_assert_uint_eq(zeroed[i], 0);
+    }
+    FREE(zeroed);
+}
+END_TEST
+
+Suite *
+check_mem_release_suite(void)
+{
+    Suite * suite      = suite_create("mem_release_test");
+    TCase * tc_release = tcase_create("Release");
+
+    tcase_add_test(tc_release, test_release_blocks_come_from_libc);
+
+    suite_add_tcase(suite, tc_release);
+    return suite;
+}
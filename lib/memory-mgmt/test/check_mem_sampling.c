@@ -0,0 +1,135 @@
+/** @file check_mem_sampling.c
+ *
+ * @brief Tests for sampled tracking: the live bytes estimated from the
+ *        samples against the bytes really allocated, and no bias from the
+ *        first allocation of each thread.
+ *
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "../include/mem-mgmt.h"
+#include "check_mem_mgmt.h"
+
+#define SAMPLE_INTERVAL (16 * 1024)
+#define BLOCK_COUNT 20000
+#define THREAD_COUNT 256
+#define THREAD_BLOCK_SIZE 32
+#define THREAD_INTERVAL (1024 * 1024)
+
+/* Each test allocates at its own line of this site. */
+static const char g_sampling_site[] = "sampling-test";
+
+#define ESTIMATE_LINE 1
+#define THREAD_LINE 2
+
+typedef struct
+{
+    void * blocks[THREAD_COUNT];
+    size_t next;
+} Blocks_T;
+
+/* Live bytes estimated for a site, 0 if it has none. */
+static int64_t
+site_live_bytes(const char * file, int line)
+{
+    MemSnapshot_T * snapshot = CustomSnapshot();
+    int64_t         live     = 0;
+
+    ck_assert_ptr_nonnull(snapshot);
+    for (size_t i = 0; i < snapshot->count; i++)
+    {
+        if (snapshot->sites[i].file == file && snapshot->sites[i].line == line)
+        {
+            live = snapshot->sites[i].live_bytes;
+        }
+    }
+    CustomSnapshotFree(snapshot);
+    return live;
+}
+
+START_TEST(test_estimate_matches_total)
+{
+    void ** blocks = malloc(BLOCK_COUNT * sizeof(void *));
+    int64_t total  = 0;
+
+    ck_assert_ptr_nonnull(blocks);
+    CustomSetSamplingInterval(SAMPLE_INTERVAL);
+    for (size_t i = 0; i < BLOCK_COUNT; i++)
+    {
+        /* Sizes from 16 bytes to 8 KiB, so that both small allocations,
+         * rarely sampled, and large ones count towards the estimate. */
+        size_t size = (size_t)16 << (i % 10);
+        blocks[i]   = CustomMalloc(size, g_sampling_site, ESTIMATE_LINE);
+        ck_assert_ptr_nonnull(blocks[i]);
+        total += (int64_t)size;
+    }
+
+    /* About 1700 samples make for a standard error near 2%. */
+    int64_t estimate = site_live_bytes(g_sampling_site, ESTIMATE_LINE);
+    ck_assert_int_ge(estimate, total * 85 / 100);
+    ck_assert_int_le(estimate, total * 115 / 100);
+
+    for (size_t i = 0; i < BLOCK_COUNT; i++)
+    {
+        CustomFree(blocks[i]);
+    }
+    ck_assert_int_eq(site_live_bytes(g_sampling_site, ESTIMATE_LINE), 0);
+    CustomSetSamplingInterval(0);
+    free(blocks);
+}
+END_TEST
+
+static void *
+allocate_once(void * arg)
+{
+    Blocks_T * blocks = arg;
+
+    blocks->blocks[blocks->next]
+        = CustomMalloc(THREAD_BLOCK_SIZE, g_sampling_site, THREAD_LINE);
+    ck_assert_ptr_nonnull(blocks->blocks[blocks->next]);
+    return NULL;
+}
+
+START_TEST(test_first_allocation_is_not_sampled)
+{
+    Blocks_T blocks = { 0 };
+
+    /* Each thread makes one small allocation. Were it always sampled, each
+     * would count for a whole interval, about a megabyte, where all of them
+     * together hold 8 KiB. */
+    CustomSetSamplingInterval(THREAD_INTERVAL);
+    for (blocks.next = 0; blocks.next < THREAD_COUNT; blocks.next++)
+    {
+        pthread_t thread;
+        ck_assert_int_eq(
+            pthread_create(&thread, NULL, allocate_once, &blocks), 0);
+        ck_assert_int_eq(pthread_join(thread, NULL), 0);
+    }
+    ck_assert_int_lt(site_live_bytes(g_sampling_site, THREAD_LINE),
+                     4 * THREAD_INTERVAL);
+
+    for (size_t i = 0; i < THREAD_COUNT; i++)
+    {
+        CustomFree(blocks.blocks[i]);
+    }
+    ck_assert_int_eq(site_live_bytes(g_sampling_site, THREAD_LINE), 0);
+    CustomSetSamplingInterval(0);
+}
+END_TEST
+
+Suite *
+check_mem_sampling_suite(void)
+{
+    Suite * suite       = suite_create("mem_sampling_test");
+    TCase * tc_sampling = tcase_create("Sampling");
+
+    tcase_add_test(tc_sampling, test_estimate_matches_total);
+    tcase_add_test(tc_sampling, test_first_allocation_is_not_sampled);
+    tcase_set_timeout(tc_sampling, 60);
+
+    suite_add_tcase(suite, tc_sampling);
+    return suite;
+}
@@ -0,0 +1,169 @@
+/** @file check_mem_sites.c
+ *
+ * @brief Tests for the per-site statistics: snapshots of live and
+ *        cumulative counters, and the diff between two snapshots.
+ *
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "../include/mem-mgmt.h"
+#include "check_mem_mgmt.h"
+
+#define SMALL_SIZE 48
+#define LARGE_SIZE 4000
+#define BLOCK_COUNT 8
+
+/* Sites are keyed by the address of the file name, so the tests look their
+ * entries up by pointer. */
+static const char g_sites_site[] = "sites-test";
+
+#define SMALL_LINE 1
+#define LARGE_LINE 2
+#define IDLE_LINE 3
+
+/* Entry of a snapshot for a site, NULL if it has none. */
+static const MemSiteStats_T *
+find_site(const MemSnapshot_T * snapshot, int line)
+{
+    for (size_t i = 0; i < snapshot->count; i++)
+    {
+        if (snapshot->sites[i].file == g_sites_site
+            && snapshot->sites[i].line == line)
+        {
+            return &snapshot->sites[i];
+        }
+    }
+    return NULL;
+}
+
+START_TEST(test_snapshot_counts_live_and_total)
+{
+    void * blocks[BLOCK_COUNT];
+
+    for (size_t i = 0; i < BLOCK_COUNT; i++)
+    {
+        blocks[i] = CustomMalloc(SMALL_SIZE, g_sites_site, SMALL_LINE);
+        ck_assert_ptr_nonnull(blocks[i]);
+    }
+    for (size_t i = 0; i < BLOCK_COUNT / 2; i++)
+    {
+        CustomFree(blocks[i]);
+    }
+
+    MemSnapshot_T * snapshot = CustomSnapshot();
+    ck_assert_ptr_nonnull(snapshot);
+    const MemSiteStats_T * site = find_site(snapshot, SMALL_LINE);
+    ck_assert_ptr_nonnull(site);
+    ck_assert_int_eq(site->live_count, BLOCK_COUNT / 2);
+    ck_assert_int_eq(site->live_bytes, BLOCK_COUNT / 2 * SMALL_SIZE);
+    ck_assert_uint_eq(site->total_allocs, BLOCK_COUNT);
+    ck_assert_uint_eq(site->total_bytes, BLOCK_COUNT * SMALL_SIZE);
+    ck_assert_int_eq(site->peak_bytes, BLOCK_COUNT * SMALL_SIZE);
+
+    /* Snapshots are indexed by site id. */
+    for (size_t i = 0; i < snapshot->count; i++)
+    {
+        ck_assert_uint_eq(snapshot->sites[i].id, i);
+    }
+    CustomSnapshotFree(snapshot);
+
+    for (size_t i = BLOCK_COUNT / 2; i < BLOCK_COUNT; i++)
+    {
+        CustomFree(blocks[i]);
+    }
+}
+END_TEST
+
+START_TEST(test_diff_orders_by_growth)
+{
+    void * small[BLOCK_COUNT];
+    void * large[BLOCK_COUNT];
+
+    /* The idle site exists in both snapshots but does not change. */
+    void * idle = CustomMalloc(SMALL_SIZE, g_sites_site, IDLE_LINE);
+    ck_assert_ptr_nonnull(idle);
+    small[0] = CustomMalloc(SMALL_SIZE, g_sites_site, SMALL_LINE);
+    ck_assert_ptr_nonnull(small[0]);
+
+    MemSnapshot_T * before = CustomSnapshot();
+    ck_assert_ptr_nonnull(before);
+    CustomFree(small[0]);
+    for (size_t i = 0; i < BLOCK_COUNT; i++)
+    {
+        small[i] = CustomMalloc(SMALL_SIZE, g_sites_site, SMALL_LINE);
+        large[i] = CustomMalloc(LARGE_SIZE, g_sites_site, LARGE_LINE);
+        ck_assert_ptr_nonnull(small[i]);
+        ck_assert_ptr_nonnull(large[i]);
+    }
+    CustomFree(small[0]);
+    MemSnapshot_T * after = CustomSnapshot();
+    ck_assert_ptr_nonnull(after);
+
+    MemSnapshot_T * diff = CustomSnapshotDiff(before, after);
+    ck_assert_ptr_nonnull(diff);
+    ck_assert_ptr_null(find_site(diff, IDLE_LINE));
+
+    const MemSiteStats_T * small_site = find_site(diff, SMALL_LINE);
+    const MemSiteStats_T * large_site = find_site(diff, LARGE_LINE);
+    ck_assert_ptr_nonnull(small_site);
+    ck_assert_ptr_nonnull(large_site);
+    ck_assert_int_eq(small_site->live_count, BLOCK_COUNT - 2);
+    ck_assert_int_eq(small_site->live_bytes, (BLOCK_COUNT - 2) * SMALL_SIZE);
+    ck_assert_uint_eq(small_site->total_allocs, BLOCK_COUNT);
+    ck_assert_int_eq(large_site->live_count, BLOCK_COUNT);
+    ck_assert_int_eq(large_site->live_bytes, BLOCK_COUNT * LARGE_SIZE);
+    ck_assert_uint_eq(large_site->total_allocs, BLOCK_COUNT);
+
+    /* Largest live growth first; other tests may leave their own sites in
+     * the diff, so only the order of neighbours is checked. */
+    for (size_t i = 1; i < diff->count; i++)
+    {
+        ck_assert_int_ge(diff->sites[i - 1].live_bytes,
+                         diff->sites[i].live_bytes);
+    }
+    ck_assert(large_site < small_site);
+
+    CustomSnapshotFree(diff);
+    CustomSnapshotFree(after);
+    CustomSnapshotFree(before);
+    for (size_t i = 0; i < BLOCK_COUNT; i++)
+    {
+        if (i > 0)
+        {
+            CustomFree(small[i]);
+        }
+        CustomFree(large[i]);
+    }
+    CustomFree(idle);
+}
+END_TEST
+
+START_TEST(test_diff_of_equal_snapshots_is_empty)
+{
+    MemSnapshot_T * snapshot = CustomSnapshot();
+    ck_assert_ptr_nonnull(snapshot);
+    MemSnapshot_T * diff = CustomSnapshotDiff(snapshot, snapshot);
+    ck_assert_ptr_nonnull(diff);
+    ck_assert_uint_eq(diff->count, 0);
+    ck_assert_ptr_null(CustomSnapshotDiff(NULL, snapshot));
+    CustomSnapshotFree(diff);
+    CustomSnapshotFree(snapshot);
+    CustomSnapshotFree(NULL);
+}
+END_TEST
+
+Suite *
+check_mem_sites_suite(void)
+{
+    Suite * suite    = suite_create("mem_sites_test");
+    TCase * tc_sites = tcase_create("Sites");
+
+    tcase_add_test(tc_sites, test_snapshot_counts_live_and_total);
+    tcase_add_test(tc_sites, test_diff_orders_by_growth);
+    tcase_add_test(tc_sites, test_diff_of_equal_snapshots_is_empty);
+
+    suite_add_tcase(suite, tc_sites);
+    return suite;
+}
@@ -0,0 +1,202 @@
+/** @file check_mem_stacks.c
+ *
+ * @brief Tests for the interned call stack table: equal stacks share an
+ *        id, ids give back their frames, and tracked allocations carry the
+ *        stack of their caller.
+ *
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "../include/mem-mgmt.h"
+#include "../src/mem-internal.h"
+#include "check_mem_mgmt.h"
+
+#define STACK_DEPTH 4
+#define STACK_COUNT 5000
+#define BLOCK_SIZE 64
+
+/* Largest distance expected between a function's address and the return
+ * address of a call it makes. */
+#define MAX_CALL_OFFSET 512
+
+static const char g_stacks_site[] = "stacks-test";
+
+#define STACKS_LINE 1
+
+/* Made-up return addresses, distinct for every (seed, frame). */
+static void
+make_frames(void ** frames, size_t seed)
+{
+    for (size_t i = 0; i < STACK_DEPTH; i++)
+    {
+        frames[i] = (void *)(uintptr_t)(0x400000 + seed * 64 + i * 8);
+    }
+}
+
+/* Stack id of the tracking record of ptr, which must exist. */
+static uint32_t
+record_stack(const void * ptr)
+{
+    TrackedBlock_T * blocks   = NULL;
+    size_t           capacity = 0;
+    size_t           count    = 0;
+    uint32_t         stack_id = 0;
+    bool             seen     = false;
+
+    for (size_t bucket = 0; mm_track_copy(bucket, &blocks, &capacity, &count)
+                            > 0;
+         bucket++)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            if (blocks[i].ptr == ptr)
+            {
+                stack_id = blocks[i].stack_id;
+                seen     = true;
+            }
+        }
+    }
+    mm_free(blocks);
+    ck_assert(seen);
+    return stack_id;
+}
+
+static void *
+allocate_first(void)
+{
+    return CustomMalloc(BLOCK_SIZE, g_stacks_site, STACKS_LINE);
+}
+
+static void *
+allocate_second(void)
+{
+    return CustomMalloc(BLOCK_SIZE, g_stacks_site, STACKS_LINE);
+}
+
+START_TEST(test_equal_stacks_share_an_id)
+{
+    void * frames[STACK_DEPTH];
+    void * other[STACK_DEPTH];
+
+    make_frames(frames, 0);
+    make_frames(other, 0);
+    uint32_t id = mm_stack_intern(frames, STACK_DEPTH);
+    ck_assert_uint_ne(id, 0);
+    ck_assert_uint_eq(mm_stack_intern(other, STACK_DEPTH), id);
+
+    /* A prefix, or one frame changed, is another stack. */
+    uint32_t prefix = mm_stack_intern(frames, STACK_DEPTH - 1);
+    ck_assert_uint_ne(prefix, 0);
+    ck_assert_uint_ne(prefix, id);
+    other[STACK_DEPTH - 1] = (void *)(uintptr_t)0x1234;
+    uint32_t changed       = mm_stack_intern(other, STACK_DEPTH);
+    ck_assert_uint_ne(changed, 0);
+    ck_assert_uint_ne(changed, id);
+    ck_assert_uint_ne(changed, prefix);
+
+    void * const * stored = NULL;
+    ck_assert_int_eq(mm_stack_get(id, &stored), STACK_DEPTH);
+    for (size_t i = 0; i < STACK_DEPTH; i++)
+    {
+        ck_assert_ptr_eq(stored[i], frames[i]);
+    }
+    ck_assert_int_eq(mm_stack_get(prefix, &stored), STACK_DEPTH - 1);
+}
+END_TEST
+
+START_TEST(test_empty_and_unknown_stacks)
+{
+    void * frames[STACK_DEPTH];
+    void * const * stored = NULL;
+
+    make_frames(frames, 1);
+    ck_assert_uint_eq(mm_stack_intern(frames, 0), 0);
+    ck_assert_uint_eq(mm_stack_intern(frames, -1), 0);
+    ck_assert_int_eq(mm_stack_get(0, &stored), 0);
+    ck_assert_int_eq(mm_stack_get(UINT32_MAX, &stored), 0);
+}
+END_TEST
+
+START_TEST(test_many_stacks_round_trip)
+{
+    uint32_t * ids = malloc(STACK_COUNT * sizeof(uint32_t));
+    void *     frames[STACK_DEPTH];
+
+    ck_assert_ptr_nonnull(ids);
+    for (size_t i = 0; i < STACK_COUNT; i++)
+    {
+        make_frames(frames, 100 + i);
+        ids[i] = mm_stack_intern(frames, STACK_DEPTH);
+        ck_assert_uint_ne(ids[i], 0);
+        if (i > 0)
+        {
+            /* Ids are handed out in order, so new stacks never reuse one. */
+            ck_assert_uint_gt(ids[i], ids[i - 1]);
+        }
+    }
+    for (size_t i = 0; i < STACK_COUNT; i++)
+    {
+        void * const * stored = NULL;
+        make_frames(frames, 100 + i);
+        ck_assert_uint_eq(mm_stack_intern(frames, STACK_DEPTH), ids[i]);
+        ck_assert_int_eq(mm_stack_get(ids[i], &stored), STACK_DEPTH);
+        ck_assert_ptr_eq(stored[0], frames[0]);
+        ck_assert_ptr_eq(stored[STACK_DEPTH - 1], frames[STACK_DEPTH - 1]);
+    }
+    free(ids);
+}
+END_TEST
+
+START_TEST(test_tracked_blocks_carry_their_stack)
+{
+    void * first[2];
+
+    /* Both calls come from the same place, so the whole stack is equal. */
+    CustomSetStackCapture(true);
+    for (size_t i = 0; i < 2; i++)
+    {
+        first[i] = allocate_first();
+    }
+    void * second = allocate_second();
+    CustomSetStackCapture(false);
+    void * uncaptured = allocate_first();
+
+    uint32_t first_id  = record_stack(first[0]);
+    uint32_t second_id = record_stack(second);
+    ck_assert_uint_ne(first_id, 0);
+    ck_assert_uint_eq(record_stack(first[1]), first_id);
+    ck_assert_uint_ne(second_id, 0);
+    ck_assert_uint_ne(second_id, first_id);
+    ck_assert_uint_eq(record_stack(uncaptured), 0);
+
+    /* The innermost frame is the caller of CustomMalloc, not the library. */
+    void * const * frames = NULL;
+    ck_assert_int_gt(mm_stack_get(first_id, &frames), 0);
+    uintptr_t caller = (uintptr_t)allocate_first;
+    ck_assert_uint_gt((uintptr_t)frames[0], caller);
+    ck_assert_uint_lt((uintptr_t)frames[0], caller + MAX_CALL_OFFSET);
+
+    CustomFree(first[0]);
+    CustomFree(first[1]);
+    CustomFree(second);
+    CustomFree(uncaptured);
+}
+END_TEST
+
+Suite *
+check_mem_stacks_suite(void)
+{
+    Suite * suite     = suite_create("mem_stacks_test");
+    TCase * tc_stacks = tcase_create("Stacks");
+
+    tcase_add_test(tc_stacks, test_equal_stacks_share_an_id);
+    tcase_add_test(tc_stacks, test_empty_and_unknown_stacks);
+    tcase_add_test(tc_stacks, test_many_stacks_round_trip);
+    tcase_add_test(tc_stacks, test_tracked_blocks_carry_their_stack);
+
+    suite_add_tcase(suite, tc_stacks);
+    return suite;
+}
@@ -0,0 +1,285 @@
+/** @file check_mem_tags.c
+ *
+ * @brief Tests for allocation tags: the hard limit refuses the allocation
+ *        that would cross it, the soft limit calls back once per crossing,
+ *        other threads can only overrun the hard limit by their unfolded
+ *        charges, and a shrinking realloc credits the tag.
+ *
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "../include/mem-mgmt.h"
+#include "check_mem_mgmt.h"
+
+#define BLOCK_SIZE 4000
+#define SMALL_SIZE 100
+#define HARD_LIMIT (1024 * 1024)
+#define SOFT_LIMIT (256 * 1024)
+#define MAX_BLOCKS 1024
+#define THREAD_COUNT 8
+#define YIELD_BLOCKS 4
+
+/* Charges each thread may hold back from the shared count of a tag; see
+ * TAG_FOLD_BYTES in mem-tags.c. */
+#define FOLD_BYTES (64 * 1024)
+
+typedef struct
+{
+    size_t  hard_calls;
+    size_t  soft_calls;
+    int64_t live_bytes;
+} Calls_T;
+
+typedef struct
+{
+    uint32_t tag;
+    void *   blocks[MAX_BLOCKS];
+    size_t   count;
+} Thread_T;
+
+static void
+count_call(uint32_t tag, int64_t live_bytes, bool hard, void * arg)
+{
+    Calls_T * calls = arg;
+
+    (void)tag;
+    if (hard)
+    {
+        calls->hard_calls++;
+    }
+    else
+    {
+        calls->soft_calls++;
+    }
+    calls->live_bytes = live_bytes;
+}
+
+/* Live bytes of a tag, the calling thread's charges included. */
+static int64_t
+tag_live(uint32_t tag)
+{
+    MemTagStats_T stats;
+
+    ck_assert_int_eq(CustomTagGetStats(tag, &stats), 0);
+    return stats.live_bytes;
+}
+
+/* Bytes charged for one BLOCK_SIZE allocation. */
+static int64_t
+block_charge(uint32_t tag)
+{
+    uint32_t previous = CustomTagSwitch(tag);
+    int64_t  before   = tag_live(tag);
+    void *   block    = CustomFastMalloc(BLOCK_SIZE);
+    ck_assert_ptr_nonnull(block);
+    int64_t charge = tag_live(tag) - before;
+    CustomFastFree(block);
+    CustomTagSwitch(previous);
+    ck_assert_int_ge(charge, BLOCK_SIZE);
+
+    /* Fold the credit, or the shared count would stay a block high while
+     * other threads charge the tag. */
+    ck_assert_int_eq(tag_live(tag), before);
+    return charge;
+}
+
+/* Allocate BLOCK_SIZE blocks under the thread's tag until one is refused,
+ * yielding now and then so that threads interleave even on one CPU. */
+static void
+fill_tag(Thread_T * thread)
+{
+    uint32_t previous = CustomTagSwitch(thread->tag);
+
+    for (thread->count = 0; thread->count < MAX_BLOCKS; thread->count++)
+    {
+        thread->blocks[thread->count] = CustomFastMalloc(BLOCK_SIZE);
+        if (!thread->blocks[thread->count])
+        {
+            break;
+        }
+        if (thread->count % YIELD_BLOCKS == 0)
+        {
+            sched_yield();
+        }
+    }
+    CustomTagSwitch(previous);
+    ck_assert_uint_lt(thread->count, MAX_BLOCKS);
+}
+
+static void
+free_blocks(Thread_T * thread)
+{
+    for (size_t i = 0; i < thread->count; i++)
+    {
+        CustomFastFree(thread->blocks[i]);
+    }
+    thread->count = 0;
+}
+
+static void *
+fill_tag_thread(void * arg)
+{
+    fill_tag(arg);
+    return NULL;
+}
+
+START_TEST(test_hard_limit_refuses_allocation)
+{
+    Calls_T  calls  = { 0 };
+    Thread_T thread = { .tag = CustomTagCreate("hard-test") };
+    ck_assert_uint_ne(thread.tag, 0);
+    int64_t charge = block_charge(thread.tag);
+    ck_assert_int_eq(
+        CustomTagSetLimits(thread.tag, 0, HARD_LIMIT, count_call, &calls), 0);
+
+    /* A single thread stops at the last block that fits. */
+    fill_tag(&thread);
+    int64_t live = tag_live(thread.tag);
+    ck_assert_int_eq(live, (int64_t)thread.count * charge);
+    ck_assert_int_le(live, HARD_LIMIT);
+    ck_assert_int_gt(live + charge, HARD_LIMIT);
+    ck_assert_uint_eq(calls.hard_calls, 1);
+    ck_assert_uint_eq(calls.soft_calls, 0);
+    ck_assert_int_eq(calls.live_bytes, live);
+
+    MemTagStats_T stats;
+    ck_assert_int_eq(CustomTagGetStats(thread.tag, &stats), 0);
+    ck_assert_uint_eq(stats.denied_allocs, 1);
+    ck_assert_int_eq(stats.hard_limit, HARD_LIMIT);
+
+    /* Freeing a block makes room for one more. */
+    uint32_t previous = CustomTagSwitch(thread.tag);
+    CustomFastFree(thread.blocks[--thread.count]);
+    thread.blocks[thread.count] = CustomFastMalloc(BLOCK_SIZE);
+    ck_assert_ptr_nonnull(thread.blocks[thread.count]);
+    thread.count++;
+    ck_assert_ptr_null(CustomFastMalloc(BLOCK_SIZE));
+    CustomTagSwitch(previous);
+    ck_assert_uint_eq(calls.hard_calls, 2);
+
+    free_blocks(&thread);
+    ck_assert_int_eq(tag_live(thread.tag), 0);
+    CustomTagSetLimits(thread.tag, 0, 0, NULL, NULL);
+}
+END_TEST
+
+START_TEST(test_soft_limit_calls_back_once)
+{
+    Calls_T  calls  = { 0 };
+    Thread_T thread = { .tag = CustomTagCreate("soft-test") };
+    ck_assert_uint_ne(thread.tag, 0);
+    int64_t charge = block_charge(thread.tag);
+    ck_assert_int_eq(
+        CustomTagSetLimits(thread.tag, SOFT_LIMIT, 0, count_call, &calls), 0);
+
+    uint32_t previous = CustomTagSwitch(thread.tag);
+    for (size_t round = 1; round <= 2; round++)
+    {
+        /* Nothing is refused; the callback runs when the crossing charge is
+         * folded, at most one fold's worth late. */
+        while ((int64_t)thread.count * charge < 2 * SOFT_LIMIT)
+        {
+            thread.blocks[thread.count] = CustomFastMalloc(BLOCK_SIZE);
+            ck_assert_ptr_nonnull(thread.blocks[thread.count]);
+            thread.count++;
+            if (calls.soft_calls < round)
+            {
+                ck_assert_int_le((int64_t)thread.count * charge,
+                                 SOFT_LIMIT + FOLD_BYTES + charge);
+            }
+        }
+        ck_assert_uint_eq(calls.soft_calls, round);
+        ck_assert_int_gt(calls.live_bytes, SOFT_LIMIT);
+
+        /* Dropping back under the limit re-arms the callback. */
+        free_blocks(&thread);
+        ck_assert_int_eq(tag_live(thread.tag), 0);
+    }
+    CustomTagSwitch(previous);
+    ck_assert_uint_eq(calls.hard_calls, 0);
+    CustomTagSetLimits(thread.tag, 0, 0, NULL, NULL);
+}
+END_TEST
+
+START_TEST(test_threads_overrun_by_unfolded_charges)
+{
+    static Thread_T threads[THREAD_COUNT];
+    pthread_t       ids[THREAD_COUNT];
+    uint32_t        tag = CustomTagCreate("overrun-test");
+    ck_assert_uint_ne(tag, 0);
+    int64_t charge = block_charge(tag);
+    ck_assert_int_eq(CustomTagSetLimits(tag, 0, HARD_LIMIT, NULL, NULL), 0);
+
+    for (size_t i = 0; i < THREAD_COUNT; i++)
+    {
+        threads[i].tag = tag;
+        ck_assert_int_eq(
+            pthread_create(&ids[i], NULL, fill_tag_thread, &threads[i]), 0);
+    }
+    int64_t held = 0;
+    for (size_t i = 0; i < THREAD_COUNT; i++)
+    {
+        ck_assert_int_eq(pthread_join(ids[i], NULL), 0);
+        held += (int64_t)threads[i].count * charge;
+    }
+
+    /* Each thread saw the shared count and its own charges, so it stopped
+     * with the tag within a block of the limit as far as it could tell;
+     * only the charges the others had not folded yet were hidden from it. */
+    ck_assert_int_gt(held + charge, HARD_LIMIT);
+    ck_assert_int_le(held, HARD_LIMIT + (THREAD_COUNT - 1) * FOLD_BYTES);
+
+    /* The threads folded their charges as they exited. */
+    ck_assert_int_eq(tag_live(tag), held);
+    for (size_t i = 0; i < THREAD_COUNT; i++)
+    {
+        free_blocks(&threads[i]);
+    }
+    ck_assert_int_eq(tag_live(tag), 0);
+    CustomTagSetLimits(tag, 0, 0, NULL, NULL);
+}
+END_TEST
+
+START_TEST(test_realloc_shrink_credits_tag)
+{
+    uint32_t tag = CustomTagCreate("shrink-test");
+    ck_assert_uint_ne(tag, 0);
+
+    uint32_t previous = CustomTagSwitch(tag);
+    void *   block    = CustomFastMalloc(BLOCK_SIZE);
+    CustomTagSwitch(previous);
+    ck_assert_ptr_nonnull(block);
+    int64_t large = tag_live(tag);
+    ck_assert_int_ge(large, BLOCK_SIZE);
+
+    /* The block is charged to its tag whichever tag reallocates it. */
+    block = CustomFastRealloc(block, SMALL_SIZE);
+    ck_assert_ptr_nonnull(block);
+    int64_t small = tag_live(tag);
+    ck_assert_int_ge(small, SMALL_SIZE);
+    ck_assert_int_le(small, large / 2);
+
+    CustomFastFree(block);
+    ck_assert_int_eq(tag_live(tag), 0);
+}
+END_TEST
+
+Suite *
+check_mem_tags_suite(void)
+{
+    Suite * suite   = suite_create("mem_tags_test");
+    TCase * tc_tags = tcase_create("Tags");
+
+    tcase_add_test(tc_tags, test_hard_limit_refuses_allocation);
+    tcase_add_test(tc_tags, test_soft_limit_calls_back_once);
+    tcase_add_test(tc_tags, test_threads_overrun_by_unfolded_charges);
+    tcase_add_test(tc_tags, test_realloc_shrink_credits_tag);
+
+    suite_add_tcase(suite, tc_tags);
+    return suite;
+}
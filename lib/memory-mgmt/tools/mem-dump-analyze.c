@@ -0,0 +1,756 @@
+/**
+ * @file
+ * @brief Offline analyzer for the binary heap dumps written by
+ * CustomHeapDump.
+ *
+ *     mem-dump-analyze [-k] [-t] [-b] [-n count] dump
+ *     mem-dump-analyze [-k] [-t] [-b] [-n count] -d before after
+ *
+ * Blocks are grouped by allocation site, or by tag with -t, and with -k by
+ * call stack as well. Groups are printed largest first, by estimated bytes
+ * or with -b by block count. With -d the change from the first dump to the
+ * second is printed instead. Stack frames are shown as offsets into the
+ * module they belong to, ready for addr2line.
+ *
+ * A dump that was cut short is analyzed as far as it goes; one with a
+ * corrupt record is turned away.
+ */
+
+#include "../include/mem-dump.h"
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/** @brief Number of groups printed unless -n says otherwise. */
+#define DEFAULT_TOP 20
+
+/** @brief Initial number of buckets in the group table. */
+#define GROUP_BUCKETS 1024
+
+/** @brief Ids of file, tag and stack records must be below this. The
+ * library interns at most this many stacks and has far fewer files and
+ * tags, so a larger id can only come from a corrupt dump. */
+#define MAX_RECORD_ID (1024 * 1024)
+
+/** @brief A mapping read from /proc/self/maps of the dumped process. */
+typedef struct Mapping_Tag
+{
+    uint64_t start;  /**< First address of the mapping. */
+    uint64_t end;    /**< Address past the mapping. */
+    uint64_t offset; /**< File offset of start. */
+    char *   path;   /**< Mapped file. */
+} Mapping_T;
+
+/** @brief A call stack read from a dump. */
+typedef struct Stack_Tag
+{
+    uint32_t   depth;  /**< Number of frames. */
+    uint64_t * frames; /**< Return addresses, innermost first. */
+    char *     text;   /**< Frames formatted for output, built lazily. */
+} Stack_T;
+
+/** @brief Contents of a dump. */
+typedef struct Dump_Tag
+{
+    MemDumpHeader_T  header;        /**< Header of the dump. */
+    bool             complete;      /**< Whether the end record was read. */
+    char *           maps;          /**< Text of the maps records. */
+    size_t           maps_length;   /**< Length of maps. */
+    Mapping_T *      mappings;      /**< Mappings parsed from maps. */
+    size_t           mapping_count; /**< Number of mappings. */
+    char **          files;         /**< File names, by id. */
+    size_t           file_count;    /**< Number of entries in files. */
+    char **          tags;          /**< Tag names, by tag. */
+    size_t           tag_count;     /**< Number of entries in tags. */
+    Stack_T *        stacks;        /**< Call stacks, by id. */
+    size_t           stack_count;   /**< Number of entries in stacks. */
+    MemDumpBlock_T * blocks;        /**< Every block in the dump. */
+    size_t           block_count;   /**< Number of blocks. */
+} Dump_T;
+
+/** @brief Blocks sharing a key. */
+typedef struct Group_Tag
+{
+    char *             key;    /**< Site, tag or stack text. */
+    int64_t            bytes;  /**< Estimated bytes. */
+    int64_t            blocks; /**< Estimated blocks. */
+    struct Group_Tag * next;   /**< Next group in the same bucket. */
+} Group_T;
+
+/** @brief Hash table of groups. */
+typedef struct GroupTable_Tag
+{
+    Group_T ** buckets;      /**< Chains of groups. */
+    size_t     bucket_count; /**< Number of buckets, a power of two. */
+    size_t     count;        /**< Number of groups. */
+} GroupTable_T;
+
+/** @brief Command line options. */
+typedef struct Options_Tag
+{
+    bool   by_stack;  /**< Group by call stack as well. */
+    bool   by_tag;    /**< Group by tag instead of site. */
+    bool   by_blocks; /**< Sort by block count instead of bytes. */
+    size_t top;       /**< Number of groups to print, 0 for all. */
+} Options_T;
+
+static void *
+xrealloc(void * ptr, size_t size)
+{
+    void * grown = realloc(ptr, size ? size : 1);
+    if (!grown)
+    {
+        fprintf(stderr, "mem-dump-analyze: out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    return grown;
+}
+
+static char *
+xstrndup(const char * text, size_t length)
+{
+    char * copy = xrealloc(NULL, length + 1);
+    memcpy(copy, text, length);
+    copy[length] = '\0';
+    return copy;
+}
+
+/* Make table[index] valid, zero filling new entries. index is below
+ * MAX_RECORD_ID. */
+static void *
+grow_array(void * array, size_t * count, size_t index, size_t size)
+{
+    if (index < *count)
+    {
+        return array;
+    }
+    size_t new_count = 2 * index + 16;
+    if (new_count > MAX_RECORD_ID)
+    {
+        new_count = MAX_RECORD_ID;
+    }
+    array            = xrealloc(array, new_count * size);
+    memset((char *)array + *count * size, 0, (new_count - *count) * size);
+    *count = new_count;
+    return array;
+}
+
+static int
+compare_mappings(const void * lhs, const void * rhs)
+{
+    const Mapping_T * a = lhs;
+    const Mapping_T * b = rhs;
+    return (a->start > b->start) - (a->start < b->start);
+}
+
+/* Keep the file backed mappings listed in the maps text. */
+static void
+parse_maps(Dump_T * dump)
+{
+    size_t capacity = 0;
+    char * line     = dump->maps;
+    char * end      = dump->maps + dump->maps_length;
+    while (line < end)
+    {
+        char * newline = memchr(line, '\n', (size_t)(end - line));
+        if (!newline)
+        {
+            newline = end;
+        }
+        *newline = '\0';
+
+        unsigned long long start  = 0;
+        unsigned long long stop   = 0;
+        unsigned long long offset = 0;
+        int                path   = 0;
+        int fields = sscanf(line,
+                            "%llx-%llx %*s %llx %*s %*s %n",
+                            &start,
+                            &stop,
+                            &offset,
+                            &path);
+        if (fields >= 3 && path && line[path] == '/')
+        {
+            if (dump->mapping_count == capacity)
+            {
+                capacity       = capacity ? 2 * capacity : 64;
+                dump->mappings = xrealloc(dump->mappings,
+                                          capacity * sizeof(Mapping_T));
+            }
+            Mapping_T * mapping = &dump->mappings[dump->mapping_count++];
+            mapping->start      = start;
+            mapping->end        = stop;
+            mapping->offset     = offset;
+            mapping->path       = line + path;
+        }
+        line = newline + 1;
+    }
+
+    qsort(dump->mappings,
+          dump->mapping_count,
+          sizeof(Mapping_T),
+          compare_mappings);
+}
+
+static const Mapping_T *
+find_mapping(const Dump_T * dump, uint64_t address)
+{
+    size_t low  = 0;
+    size_t high = dump->mapping_count;
+    while (low < high)
+    {
+        size_t middle = low + (high - low) / 2;
+        if (address < dump->mappings[middle].start)
+        {
+            high = middle;
+        }
+        else if (address >= dump->mappings[middle].end)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            return &dump->mappings[middle];
+        }
+    }
+    return NULL;
+}
+
+static bool
+read_exact(FILE * stream, void * data, size_t length)
+{
+    return fread(data, 1, length, stream) == length;
+}
+
+/* Add a record to the dump. Returns false if the record is corrupt. */
+static bool
+add_record(Dump_T * dump, uint32_t type, char * payload, uint32_t length)
+{
+    uint32_t id = 0;
+    if (type == MEM_DUMP_FILE || type == MEM_DUMP_TAG
+        || type == MEM_DUMP_STACK)
+    {
+        if (length < sizeof(id))
+        {
+            return false;
+        }
+        memcpy(&id, payload, sizeof(id));
+        if (id >= MAX_RECORD_ID)
+        {
+            return false;
+        }
+    }
+
+    switch (type)
+    {
+        case MEM_DUMP_MAPS:
+            /* One spare byte lets parse_maps terminate the last line. */
+            dump->maps
+                = xrealloc(dump->maps, dump->maps_length + length + 1);
+            memcpy(dump->maps + dump->maps_length, payload, length);
+            dump->maps_length += length;
+            break;
+        case MEM_DUMP_FILE:
+            dump->files = grow_array(
+                dump->files, &dump->file_count, id, sizeof(char *));
+            free(dump->files[id]);
+            dump->files[id]
+                = xstrndup(payload + sizeof(id), length - sizeof(id));
+            break;
+        case MEM_DUMP_TAG:
+            dump->tags
+                = grow_array(dump->tags, &dump->tag_count, id, sizeof(char *));
+            free(dump->tags[id]);
+            dump->tags[id]
+                = xstrndup(payload + sizeof(id), length - sizeof(id));
+            break;
+        case MEM_DUMP_STACK:
+        {
+            uint32_t depth = 0;
+            if (length < 2 * sizeof(uint32_t))
+            {
+                return false;
+            }
+            memcpy(&depth, payload + sizeof(id), sizeof(depth));
+            if (depth > (length - 2 * sizeof(uint32_t)) / sizeof(uint64_t))
+            {
+                return false;
+            }
+            dump->stacks = grow_array(
+                dump->stacks, &dump->stack_count, id, sizeof(Stack_T));
+            Stack_T * stack = &dump->stacks[id];
+            stack->depth    = depth;
+            stack->frames   = xrealloc(stack->frames, depth * sizeof(uint64_t));
+            memcpy(stack->frames,
+                   payload + 2 * sizeof(uint32_t),
+                   depth * sizeof(uint64_t));
+            break;
+        }
+        case MEM_DUMP_BLOCKS:
+        {
+            size_t count = length / sizeof(MemDumpBlock_T);
+            dump->blocks = xrealloc(dump->blocks,
+                                    (dump->block_count + count)
+                                        * sizeof(MemDumpBlock_T));
+            memcpy(dump->blocks + dump->block_count,
+                   payload,
+                   count * sizeof(MemDumpBlock_T));
+            dump->block_count += count;
+            break;
+        }
+        case MEM_DUMP_END:
+            dump->complete = true;
+            break;
+        default:
+            break;
+    }
+    return true;
+}
+
+static void
+free_dump(Dump_T * dump)
+{
+    for (size_t i = 0; i < dump->file_count; i++)
+    {
+        free(dump->files[i]);
+    }
+    for (size_t i = 0; i < dump->tag_count; i++)
+    {
+        free(dump->tags[i]);
+    }
+    for (size_t i = 0; i < dump->stack_count; i++)
+    {
+        free(dump->stacks[i].frames);
+        free(dump->stacks[i].text);
+    }
+    free(dump->files);
+    free(dump->tags);
+    free(dump->stacks);
+    free(dump->blocks);
+    free(dump->mappings);
+    free(dump->maps);
+}
+
+static bool
+load_dump(const char * path, Dump_T * dump)
+{
+    FILE * stream = fopen(path, "rb");
+    if (!stream)
+    {
+        perror(path);
+        return false;
+    }
+
+    memset(dump, 0, sizeof(Dump_T));
+    if (!read_exact(stream, &dump->header, sizeof(dump->header))
+        || memcmp(dump->header.magic,
+                  MEM_DUMP_MAGIC,
+                  sizeof(dump->header.magic))
+        || dump->header.version != MEM_DUMP_VERSION)
+    {
+        fprintf(stderr,
+                "%s: not a version %d heap dump\n",
+                path,
+                MEM_DUMP_VERSION);
+        fclose(stream);
+        return false;
+    }
+
+    /* Payloads are only read once they are known to fit in the file, so
+     * that a corrupt length cannot ask for more memory than the dump. */
+    long start = ftell(stream);
+    long size  = (start < 0 || fseek(stream, 0, SEEK_END)) ? -1 : ftell(stream);
+    if (size < 0 || fseek(stream, start, SEEK_SET))
+    {
+        perror(path);
+        fclose(stream);
+        return false;
+    }
+
+    MemDumpRecord_T record;
+    char *          payload  = NULL;
+    size_t          capacity = 0;
+    bool            corrupt  = false;
+    while (!dump->complete && read_exact(stream, &record, sizeof(record)))
+    {
+        long offset = ftell(stream);
+        if (offset < 0 || record.length > (uint64_t)(size - offset))
+        {
+            break;
+        }
+        if (record.length > capacity)
+        {
+            capacity = record.length;
+            payload  = xrealloc(payload, capacity);
+        }
+        if (!read_exact(stream, payload, record.length))
+        {
+            break;
+        }
+        if (!add_record(dump, record.type, payload, record.length))
+        {
+            fprintf(stderr,
+                    "%s: corrupt record at offset %ld\n",
+                    path,
+                    offset - (long)sizeof(record));
+            corrupt = true;
+            break;
+        }
+    }
+    free(payload);
+    fclose(stream);
+
+    if (corrupt)
+    {
+        free_dump(dump);
+        return false;
+    }
+    if (!dump->complete)
+    {
+        fprintf(stderr, "%s: dump is truncated\n", path);
+    }
+    parse_maps(dump);
+    return true;
+}
+
+/* Frames of a stack as indented lines of module+offset. */
+static const char *
+stack_text(Dump_T * dump, uint32_t id)
+{
+    if (id >= dump->stack_count || !dump->stacks[id].frames)
+    {
+        return "";
+    }
+
+    Stack_T * stack = &dump->stacks[id];
+    if (stack->text)
+    {
+        return stack->text;
+    }
+
+    size_t capacity = 1;
+    size_t length   = 0;
+    char * text     = xrealloc(NULL, capacity);
+    text[0]         = '\0';
+    for (uint32_t i = 0; i < stack->depth; i++)
+    {
+        char              frame[4096];
+        const Mapping_T * mapping = find_mapping(dump, stack->frames[i]);
+        int               written;
+        if (mapping)
+        {
+            written = snprintf(frame,
+                               sizeof(frame),
+                               "\n        %s+0x%" PRIx64,
+                               mapping->path,
+                               stack->frames[i] - mapping->start
+                                   + mapping->offset);
+        }
+        else
+        {
+            written = snprintf(
+                frame, sizeof(frame), "\n        0x%" PRIx64, stack->frames[i]);
+        }
+        if (written < 0)
+        {
+            continue;
+        }
+        if ((size_t)written >= sizeof(frame))
+        {
+            written = sizeof(frame) - 1;
+        }
+
+        capacity += (size_t)written;
+        text = xrealloc(text, capacity);
+        memcpy(text + length, frame, (size_t)written + 1);
+        length += (size_t)written;
+    }
+
+    stack->text = text;
+    return text;
+}
+
+static uint64_t
+hash_key(const char * key)
+{
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (; *key; key++)
+    {
+        hash ^= (unsigned char)*key;
+        hash *= 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+static void
+grow_groups(GroupTable_T * table)
+{
+    size_t     bucket_count = table->bucket_count ? 2 * table->bucket_count
+                                                  : GROUP_BUCKETS;
+    Group_T ** buckets = xrealloc(NULL, bucket_count * sizeof(Group_T *));
+    memset(buckets, 0, bucket_count * sizeof(Group_T *));
+
+    for (size_t i = 0; i < table->bucket_count; i++)
+    {
+        Group_T * group = table->buckets[i];
+        while (group)
+        {
+            Group_T * next   = group->next;
+            size_t    bucket = hash_key(group->key) & (bucket_count - 1);
+            group->next      = buckets[bucket];
+            buckets[bucket]  = group;
+            group            = next;
+        }
+    }
+
+    free(table->buckets);
+    table->buckets      = buckets;
+    table->bucket_count = bucket_count;
+}
+
+static Group_T *
+find_group(GroupTable_T * table, const char * key)
+{
+    if (table->count >= table->bucket_count)
+    {
+        grow_groups(table);
+    }
+
+    size_t    bucket = hash_key(key) & (table->bucket_count - 1);
+    Group_T * group  = table->buckets[bucket];
+    while (group && strcmp(group->key, key))
+    {
+        group = group->next;
+    }
+    if (!group)
+    {
+        group                  = xrealloc(NULL, sizeof(Group_T));
+        group->key             = xstrndup(key, strlen(key));
+        group->bytes           = 0;
+        group->blocks          = 0;
+        group->next            = table->buckets[bucket];
+        table->buckets[bucket] = group;
+        table->count++;
+    }
+    return group;
+}
+
+/* Add every block of a dump to its group, negated when sign is -1. */
+static void
+aggregate(Dump_T *          dump,
+          const Options_T * options,
+          GroupTable_T *    table,
+          int               sign)
+{
+    char * key      = NULL;
+    size_t capacity = 0;
+    for (size_t i = 0; i < dump->block_count; i++)
+    {
+        const MemDumpBlock_T * block = &dump->blocks[i];
+        const char *           name  = NULL;
+        if (options->by_tag)
+        {
+            name = (block->tag < dump->tag_count && dump->tags[block->tag])
+                       ? dump->tags[block->tag]
+                       : "(untagged)";
+        }
+        else
+        {
+            name = (block->file_id < dump->file_count
+                    && dump->files[block->file_id])
+                       ? dump->files[block->file_id]
+                       : "(unknown)";
+        }
+        const char * frames
+            = options->by_stack ? stack_text(dump, block->stack_id) : "";
+
+        size_t length = strlen(name) + strlen(frames) + 16;
+        if (length > capacity)
+        {
+            capacity = 2 * length;
+            key      = xrealloc(key, capacity);
+        }
+        if (options->by_tag)
+        {
+            snprintf(key, capacity, "%s%s", name, frames);
+        }
+        else
+        {
+            snprintf(key, capacity, "%s:%d%s", name, (int)block->line, frames);
+        }
+
+        /* A sampled block stands for weight / size blocks of its size. */
+        int64_t blocks = 1;
+        if (block->size && block->weight > block->size)
+        {
+            blocks = (int64_t)(block->weight / block->size);
+        }
+
+        Group_T * group = find_group(table, key);
+        group->bytes += sign * (int64_t)block->weight;
+        group->blocks += sign * blocks;
+    }
+    free(key);
+}
+
+static bool g_sort_by_blocks = false;
+
+static int
+compare_groups(const void * lhs, const void * rhs)
+{
+    const Group_T * a = *(Group_T * const *)lhs;
+    const Group_T * b = *(Group_T * const *)rhs;
+    int64_t         x = g_sort_by_blocks ? a->blocks : a->bytes;
+    int64_t         y = g_sort_by_blocks ? b->blocks : b->bytes;
+    if (x != y)
+    {
+        return (x < y) ? 1 : -1;
+    }
+    return strcmp(a->key, b->key);
+}
+
+static void
+print_groups(GroupTable_T * table, const Options_T * options, bool diff)
+{
+    Group_T ** groups = xrealloc(NULL, table->count * sizeof(Group_T *));
+    size_t     count  = 0;
+    int64_t    bytes  = 0;
+    int64_t    blocks = 0;
+    for (size_t i = 0; i < table->bucket_count; i++)
+    {
+        for (Group_T * group = table->buckets[i]; group; group = group->next)
+        {
+            if (group->bytes || group->blocks)
+            {
+                groups[count++] = group;
+                bytes += group->bytes;
+                blocks += group->blocks;
+            }
+        }
+    }
+
+    g_sort_by_blocks = options->by_blocks;
+    qsort(groups, count, sizeof(Group_T *), compare_groups);
+
+    const char * format = diff ? "%+14" PRId64 " %+10" PRId64 "  %s\n"
+                               : "%14" PRId64 " %10" PRId64 "  %s\n";
+    printf("%14s %10s  %s\n",
+           "bytes",
+           "blocks",
+           options->by_tag ? "tag" : "site");
+    size_t shown
+        = (options->top && options->top < count) ? options->top : count;
+    for (size_t i = 0; i < shown; i++)
+    {
+        printf(format, groups[i]->bytes, groups[i]->blocks, groups[i]->key);
+    }
+    printf(format, bytes, blocks, "total");
+    free(groups);
+}
+
+static void
+free_groups(GroupTable_T * table)
+{
+    for (size_t i = 0; i < table->bucket_count; i++)
+    {
+        Group_T * group = table->buckets[i];
+        while (group)
+        {
+            Group_T * next = group->next;
+            free(group->key);
+            free(group);
+            group = next;
+        }
+    }
+    free(table->buckets);
+}
+
+static void
+usage(void)
+{
+    fprintf(stderr,
+            "usage: mem-dump-analyze [-k] [-t] [-b] [-n count] dump\n"
+            "       mem-dump-analyze [-k] [-t] [-b] [-n count] -d before "
+            "after\n"
+            "  -k        group by call stack as well\n"
+            "  -t        group by allocation tag instead of site\n"
+            "  -b        sort by block count instead of bytes\n"
+            "  -n count  print the largest count groups, 0 for all "
+            "(default %d)\n"
+            "  -d        print the change from before to after\n",
+            DEFAULT_TOP);
+}
+
+int
+main(int argc, char ** argv)
+{
+    Options_T options = { .top = DEFAULT_TOP };
+    bool      diff    = false;
+    int       option;
+    while ((option = getopt(argc, argv, "ktbn:d")) != -1)
+    {
+        switch (option)
+        {
+            case 'k':
+                options.by_stack = true;
+                break;
+            case 't':
+                options.by_tag = true;
+                break;
+            case 'b':
+                options.by_blocks = true;
+                break;
+            case 'n':
+                options.top = strtoul(optarg, NULL, 10);
+                break;
+            case 'd':
+                diff = true;
+                break;
+            default:
+                usage();
+                return EXIT_FAILURE;
+        }
+    }
+    if (argc - optind != (diff ? 2 : 1))
+    {
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    Dump_T       dumps[2];
+    int          loaded = 0;
+    GroupTable_T table  = { 0 };
+    for (; loaded < argc - optind; loaded++)
+    {
+        if (!load_dump(argv[optind + loaded], &dumps[loaded]))
+        {
+            break;
+        }
+    }
+
+    int status = EXIT_FAILURE;
+    if (loaded == argc - optind)
+    {
+        for (int i = 0; i < loaded; i++)
+        {
+            printf("%s: pid %" PRIu32 ", %zu blocks\n",
+                   argv[optind + i],
+                   dumps[i].header.pid,
+                   dumps[i].block_count);
+            /* In a diff the earlier dump counts negatively. */
+            aggregate(&dumps[i], &options, &table, (diff && i == 0) ? -1 : 1);
+        }
+        print_groups(&table, &options, diff);
+        status = EXIT_SUCCESS;
+    }
+
+    free_groups(&table);
+    for (int i = 0; i < loaded; i++)
+    {
+        free_dump(&dumps[i]);
+    }
+    return status;
+}